@@ -34,12 +34,23 @@
 #import "S3GlacierRestorerDelegate.h"
 #import "GlacierRestorerDelegate.h"
 @class Target;
+@class RestoreProgressPrinter;
+@class LocalGlacierEnvironment;
 
 @interface ArqRestoreCommand : NSObject <StandardRestorerDelegate, S3GlacierRestorerDelegate, GlacierRestorerDelegate> {
     unsigned long long maxRequested;
     unsigned long long maxTransfer;
+    RestoreProgressPrinter *progressPrinter;
+#ifdef ARQ_RESTORE_BENCHMARKS
+    LocalGlacierEnvironment *localGlacierEnvironment;
+#endif
 }
 
 - (NSString *)errorDomain;
 - (BOOL)executeWithArgc:(int)argc argv:(const char **)argv error:(NSError **)error;
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+// Runs the "restore" command with Glacier, SNS and SQS calls sent to theLocalGlacierEnvironment instead of AWS.
+- (BOOL)restore:(NSArray *)args localGlacierEnvironment:(LocalGlacierEnvironment *)theLocalGlacierEnvironment error:(NSError **)error;
+#endif
 @end
@@ -42,6 +42,7 @@
 #import "StandardRestorerParamSet.h"
 #import "Tree.h"
 #import "Commit.h"
+#import "CommitIndex.h"
 #import "Node.h"
 #import "BlobKey.h"
 #import "StandardRestorer.h"
@@ -69,10 +70,21 @@
 #import "Arq6SnapshotVolume.h"
 #import "Arq6Restorer.h"
 #import "TargetConnection.h"
+#import "DerivedKeyCache.h"
+#import "ParallelDiscovery.h"
+#import "BenchmarkCommand.h"
+#import "RestoreProgressPrinter.h"
+#import "RestoreMetricsReporter.h"
 
 #define BUFSIZE (65536)
 
 @implementation ArqRestoreCommand
+- (id)init {
+    if (self = [super init]) {
+        progressPrinter = [[RestoreProgressPrinter alloc] init];
+    }
+    return self;
+}
 - (NSString *)errorDomain {
     return @"ArqRestoreCommandErrorDomain";
 }
@@ -109,10 +121,19 @@
         return [self printPlist:args error:error];
     } else if ([cmd isEqualToString:@"listtree"]) {
         return [self listTree:args error:error];
+    } else if ([cmd isEqualToString:@"listcommits"]) {
+        return [self listCommits:args error:error];
     } else if ([cmd isEqualToString:@"restore"]) {
         return [self restore:args error:error];
     } else if ([cmd isEqualToString:@"clearcache"]) {
         return [self clearCache:args error:error];
+    } else if ([cmd isEqualToString:@"purgekeycache"]) {
+        return [self purgeKeyCache:args error:error];
+#ifdef ARQ_RESTORE_BENCHMARKS
+    } else if ([cmd isEqualToString:@"benchmark"]) {
+        BenchmarkCommand *benchmarkCommand = [[BenchmarkCommand alloc] initWithArqRestoreCommand:self];
+        return [benchmarkCommand executeWithArgs:[args subarrayWithRange:NSMakeRange(2, [args count] - 2)] error:error];
+#endif
     } else {
         SETNSERROR([self errorDomain], ERROR_USAGE, @"unknown command: %@", cmd);
         return NO;
@@ -273,10 +294,19 @@
             if (arq7BackupSets == nil) {
                 HSLogError(@"error getting Arq7/Arq6 backup sets for %@: %@", theTarget, arq7Error);
             } else {
+                NSMutableSet *arq6PlanUUIDs = [NSMutableSet set];
+                if (listConn != nil) {
+                    [ParallelDiscovery performCount:[arq7BackupSets count] block:^(NSUInteger theIndex) {
+                        NSString *planUUID = [[arq7BackupSets objectAtIndex:theIndex] planUUID];
+                        if ([Arq6Snapshot isArq6PlanUUID:planUUID targetConnection:listConn delegate:nil]) {
+                            @synchronized(arq6PlanUUIDs) {
+                                [arq6PlanUUIDs addObject:planUUID];
+                            }
+                        }
+                    }];
+                }
                 for (Arq7BackupSet *bs in arq7BackupSets) {
-                    BOOL isArq6 = (listConn != nil) && [Arq6Snapshot isArq6PlanUUID:[bs planUUID]
-                                                                    targetConnection:listConn
-                                                                            delegate:nil];
+                    BOOL isArq6 = [arq6PlanUUIDs containsObject:[bs planUUID]];
                     printf("\t[%s] plan %s\n", isArq6 ? "arq6" : "arq7", [[bs planUUID] UTF8String]);
                     NSString *cn = [bs computerName] ?: @"";
                     NSString *bn = [bs backupName] ?: @"";
@@ -710,6 +740,72 @@
     }
     return [self printTree:rootTree repo:repo relativePath:@"" error:error];
 }
+- (BOOL)listCommits:(NSArray *)args error:(NSError **)error {
+    if ([args count] != 5) {
+        SETNSERROR([self errorDomain], ERROR_USAGE, @"invalid arguments");
+        return NO;
+    }
+    Target *target = [[TargetFactory sharedTargetFactory] targetWithNickname:[args objectAtIndex:2]];
+    if (target == nil) {
+        SETNSERROR([self errorDomain], ERROR_NOT_FOUND, @"target not found");
+        return NO;
+    }
+
+    NSString *theComputerUUID = [args objectAtIndex:3];
+    NSString *theFolderUUID = [args objectAtIndex:4];
+
+    NSString *theEncryptionPassword = [self readPasswordWithPrompt:@"enter encryption password:" error:error];
+    if (theEncryptionPassword == nil) {
+        return NO;
+    }
+
+    BackupSet *backupSet = [self backupSetForTarget:target computerUUID:theComputerUUID error:error];
+    if (backupSet == nil) {
+        return NO;
+    }
+
+    // Reset Target:
+    target = [backupSet target];
+
+    NSArray *buckets = [Bucket bucketsWithTarget:target computerUUID:theComputerUUID encryptionPassword:theEncryptionPassword targetConnectionDelegate:nil error:error];
+    if (buckets == nil) {
+        return NO;
+    }
+    Bucket *matchingBucket = nil;
+    for (Bucket *bucket in buckets) {
+        if ([[bucket bucketUUID] isEqualToString:theFolderUUID]) {
+            matchingBucket = bucket;
+            break;
+        }
+    }
+    if (matchingBucket == nil) {
+        SETNSERROR([self errorDomain], ERROR_NOT_FOUND, @"folder %@ not found", theFolderUUID);
+        return NO;
+    }
+
+    Repo *repo = [[Repo alloc] initWithBucket:matchingBucket encryptionPassword:theEncryptionPassword targetConnectionDelegate:nil repoDelegate:nil activityListener:nil error:error];
+    if (repo == nil) {
+        return NO;
+    }
+    NSArray *entries = [repo commitIndexEntries:error];
+    if (entries == nil) {
+        return NO;
+    }
+
+    printf("target   %s\n", [[target endpointDisplayName] UTF8String]);
+    printf("computer %s\n", [theComputerUUID UTF8String]);
+    printf("folder   %s\n", [theFolderUUID UTF8String]);
+    printf("\n");
+    printf("%-40s  %-25s  %-40s  %s\n", "commit", "created", "tree", "failed files");
+    for (CommitIndexEntry *entry in entries) {
+        printf("%-40s  %-25s  %-40s  %lu\n",
+               [[[entry commitBlobKey] sha1] UTF8String],
+               [[[entry creationDate] description] UTF8String],
+               [[[entry treeBlobKey] sha1] UTF8String],
+               (unsigned long)[entry failedFileCount]);
+    }
+    return YES;
+}
 - (BOOL)printArq7Tree:(Arq7Tree *)theTree blobReader:(Arq7BlobReader *)theBlobReader relativePath:(NSString *)theRelativePath error:(NSError **)error {
     for (NSString *childName in [theTree childNodeNames]) {
         NSString *childRelativePath = [theRelativePath stringByAppendingFormat:@"/%@", childName];
@@ -754,6 +850,23 @@
 }
 
 - (BOOL)restore:(NSArray *)args error:(NSError **)error {
+    RestoreMetricsReporter *metricsReporter = [[RestoreMetricsReporter alloc] init];
+    if (![metricsReporter start:error]) {
+        return NO;
+    }
+    BOOL ret = [self doRestore:args error:error];
+    [metricsReporter stop];
+    return ret;
+}
+#ifdef ARQ_RESTORE_BENCHMARKS
+- (BOOL)restore:(NSArray *)args localGlacierEnvironment:(LocalGlacierEnvironment *)theLocalGlacierEnvironment error:(NSError **)error {
+    localGlacierEnvironment = theLocalGlacierEnvironment;
+    BOOL ret = [self restore:args error:error];
+    localGlacierEnvironment = nil;
+    return ret;
+}
+#endif
+- (BOOL)doRestore:(NSArray *)args error:(NSError **)error {
     if ([args count] != 5 && [args count] != 6) {
         SETNSERROR([self errorDomain], ERROR_USAGE, @"invalid arguments");
         return NO;
@@ -779,6 +892,12 @@
         return NO;
     }
 
+#ifdef ARQ_RESTORE_BENCHMARKS
+    if ([isArq7 boolValue] && localGlacierEnvironment != nil) {
+        SETNSERROR([self errorDomain], -1, @"%@ is not a Glacier vault backup", theUUID);
+        return NO;
+    }
+#endif
     if ([isArq7 boolValue]) {
         Arq7BackupSet *bs = [Arq7BackupSet backupSetWithPlanUUID:theUUID targetConnection:conn delegate:nil error:error];
         if (bs == nil) {
@@ -957,6 +1076,12 @@
     
     AWSRegion *region = [AWSRegion regionWithS3Endpoint:[target endpoint]];
     BOOL isGlacierDestination = [region supportsGlacier];
+#ifdef ARQ_RESTORE_BENCHMARKS
+    if (localGlacierEnvironment != nil && !([matchingBucket storageType] == StorageTypeGlacier && isGlacierDestination)) {
+        SETNSERROR([self errorDomain], -1, @"folder %@ is not stored in a Glacier vault", theBucketUUID);
+        return NO;
+    }
+#endif
     if ([matchingBucket storageType] == StorageTypeGlacier && isGlacierDestination) {
         GlacierRestorerParamSet *paramSet = [[GlacierRestorerParamSet alloc] initWithBucket:matchingBucket
                                                                           encryptionPassword:theEncryptionPassword
@@ -972,7 +1097,17 @@
                                                                           useTargetUIDAndGID:YES
                                                                              destinationPath:destinationPath
                                                                                     logLevel:[[HSLog sharedHSLog] hsLogLevel]];
-        (void)[[GlacierRestorer alloc] initWithGlacierRestorerParamSet:paramSet delegate:self];
+        GlacierRestorer *restorer = nil;
+#ifdef ARQ_RESTORE_BENCHMARKS
+        if (localGlacierEnvironment != nil) {
+            restorer = [[GlacierRestorer alloc] initWithGlacierRestorerParamSet:paramSet delegate:self localEnvironment:localGlacierEnvironment];
+        } else {
+            restorer = [[GlacierRestorer alloc] initWithGlacierRestorerParamSet:paramSet delegate:self];
+        }
+#else
+        restorer = [[GlacierRestorer alloc] initWithGlacierRestorerParamSet:paramSet delegate:self];
+#endif
+        [restorer run];
         
     } else if ([matchingBucket storageType] == StorageTypeS3Glacier && isGlacierDestination) {
         S3GlacierRestorerParamSet *paramSet = [[S3GlacierRestorerParamSet alloc] initWithBucket:matchingBucket
@@ -1025,7 +1160,13 @@
     }
     return [conn clearAllCachedData:error];
 }
-
+- (BOOL)purgeKeyCache:(NSArray *)args error:(NSError **)error {
+    if ([args count] != 2) {
+        SETNSERROR([self errorDomain], ERROR_USAGE, @"invalid arguments");
+        return NO;
+    }
+    return [[DerivedKeyCache sharedDerivedKeyCache] purge:error];
+}
 - (BackupSet *)backupSetForTarget:(Target *)theInitialTarget computerUUID:(NSString *)theComputerUUID error:(NSError **)error {
     NSArray *expandedTargetList = [self expandedTargetListForTarget:theInitialTarget error:error];
     if (expandedTargetList == nil) {
@@ -1178,7 +1319,7 @@
     return NO;
 }
 - (BOOL)s3GlacierRestorerBytesTransferredDidChange:(NSNumber *)theTransferred {
-    printf("restored %qu of %qu\n", [theTransferred unsignedLongLongValue], maxTransfer);
+    [progressPrinter didTransferBytes:[theTransferred unsignedLongLongValue] ofTotal:maxTransfer];
     return NO;
 }
 - (BOOL)s3GlacierRestorerTotalBytesToTransferDidChange:(NSNumber *)theTotal {
@@ -47,6 +47,7 @@
 #import "Repo.h"
 #import "UserLibrary_Arq.h"
 #import "NSString+SBJSON.h"
+#import "ParallelDiscovery.h"
 
 @implementation BackupSet
 + (NSArray *)allBackupSetsForTarget:(Target *)theTarget targetConnectionDelegate:(id <TargetConnectionDelegate>)theDelegate activityListener:(id<BackupSetActivityListener>)theActivityListener error:(NSError **)error {
@@ -64,11 +65,11 @@
         return nil;
     }
 
+    // Read each computer's computerinfo concurrently. Results are sorted below, so completion order doesn't matter.
     NSMutableArray *ret = [NSMutableArray array];
-    for (NSUInteger i = 0; i < [theComputerUUIDs count]; i++) {
-        [theActivityListener backupSetActivity:[NSString stringWithFormat:@"Loading backup set %ld of %ld at %@", i+1, [theComputerUUIDs count], [theTarget description]]];
-
-        NSString *theComputerUUID = [theComputerUUIDs objectAtIndex:i];
+    __block NSUInteger loadedCount = 0;
+    [ParallelDiscovery performCount:[theComputerUUIDs count] block:^(NSUInteger theIndex) {
+        NSString *theComputerUUID = [theComputerUUIDs objectAtIndex:theIndex];
         NSError *uacError = nil;
         UserAndComputer *uac = nil;
         NSData *uacData = [targetConnection computerInfoForComputerUUID:theComputerUUID delegate:theDelegate error:&uacError];
@@ -83,8 +84,12 @@
         BackupSet *backupSet = [[BackupSet alloc] initWithTarget:theTarget
                                                      computerUUID:theComputerUUID
                                                   userAndComputer:uac];
-        [ret addObject:backupSet];
-    }
+        @synchronized(ret) {
+            [ret addObject:backupSet];
+            loadedCount++;
+            [theActivityListener backupSetActivity:[NSString stringWithFormat:@"Loaded backup set %ld of %ld at %@", loadedCount, [theComputerUUIDs count], [theTarget description]]];
+        }
+    }];
     NSSortDescriptor *descriptor = [[NSSortDescriptor alloc] initWithKey:@"description" ascending:YES];
     [ret sortUsingDescriptors:[NSArray arrayWithObject:descriptor]];
     return ret;
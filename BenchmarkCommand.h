@@ -0,0 +1,49 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+@class ArqRestoreCommand;
+
+// Developer benchmarks and simulations, run as "arq_restore benchmark <name> [args...]".
+// They're compiled only when ARQ_RESTORE_BENCHMARKS is defined (Debug builds), so release builds don't offer them.
+@interface BenchmarkCommand : NSObject {
+    ArqRestoreCommand *arqRestoreCommand;
+    NSString *errorDomain;
+}
++ (void)printUsageWithExeName:(const char *)theExeName;
+
+// Usage errors are reported as ERROR_USAGE in theArqRestoreCommand's error domain, so the caller prints its usage text for them.
+// The glacierrestore simulation runs theArqRestoreCommand's restore against a local Glacier stand-in.
+- (id)initWithArqRestoreCommand:(ArqRestoreCommand *)theArqRestoreCommand;
+
+// theArgs begins with the benchmark name.
+- (BOOL)executeWithArgs:(NSArray *)theArgs error:(NSError **)error;
+@end
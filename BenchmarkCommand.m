@@ -0,0 +1,329 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "BenchmarkCommand.h"
+#import "TargetItemsDBBenchmark.h"
+#import "S3ListerBenchmark.h"
+#import "S3SigningBenchmark.h"
+#import "S3HedgingSimulation.h"
+#import "URLConnectionBenchmark.h"
+#import "Arq7BackupRecordBenchmark.h"
+#import "ArqRestoreCommand.h"
+#import "GlacierRetrievalScheduler.h"
+#import "GlacierRetrievalSimulation.h"
+#import "SimulatedGlacierRetrievalClock.h"
+#import "ThroughputGlacierRetrievalPolicy.h"
+#import "CostCappedGlacierRetrievalPolicy.h"
+#import "DeadlineGlacierRetrievalPolicy.h"
+#import "SystemGlacierRetrievalClock.h"
+#import "LocalGlacierEnvironment.h"
+
+
+@implementation BenchmarkCommand
++ (void)printUsageWithExeName:(const char *)theExeName {
+    fprintf(stderr, "\t%s [-l loglevel] benchmark itemscache <row_count>\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark s3listing <object_count>\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark s3signing <thread_count> <signs_per_thread>\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark s3hedging <request_count> <thread_count> <slow_fraction> <slow_seconds> [hedge_percentile]\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark http <request_count> <thread_count> [response_bytes]\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark backuprecord <record_megabytes> <iterations>\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark glacierretrieval <plan_file> <download_bytes_per_second> [throughput | costcapped <max_bytes_per_day> | deadline <hours>]\n", theExeName);
+    fprintf(stderr, "\t%s [-l loglevel] benchmark glacierrestore <archive_directory> <job_completion_seconds> <request_latency_seconds> <failure_probability> <target_nickname> <computer_uuid> <folder_uuid> [relative_path]\n", theExeName);
+}
+
+- (id)initWithArqRestoreCommand:(ArqRestoreCommand *)theArqRestoreCommand {
+    if (self = [super init]) {
+        arqRestoreCommand = theArqRestoreCommand;
+        errorDomain = [theArqRestoreCommand errorDomain];
+    }
+    return self;
+}
+- (BOOL)executeWithArgs:(NSArray *)theArgs error:(NSError **)error {
+    if ([theArgs count] < 1) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"missing benchmark name");
+        return NO;
+    }
+    NSString *name = [theArgs objectAtIndex:0];
+    NSArray *args = [theArgs subarrayWithRange:NSMakeRange(1, [theArgs count] - 1)];
+    
+    if ([name isEqualToString:@"itemscache"]) {
+        return [self benchmarkItemsCache:args error:error];
+    } else if ([name isEqualToString:@"s3listing"]) {
+        return [self benchmarkS3Listing:args error:error];
+    } else if ([name isEqualToString:@"s3signing"]) {
+        return [self benchmarkS3Signing:args error:error];
+    } else if ([name isEqualToString:@"s3hedging"]) {
+        return [self simulateS3Hedging:args error:error];
+    } else if ([name isEqualToString:@"http"]) {
+        return [self benchmarkHTTP:args error:error];
+    } else if ([name isEqualToString:@"backuprecord"]) {
+        return [self benchmarkBackupRecord:args error:error];
+    } else if ([name isEqualToString:@"glacierretrieval"]) {
+        return [self simulateGlacierRetrieval:args error:error];
+    } else if ([name isEqualToString:@"glacierrestore"]) {
+        return [self simulateGlacierRestore:args error:error];
+    }
+    SETNSERROR(errorDomain, ERROR_USAGE, @"unknown benchmark: %@", name);
+    return NO;
+}
+
+#pragma mark internal
+- (BOOL)checkArgs:(NSArray *)theArgs minCount:(NSUInteger)theMinCount maxCount:(NSUInteger)theMaxCount error:(NSError **)error {
+    if ([theArgs count] < theMinCount || [theArgs count] > theMaxCount) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid arguments");
+        return NO;
+    }
+    return YES;
+}
+- (BOOL)countArg:(NSArray *)theArgs atIndex:(NSUInteger)theIndex name:(NSString *)theName count:(NSUInteger *)theCount error:(NSError **)error {
+    long long value = [[theArgs objectAtIndex:theIndex] longLongValue];
+    if (value <= 0) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid %@", theName);
+        return NO;
+    }
+    *theCount = (NSUInteger)value;
+    return YES;
+}
+
+- (BOOL)benchmarkItemsCache:(NSArray *)args error:(NSError **)error {
+    NSUInteger rowCount = 0;
+    if (![self checkArgs:args minCount:1 maxCount:1 error:error]
+        || ![self countArg:args atIndex:0 name:@"row count" count:&rowCount error:error]) {
+        return NO;
+    }
+    TargetItemsDBBenchmark *benchmark = [[TargetItemsDBBenchmark alloc] initWithRowCount:rowCount];
+    if (![benchmark run:error]) {
+        return NO;
+    }
+    printf("load: %0.1f seconds\n", [benchmark loadTimeInterval]);
+    for (NSDictionary *result in [benchmark queryResults]) {
+        printf("%s: %0.3f seconds (%s)\n", [[result objectForKey:@"query"] UTF8String], [[result objectForKey:@"seconds"] doubleValue], [[result objectForKey:@"result"] UTF8String]);
+    }
+    return YES;
+}
+- (BOOL)benchmarkS3Listing:(NSArray *)args error:(NSError **)error {
+    NSUInteger objectCount = 0;
+    if (![self checkArgs:args minCount:1 maxCount:1 error:error]
+        || ![self countArg:args atIndex:0 name:@"object count" count:&objectCount error:error]) {
+        return NO;
+    }
+    S3ListerBenchmark *benchmark = [[S3ListerBenchmark alloc] initWithObjectCount:objectCount];
+    if (![benchmark run:error]) {
+        return NO;
+    }
+    for (NSDictionary *result in [benchmark results]) {
+        printf("%s: %lu pages, %lu items, %0.3f seconds\n", [[result objectForKey:@"method"] UTF8String], [[result objectForKey:@"pages"] unsignedLongValue], [[result objectForKey:@"items"] unsignedLongValue], [[result objectForKey:@"seconds"] doubleValue]);
+    }
+    return YES;
+}
+- (BOOL)benchmarkS3Signing:(NSArray *)args error:(NSError **)error {
+    NSUInteger threadCount = 0;
+    NSUInteger signsPerThread = 0;
+    if (![self checkArgs:args minCount:2 maxCount:2 error:error]
+        || ![self countArg:args atIndex:0 name:@"thread count" count:&threadCount error:error]
+        || ![self countArg:args atIndex:1 name:@"signs per thread" count:&signsPerThread error:error]) {
+        return NO;
+    }
+    S3SigningBenchmark *benchmark = [[S3SigningBenchmark alloc] initWithThreadCount:threadCount signsPerThread:signsPerThread];
+    if (![benchmark run:error]) {
+        return NO;
+    }
+    printf("%lu signatures on %lu threads (%lu cores); %0.3f seconds spent signing\n", (unsigned long)(threadCount * signsPerThread), (unsigned long)threadCount, (unsigned long)[benchmark coreCount], [benchmark signingTime]);
+    printf("%0.0f signs/second, %0.0f signs/second/core\n", [benchmark signsPerSecond], [benchmark signsPerSecondPerCore]);
+    return YES;
+}
+- (BOOL)simulateS3Hedging:(NSArray *)args error:(NSError **)error {
+    NSUInteger requestCount = 0;
+    NSUInteger threadCount = 0;
+    if (![self checkArgs:args minCount:4 maxCount:5 error:error]
+        || ![self countArg:args atIndex:0 name:@"request count" count:&requestCount error:error]
+        || ![self countArg:args atIndex:1 name:@"thread count" count:&threadCount error:error]) {
+        return NO;
+    }
+    double slowProbability = [[args objectAtIndex:2] doubleValue];
+    NSTimeInterval slowLatency = [[args objectAtIndex:3] doubleValue];
+    double hedgePercentile = [args count] == 5 ? [[args objectAtIndex:4] doubleValue] : 95.0;
+    if (slowProbability < 0 || slowProbability > 1 || slowLatency < 0 || hedgePercentile <= 0 || hedgePercentile >= 100) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid arguments");
+        return NO;
+    }
+    S3HedgingSimulation *simulation = [[S3HedgingSimulation alloc] initWithRequestCount:requestCount
+                                                                             threadCount:threadCount
+                                                                         slowProbability:slowProbability
+                                                                             slowLatency:slowLatency
+                                                                         hedgePercentile:hedgePercentile];
+    if (![simulation run:error]) {
+        return NO;
+    }
+    for (NSDictionary *result in [simulation results]) {
+        double percentile = [[result objectForKey:@"hedgePercentile"] doubleValue];
+        if (percentile == 0) {
+            printf("no hedging:\n");
+        } else {
+            printf("hedging at p%0.0f:\n", percentile);
+        }
+        printf("  %0.3f seconds total; latency p50 %0.3f, p99 %0.3f, max %0.3f\n", [[result objectForKey:@"seconds"] doubleValue], [[result objectForKey:@"p50"] doubleValue], [[result objectForKey:@"p99"] doubleValue], [[result objectForKey:@"max"] doubleValue]);
+        printf("  %llu requests sent, %llu hedges fired, %llu hedges won\n", [[result objectForKey:@"requestsSent"] unsignedLongLongValue], [[result objectForKey:@"hedgesFired"] unsignedLongLongValue], [[result objectForKey:@"hedgesWon"] unsignedLongLongValue]);
+    }
+    return YES;
+}
+- (BOOL)benchmarkHTTP:(NSArray *)args error:(NSError **)error {
+    NSUInteger requestCount = 0;
+    NSUInteger threadCount = 0;
+    if (![self checkArgs:args minCount:2 maxCount:3 error:error]
+        || ![self countArg:args atIndex:0 name:@"request count" count:&requestCount error:error]
+        || ![self countArg:args atIndex:1 name:@"thread count" count:&threadCount error:error]) {
+        return NO;
+    }
+    NSUInteger responseBytes = [args count] == 3 ? (NSUInteger)[[args objectAtIndex:2] longLongValue] : 4096;
+    URLConnectionBenchmark *benchmark = [[URLConnectionBenchmark alloc] initWithRequestCount:requestCount threadCount:threadCount responseBytes:responseBytes];
+    if (![benchmark run:error]) {
+        return NO;
+    }
+    printf("%lu GETs of %lu bytes on %lu threads in %0.3f seconds (%0.0f requests/second)\n", (unsigned long)requestCount, (unsigned long)responseBytes, (unsigned long)threadCount, [benchmark elapsed], [benchmark requestsPerSecond]);
+    printf("latency p50 %0.3f ms, p99 %0.3f ms, max %0.3f ms\n", [benchmark latencyAtPercentile:50] * 1000.0, [benchmark latencyAtPercentile:99] * 1000.0, [benchmark latencyAtPercentile:100] * 1000.0);
+    printf("synchronizing and reading defaults: %0.3f ms per call\n", [benchmark defaultsReadSeconds] * 1000.0);
+    return YES;
+}
+- (BOOL)benchmarkBackupRecord:(NSArray *)args error:(NSError **)error {
+    NSUInteger recordMegabytes = 0;
+    NSUInteger iterations = 0;
+    if (![self checkArgs:args minCount:2 maxCount:2 error:error]
+        || ![self countArg:args atIndex:0 name:@"record size" count:&recordMegabytes error:error]
+        || ![self countArg:args atIndex:1 name:@"iteration count" count:&iterations error:error]) {
+        return NO;
+    }
+    Arq7BackupRecordBenchmark *benchmark = [[Arq7BackupRecordBenchmark alloc] initWithRecordBytes:recordMegabytes * 1024 * 1024 iterations:iterations];
+    if (![benchmark run:error]) {
+        return NO;
+    }
+    printf("record of %lu bytes read %lu times\n", (unsigned long)[benchmark recordBytes], (unsigned long)iterations);
+    printf("NSJSONSerialization: %0.3f ms per record\n", [benchmark dictionarySecondsPerRecord] * 1000.0);
+    printf("Arq7JSONReader: %0.3f ms per record\n", [benchmark streamingSecondsPerRecord] * 1000.0);
+    return YES;
+}
+- (BOOL)simulateGlacierRetrieval:(NSArray *)args error:(NSError **)error {
+    if (![self checkArgs:args minCount:2 maxCount:4 error:error]) {
+        return NO;
+    }
+    NSString *planPath = [args objectAtIndex:0];
+    unsigned long long downloadBytesPerSecond = (unsigned long long)[[args objectAtIndex:1] longLongValue];
+    if (downloadBytesPerSecond == 0) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid download bytes per second");
+        return NO;
+    }
+    NSString *policyName = [args count] > 2 ? [args objectAtIndex:2] : @"throughput";
+    
+    // Standard-tier retrievals take 3-5 hours.
+    NSTimeInterval roundTimeInterval = 60 * 60 * 4;
+    NSTimeInterval thawTimeInterval = 60 * 60 * 4;
+    
+    NSDate *startDate = [NSDate date];
+    id <GlacierRetrievalPolicy> policy = nil;
+    if ([policyName isEqualToString:@"throughput"] && [args count] == 3) {
+        policy = [[ThroughputGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:downloadBytesPerSecond roundTimeInterval:roundTimeInterval];
+    } else if ([policyName isEqualToString:@"costcapped"] && [args count] == 4) {
+        unsigned long long maxBytesPerDay = (unsigned long long)[[args objectAtIndex:3] longLongValue];
+        policy = [[CostCappedGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:downloadBytesPerSecond maxBytesPerDay:maxBytesPerDay roundTimeInterval:roundTimeInterval];
+    } else if ([policyName isEqualToString:@"deadline"] && [args count] == 4) {
+        NSDate *deadline = [startDate dateByAddingTimeInterval:([[args objectAtIndex:3] doubleValue] * 60 * 60)];
+        policy = [[DeadlineGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:downloadBytesPerSecond deadline:deadline roundTimeInterval:roundTimeInterval];
+    } else if ([args count] == 2) {
+        policy = [[ThroughputGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:downloadBytesPerSecond roundTimeInterval:roundTimeInterval];
+    } else {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid arguments");
+        return NO;
+    }
+    
+    // The plan is a list of object sizes in bytes, one per line, in the order they'd be requested.
+    NSString *plan = [NSString stringWithContentsOfFile:planPath encoding:NSUTF8StringEncoding error:error];
+    if (plan == nil) {
+        return NO;
+    }
+    NSMutableArray *objectSizes = [NSMutableArray array];
+    unsigned long long totalBytes = 0;
+    for (NSString *line in [plan componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+        NSString *trimmed = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([trimmed length] == 0) {
+            continue;
+        }
+        unsigned long long size = (unsigned long long)[trimmed longLongValue];
+        [objectSizes addObject:[NSNumber numberWithUnsignedLongLong:size]];
+        totalBytes += size;
+    }
+    
+    SimulatedGlacierRetrievalClock *clock = [[SimulatedGlacierRetrievalClock alloc] initWithStartDate:startDate];
+    GlacierRetrievalScheduler *scheduler = [[GlacierRetrievalScheduler alloc] initWithPolicy:policy clock:clock];
+    GlacierRetrievalSimulation *simulation = [[GlacierRetrievalSimulation alloc] initWithObjectSizes:objectSizes
+                                                                                           scheduler:scheduler
+                                                                              downloadBytesPerSecond:downloadBytesPerSecond
+                                                                                    thawTimeInterval:thawTimeInterval];
+    [simulation run];
+    
+    printf("policy: %s\n", [[policy name] UTF8String]);
+    printf("objects: %lu\n", (unsigned long)[objectSizes count]);
+    printf("bytes: %qu\n", totalBytes);
+    printf("projected duration: %0.1f hours\n", [simulation projectedDuration] / (60 * 60));
+    NSUInteger round = 1;
+    for (NSNumber *bytes in [simulation bytesRequestedPerRound]) {
+        printf("round %lu: %qu bytes requested\n", (unsigned long)round++, [bytes unsignedLongLongValue]);
+    }
+    return YES;
+}
+- (BOOL)simulateGlacierRestore:(NSArray *)args error:(NSError **)error {
+    if (![self checkArgs:args minCount:7 maxCount:8 error:error]) {
+        return NO;
+    }
+    NSString *archiveDirectory = [args objectAtIndex:0];
+    NSTimeInterval jobCompletionTimeInterval = [[args objectAtIndex:1] doubleValue];
+    NSTimeInterval requestLatency = [[args objectAtIndex:2] doubleValue];
+    double failureProbability = [[args objectAtIndex:3] doubleValue];
+    if (jobCompletionTimeInterval < 0 || requestLatency < 0 || failureProbability < 0 || failureProbability >= 1.0) {
+        SETNSERROR(errorDomain, ERROR_USAGE, @"invalid job completion time, latency or failure probability");
+        return NO;
+    }
+    
+    // Glacier, SNS and SQS calls go to the in-process stand-in; everything else is the real restore.
+    LocalGlacierEnvironment *localGlacierEnvironment = [[LocalGlacierEnvironment alloc] initWithArchiveDirectory:archiveDirectory
+                                                                                                           clock:[[SystemGlacierRetrievalClock alloc] init]
+                                                                                       jobCompletionTimeInterval:jobCompletionTimeInterval
+                                                                                                  requestLatency:requestLatency
+                                                                                              failureProbability:failureProbability];
+    NSMutableArray *restoreArgs = [NSMutableArray arrayWithObjects:[[NSProcessInfo processInfo] processName], @"restore", nil];
+    [restoreArgs addObjectsFromArray:[args subarrayWithRange:NSMakeRange(4, [args count] - 4)]];
+    return [arqRestoreCommand restore:restoreArgs localGlacierEnvironment:localGlacierEnvironment error:error];
+}
+@end
+
+#endif
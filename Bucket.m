@@ -38,6 +38,7 @@
 #import "IntegerNode.h"
 #import "RealNode.h"
 #import "NSString_slashed.h"
+#import "ParallelDiscovery.h"
 #import "BucketExcludeSet.h"
 #import "S3AuthorizationProvider.h"
 #import "S3Service.h"
@@ -121,10 +122,16 @@
             ret = nil;
             break;
         }
-        for (NSUInteger i = 0; i < [bucketUUIDs count]; i++) {
-            [theActivityListener bucketActivity:[NSString stringWithFormat:@"Loading folder %ld of %ld", i+1, [bucketUUIDs count]]];
-            
-            NSString *bucketUUID = [bucketUUIDs objectAtIndex:i];
+        // Load the bucket plists concurrently; the first error other than an invalid plist fails the whole listing.
+        __block NSUInteger loadedCount = 0;
+        __block NSError *fatalError = nil;
+        [ParallelDiscovery performCount:[bucketUUIDs count] block:^(NSUInteger theIndex) {
+            @synchronized(ret) {
+                if (fatalError != nil) {
+                    return;
+                }
+            }
+            NSString *bucketUUID = [bucketUUIDs objectAtIndex:theIndex];
             NSError *myError = nil;
             Bucket *bucket = [Bucket bucketWithTarget:theTarget
                                      targetConnection:targetConnection
@@ -133,16 +140,25 @@
                                            bucketUUID:bucketUUID
                              targetConnectionDelegate:theTCD
                                                 error:&myError];
-            if (bucket == nil) {
-                HSLogError(@"failed to load bucket plist for %@/%@: %@", theComputerUUID, bucketUUID, myError);
-                if ([myError code] != ERROR_INVALID_PLIST_XML) {
-                    SETERRORFROMMYERROR;
-                    ret = nil;
-                    break;
+            @synchronized(ret) {
+                if (bucket == nil) {
+                    HSLogError(@"failed to load bucket plist for %@/%@: %@", theComputerUUID, bucketUUID, myError);
+                    if ([myError code] != ERROR_INVALID_PLIST_XML && fatalError == nil) {
+                        fatalError = myError;
+                    }
+                } else {
+                    [ret addObject:bucket];
                 }
-            } else {
-                [ret addObject:bucket];
+                loadedCount++;
+                [theActivityListener bucketActivity:[NSString stringWithFormat:@"Loaded folder %ld of %ld", loadedCount, [bucketUUIDs count]]];
+            }
+        }];
+        if (fatalError != nil) {
+            if (error != NULL) {
+                *error = fatalError;
             }
+            ret = nil;
+            break;
         }
         NSSortDescriptor *descriptor = [[NSSortDescriptor alloc] initWithKey:@"bucketName" ascending:YES selector:@selector(caseInsensitiveCompare:)];
         [ret sortUsingDescriptors:[NSArray arrayWithObject:descriptor]];
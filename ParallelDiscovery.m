@@ -0,0 +1,72 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "ParallelDiscovery.h"
+
+
+#define DEFAULT_MAX_CONCURRENT_REQUESTS (8)
+
+
+@implementation ParallelDiscovery
++ (NSUInteger)maxConcurrentRequests {
+    NSInteger ret = [[NSUserDefaults standardUserDefaults] integerForKey:@"DiscoveryConcurrency"];
+    if (ret < 1) {
+        ret = DEFAULT_MAX_CONCURRENT_REQUESTS;
+    }
+    return (NSUInteger)ret;
+}
++ (void)performCount:(NSUInteger)theCount block:(void (^)(NSUInteger theIndex))theBlock {
+    NSUInteger maxConcurrent = [ParallelDiscovery maxConcurrentRequests];
+    if (theCount < 2 || maxConcurrent == 1) {
+        for (NSUInteger i = 0; i < theCount; i++) {
+            @autoreleasepool {
+                theBlock(i);
+            }
+        }
+        return;
+    }
+    dispatch_semaphore_t slots = dispatch_semaphore_create((long)maxConcurrent);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    for (NSUInteger i = 0; i < theCount; i++) {
+        dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+        dispatch_group_async(group, queue, ^{
+            @autoreleasepool {
+                theBlock(i);
+            }
+            dispatch_semaphore_signal(slots);
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+}
+@end
@@ -35,6 +35,7 @@
 @class Item;
 @protocol DataTransferDelegate;
 @protocol DeleteDelegate;
+@class TargetMetadataCache;
 
 @protocol TargetConnectionDelegate <NSObject>
 - (BOOL)targetConnectionShouldRetryOnTransientError:(NSError **)error;
@@ -45,6 +46,7 @@
     NSString *pathPrefix;
     NSMutableDictionary *remoteFSByThreadId;
     NSLock *lock;
+    TargetMetadataCache *metadataCache;
 }
 - (id)initWithTarget:(Target *)theTarget;
 
@@ -69,7 +71,9 @@
 
 - (NSNumber *)fileExistsAtPath:(NSString *)thePath dataSize:(unsigned long long *)theDataSize delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
 - (NSData *)contentsOfFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
+- (NSData *)cachedContentsOfFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
 - (NSData *)contentsOfRange:(NSRange)theRange ofFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
 - (BOOL)writeData:(NSData *)theData toFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDelegate targetConnectionDelegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
 - (BOOL)removeItemAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error;
 
@@ -44,6 +44,7 @@
 #import "IntegerIO.h"
 #import "DataInputStream.h"
 #import "BufferedInputStream.h"
+#import "TargetMetadataCache.h"
 
 @implementation TargetConnection
 - (id)initWithTarget:(Target *)theTarget {
@@ -58,6 +59,7 @@
         remoteFSByThreadId = [[NSMutableDictionary alloc] init];
         lock = [[NSLock alloc] init];
         [lock setName:@"TargetConnection lock"];
+        metadataCache = [[TargetMetadataCache alloc] initWithTargetUUID:[theTarget targetUUID]];
     }
     return self;
 }
@@ -137,7 +139,7 @@
 - (NSData *)bucketPlistDataForComputerUUID:(NSString *)theComputerUUID bucketUUID:(NSString *)theBucketUUID deleted:(BOOL)deleted delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     NSString *subdir = deleted ? @"deletedbuckets" : @"buckets";
     NSString *path = [NSString stringWithFormat:@"%@/%@/%@/%@", pathPrefix, theComputerUUID, subdir, theBucketUUID];
-    return [[self remoteFS:error] contentsOfFileAtPath:path dataTransferDelegate:nil targetConnectionDelegate:theDelegate error:error];
+    return [self cachedContentsOfFileAtPath:path delegate:theDelegate error:error];
 }
 - (BOOL)saveBucketPlistData:(NSData *)theData forComputerUUID:(NSString *)theComputerUUID bucketUUID:(NSString *)theBucketUUID deleted:(BOOL)deleted delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     RemoteFS *remoteFS = [self remoteFS:error];
@@ -170,7 +172,7 @@
 
 - (NSData *)computerInfoForComputerUUID:(NSString *)theComputerUUID delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     NSString *path = [NSString stringWithFormat:@"%@/%@/computerinfo", pathPrefix, theComputerUUID];
-    return [[self remoteFS:error] contentsOfFileAtPath:path dataTransferDelegate:nil targetConnectionDelegate:theDelegate error:error];
+    return [self cachedContentsOfFileAtPath:path delegate:theDelegate error:error];
 }
 - (BOOL)saveComputerInfo:(NSData *)theData forComputerUUID:(NSString *)theComputerUUID delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     NSString *path = [NSString stringWithFormat:@"%@/%@/computerinfo", pathPrefix, theComputerUUID];
@@ -204,9 +206,37 @@
 - (NSData *)contentsOfFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     return [self contentsOfRange:NSMakeRange(NSNotFound, 0) ofFileAtPath:thePath delegate:theDelegate error:error];
 }
+- (NSData *)cachedContentsOfFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
+    // Ask the target for the file only if it changed since we cached it (a conditional GET on S3).
+    // This is one request per file like an uncached read, but it doesn't go through RemoteFS's items cache
+    // or its lock, so callers on several threads run in parallel.
+    RemoteFS *remoteFS = [self remoteFS:error];
+    if (remoteFS == nil) {
+        return nil;
+    }
+    NSString *checksum = nil;
+    NSData *cached = [metadataCache cachedDataForPath:thePath checksum:&checksum];
+    Item *item = nil;
+    BOOL notModified = NO;
+    NSData *ret = [remoteFS contentsOfFileAtPath:thePath unlessChecksumMatches:(cached != nil ? checksum : nil) item:&item notModified:&notModified targetConnectionDelegate:theDelegate error:error];
+    if (ret == nil) {
+        return nil;
+    }
+    if (notModified) {
+        HSLogDebug(@"using cached metadata for %@", thePath);
+        return cached;
+    }
+    if (item != nil) {
+        [metadataCache setData:ret forPath:thePath item:item];
+    }
+    return ret;
+}
 - (NSData *)contentsOfRange:(NSRange)theRange ofFileAtPath:(NSString *)thePath delegate:(id<TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     return [[self remoteFS:error] contentsOfRange:theRange ofFileAtPath:thePath dataTransferDelegate:nil targetConnectionDelegate:theDelegate error:error];
 }
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileAtPath:(NSString *)thePath delegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
+    return [[self remoteFS:error] contentsOfRanges:theRanges ofFileAtPath:thePath dataTransferDelegate:nil targetConnectionDelegate:theDelegate error:error];
+}
 - (BOOL)writeData:(NSData *)theData toFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDataTransferDelegate targetConnectionDelegate:(id <TargetConnectionDelegate>)theTargetConnectionDelegate error:(NSError **)error {
     RemoteFS *remoteFS = [self remoteFS:error];
     if (remoteFS == nil) {
@@ -0,0 +1,97 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "TargetMetadataCache.h"
+#import "Item.h"
+#import "SHA1Hash.h"
+#import "UserLibrary_Arq.h"
+
+
+@implementation TargetMetadataCache
+- (id)initWithTargetUUID:(NSString *)theTargetUUID {
+    if (self = [super init]) {
+        cacheDir = [[[UserLibrary arqCachePath] stringByAppendingPathComponent:theTargetUUID] stringByAppendingPathComponent:@"metadata"];
+    }
+    return self;
+}
+- (NSData *)cachedDataForPath:(NSString *)thePath checksum:(NSString **)theChecksum {
+    NSDictionary *entry = [NSDictionary dictionaryWithContentsOfFile:[self entryPathForPath:thePath]];
+    if (entry == nil) {
+        return nil;
+    }
+    if (![[entry objectForKey:@"path"] isEqualToString:thePath]) {
+        return nil;
+    }
+    NSData *ret = [entry objectForKey:@"data"];
+    NSString *checksum = [entry objectForKey:@"checksum"];
+    if (![ret isKindOfClass:[NSData class]] || ![checksum isKindOfClass:[NSString class]] || [ret length] != [[entry objectForKey:@"size"] unsignedLongLongValue]) {
+        return nil;
+    }
+    *theChecksum = checksum;
+    return ret;
+}
+- (void)setData:(NSData *)theData forPath:(NSString *)thePath item:(Item *)theItem {
+    if (![self isValidatableItem:theItem] || [theData length] != [theItem fileSize]) {
+        return;
+    }
+    NSError *myError = nil;
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:cacheDir withIntermediateDirectories:YES attributes:nil error:&myError]) {
+        HSLogError(@"failed to create %@: %@", cacheDir, myError);
+        return;
+    }
+    NSMutableDictionary *entry = [NSMutableDictionary dictionary];
+    [entry setObject:thePath forKey:@"path"];
+    [entry setObject:theData forKey:@"data"];
+    [entry setObject:[NSNumber numberWithUnsignedLongLong:[theItem fileSize]] forKey:@"size"];
+    if ([theItem checksum] != nil) {
+        [entry setObject:[theItem checksum] forKey:@"checksum"];
+    }
+    if ([theItem fileLastModified] != nil) {
+        [entry setObject:[theItem fileLastModified] forKey:@"lastModified"];
+    }
+    NSString *entryPath = [self entryPathForPath:thePath];
+    if (![entry writeToFile:entryPath atomically:YES]) {
+        HSLogError(@"failed to write cached metadata to %@", entryPath);
+    }
+}
+
+#pragma mark internal
+- (BOOL)isValidatableItem:(Item *)theItem {
+    // Without a checksum the target can't tell us when the cached copy is stale.
+    return theItem != nil && ![theItem isDirectory] && [theItem checksum] != nil;
+}
+- (NSString *)entryPathForPath:(NSString *)thePath {
+    NSString *hash = [SHA1Hash hashData:[thePath dataUsingEncoding:NSUTF8StringEncoding]];
+    return [cacheDir stringByAppendingPathComponent:[hash stringByAppendingPathExtension:@"plist"]];
+}
+@end
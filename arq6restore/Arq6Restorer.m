@@ -11,6 +11,8 @@
 #import "XAttrSet.h"
 #import "DataInputStream.h"
 #import "BufferedInputStream.h"
+#import "RestoreProgressPrinter.h"
+#import "RestoreMetrics.h"
 #include <sys/stat.h>
 #include <utime.h>
 
@@ -24,6 +26,7 @@
     NSString *_destinationPath;
     id <TargetConnectionDelegate> _delegate;
     Arq7BlobReader *_blobReader;
+    RestoreProgressPrinter *_progressPrinter;
 }
 @end
 
@@ -45,6 +48,7 @@
         _relativePath = theRelativePath;
         _destinationPath = theDestinationPath;
         _delegate = theDelegate;
+        _progressPrinter = [[RestoreProgressPrinter alloc] init];
     }
     return self;
 }
@@ -54,6 +58,12 @@
 }
 
 - (BOOL)restore:(NSError **)error {
+    BOOL ret = [self doRestore:error];
+    [_progressPrinter restoreDidFinish];
+    return ret;
+}
+
+- (BOOL)doRestore:(NSError **)error {
     Arq6Snapshot *snapshot = [Arq6Snapshot mostRecentSnapshotForPlanUUID:_planUUID
                                                          targetConnection:_conn
                                                                    keySet:_keySet
@@ -191,7 +201,9 @@
             success = NO;
             break;
         }
+        NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
         [fh writeData:blobData];
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageFileWrite startTime:startTime bytes:[blobData length]];
     }
     [fh closeFile];
 
@@ -218,11 +230,12 @@
         HSLogError(@"failed to apply metadata to %@", thePath);
     }
 
-    printf("restored %s\n", [thePath UTF8String]);
+    [_progressPrinter didRestorePath:thePath];
     return YES;
 }
 
 - (BOOL)applyMetadata:(Arq7Node *)theNode toPath:(NSString *)thePath isDirectory:(BOOL)isDirectory error:(NSError **)error {
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
     if (theNode.mac_st_mode != 0) {
         NSError *myError = nil;
         if (![FileAttributes applyMode:theNode.mac_st_mode toPath:thePath isDirectory:isDirectory error:&myError]) {
@@ -250,6 +263,7 @@
             HSLogError(@"applyMTimeSec failed for %@: %@", thePath, myError);
         }
     }
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageMetadata startTime:startTime bytes:0];
     return YES;
 }
 @end
@@ -3,6 +3,8 @@
 #import "Arq7EncryptedObjectDecryptor.h"
 #import "TargetConnection.h"
 #import "Item.h"
+#import "ParallelDiscovery.h"
+#import "Arq7JSONReader.h"
 
 
 @interface Arq7BackupFolder() {
@@ -31,7 +33,7 @@
         return nil;
     }
 
-    NSMutableArray *ret = [NSMutableArray array];
+    NSMutableArray *folderUUIDs = [NSMutableArray array];
     for (NSString *folderUUID in [itemsByName allKeys]) {
         if ([folderUUID isEqualToString:@".DS_Store"] || [folderUUID isEqualToString:@"@eaDir"]) {
             continue;
@@ -40,45 +42,102 @@
         if (![item isDirectory]) {
             continue;
         }
+        [folderUUIDs addObject:folderUUID];
+    }
 
-        NSString *jsonPath = [NSString stringWithFormat:@"%@/%@/backupfolders/%@/backupfolder.json", [theConn pathPrefix], thePlanUUID, folderUUID];
+    // Fetch each folder's backupfolder.json concurrently.
+    NSMutableArray *ret = [NSMutableArray array];
+    __block NSError *fatalError = nil;
+    [ParallelDiscovery performCount:[folderUUIDs count] block:^(NSUInteger theIndex) {
+        NSString *folderUUID = [folderUUIDs objectAtIndex:theIndex];
         NSError *myError = nil;
-        NSData *data = [theConn contentsOfFileAtPath:jsonPath delegate:theDelegate error:&myError];
-        if (data == nil) {
-            HSLogError(@"failed to read %@: %@", jsonPath, myError);
-            continue;
-        }
-
-        // Decrypt if ARQO-prefixed.
-        if ([Arq7EncryptedObjectDecryptor isEncryptedData:data]) {
-            if (theKeySet == nil) {
-                SETNSERROR(@"Arq7BackupFolderErrorDomain", ERROR_INVALID_PASSWORD, @"backupfolder.json is encrypted but no key set provided");
-                return nil;
-            }
-            Arq7EncryptedObjectDecryptor *dec = [[Arq7EncryptedObjectDecryptor alloc] initWithKeySet:theKeySet];
-            data = [dec decryptData:data error:error];
-            if (data == nil) {
-                return nil;
+        Arq7BackupFolder *folder = [Arq7BackupFolder backupFolderWithPlanUUID:thePlanUUID folderUUID:folderUUID targetConnection:theConn keySet:theKeySet delegate:theDelegate error:&myError];
+        @synchronized(ret) {
+            if (folder != nil) {
+                [ret addObject:folder];
+            } else if (myError != nil && fatalError == nil) {
+                fatalError = myError;
             }
         }
+    }];
+    if (fatalError != nil) {
+        if (error != NULL) {
+            *error = fatalError;
+        }
+        return nil;
+    }
+    return ret;
+}
 
-        NSDictionary *json = [NSJSONSerialization JSONObjectWithData:data options:0 error:error];
-        if (json == nil) {
+// Returns nil without setting an error if backupfolder.json couldn't be read, so the folder is skipped.
++ (Arq7BackupFolder *)backupFolderWithPlanUUID:(NSString *)thePlanUUID
+                                    folderUUID:(NSString *)theFolderUUID
+                              targetConnection:(TargetConnection *)theConn
+                                        keySet:(Arq7KeySet *)theKeySet
+                                      delegate:(id <TargetConnectionDelegate>)theDelegate
+                                         error:(NSError **)error {
+    NSString *jsonPath = [NSString stringWithFormat:@"%@/%@/backupfolders/%@/backupfolder.json", [theConn pathPrefix], thePlanUUID, theFolderUUID];
+    NSError *myError = nil;
+    NSData *data = [theConn cachedContentsOfFileAtPath:jsonPath delegate:theDelegate error:&myError];
+    if (data == nil) {
+        HSLogError(@"failed to read %@: %@", jsonPath, myError);
+        return nil;
+    }
+
+    // Decrypt if ARQO-prefixed.
+    if ([Arq7EncryptedObjectDecryptor isEncryptedData:data]) {
+        if (theKeySet == nil) {
+            SETNSERROR(@"Arq7BackupFolderErrorDomain", ERROR_INVALID_PASSWORD, @"backupfolder.json is encrypted but no key set provided");
+            return nil;
+        }
+        Arq7EncryptedObjectDecryptor *dec = [[Arq7EncryptedObjectDecryptor alloc] initWithKeySet:theKeySet];
+        data = [dec decryptData:data error:error];
+        if (data == nil) {
             return nil;
         }
-
-        Arq7BackupFolder *folder = [[Arq7BackupFolder alloc] initWithFolderUUID:folderUUID json:json];
-        [ret addObject:folder];
     }
-    return ret;
+
+    Arq7JSONReader *reader = [[Arq7JSONReader alloc] initWithData:data];
+    return [[Arq7BackupFolder alloc] initWithFolderUUID:theFolderUUID jsonReader:reader error:error];
 }
 
-- (instancetype)initWithFolderUUID:(NSString *)theFolderUUID json:(NSDictionary *)theJSON {
+// Reads the three fields we use and stops; the rest of the folder config isn't parsed.
+- (instancetype)initWithFolderUUID:(NSString *)theFolderUUID jsonReader:(Arq7JSONReader *)theReader error:(NSError **)error {
     if (self = [super init]) {
         _folderUUID = theFolderUUID;
-        _localPath = [theJSON objectForKey:@"localPath"];
-        _name = [theJSON objectForKey:@"name"];
-        _storageClass = [theJSON objectForKey:@"storageClass"];
+        if (![theReader readObjectStart:error]) {
+            return nil;
+        }
+        NSUInteger remainingFields = 3;
+        while (remainingFields > 0) {
+            NSString *key = nil;
+            if (![theReader readKey:&key error:error]) {
+                return nil;
+            }
+            if (key == nil) {
+                break;
+            }
+            BOOL ret = YES;
+            NSString *stringValue = nil;
+            if ([key isEqualToString:@"localPath"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _localPath = stringValue;
+                remainingFields--;
+            } else if ([key isEqualToString:@"name"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _name = stringValue;
+                remainingFields--;
+            } else if ([key isEqualToString:@"storageClass"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _storageClass = stringValue;
+                remainingFields--;
+            } else {
+                ret = [theReader skipValue:error];
+            }
+            if (!ret) {
+                return nil;
+            }
+        }
     }
     return self;
 }
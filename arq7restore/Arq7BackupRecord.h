@@ -26,4 +26,8 @@
                                                  keySet:(Arq7KeySet *)theKeySet
                                                delegate:(id <TargetConnectionDelegate>)theDelegate
                                                   error:(NSError **)error;
+
+// Parses decompressed backup record JSON. Only the fields above are decoded; the rest of the
+// document (which for large plans is most of it) is skipped.
++ (Arq7BackupRecord *)backupRecordWithJSONData:(NSData *)theData error:(NSError **)error;
 @end
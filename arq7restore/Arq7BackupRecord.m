@@ -2,12 +2,26 @@
 #import "Arq7KeySet.h"
 #import "Arq7EncryptedObjectDecryptor.h"
 #import "Arq7Node.h"
+#import "Arq7JSONReader.h"
 #import "TargetConnection.h"
 #import "Item.h"
 #include "lz4.h"
 #include <libkern/OSByteOrder.h>
 
 
+// The fields a record is read for; once all have been seen, the rest of the record is left unparsed.
+enum {
+    kRecordFieldVersion = 1 << 0,
+    kRecordFieldLocalPath = 1 << 1,
+    kRecordFieldBackupFolderUUID = 1 << 2,
+    kRecordFieldBackupPlanUUID = 1 << 3,
+    kRecordFieldCreationDate = 1 << 4,
+    kRecordFieldIsComplete = 1 << 5,
+    kRecordFieldNode = 1 << 6,
+    kRecordFieldsAll = (1 << 7) - 1
+};
+
+
 @interface Arq7BackupRecord() {
     int _version;
     NSString *_localPath;
@@ -73,6 +87,7 @@
                                                            targetConnection:theConn
                                                                      keySet:theKeySet
                                                                    delegate:theDelegate
+                                                           stopIfIncomplete:YES
                                                                       error:&myError];
             if (record == nil) {
                 HSLogError(@"failed to read backup record %@: %@", recordPath, myError);
@@ -93,6 +108,7 @@
                         targetConnection:(TargetConnection *)theConn
                                   keySet:(Arq7KeySet *)theKeySet
                                 delegate:(id <TargetConnectionDelegate>)theDelegate
+                        stopIfIncomplete:(BOOL)stopIfIncomplete
                                    error:(NSError **)error {
     NSData *rawData = [theConn contentsOfFileAtPath:thePath delegate:theDelegate error:error];
     if (rawData == nil) {
@@ -138,34 +154,76 @@
         return nil;
     }
 
-    // Step 3: parse as JSON.
-    NSDictionary *json = [NSJSONSerialization JSONObjectWithData:jsonData options:0 error:error];
-    if (json == nil) {
-        return nil;
-    }
+    // Step 3: read the fields we need from the JSON.
+    Arq7JSONReader *reader = [[Arq7JSONReader alloc] initWithData:jsonData];
+    return [[Arq7BackupRecord alloc] initWithJSONReader:reader stopIfIncomplete:stopIfIncomplete error:error];
+}
 
-    return [[Arq7BackupRecord alloc] initWithJSON:json error:error];
++ (Arq7BackupRecord *)backupRecordWithJSONData:(NSData *)theData error:(NSError **)error {
+    Arq7JSONReader *reader = [[Arq7JSONReader alloc] initWithData:theData];
+    return [[Arq7BackupRecord alloc] initWithJSONReader:reader stopIfIncomplete:NO error:error];
 }
 
-- (instancetype)initWithJSON:(NSDictionary *)theJSON error:(NSError **)error {
+// If stopIfIncomplete is YES, reading stops as soon as isComplete turns out to be false;
+// such a record has only the fields that came before it.
+- (instancetype)initWithJSONReader:(Arq7JSONReader *)theReader stopIfIncomplete:(BOOL)stopIfIncomplete error:(NSError **)error {
     if (self = [super init]) {
-        _version = [[theJSON objectForKey:@"version"] intValue];
-        _localPath = [theJSON objectForKey:@"localPath"];
-        _backupFolderUUID = [theJSON objectForKey:@"backupFolderUUID"];
-        _backupPlanUUID = [theJSON objectForKey:@"backupPlanUUID"];
-        _isComplete = [[theJSON objectForKey:@"isComplete"] boolValue];
-
-        // Parse creationDate (seconds since epoch stored as a number).
-        id dateVal = [theJSON objectForKey:@"creationDate"];
-        if (dateVal != nil) {
-            _creationDate = [NSDate dateWithTimeIntervalSince1970:[dateVal doubleValue]];
+        if (![theReader readObjectStart:error]) {
+            return nil;
         }
-
-        // Parse root node (version 100 only).
-        NSDictionary *nodeJSON = [theJSON objectForKey:@"node"];
-        if (nodeJSON != nil) {
-            _node = [[Arq7Node alloc] initWithJSON:nodeJSON error:error];
-            if (_node == nil) {
+        unsigned int seenFields = 0;
+        while (seenFields != kRecordFieldsAll) {
+            NSString *key = nil;
+            if (![theReader readKey:&key error:error]) {
+                return nil;
+            }
+            if (key == nil) {
+                break;
+            }
+            BOOL ret = YES;
+            NSString *stringValue = nil;
+            if ([key isEqualToString:@"version"]) {
+                int64_t version = 0;
+                ret = [theReader readInt64:&version error:error];
+                _version = (int)version;
+                seenFields |= kRecordFieldVersion;
+            } else if ([key isEqualToString:@"localPath"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _localPath = stringValue;
+                seenFields |= kRecordFieldLocalPath;
+            } else if ([key isEqualToString:@"backupFolderUUID"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _backupFolderUUID = stringValue;
+                seenFields |= kRecordFieldBackupFolderUUID;
+            } else if ([key isEqualToString:@"backupPlanUUID"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _backupPlanUUID = stringValue;
+                seenFields |= kRecordFieldBackupPlanUUID;
+            } else if ([key isEqualToString:@"creationDate"]) {
+                // Seconds since epoch stored as a number.
+                if (![theReader readNull]) {
+                    double creationDate = 0;
+                    ret = [theReader readDouble:&creationDate error:error];
+                    _creationDate = [NSDate dateWithTimeIntervalSince1970:creationDate];
+                }
+                seenFields |= kRecordFieldCreationDate;
+            } else if ([key isEqualToString:@"isComplete"]) {
+                ret = [theReader readBool:&_isComplete error:error];
+                seenFields |= kRecordFieldIsComplete;
+                if (ret && !_isComplete && stopIfIncomplete) {
+                    break;
+                }
+            } else if ([key isEqualToString:@"node"]) {
+                // Root node (version 100 only).
+                if (![theReader readNull]) {
+                    _node = [[Arq7Node alloc] initWithJSONReader:theReader error:error];
+                    ret = (_node != nil);
+                }
+                seenFields |= kRecordFieldNode;
+            } else {
+                ret = [theReader skipValue:error];
+            }
+            if (!ret) {
                 return nil;
             }
         }
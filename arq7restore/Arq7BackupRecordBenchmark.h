@@ -0,0 +1,19 @@
+/*
+ Arq7BackupRecordBenchmark — times reading a synthetic multi-MB backup record two ways:
+ parsing the whole document with NSJSONSerialization (as records used to be read), and
+ reading just the record's fields with Arq7JSONReader.
+*/
+
+@interface Arq7BackupRecordBenchmark : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+- (instancetype)initWithRecordBytes:(NSUInteger)theRecordBytes iterations:(NSUInteger)theIterations;
+
+- (NSString *)errorDomain;
+- (BOOL)run:(NSError **)error;
+
+// Size of the generated record's JSON.
+- (NSUInteger)recordBytes;
+- (NSTimeInterval)dictionarySecondsPerRecord;
+- (NSTimeInterval)streamingSecondsPerRecord;
+@end
@@ -0,0 +1,196 @@
+#import "Arq7BackupRecordBenchmark.h"
+#import "Arq7BackupRecord.h"
+#import "Arq7Node.h"
+#import "Arq7BlobLoc.h"
+
+
+// Approximate size of one generated plan exclude or record error entry.
+#define BYTES_PER_FILLER_ENTRY (120)
+
+
+@interface Arq7BackupRecordBenchmark() {
+    NSUInteger _requestedBytes;
+    NSUInteger _iterations;
+    NSUInteger _recordBytes;
+    NSTimeInterval _dictionarySeconds;
+    NSTimeInterval _streamingSeconds;
+}
+@end
+
+
+@implementation Arq7BackupRecordBenchmark
+
+- (instancetype)initWithRecordBytes:(NSUInteger)theRecordBytes iterations:(NSUInteger)theIterations {
+    if (self = [super init]) {
+        _requestedBytes = theRecordBytes;
+        _iterations = theIterations;
+    }
+    return self;
+}
+
+- (NSString *)errorDomain {
+    return @"Arq7BackupRecordBenchmarkErrorDomain";
+}
+
+- (BOOL)run:(NSError **)error {
+    NSData *recordData = [self syntheticRecordData:error];
+    if (recordData == nil) {
+        return NO;
+    }
+    _recordBytes = [recordData length];
+
+    // Read it once each way first, to check both agree on what the record says.
+    Arq7BackupRecord *record = [Arq7BackupRecord backupRecordWithJSONData:recordData error:error];
+    if (record == nil) {
+        return NO;
+    }
+    NSDictionary *json = [NSJSONSerialization JSONObjectWithData:recordData options:0 error:error];
+    if (json == nil) {
+        return NO;
+    }
+    Arq7Node *node = [[Arq7Node alloc] initWithJSON:[json objectForKey:@"node"] error:error];
+    if (node == nil) {
+        return NO;
+    }
+    if (record.version != [[json objectForKey:@"version"] intValue]
+        || ![record.localPath isEqualToString:[json objectForKey:@"localPath"]]
+        || ![record.backupPlanUUID isEqualToString:[json objectForKey:@"backupPlanUUID"]]
+        || record.isComplete != [[json objectForKey:@"isComplete"] boolValue]
+        || [record.creationDate timeIntervalSince1970] != [[json objectForKey:@"creationDate"] doubleValue]
+        || record.node.itemSize != node.itemSize
+        || record.node.mac_st_ino != node.mac_st_ino
+        || ![record.node.treeBlobLoc.blobIdentifier isEqualToString:node.treeBlobLoc.blobIdentifier]
+        || record.node.treeBlobLoc.offset != node.treeBlobLoc.offset) {
+        SETNSERROR([self errorDomain], -1, @"streaming and dictionary parsing disagree about the synthetic record");
+        return NO;
+    }
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < _iterations; i++) {
+        @autoreleasepool {
+            // The old path: build the whole dictionary tree, then pick out the record's fields.
+            NSDictionary *recordJSON = [NSJSONSerialization JSONObjectWithData:recordData options:0 error:error];
+            if (recordJSON == nil) {
+                return NO;
+            }
+            if ([[recordJSON objectForKey:@"isComplete"] boolValue]) {
+                Arq7Node *recordNode = [[Arq7Node alloc] initWithJSON:[recordJSON objectForKey:@"node"] error:error];
+                if (recordNode == nil) {
+                    return NO;
+                }
+            }
+        }
+    }
+    _dictionarySeconds = [NSDate timeIntervalSinceReferenceDate] - start;
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < _iterations; i++) {
+        @autoreleasepool {
+            if ([Arq7BackupRecord backupRecordWithJSONData:recordData error:error] == nil) {
+                return NO;
+            }
+        }
+    }
+    _streamingSeconds = [NSDate timeIntervalSinceReferenceDate] - start;
+    return YES;
+}
+
+- (NSUInteger)recordBytes {
+    return _recordBytes;
+}
+- (NSTimeInterval)dictionarySecondsPerRecord {
+    return _iterations > 0 ? _dictionarySeconds / (double)_iterations : 0;
+}
+- (NSTimeInterval)streamingSecondsPerRecord {
+    return _iterations > 0 ? _streamingSeconds / (double)_iterations : 0;
+}
+
+
+#pragma mark internal
+
+// A version 100 record whose bulk is an embedded plan and a list of per-file errors, with the plan
+// ahead of the record's own fields and the errors after them.
+- (NSData *)syntheticRecordData:(NSError **)error {
+    NSUInteger entryCount = _requestedBytes / BYTES_PER_FILLER_ENTRY / 2 + 1;
+
+    NSMutableArray *excludes = [NSMutableArray arrayWithCapacity:entryCount];
+    for (NSUInteger i = 0; i < entryCount; i++) {
+        [excludes addObject:@{
+            @"type": @(i % 4),
+            @"matchesFullPath": @(i % 2 == 0),
+            @"text": [NSString stringWithFormat:@"/Users/someone/Library/Caches/com.example.app-%lu/Cache.db", (unsigned long)i]
+        }];
+    }
+    NSDictionary *plan = @{
+        @"name": @"Back up to S3",
+        @"isEncrypted": @YES,
+        @"retainHours": @720,
+        @"excludes": excludes
+    };
+
+    NSMutableArray *errors = [NSMutableArray arrayWithCapacity:entryCount];
+    for (NSUInteger i = 0; i < entryCount; i++) {
+        [errors addObject:@{
+            @"localPath": [NSString stringWithFormat:@"/Users/someone/Documents/Projects/\"Draft\" %lu/notes.txt", (unsigned long)i],
+            @"errorMessage": @"open: Operation not permitted",
+            @"pathIsDirectory": @NO
+        }];
+    }
+
+    NSDictionary *node = @{
+        @"isTree": @YES,
+        @"treeBlobLoc": @{
+            @"blobIdentifier": @"9a4e8d5bbd29c5f1f4f2c0b4f4d9ab2e3a1c6e3b8d1a5c3b2e1f0a9b8c7d6e5f",
+            @"isPacked": @YES,
+            @"isLargePack": @NO,
+            @"relativePath": @"/B0B1F3E6-6A3C-4E59-9C4D-3C1D2E3F4A5B/treepacks/9A/4E8D5BBD-1111-2222-3333-444455556666.pack",
+            @"offset": @123456,
+            @"length": @7890,
+            @"stretchEncryptionKey": @YES,
+            @"compressionType": @2
+        },
+        @"computerOSType": @1,
+        @"dataBlobLocs": @[],
+        @"xattrsBlobLocs": @[],
+        @"itemSize": @1234567890123,
+        @"containedFilesCount": @987654,
+        @"modificationTime_sec": @1700000000,
+        @"modificationTime_nsec": @123456789,
+        @"changeTime_sec": @1700000001,
+        @"changeTime_nsec": @0,
+        @"creationTime_sec": @1600000000,
+        @"creationTime_nsec": @0,
+        @"userName": @"someone",
+        @"groupName": @"staff",
+        @"deleted": @NO,
+        @"mac_st_dev": @16777220,
+        @"mac_st_ino": @12345678,
+        @"mac_st_mode": @16877,
+        @"mac_st_nlink": @42,
+        @"mac_st_uid": @501,
+        @"mac_st_gid": @20,
+        @"mac_st_rdev": @0,
+        @"mac_st_flags": @0,
+        @"winAttrs": @0,
+        @"reparseTag": @0,
+        @"reparsePointIsDirectory": @NO
+    };
+
+    NSData *planData = [NSJSONSerialization dataWithJSONObject:plan options:0 error:error];
+    NSData *errorsData = [NSJSONSerialization dataWithJSONObject:errors options:0 error:error];
+    NSData *nodeData = [NSJSONSerialization dataWithJSONObject:node options:0 error:error];
+    if (planData == nil || errorsData == nil || nodeData == nil) {
+        return nil;
+    }
+
+    NSMutableData *ret = [NSMutableData dataWithCapacity:[planData length] + [errorsData length] + [nodeData length] + 1024];
+    [ret appendData:[@"{\"version\":100,\"backupFolderUUID\":\"5A0B2C3D-4E5F-6071-8293-A4B5C6D7E8F9\",\"backupPlanUUID\":\"B0B1F3E6-6A3C-4E59-9C4D-3C1D2E3F4A5B\",\"backupPlanJSON\":" dataUsingEncoding:NSUTF8StringEncoding]];
+    [ret appendData:planData];
+    [ret appendData:[@",\"creationDate\":1700000123.5,\"localPath\":\"\\/Users\\/someone\\/Documents\",\"isComplete\":true,\"node\":" dataUsingEncoding:NSUTF8StringEncoding]];
+    [ret appendData:nodeData];
+    [ret appendData:[@",\"backupRecordErrors\":" dataUsingEncoding:NSUTF8StringEncoding]];
+    [ret appendData:errorsData];
+    [ret appendData:[@",\"arqVersion\":\"7.30\"}" dataUsingEncoding:NSUTF8StringEncoding]];
+    return ret;
+}
+@end
@@ -1,6 +1,8 @@
 #import "Arq7BackupSet.h"
 #import "Target.h"
 #import "TargetConnection.h"
+#import "ParallelDiscovery.h"
+#import "Arq7JSONReader.h"
 
 
 @interface Arq7BackupSet() {
@@ -33,14 +35,27 @@
         return nil;
     }
 
-    NSMutableArray *ret = [NSMutableArray array];
-    for (NSString *uuid in uuids) {
+    // Fetch each plan's backupconfig.json concurrently; results keep the order of uuids.
+    NSMutableArray *backupSetsByIndex = [NSMutableArray arrayWithCapacity:[uuids count]];
+    for (NSUInteger i = 0; i < [uuids count]; i++) {
+        [backupSetsByIndex addObject:[NSNull null]];
+    }
+    [ParallelDiscovery performCount:[uuids count] block:^(NSUInteger theIndex) {
         NSError *myError = nil;
-        Arq7BackupSet *bs = [Arq7BackupSet backupSetWithPlanUUID:uuid targetConnection:conn delegate:theDelegate error:&myError];
+        Arq7BackupSet *bs = [Arq7BackupSet backupSetWithPlanUUID:[uuids objectAtIndex:theIndex] targetConnection:conn delegate:theDelegate error:&myError];
+        // If nil, it's not an Arq7 backup set (e.g., it's an Arq5 computerUUID) — skip silently.
         if (bs != nil) {
+            @synchronized(backupSetsByIndex) {
+                [backupSetsByIndex replaceObjectAtIndex:theIndex withObject:bs];
+            }
+        }
+    }];
+
+    NSMutableArray *ret = [NSMutableArray array];
+    for (id bs in backupSetsByIndex) {
+        if (bs != [NSNull null]) {
             [ret addObject:bs];
         }
-        // If nil, it's not an Arq7 backup set (e.g., it's an Arq5 computerUUID) — skip silently.
     }
     return ret;
 }
@@ -51,33 +66,61 @@
                                    error:(NSError **)error {
     NSString *configPath = [NSString stringWithFormat:@"%@/%@/backupconfig.json", [theConn pathPrefix], thePlanUUID];
     NSError *myError = nil;
-    NSNumber *exists = [theConn fileExistsAtPath:configPath dataSize:NULL delegate:theDelegate error:&myError];
-    if (exists == nil || ![exists boolValue]) {
-        // Not an Arq7 backup set.
-        return nil;
-    }
-
-    NSData *jsonData = [theConn contentsOfFileAtPath:configPath delegate:theDelegate error:error];
+    NSData *jsonData = [theConn cachedContentsOfFileAtPath:configPath delegate:theDelegate error:&myError];
     if (jsonData == nil) {
+        if ([myError code] != ERROR_NOT_FOUND) {
+            SETERRORFROMMYERROR;
+        }
+        // Not an Arq7 backup set.
         return nil;
     }
 
-    NSDictionary *json = [NSJSONSerialization JSONObjectWithData:jsonData options:0 error:error];
-    if (json == nil) {
-        return nil;
-    }
-
-    Arq7BackupSet *bs = [[Arq7BackupSet alloc] initWithPlanUUID:thePlanUUID json:json];
+    Arq7JSONReader *reader = [[Arq7JSONReader alloc] initWithData:jsonData];
+    Arq7BackupSet *bs = [[Arq7BackupSet alloc] initWithPlanUUID:thePlanUUID jsonReader:reader error:error];
     return bs;
 }
 
-- (instancetype)initWithPlanUUID:(NSString *)thePlanUUID json:(NSDictionary *)theJSON {
+// Reads the four fields we use and stops; the rest of the plan's config isn't parsed.
+- (instancetype)initWithPlanUUID:(NSString *)thePlanUUID jsonReader:(Arq7JSONReader *)theReader error:(NSError **)error {
     if (self = [super init]) {
         _planUUID = thePlanUUID;
-        _backupName = [theJSON objectForKey:@"backupName"];
-        _computerName = [theJSON objectForKey:@"computerName"];
-        _isEncrypted = [[theJSON objectForKey:@"isEncrypted"] boolValue];
-        _blobIdentifierType = [[theJSON objectForKey:@"blobIdentifierType"] intValue];
+        if (![theReader readObjectStart:error]) {
+            return nil;
+        }
+        NSUInteger remainingFields = 4;
+        while (remainingFields > 0) {
+            NSString *key = nil;
+            if (![theReader readKey:&key error:error]) {
+                return nil;
+            }
+            if (key == nil) {
+                break;
+            }
+            BOOL ret = YES;
+            NSString *stringValue = nil;
+            if ([key isEqualToString:@"backupName"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _backupName = stringValue;
+                remainingFields--;
+            } else if ([key isEqualToString:@"computerName"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _computerName = stringValue;
+                remainingFields--;
+            } else if ([key isEqualToString:@"isEncrypted"]) {
+                ret = [theReader readBool:&_isEncrypted error:error];
+                remainingFields--;
+            } else if ([key isEqualToString:@"blobIdentifierType"]) {
+                int64_t blobIdentifierType = 0;
+                ret = [theReader readInt64:&blobIdentifierType error:error];
+                _blobIdentifierType = (int)blobIdentifierType;
+                remainingFields--;
+            } else {
+                ret = [theReader skipValue:error];
+            }
+            if (!ret) {
+                return nil;
+            }
+        }
     }
     return self;
 }
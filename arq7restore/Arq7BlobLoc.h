@@ -5,6 +5,7 @@
 
 #import "Arq7Types.h"
 @class BufferedInputStream;
+@class Arq7JSONReader;
 
 @interface Arq7BlobLoc : NSObject <NSCopying>
 
@@ -18,6 +19,7 @@
                   stretchEncryptionKey:(BOOL)doStretchEncryptionKey
                        compressionType:(Arq7CompressionType)theCompressionType;
 - (instancetype)initWithJSON:(NSDictionary *)theJSON error:(NSError **)error;
+- (instancetype)initWithJSONReader:(Arq7JSONReader *)theReader error:(NSError **)error;
 - (instancetype)initWithBufferedInputStream:(BufferedInputStream *)theBIS
                                 treeVersion:(int)theTreeVersion
                                       error:(NSError **)error;
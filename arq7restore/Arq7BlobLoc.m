@@ -8,6 +8,7 @@
 #import "IntegerIO.h"
 #import "BooleanIO.h"
 #import "BufferedInputStream.h"
+#import "Arq7JSONReader.h"
 
 
 @implementation Arq7BlobLoc
@@ -56,6 +57,57 @@
     return self;
 }
 
+- (instancetype)initWithJSONReader:(Arq7JSONReader *)theReader error:(NSError **)error {
+    if (self = [super init]) {
+        if (![theReader readObjectStart:error]) {
+            return nil;
+        }
+        NSString *blobIdentifier = nil;
+        NSString *relativePath = nil;
+        int64_t compressionType = 0;
+        for (;;) {
+            NSString *key = nil;
+            if (![theReader readKey:&key error:error]) {
+                return nil;
+            }
+            if (key == nil) {
+                break;
+            }
+            BOOL ret = NO;
+            if ([key isEqualToString:@"blobIdentifier"]) {
+                ret = [theReader readString:&blobIdentifier error:error];
+            } else if ([key isEqualToString:@"isPacked"]) {
+                ret = [theReader readBool:&_isPacked error:error];
+            } else if ([key isEqualToString:@"isLargePack"]) {
+                ret = [theReader readBool:&_isLargePack error:error];
+            } else if ([key isEqualToString:@"relativePath"]) {
+                ret = [theReader readString:&relativePath error:error];
+            } else if ([key isEqualToString:@"offset"]) {
+                ret = [theReader readUInt64:&_offset error:error];
+            } else if ([key isEqualToString:@"length"]) {
+                ret = [theReader readUInt64:&_length error:error];
+            } else if ([key isEqualToString:@"stretchEncryptionKey"]) {
+                ret = [theReader readBool:&_stretchEncryptionKey error:error];
+            } else if ([key isEqualToString:@"compressionType"]) {
+                ret = [theReader readInt64:&compressionType error:error];
+            } else {
+                ret = [theReader skipValue:error];
+            }
+            if (!ret) {
+                return nil;
+            }
+        }
+        if (blobIdentifier == nil) {
+            SETNSERROR([self errorDomain], -1, @"missing blob identifier");
+            return nil;
+        }
+        _blobIdentifier = blobIdentifier;
+        _relativePath = relativePath != nil ? relativePath : @"";
+        _compressionType = (Arq7CompressionType)compressionType;
+    }
+    return self;
+}
+
 - (instancetype)initWithBufferedInputStream:(BufferedInputStream *)theBIS
                                 treeVersion:(int)theTreeVersion
                                       error:(NSError **)error {
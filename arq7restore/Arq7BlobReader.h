@@ -19,6 +19,10 @@
 // Fetches, decrypts, and decompresses raw blob data.
 - (NSData *)dataForBlobLoc:(Arq7BlobLoc *)theBlobLoc error:(NSError **)error;
 
+// Same as dataForBlobLoc: for several blobs; returns an NSData per blob loc, in order.
+// Blobs that share a pack file are fetched with one multi-range read where the target supports it.
+- (NSArray *)dataForBlobLocs:(NSArray *)theBlobLocs error:(NSError **)error;
+
 // Convenience: reads and parses a Tree from a blob loc.
 - (Arq7Tree *)treeForBlobLoc:(Arq7BlobLoc *)theBlobLoc error:(NSError **)error;
 @end
@@ -6,6 +6,7 @@
 #import "TargetConnection.h"
 #import "DataInputStream.h"
 #import "BufferedInputStream.h"
+#import "RestoreMetrics.h"
 #include "lz4.h"
 #include <libkern/OSByteOrder.h>
 
@@ -44,6 +45,7 @@
     // Build the full relative path (relative to target root).
     NSString *relativePath = [NSString stringWithFormat:@"%@%@", [_conn pathPrefix], theBlobLoc.relativePath];
 
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
     if (theBlobLoc.isPacked) {
         // Read a slice from a pack file.
         NSRange range = NSMakeRange((NSUInteger)theBlobLoc.offset, (NSUInteger)theBlobLoc.length);
@@ -56,6 +58,85 @@
     if (rawData == nil) {
         return nil;
     }
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageNetwork startTime:startTime bytes:[rawData length]];
+    return [self decodedData:rawData forBlobLoc:theBlobLoc error:error];
+}
+
+- (NSArray *)dataForBlobLocs:(NSArray *)theBlobLocs error:(NSError **)error {
+    // Group the packed blobs by pack file, keeping each blob's index so results go back in order.
+    NSMutableArray *packPaths = [NSMutableArray array];
+    NSMutableDictionary *indexesByPackPath = [NSMutableDictionary dictionary];
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:[theBlobLocs count]];
+    for (NSUInteger index = 0; index < [theBlobLocs count]; index++) {
+        Arq7BlobLoc *blobLoc = [theBlobLocs objectAtIndex:index];
+        [ret addObject:[NSNull null]];
+        if (!blobLoc.isPacked) {
+            NSData *data = [self dataForBlobLoc:blobLoc error:error];
+            if (data == nil) {
+                return nil;
+            }
+            [ret replaceObjectAtIndex:index withObject:data];
+            continue;
+        }
+        NSMutableArray *indexes = [indexesByPackPath objectForKey:blobLoc.relativePath];
+        if (indexes == nil) {
+            indexes = [NSMutableArray array];
+            [indexesByPackPath setObject:indexes forKey:blobLoc.relativePath];
+            [packPaths addObject:blobLoc.relativePath];
+        }
+        [indexes addObject:[NSNumber numberWithUnsignedInteger:index]];
+    }
+
+    for (NSString *packPath in packPaths) {
+        NSArray *indexes = [indexesByPackPath objectForKey:packPath];
+        NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:[indexes count]];
+        for (NSNumber *index in indexes) {
+            Arq7BlobLoc *blobLoc = [theBlobLocs objectAtIndex:[index unsignedIntegerValue]];
+            [ranges addObject:[NSValue valueWithRange:NSMakeRange((NSUInteger)blobLoc.offset, (NSUInteger)blobLoc.length)]];
+        }
+        NSString *relativePath = [NSString stringWithFormat:@"%@%@", [_conn pathPrefix], packPath];
+        NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+        NSArray *rawDatas = [_conn contentsOfRanges:ranges ofFileAtPath:relativePath delegate:_delegate error:error];
+        if (rawDatas == nil) {
+            return nil;
+        }
+        unsigned long long rawBytes = 0;
+        for (NSData *rawData in rawDatas) {
+            rawBytes += [rawData length];
+        }
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageNetwork startTime:startTime bytes:rawBytes];
+        for (NSUInteger i = 0; i < [indexes count]; i++) {
+            NSUInteger index = [[indexes objectAtIndex:i] unsignedIntegerValue];
+            NSData *data = [self decodedData:[rawDatas objectAtIndex:i] forBlobLoc:[theBlobLocs objectAtIndex:index] error:error];
+            if (data == nil) {
+                return nil;
+            }
+            [ret replaceObjectAtIndex:index withObject:data];
+        }
+    }
+    return ret;
+}
+
+- (Arq7Tree *)treeForBlobLoc:(Arq7BlobLoc *)theBlobLoc error:(NSError **)error {
+    NSData *data = [self dataForBlobLoc:theBlobLoc error:error];
+    if (data == nil) {
+        return nil;
+    }
+    DataInputStream *dis = [[DataInputStream alloc] initWithData:data description:@"tree data"];
+    BufferedInputStream *bis = [[BufferedInputStream alloc] initWithUnderlyingStream:dis];
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    Arq7Tree *ret = [[Arq7Tree alloc] initWithBufferedInputStream:bis error:error];
+    if (ret != nil) {
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageTreeDecode startTime:startTime bytes:[data length]];
+    }
+    return ret;
+}
+
+
+#pragma mark internal
+
+- (NSData *)decodedData:(NSData *)theRawData forBlobLoc:(Arq7BlobLoc *)theBlobLoc error:(NSError **)error {
+    NSData *rawData = theRawData;
 
     // Decrypt if ARQO-prefixed.
     if ([Arq7EncryptedObjectDecryptor isEncryptedData:rawData]) {
@@ -63,38 +144,29 @@
             SETNSERROR([self errorDomain], ERROR_INVALID_PASSWORD, @"blob is encrypted but no key set provided");
             return nil;
         }
+        NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
         Arq7EncryptedObjectDecryptor *dec = [[Arq7EncryptedObjectDecryptor alloc] initWithKeySet:_keySet];
         rawData = [dec decryptData:rawData error:error];
         if (rawData == nil) {
             return nil;
         }
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageDecrypt startTime:startTime bytes:[rawData length]];
     }
 
     // Decompress if needed.
     if (theBlobLoc.compressionType == kArq7CompressionTypeLZ4) {
+        NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
         rawData = [self lz4Decompress:rawData error:error];
         if (rawData == nil) {
             return nil;
         }
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageDecompress startTime:startTime bytes:[rawData length]];
     }
     // kArq7CompressionTypeNone and kArq7CompressionTypeGzip — return as-is (gzip not currently used in Arq7).
 
     return rawData;
 }
 
-- (Arq7Tree *)treeForBlobLoc:(Arq7BlobLoc *)theBlobLoc error:(NSError **)error {
-    NSData *data = [self dataForBlobLoc:theBlobLoc error:error];
-    if (data == nil) {
-        return nil;
-    }
-    DataInputStream *dis = [[DataInputStream alloc] initWithData:data description:@"tree data"];
-    BufferedInputStream *bis = [[BufferedInputStream alloc] initWithUnderlyingStream:dis];
-    return [[Arq7Tree alloc] initWithBufferedInputStream:bis error:error];
-}
-
-
-#pragma mark internal
-
 - (NSData *)lz4Decompress:(NSData *)theData error:(NSError **)error {
     if ([theData length] < 5) {
         SETNSERROR([self errorDomain], -1, @"data too short for LZ4 decompression (%lu bytes)", (unsigned long)[theData length]);
@@ -0,0 +1,40 @@
+/*
+ Arq7JSONReader — pull parser over a JSON document held in memory.
+ Callers walk an object key by key and read only the values they need. Everything else is skipped
+ without creating Foundation objects, and a caller can stop as soon as it has what it wants.
+*/
+
+@interface Arq7JSONReader : NSObject
+
+- (instancetype)init NS_UNAVAILABLE;
+- (instancetype)initWithData:(NSData *)theData;
+
+- (NSString *)errorDomain;
+
+// Consumes the '{' that opens an object.
+- (BOOL)readObjectStart:(NSError **)error;
+
+// Reads the next key of the current object and the ':' after it.
+// At the end of the object, consumes the '}' and sets *outKey to nil.
+- (BOOL)readKey:(NSString **)outKey error:(NSError **)error;
+
+// Consumes the '[' that opens an array.
+- (BOOL)readArrayStart:(NSError **)error;
+
+// Sets *outHasElement to YES if another element follows.
+// At the end of the array, consumes the ']' and sets it to NO.
+- (BOOL)readArrayHasElement:(BOOL *)outHasElement error:(NSError **)error;
+
+// Scalar values. null reads as nil, NO or 0, the way a missing key did with NSJSONSerialization.
+- (BOOL)readString:(NSString **)outValue error:(NSError **)error;
+- (BOOL)readBool:(BOOL *)outValue error:(NSError **)error;
+- (BOOL)readInt64:(int64_t *)outValue error:(NSError **)error;
+- (BOOL)readUInt64:(uint64_t *)outValue error:(NSError **)error;
+- (BOOL)readDouble:(double *)outValue error:(NSError **)error;
+
+// Returns YES and consumes it if the next value is null.
+- (BOOL)readNull;
+
+// Skips the next value, however deeply it nests.
+- (BOOL)skipValue:(NSError **)error;
+@end
@@ -0,0 +1,472 @@
+#import "Arq7JSONReader.h"
+
+
+// Deepest nesting skipValue: will follow.
+#define MAX_SKIP_DEPTH (512)
+
+// Longest number token we parse.
+#define MAX_NUMBER_LENGTH (63)
+
+
+static void skipWhitespace(const unsigned char *bytes, size_t length, size_t *pos) {
+    while (*pos < length && (bytes[*pos] == ' ' || bytes[*pos] == '\t' || bytes[*pos] == '\n' || bytes[*pos] == '\r')) {
+        (*pos)++;
+    }
+}
+
+// Scans the string whose opening quote is at *pos. On success *pos is just past the closing quote,
+// *outStart and *outEnd delimit the contents and *outHasEscapes says whether any backslashes were seen.
+static BOOL scanString(const unsigned char *bytes, size_t length, size_t *pos, size_t *outStart, size_t *outEnd, BOOL *outHasEscapes) {
+    size_t i = *pos + 1;
+    BOOL hasEscapes = NO;
+    for (;;) {
+        // Jump to the next quote, then make sure it isn't escaped by an odd run of backslashes.
+        const unsigned char *quote = memchr(bytes + i, '"', length - i);
+        if (quote == NULL) {
+            return NO;
+        }
+        size_t q = (size_t)(quote - bytes);
+        size_t backslashes = 0;
+        while (q - backslashes > i && bytes[q - backslashes - 1] == '\\') {
+            backslashes++;
+        }
+        if (!hasEscapes && memchr(bytes + i, '\\', q - i) != NULL) {
+            hasEscapes = YES;
+        }
+        if (backslashes % 2 == 0) {
+            *outStart = *pos + 1;
+            *outEnd = q;
+            *outHasEscapes = hasEscapes;
+            *pos = q + 1;
+            return YES;
+        }
+        i = q + 1;
+    }
+}
+
+static int hexValue(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static BOOL readHex4(const unsigned char *bytes, size_t end, size_t i, uint32_t *outValue) {
+    if (i + 4 > end) {
+        return NO;
+    }
+    uint32_t value = 0;
+    for (size_t j = i; j < i + 4; j++) {
+        int h = hexValue(bytes[j]);
+        if (h < 0) {
+            return NO;
+        }
+        value = (value << 4) | (uint32_t)h;
+    }
+    *outValue = value;
+    return YES;
+}
+
+// Writes the UTF-8 encoding of theCodePoint to theBuf and returns the number of bytes written.
+static size_t encodeUTF8(uint32_t theCodePoint, unsigned char *theBuf) {
+    if (theCodePoint < 0x80) {
+        theBuf[0] = (unsigned char)theCodePoint;
+        return 1;
+    }
+    if (theCodePoint < 0x800) {
+        theBuf[0] = (unsigned char)(0xC0 | (theCodePoint >> 6));
+        theBuf[1] = (unsigned char)(0x80 | (theCodePoint & 0x3F));
+        return 2;
+    }
+    if (theCodePoint < 0x10000) {
+        theBuf[0] = (unsigned char)(0xE0 | (theCodePoint >> 12));
+        theBuf[1] = (unsigned char)(0x80 | ((theCodePoint >> 6) & 0x3F));
+        theBuf[2] = (unsigned char)(0x80 | (theCodePoint & 0x3F));
+        return 3;
+    }
+    theBuf[0] = (unsigned char)(0xF0 | (theCodePoint >> 18));
+    theBuf[1] = (unsigned char)(0x80 | ((theCodePoint >> 12) & 0x3F));
+    theBuf[2] = (unsigned char)(0x80 | ((theCodePoint >> 6) & 0x3F));
+    theBuf[3] = (unsigned char)(0x80 | (theCodePoint & 0x3F));
+    return 4;
+}
+
+// Decodes the escaped string contents between theStart and theEnd into theOut (which must hold at least
+// theEnd - theStart bytes; decoding never grows the text). Returns the decoded length, or -1 for a bad escape.
+static ssize_t unescapeString(const unsigned char *bytes, size_t theStart, size_t theEnd, unsigned char *theOut) {
+    size_t o = 0;
+    size_t i = theStart;
+    while (i < theEnd) {
+        unsigned char c = bytes[i++];
+        if (c != '\\') {
+            theOut[o++] = c;
+            continue;
+        }
+        if (i >= theEnd) {
+            return -1;
+        }
+        c = bytes[i++];
+        switch (c) {
+            case '"': theOut[o++] = '"'; break;
+            case '\\': theOut[o++] = '\\'; break;
+            case '/': theOut[o++] = '/'; break;
+            case 'b': theOut[o++] = '\b'; break;
+            case 'f': theOut[o++] = '\f'; break;
+            case 'n': theOut[o++] = '\n'; break;
+            case 'r': theOut[o++] = '\r'; break;
+            case 't': theOut[o++] = '\t'; break;
+            case 'u': {
+                uint32_t codePoint = 0;
+                if (!readHex4(bytes, theEnd, i, &codePoint)) {
+                    return -1;
+                }
+                i += 4;
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                    // High surrogate; combine it with the low surrogate that must follow.
+                    uint32_t low = 0;
+                    if (i + 2 > theEnd || bytes[i] != '\\' || bytes[i + 1] != 'u' || !readHex4(bytes, theEnd, i + 2, &low) || low < 0xDC00 || low > 0xDFFF) {
+                        return -1;
+                    }
+                    i += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                    return -1;
+                }
+                o += encodeUTF8(codePoint, theOut + o);
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+    return (ssize_t)o;
+}
+
+// Skips the value starting at *pos (after whitespace), checking that brackets and braces pair up.
+static BOOL skipValueAt(const unsigned char *bytes, size_t length, size_t *pos) {
+    unsigned char closers[MAX_SKIP_DEPTH];
+    size_t depth = 0;
+    size_t i = *pos;
+    do {
+        skipWhitespace(bytes, length, &i);
+        if (i >= length) {
+            return NO;
+        }
+        unsigned char c = bytes[i];
+        if (c == '"') {
+            size_t start = 0, end = 0;
+            BOOL hasEscapes = NO;
+            if (!scanString(bytes, length, &i, &start, &end, &hasEscapes)) {
+                return NO;
+            }
+        } else if (c == '{' || c == '[') {
+            if (depth == MAX_SKIP_DEPTH) {
+                return NO;
+            }
+            closers[depth++] = (c == '{') ? '}' : ']';
+            i++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0 || closers[depth - 1] != c) {
+                return NO;
+            }
+            depth--;
+            i++;
+        } else if (c == ',' || c == ':') {
+            if (depth == 0) {
+                return NO;
+            }
+            i++;
+        } else {
+            // Number or literal: runs until a delimiter.
+            size_t start = i;
+            while (i < length && strchr(" \t\r\n,:]}", bytes[i]) == NULL) {
+                i++;
+            }
+            if (i == start) {
+                return NO;
+            }
+        }
+    } while (depth > 0);
+    *pos = i;
+    return YES;
+}
+
+
+@interface Arq7JSONReader() {
+    NSData *_data;
+    const unsigned char *_bytes;
+    size_t _length;
+    size_t _pos;
+
+    // YES right after '{' or '[', when the next key or element isn't preceded by a comma.
+    BOOL _atContainerStart;
+}
+@end
+
+
+@implementation Arq7JSONReader
+
+- (instancetype)initWithData:(NSData *)theData {
+    if (self = [super init]) {
+        _data = theData;
+        _bytes = (const unsigned char *)[theData bytes];
+        _length = [theData length];
+        _pos = 0;
+        // A UTF-8 byte order mark isn't part of the document.
+        if (_length >= 3 && _bytes[0] == 0xEF && _bytes[1] == 0xBB && _bytes[2] == 0xBF) {
+            _pos = 3;
+        }
+    }
+    return self;
+}
+
+- (NSString *)errorDomain {
+    return @"Arq7JSONReaderErrorDomain";
+}
+
+- (BOOL)readObjectStart:(NSError **)error {
+    if (![self consumeByte:'{' error:error]) {
+        return NO;
+    }
+    _atContainerStart = YES;
+    return YES;
+}
+
+- (BOOL)readKey:(NSString **)outKey error:(NSError **)error {
+    BOOL didClose = NO;
+    if (![self consumeSeparatorOrClosing:'}' didClose:&didClose error:error]) {
+        return NO;
+    }
+    if (didClose) {
+        *outKey = nil;
+        return YES;
+    }
+    NSString *key = nil;
+    if (![self readString:&key error:error]) {
+        return NO;
+    }
+    if (key == nil) {
+        SETNSERROR([self errorDomain], -1, @"expected an object key at offset %lu", (unsigned long)_pos);
+        return NO;
+    }
+    if (![self consumeByte:':' error:error]) {
+        return NO;
+    }
+    *outKey = key;
+    return YES;
+}
+
+- (BOOL)readArrayStart:(NSError **)error {
+    if (![self consumeByte:'[' error:error]) {
+        return NO;
+    }
+    _atContainerStart = YES;
+    return YES;
+}
+
+- (BOOL)readArrayHasElement:(BOOL *)outHasElement error:(NSError **)error {
+    BOOL didClose = NO;
+    if (![self consumeSeparatorOrClosing:']' didClose:&didClose error:error]) {
+        return NO;
+    }
+    *outHasElement = !didClose;
+    return YES;
+}
+
+- (BOOL)readString:(NSString **)outValue error:(NSError **)error {
+    if ([self readNull]) {
+        *outValue = nil;
+        return YES;
+    }
+    skipWhitespace(_bytes, _length, &_pos);
+    if (_pos >= _length || _bytes[_pos] != '"') {
+        SETNSERROR([self errorDomain], -1, @"expected a string at offset %lu", (unsigned long)_pos);
+        return NO;
+    }
+    size_t start = 0;
+    size_t end = 0;
+    BOOL hasEscapes = NO;
+    if (!scanString(_bytes, _length, &_pos, &start, &end, &hasEscapes)) {
+        SETNSERROR([self errorDomain], -1, @"unterminated string at offset %lu", (unsigned long)_pos);
+        return NO;
+    }
+    NSString *ret = nil;
+    if (!hasEscapes) {
+        ret = [[NSString alloc] initWithBytes:(_bytes + start) length:(end - start) encoding:NSUTF8StringEncoding];
+    } else {
+        NSMutableData *unescaped = [NSMutableData dataWithLength:(end - start)];
+        ssize_t unescapedLength = unescapeString(_bytes, start, end, (unsigned char *)[unescaped mutableBytes]);
+        if (unescapedLength < 0) {
+            SETNSERROR([self errorDomain], -1, @"invalid escape in string at offset %lu", (unsigned long)start);
+            return NO;
+        }
+        ret = [[NSString alloc] initWithBytes:[unescaped bytes] length:(NSUInteger)unescapedLength encoding:NSUTF8StringEncoding];
+    }
+    if (ret == nil) {
+        SETNSERROR([self errorDomain], -1, @"invalid UTF-8 in string at offset %lu", (unsigned long)start);
+        return NO;
+    }
+    _atContainerStart = NO;
+    *outValue = ret;
+    return YES;
+}
+
+- (BOOL)readBool:(BOOL *)outValue error:(NSError **)error {
+    skipWhitespace(_bytes, _length, &_pos);
+    if ([self consumeLiteral:"true"]) {
+        *outValue = YES;
+        return YES;
+    }
+    if ([self consumeLiteral:"false"] || [self consumeLiteral:"null"]) {
+        *outValue = NO;
+        return YES;
+    }
+    double value = 0;
+    if (![self readDouble:&value error:error]) {
+        return NO;
+    }
+    *outValue = (value != 0);
+    return YES;
+}
+
+- (BOOL)readInt64:(int64_t *)outValue error:(NSError **)error {
+    char buf[MAX_NUMBER_LENGTH + 1];
+    if (![self readNumberToken:buf error:error]) {
+        return NO;
+    }
+    char *endp = NULL;
+    long long value = strtoll(buf, &endp, 10);
+    if (*endp != '\0') {
+        // A fraction or exponent.
+        value = (long long)strtod(buf, NULL);
+    }
+    *outValue = (int64_t)value;
+    return YES;
+}
+
+- (BOOL)readUInt64:(uint64_t *)outValue error:(NSError **)error {
+    char buf[MAX_NUMBER_LENGTH + 1];
+    if (![self readNumberToken:buf error:error]) {
+        return NO;
+    }
+    char *endp = NULL;
+    unsigned long long value = 0;
+    if (buf[0] == '-') {
+        value = (unsigned long long)strtoll(buf, &endp, 10);
+    } else {
+        value = strtoull(buf, &endp, 10);
+    }
+    if (*endp != '\0') {
+        value = (unsigned long long)strtod(buf, NULL);
+    }
+    *outValue = (uint64_t)value;
+    return YES;
+}
+
+- (BOOL)readDouble:(double *)outValue error:(NSError **)error {
+    char buf[MAX_NUMBER_LENGTH + 1];
+    if (![self readNumberToken:buf error:error]) {
+        return NO;
+    }
+    *outValue = strtod(buf, NULL);
+    return YES;
+}
+
+- (BOOL)readNull {
+    skipWhitespace(_bytes, _length, &_pos);
+    return [self consumeLiteral:"null"];
+}
+
+- (BOOL)skipValue:(NSError **)error {
+    size_t start = _pos;
+    if (!skipValueAt(_bytes, _length, &_pos)) {
+        SETNSERROR([self errorDomain], -1, @"malformed value at offset %lu", (unsigned long)start);
+        return NO;
+    }
+    _atContainerStart = NO;
+    return YES;
+}
+
+
+#pragma mark internal
+
+- (BOOL)consumeByte:(unsigned char)theByte error:(NSError **)error {
+    skipWhitespace(_bytes, _length, &_pos);
+    if (_pos >= _length || _bytes[_pos] != theByte) {
+        SETNSERROR([self errorDomain], -1, @"expected '%c' at offset %lu", theByte, (unsigned long)_pos);
+        return NO;
+    }
+    _pos++;
+    return YES;
+}
+
+// Consumes the ',' between members or elements, or theClosing at the end of the container.
+- (BOOL)consumeSeparatorOrClosing:(unsigned char)theClosing didClose:(BOOL *)didClose error:(NSError **)error {
+    skipWhitespace(_bytes, _length, &_pos);
+    if (_pos >= _length) {
+        SETNSERROR([self errorDomain], -1, @"unexpected end of JSON");
+        return NO;
+    }
+    if (_bytes[_pos] == theClosing) {
+        _pos++;
+        _atContainerStart = NO;
+        if (didClose != NULL) {
+            *didClose = YES;
+        }
+        return YES;
+    }
+    if (!_atContainerStart) {
+        if (_bytes[_pos] != ',') {
+            SETNSERROR([self errorDomain], -1, @"expected ',' or '%c' at offset %lu", theClosing, (unsigned long)_pos);
+            return NO;
+        }
+        _pos++;
+    }
+    _atContainerStart = NO;
+    if (didClose != NULL) {
+        *didClose = NO;
+    }
+    return YES;
+}
+
+- (BOOL)consumeLiteral:(const char *)theLiteral {
+    size_t len = strlen(theLiteral);
+    if (_pos + len > _length || memcmp(_bytes + _pos, theLiteral, len) != 0) {
+        return NO;
+    }
+    _pos += len;
+    _atContainerStart = NO;
+    return YES;
+}
+
+// Copies the next number (or true/false/null, read as 1/0/0) into theBuf as a C string.
+- (BOOL)readNumberToken:(char *)theBuf error:(NSError **)error {
+    skipWhitespace(_bytes, _length, &_pos);
+    if ([self consumeLiteral:"true"]) {
+        strcpy(theBuf, "1");
+        return YES;
+    }
+    if ([self consumeLiteral:"false"] || [self consumeLiteral:"null"]) {
+        strcpy(theBuf, "0");
+        return YES;
+    }
+    size_t start = _pos;
+    while (_pos < _length && _pos - start < MAX_NUMBER_LENGTH && strchr("+-.0123456789eE", _bytes[_pos]) != NULL && _bytes[_pos] != '\0') {
+        _pos++;
+    }
+    if (_pos == start) {
+        SETNSERROR([self errorDomain], -1, @"expected a number at offset %lu", (unsigned long)start);
+        return NO;
+    }
+    memcpy(theBuf, _bytes + start, _pos - start);
+    theBuf[_pos - start] = '\0';
+    _atContainerStart = NO;
+    return YES;
+}
+@end
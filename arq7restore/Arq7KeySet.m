@@ -11,6 +11,7 @@
 #import "DataInputStream.h"
 #import "BufferedInputStream.h"
 #import "IntegerIO.h"
+#import "DerivedKeyCache.h"
 
 
 #define ARQ7_KEYSET_HEADER          "ARQ_ENCRYPTED_MASTER_KEYS"
@@ -47,37 +48,59 @@
         // Extract salt (8 bytes after header).
         const unsigned char *saltBytes = bytes + ARQ7_KEYSET_HEADER_LEN;
 
-        // Derive 64-byte key from password + salt using PBKDF2-SHA256.
-        NSData *passwordData = [thePassword dataUsingEncoding:NSUTF8StringEncoding];
+        // Derive 64-byte key from password + salt using PBKDF2-SHA256, unless it's already cached.
+        NSData *saltData = [NSData dataWithBytes:saltBytes length:ARQ7_KEYSET_SALT_LEN];
         unsigned char derivedKey[ARQ7_DERIVED_KEY_LEN];
-        CCKeyDerivationPBKDF(kCCPBKDF2,
-                             (const char *)[passwordData bytes],
-                             [passwordData length],
-                             saltBytes,
-                             ARQ7_KEYSET_SALT_LEN,
-                             kCCPRFHmacAlgSHA256,
-                             ARQ7_KEY_DERIVATION_ROUNDS,
-                             derivedKey,
-                             ARQ7_DERIVED_KEY_LEN);
-
-        // Split derived key: first 32 bytes = AES key, second 32 bytes = HMAC key.
-        const unsigned char *aesKey  = derivedKey;
-        const unsigned char *hmacKey = derivedKey + kCCKeySizeAES256;
+        unsigned char calculatedHMAC[CC_SHA256_DIGEST_LENGTH];
 
-        // Verify HMAC-SHA256 of (IV + ciphertext) using derived HMAC key.
+        // Verify HMAC-SHA256 of (IV + ciphertext) using derived HMAC key (the second 32 bytes of the derived key).
         // HMAC covers everything after header + salt + stored-HMAC, i.e. from IV onwards.
         const unsigned char *hmacStart = bytes + ARQ7_KEYSET_HEADER_LEN + ARQ7_KEYSET_SALT_LEN + CC_SHA256_DIGEST_LENGTH;
         NSUInteger hmacDataLen = dataLen - (ARQ7_KEYSET_HEADER_LEN + ARQ7_KEYSET_SALT_LEN + CC_SHA256_DIGEST_LENGTH);
-
-        unsigned char calculatedHMAC[CC_SHA256_DIGEST_LENGTH];
-        CCHmac(kCCHmacAlgSHA256, hmacKey, kCCKeySizeAES256, hmacStart, hmacDataLen, calculatedHMAC);
-
         const unsigned char *storedHMAC = bytes + ARQ7_KEYSET_HEADER_LEN + ARQ7_KEYSET_SALT_LEN;
-        if (memcmp(calculatedHMAC, storedHMAC, CC_SHA256_DIGEST_LENGTH) != 0) {
-            SETNSERROR([self errorDomain], ERROR_INVALID_PASSWORD, @"incorrect encryption password for encryptedkeyset.dat");
-            return nil;
+
+        NSData *cachedDerivedKey = [[DerivedKeyCache sharedDerivedKeyCache] derivedKeyForAlgorithm:@"PBKDF2-SHA256"
+                                                                                              salt:saltData
+                                                                                            rounds:ARQ7_KEY_DERIVATION_ROUNDS
+                                                                                            length:ARQ7_DERIVED_KEY_LEN];
+        if (cachedDerivedKey != nil) {
+            memcpy(derivedKey, [cachedDerivedKey bytes], ARQ7_DERIVED_KEY_LEN);
+            CCHmac(kCCHmacAlgSHA256, derivedKey + kCCKeySizeAES256, kCCKeySizeAES256, hmacStart, hmacDataLen, calculatedHMAC);
+            if (memcmp(calculatedHMAC, storedHMAC, CC_SHA256_DIGEST_LENGTH) != 0) {
+                // The cache doesn't know which password its key came from; this one doesn't fit the file.
+                [[DerivedKeyCache sharedDerivedKeyCache] removeDerivedKeyForAlgorithm:@"PBKDF2-SHA256"
+                                                                                 salt:saltData
+                                                                               rounds:ARQ7_KEY_DERIVATION_ROUNDS
+                                                                               length:ARQ7_DERIVED_KEY_LEN];
+                cachedDerivedKey = nil;
+            }
+        }
+        if (cachedDerivedKey == nil) {
+            NSData *passwordData = [thePassword dataUsingEncoding:NSUTF8StringEncoding];
+            CCKeyDerivationPBKDF(kCCPBKDF2,
+                                 (const char *)[passwordData bytes],
+                                 [passwordData length],
+                                 saltBytes,
+                                 ARQ7_KEYSET_SALT_LEN,
+                                 kCCPRFHmacAlgSHA256,
+                                 ARQ7_KEY_DERIVATION_ROUNDS,
+                                 derivedKey,
+                                 ARQ7_DERIVED_KEY_LEN);
+            CCHmac(kCCHmacAlgSHA256, derivedKey + kCCKeySizeAES256, kCCKeySizeAES256, hmacStart, hmacDataLen, calculatedHMAC);
+            if (memcmp(calculatedHMAC, storedHMAC, CC_SHA256_DIGEST_LENGTH) != 0) {
+                SETNSERROR([self errorDomain], ERROR_INVALID_PASSWORD, @"incorrect encryption password for encryptedkeyset.dat");
+                return nil;
+            }
+            // Only cache keys derived from a correct password.
+            [[DerivedKeyCache sharedDerivedKeyCache] setDerivedKey:[NSData dataWithBytes:derivedKey length:ARQ7_DERIVED_KEY_LEN]
+                                                      forAlgorithm:@"PBKDF2-SHA256"
+                                                              salt:saltData
+                                                            rounds:ARQ7_KEY_DERIVATION_ROUNDS];
         }
 
+        // Split derived key: first 32 bytes = AES key, second 32 bytes = HMAC key.
+        const unsigned char *aesKey  = derivedKey;
+
         // Extract IV (16 bytes after header + salt + HMAC).
         const unsigned char *iv = bytes + ARQ7_KEYSET_HEADER_LEN + ARQ7_KEYSET_SALT_LEN + CC_SHA256_DIGEST_LENGTH;
 
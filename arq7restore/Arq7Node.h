@@ -6,6 +6,7 @@
 #import "Arq7Types.h"
 @class Arq7BlobLoc;
 @class BufferedInputStream;
+@class Arq7JSONReader;
 
 @interface Arq7Node : NSObject
 
@@ -67,6 +68,7 @@
              reparsePointIsDirectory:(BOOL)theReparsePointIsDirectory;
 
 - (instancetype)initWithJSON:(NSDictionary *)theJSON error:(NSError **)error;
+- (instancetype)initWithJSONReader:(Arq7JSONReader *)theReader error:(NSError **)error;
 - (instancetype)initWithBufferedInputStream:(BufferedInputStream *)bis
                                 treeVersion:(int)theTreeVersion
                                       error:(NSError **)error;
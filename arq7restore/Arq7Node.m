@@ -9,6 +9,7 @@
 #import "StringIO.h"
 #import "IntegerIO.h"
 #import "BufferedInputStream.h"
+#import "Arq7JSONReader.h"
 
 
 @interface Arq7Node() {
@@ -227,6 +228,111 @@
     return self;
 }
 
+- (instancetype)initWithJSONReader:(Arq7JSONReader *)theReader error:(NSError **)error {
+    if (self = [super init]) {
+        if (![theReader readObjectStart:error]) {
+            return nil;
+        }
+        _dataBlobLocs = [NSArray array];
+        _xattrsBlobLocs = [NSArray array];
+        for (;;) {
+            NSString *key = nil;
+            if (![theReader readKey:&key error:error]) {
+                return nil;
+            }
+            if (key == nil) {
+                break;
+            }
+            BOOL ret = YES;
+            NSString *stringValue = nil;
+            int64_t intValue = 0;
+            if ([key isEqualToString:@"isTree"]) {
+                ret = [theReader readBool:&_isTree error:error];
+            } else if ([key isEqualToString:@"treeBlobLoc"]) {
+                if (![theReader readNull]) {
+                    _treeBlobLoc = [[Arq7BlobLoc alloc] initWithJSONReader:theReader error:error];
+                    ret = (_treeBlobLoc != nil);
+                }
+            } else if ([key isEqualToString:@"computerOSType"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _computerOSType = (Arq7ComputerOSType)intValue;
+            } else if ([key isEqualToString:@"dataBlobLocs"]) {
+                _dataBlobLocs = [self blobLocsFromJSONReader:theReader error:error];
+                ret = (_dataBlobLocs != nil);
+            } else if ([key isEqualToString:@"aclBlobLoc"]) {
+                if (![theReader readNull]) {
+                    _aclBlobLoc = [[Arq7BlobLoc alloc] initWithJSONReader:theReader error:error];
+                    ret = (_aclBlobLoc != nil);
+                }
+            } else if ([key isEqualToString:@"xattrsBlobLocs"]) {
+                _xattrsBlobLocs = [self blobLocsFromJSONReader:theReader error:error];
+                ret = (_xattrsBlobLocs != nil);
+            } else if ([key isEqualToString:@"itemSize"]) {
+                ret = [theReader readUInt64:&_itemSize error:error];
+            } else if ([key isEqualToString:@"containedFilesCount"]) {
+                ret = [theReader readUInt64:&_containedFilesCount error:error];
+            } else if ([key isEqualToString:@"modificationTime_sec"]) {
+                ret = [theReader readInt64:&_modificationTime_sec error:error];
+            } else if ([key isEqualToString:@"modificationTime_nsec"]) {
+                ret = [theReader readInt64:&_modificationTime_nsec error:error];
+            } else if ([key isEqualToString:@"changeTime_sec"]) {
+                ret = [theReader readInt64:&_changeTime_sec error:error];
+            } else if ([key isEqualToString:@"changeTime_nsec"]) {
+                ret = [theReader readInt64:&_changeTime_nsec error:error];
+            } else if ([key isEqualToString:@"creationTime_sec"]) {
+                ret = [theReader readInt64:&_creationTime_sec error:error];
+            } else if ([key isEqualToString:@"creationTime_nsec"]) {
+                ret = [theReader readInt64:&_creationTime_nsec error:error];
+            } else if ([key isEqualToString:@"userName"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _userName = stringValue;
+            } else if ([key isEqualToString:@"groupName"]) {
+                ret = [theReader readString:&stringValue error:error];
+                _groupName = stringValue;
+            } else if ([key isEqualToString:@"deleted"]) {
+                ret = [theReader readBool:&_deleted error:error];
+            } else if ([key isEqualToString:@"mac_st_dev"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_dev = (int32_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_ino"]) {
+                ret = [theReader readUInt64:&_mac_st_ino error:error];
+            } else if ([key isEqualToString:@"mac_st_mode"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_mode = (uint16_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_nlink"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_nlink = (uint16_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_uid"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_uid = (uint16_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_gid"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_gid = (uint16_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_rdev"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_rdev = (int32_t)intValue;
+            } else if ([key isEqualToString:@"mac_st_flags"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _mac_st_flags = (uint32_t)intValue;
+            } else if ([key isEqualToString:@"winAttrs"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _winAttrs = (uint32_t)intValue;
+            } else if ([key isEqualToString:@"reparseTag"]) {
+                ret = [theReader readInt64:&intValue error:error];
+                _reparseTag = (uint32_t)intValue;
+            } else if ([key isEqualToString:@"reparsePointIsDirectory"]) {
+                ret = [theReader readBool:&_reparsePointIsDirectory error:error];
+            } else {
+                ret = [theReader skipValue:error];
+            }
+            if (!ret) {
+                return nil;
+            }
+        }
+    }
+    return self;
+}
+
 - (instancetype)initWithBufferedInputStream:(BufferedInputStream *)bis
                                 treeVersion:(int)theTreeVersion
                                       error:(NSError **)error {
@@ -336,6 +442,32 @@
     return @"Arq7NodeErrorDomain";
 }
 
+// Reads an array of blob locations; null reads as an empty array.
+- (NSArray *)blobLocsFromJSONReader:(Arq7JSONReader *)theReader error:(NSError **)error {
+    NSMutableArray *ret = [NSMutableArray array];
+    if ([theReader readNull]) {
+        return ret;
+    }
+    if (![theReader readArrayStart:error]) {
+        return nil;
+    }
+    for (;;) {
+        BOOL hasElement = NO;
+        if (![theReader readArrayHasElement:&hasElement error:error]) {
+            return nil;
+        }
+        if (!hasElement) {
+            break;
+        }
+        Arq7BlobLoc *blobLoc = [[Arq7BlobLoc alloc] initWithJSONReader:theReader error:error];
+        if (blobLoc == nil) {
+            return nil;
+        }
+        [ret addObject:blobLoc];
+    }
+    return ret;
+}
+
 - (BOOL)isTree { return _isTree; }
 - (Arq7BlobLoc *)treeBlobLoc { return _treeBlobLoc; }
 - (Arq7ComputerOSType)computerOSType { return _computerOSType; }
@@ -10,10 +10,20 @@
 #import "XAttrSet.h"
 #import "DataInputStream.h"
 #import "BufferedInputStream.h"
+#import "RestoredBlobMap.h"
+#import "HardlinkMap.h"
+#import "RestoreFileWriter.h"
+#import "RestoreProgressPrinter.h"
+#import "RestoreMetrics.h"
 #include <sys/stat.h>
 #include <utime.h>
 
 
+// Upper bounds on how many blobs (and bytes) of one file are fetched together.
+#define MAX_BLOBS_PER_FETCH (32)
+#define MAX_BYTES_PER_FETCH (16 * 1024 * 1024)
+
+
 @interface Arq7Restorer() {
     NSString *_planUUID;
     NSString *_folderUUID;
@@ -23,6 +33,10 @@
     NSString *_destinationPath;
     id <TargetConnectionDelegate> _delegate;
     Arq7BlobReader *_blobReader;
+    HardlinkMap *_hardlinkMap;
+    RestoredBlobMap *_restoredBlobMap;
+    NSMutableArray *_directoriesToApply;
+    RestoreProgressPrinter *_progressPrinter;
 }
 @end
 
@@ -44,6 +58,10 @@
         _relativePath = theRelativePath;
         _destinationPath = theDestinationPath;
         _delegate = theDelegate;
+        _hardlinkMap = [[HardlinkMap alloc] init];
+        _restoredBlobMap = [[RestoredBlobMap alloc] init];
+        _directoriesToApply = [[NSMutableArray alloc] init];
+        _progressPrinter = [[RestoreProgressPrinter alloc] init];
     }
     return self;
 }
@@ -53,6 +71,12 @@
 }
 
 - (BOOL)restore:(NSError **)error {
+    BOOL ret = [self doRestore:error];
+    [_progressPrinter restoreDidFinish];
+    return ret;
+}
+
+- (BOOL)doRestore:(NSError **)error {
     // Load most recent complete backup record.
     Arq7BackupRecord *record = [Arq7BackupRecord mostRecentBackupRecordForPlanUUID:_planUUID
                                                                         folderUUID:_folderUUID
@@ -110,7 +134,7 @@
                 }
                 if (i == [components count] - 1) {
                     // Last component is a directory — restore this subtree.
-                    return [self restoreTree:currentTree toPath:_destinationPath error:error];
+                    return [self restoreRootTree:currentTree toPath:_destinationPath error:error];
                 }
             } else {
                 if (i < [components count] - 1) {
@@ -129,15 +153,38 @@
         }
     }
 
-    return [self restoreTree:rootTree toPath:_destinationPath error:error];
+    return [self restoreRootTree:rootTree toPath:_destinationPath error:error];
 }
 
 
 #pragma mark internal
 
+- (BOOL)restoreRootTree:(Arq7Tree *)theTree toPath:(NSString *)theDestPath error:(NSError **)error {
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:theDestPath withIntermediateDirectories:YES attributes:nil error:error]) {
+        return NO;
+    }
+    BOOL ret = [self restoreTree:theTree toPath:theDestPath error:error];
+
+    // Directory metadata is applied last (in post-order) so that restoring the contents doesn't bump the mtimes
+    // again and so that read-only or immutable directories don't block restoring their children.
+    for (NSArray *pathAndNode in _directoriesToApply) {
+        [self applyMetadata:[pathAndNode objectAtIndex:1] toDirectoryAtPath:[pathAndNode objectAtIndex:0]];
+    }
+    [_directoriesToApply removeAllObjects];
+    return ret;
+}
+
 - (BOOL)restoreTree:(Arq7Tree *)theTree toPath:(NSString *)theDestPath error:(NSError **)error {
-    NSFileManager *fm = [NSFileManager defaultManager];
+    // Children are created relative to this descriptor so the kernel doesn't resolve the full path for each one.
+    int dirFD = open([theDestPath fileSystemRepresentation], O_RDONLY|O_DIRECTORY);
+    if (dirFD == -1) {
+        int errnum = errno;
+        HSLogError(@"open(%@) error %d: %s", theDestPath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to open %@: %s", theDestPath, strerror(errnum));
+        return NO;
+    }
 
+    BOOL ret = YES;
     for (NSString *childName in [theTree childNodeNames]) {
         Arq7Node *childNode = [theTree childNodeWithName:childName];
         if ([childNode deleted]) {
@@ -148,66 +195,77 @@
 
         if ([childNode isTree]) {
             // Create directory.
-            if (![fm createDirectoryAtPath:childPath withIntermediateDirectories:YES attributes:nil error:error]) {
-                return NO;
+            if (mkdirat(dirFD, [childName fileSystemRepresentation], S_IRWXU|S_IRWXG|S_IRWXO) == -1 && errno != EEXIST) {
+                int errnum = errno;
+                HSLogError(@"mkdir(%@) error %d: %s", childPath, errnum, strerror(errnum));
+                SETNSERROR(@"UnixErrorDomain", errnum, @"failed to create directory %@: %s", childPath, strerror(errnum));
+                ret = NO;
+                break;
             }
             // Recurse.
             Arq7Tree *childTree = [_blobReader treeForBlobLoc:childNode.treeBlobLoc error:error];
             if (childTree == nil) {
-                return NO;
+                ret = NO;
+                break;
             }
             if (![self restoreTree:childTree toPath:childPath error:error]) {
-                return NO;
-            }
-            // Apply directory metadata.
-            if (![self applyMetadata:childNode toPath:childPath isDirectory:YES error:error]) {
-                HSLogError(@"failed to apply metadata to %@: %@", childPath, error ? *error : nil);
-                // Non-fatal: continue.
+                ret = NO;
+                break;
             }
+            // Directory metadata is applied in one pass at the end.
+            [_directoriesToApply addObject:[NSArray arrayWithObjects:childPath, childNode, nil]];
         } else {
             // Write file.
-            if (![self restoreFile:childNode toPath:childPath error:error]) {
-                return NO;
+            if (![self restoreFile:childNode toPath:childPath directoryFD:dirFD name:childName error:error]) {
+                ret = NO;
+                break;
             }
         }
     }
-    return YES;
+    close(dirFD);
+    return ret;
 }
 
 - (BOOL)restoreFile:(Arq7Node *)theNode toPath:(NSString *)thePath error:(NSError **)error {
-    // Assemble file data from dataBlobLocs.
-    NSFileManager *fm = [NSFileManager defaultManager];
-
-    if (![fm createFileAtPath:thePath contents:nil attributes:nil]) {
-        // File may already exist; open it for writing.
+    return [self restoreFile:theNode toPath:thePath directoryFD:-1 name:[thePath lastPathComponent] error:error];
+}
+- (BOOL)restoreFile:(Arq7Node *)theNode toPath:(NSString *)thePath directoryFD:(int)theDirFD name:(NSString *)theName error:(NSError **)error {
+    // If another member of this hardlink group was already restored, link to it instead of fetching the data again.
+    NSString *existingPath = [self hardlinkedPathForNode:theNode];
+    if (existingPath != nil) {
+        return [self linkPath:thePath toExistingPath:existingPath error:error];
     }
 
-    NSFileHandle *fh = [NSFileHandle fileHandleForWritingAtPath:thePath];
-    if (fh == nil) {
-        // Try creating it.
-        if (![[NSData data] writeToFile:thePath options:0 error:error]) {
+    // Identical files share the same list of blobs; clone the earlier copy rather than fetching the data again.
+    NSArray *blobIdentifiers = [theNode.dataBlobLocs valueForKey:@"blobIdentifier"];
+    NSString *duplicatePath = [_restoredBlobMap pathOfFileWithBlobIdentifiers:blobIdentifiers];
+    NSError *cloneError = nil;
+    RestoreFileWriter *writer = nil;
+    int fd = -1;
+    if (duplicatePath != nil && [RestoredBlobMap cloneFileAtPath:duplicatePath toPath:thePath error:&cloneError]) {
+        HSLogDetail(@"cloned %@ from %@", thePath, duplicatePath);
+        fd = (theDirFD != -1) ? openat(theDirFD, [theName fileSystemRepresentation], O_RDONLY) : open([thePath fileSystemRepresentation], O_RDONLY);
+        if (fd == -1) {
+            int errnum = errno;
+            HSLogError(@"open(%@) error %d: %s", thePath, errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to open %@: %s", thePath, strerror(errnum));
             return NO;
         }
-        fh = [NSFileHandle fileHandleForWritingAtPath:thePath];
-    }
-    if (fh == nil) {
-        SETNSERROR([self errorDomain], -1, @"failed to open %@ for writing", thePath);
-        return NO;
-    }
-
-    BOOL success = YES;
-    for (Arq7BlobLoc *blobLoc in [theNode dataBlobLocs]) {
-        NSData *blobData = [_blobReader dataForBlobLoc:blobLoc error:error];
-        if (blobData == nil) {
-            success = NO;
-            break;
+    } else {
+        if (duplicatePath != nil) {
+            HSLogError(@"failed to clone %@ to %@: %@", duplicatePath, thePath, cloneError);
         }
-        [fh writeData:blobData];
-    }
-    [fh closeFile];
-
-    if (!success) {
-        return NO;
+        if (theDirFD != -1) {
+            writer = [[RestoreFileWriter alloc] initWithDirectoryFD:theDirFD name:theName path:thePath expectedSize:theNode.itemSize];
+        } else {
+            writer = [[RestoreFileWriter alloc] initWithPath:thePath expectedSize:theNode.itemSize];
+        }
+        if (![self writeDataForNode:theNode writer:writer error:error]) {
+            [writer close];
+            return NO;
+        }
+        [_restoredBlobMap addPath:thePath forFileWithBlobIdentifiers:blobIdentifiers];
+        fd = [writer fd];
     }
 
     // Restore extended attributes.
@@ -222,56 +280,176 @@
         NSError *myError = nil;
         XAttrSet *xattrSet = [[XAttrSet alloc] initWithBufferedInputStream:bis error:&myError];
         if (xattrSet != nil) {
-            [xattrSet applyToFile:thePath error:&myError];
+            [xattrSet applyToFD:fd path:thePath error:&myError];
         }
     }
 
-    // Apply file metadata.
-    if (![self applyMetadata:theNode toPath:thePath isDirectory:NO error:error]) {
-        HSLogError(@"failed to apply metadata to %@", thePath);
-        // Non-fatal.
+    // Apply file metadata through the descriptor we already have open.
+    [self applyMetadata:theNode toFD:fd path:thePath];
+    if (writer != nil) {
+        [writer close];
+    } else {
+        close(fd);
     }
 
-    printf("restored %s\n", [thePath UTF8String]);
+    [self setHardlinkedPath:thePath forNode:theNode];
+
+    [_progressPrinter didRestorePath:thePath];
     return YES;
 }
+- (BOOL)writeDataForNode:(Arq7Node *)theNode writer:(RestoreFileWriter *)theWriter error:(NSError **)error {
+    // Assemble file data from dataBlobLocs.
+    if (![theWriter open:error]) {
+        return NO;
+    }
 
-- (BOOL)applyMetadata:(Arq7Node *)theNode toPath:(NSString *)thePath isDirectory:(BOOL)isDirectory error:(NSError **)error {
-    // Apply Unix permissions.
-    if (theNode.mac_st_mode != 0) {
-        NSError *myError = nil;
-        if (![FileAttributes applyMode:theNode.mac_st_mode toPath:thePath isDirectory:isDirectory error:&myError]) {
-            HSLogError(@"applyMode failed for %@: %@", thePath, myError);
+    BOOL success = YES;
+    NSMutableArray *writtenBlobLocs = [NSMutableArray array];
+    NSMutableArray *writtenLengths = [NSMutableArray array];
+    NSArray *dataBlobLocs = [theNode dataBlobLocs];
+    NSUInteger index = 0;
+    while (success && index < [dataBlobLocs count]) {
+        // Take the next window of blobs and fetch the ones we don't already have in a single batch,
+        // so blobs sharing a pack file can come down in one multi-range read.
+        NSMutableArray *window = [NSMutableArray array];
+        NSMutableArray *windowData = [NSMutableArray array];
+        NSMutableArray *missingBlobLocs = [NSMutableArray array];
+        unsigned long long windowBytes = 0;
+        while (index < [dataBlobLocs count] && [window count] < MAX_BLOBS_PER_FETCH && windowBytes < MAX_BYTES_PER_FETCH) {
+            Arq7BlobLoc *blobLoc = [dataBlobLocs objectAtIndex:index++];
+            [window addObject:blobLoc];
+            windowBytes += blobLoc.length;
+
+            // Blobs already written to another restored file are read back from disk.
+            NSData *blobData = [_restoredBlobMap dataForBlobIdentifier:blobLoc.blobIdentifier];
+            if (blobData == nil) {
+                [missingBlobLocs addObject:blobLoc];
+                [windowData addObject:[NSNull null]];
+            } else {
+                [windowData addObject:blobData];
+            }
+        }
+        NSArray *fetched = nil;
+        if ([missingBlobLocs count] > 0) {
+            fetched = [_blobReader dataForBlobLocs:missingBlobLocs error:error];
+            if (fetched == nil) {
+                success = NO;
+                break;
+            }
+        }
+
+        NSUInteger fetchedIndex = 0;
+        for (NSUInteger i = 0; i < [window count]; i++) {
+            NSData *blobData = [windowData objectAtIndex:i];
+            if ([blobData isKindOfClass:[NSNull class]]) {
+                blobData = [fetched objectAtIndex:fetchedIndex++];
+            }
+            NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+            if (![theWriter writeData:blobData error:error]) {
+                success = NO;
+                break;
+            }
+            [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageFileWrite startTime:startTime bytes:[blobData length]];
+            [writtenBlobLocs addObject:[window objectAtIndex:i]];
+            [writtenLengths addObject:[NSNumber numberWithUnsignedLongLong:[blobData length]]];
         }
     }
+    if (success) {
+        // Truncate to the exact size written, in case we're overwriting a larger file.
+        success = [theWriter finish:error];
+    }
+
+    if (!success) {
+        return NO;
+    }
+
+    // The data is all written (the descriptor stays open for applying metadata), so other files can now read these blobs back from it.
+    unsigned long long offset = 0;
+    for (NSUInteger i = 0; i < [writtenBlobLocs count]; i++) {
+        unsigned long long length = [[writtenLengths objectAtIndex:i] unsignedLongLongValue];
+        [_restoredBlobMap addBlobIdentifier:[[writtenBlobLocs objectAtIndex:i] blobIdentifier] path:[theWriter path] offset:offset length:length];
+        offset += length;
+    }
+    return YES;
+}
+- (BOOL)linkPath:(NSString *)thePath toExistingPath:(NSString *)theExistingPath error:(NSError **)error {
+    int ret = link([theExistingPath fileSystemRepresentation], [thePath fileSystemRepresentation]);
+    if (ret == -1 && errno == EEXIST) {
+        // Replace whatever is left over from a previous restore attempt.
+        unlink([thePath fileSystemRepresentation]);
+        ret = link([theExistingPath fileSystemRepresentation], [thePath fileSystemRepresentation]);
+    }
+    if (ret == -1) {
+        int errnum = errno;
+        HSLogError(@"link(%@, %@): %s", theExistingPath, thePath, strerror(errnum));
+        SETNSERROR([self errorDomain], errnum, @"link(%@, %@): %s", theExistingPath, thePath, strerror(errnum));
+        return NO;
+    }
+    [_progressPrinter didRestorePath:thePath];
+    return YES;
+}
+
+// Only nodes with st_nlink > 1 are tracked, and each group is forgotten once all its members are linked,
+// so the map holds just the partly-restored hardlink groups rather than every file in the tree.
+- (NSString *)hardlinkedPathForNode:(Arq7Node *)theNode {
+    if (theNode.mac_st_nlink < 2 || theNode.mac_st_ino == 0) {
+        return nil;
+    }
+    return [_hardlinkMap pathToLinkForDevice:theNode.mac_st_dev inode:theNode.mac_st_ino];
+}
+- (void)setHardlinkedPath:(NSString *)thePath forNode:(Arq7Node *)theNode {
+    if (theNode.mac_st_nlink < 2 || theNode.mac_st_ino == 0) {
+        return;
+    }
+    [_hardlinkMap setPath:thePath forDevice:theNode.mac_st_dev inode:theNode.mac_st_ino linkCount:theNode.mac_st_nlink];
+}
+
+// Ownership first (chown clears the setuid/setgid bits), then mode, then mtime, and flags last since uchg/schg
+// would make the other changes fail.
+- (void)applyMetadata:(Arq7Node *)theNode toFD:(int)fd path:(NSString *)thePath {
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    NSError *myError = nil;
 
     // Apply UID/GID.
     if (theNode.mac_st_uid != 0 || theNode.mac_st_gid != 0) {
-        NSError *myError = nil;
-        if (![FileAttributes applyUID:theNode.mac_st_uid gid:theNode.mac_st_gid toPath:thePath error:&myError]) {
+        if (![FileAttributes applyUID:theNode.mac_st_uid gid:theNode.mac_st_gid toFD:fd path:thePath error:&myError]) {
             HSLogError(@"applyUID:gid: failed for %@: %@", thePath, myError);
         }
     }
 
-    // Apply flags.
-    if (theNode.mac_st_flags != 0) {
-        NSError *myError = nil;
-        if (![FileAttributes applyFlags:theNode.mac_st_flags toPath:thePath error:&myError]) {
-            HSLogError(@"applyFlags failed for %@: %@", thePath, myError);
+    // Apply Unix permissions.
+    if (theNode.mac_st_mode != 0) {
+        if (![FileAttributes applyMode:theNode.mac_st_mode toFD:fd path:thePath error:&myError]) {
+            HSLogError(@"applyMode failed for %@: %@", thePath, myError);
         }
     }
 
     // Apply mtime.
     if (theNode.modificationTime_sec != 0) {
-        NSError *myError = nil;
         if (![FileAttributes applyMTimeSec:theNode.modificationTime_sec
                                  mTimeNSec:theNode.modificationTime_nsec
-                                    toPath:thePath
+                                      toFD:fd
+                                      path:thePath
                                      error:&myError]) {
             HSLogError(@"applyMTimeSec failed for %@: %@", thePath, myError);
         }
     }
 
-    return YES;
+    // Apply flags.
+    if (theNode.mac_st_flags != 0) {
+        if (![FileAttributes applyFlags:theNode.mac_st_flags toFD:fd path:thePath error:&myError]) {
+            HSLogError(@"applyFlags failed for %@: %@", thePath, myError);
+        }
+    }
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageMetadata startTime:startTime bytes:0];
+}
+- (void)applyMetadata:(Arq7Node *)theNode toDirectoryAtPath:(NSString *)thePath {
+    int fd = open([thePath fileSystemRepresentation], O_RDONLY|O_DIRECTORY|O_NOFOLLOW);
+    if (fd == -1) {
+        HSLogError(@"failed to apply metadata to %@: open: %s", thePath, strerror(errno));
+        return;
+    }
+    [self applyMetadata:theNode toFD:fd path:thePath];
+    close(fd);
 }
 @end
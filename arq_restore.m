@@ -33,6 +33,7 @@
 #include <libgen.h>
 #import <Foundation/Foundation.h>
 #import "ArqRestoreCommand.h"
+#import "BenchmarkCommand.h"
 
 static void printUsage(const char *exeName) {
 	fprintf(stderr, "Usage:\n");
@@ -45,8 +46,14 @@ static void printUsage(const char *exeName) {
     fprintf(stderr, "\t%s [-l loglevel] listfolders <target_nickname> <computer_uuid>\n", exeName);
     fprintf(stderr, "\t%s [-l loglevel] printplist <target_nickname> <computer_uuid> <folder_uuid>\n", exeName);
     fprintf(stderr, "\t%s [-l loglevel] listtree <target_nickname> <computer_uuid> <folder_uuid>\n", exeName);
+    fprintf(stderr, "\t%s [-l loglevel] listcommits <target_nickname> <computer_uuid> <folder_uuid>\n", exeName);
     fprintf(stderr, "\t%s [-l loglevel] restore <target_nickname> <computer_uuid> <folder_uuid> [relative_path]\n", exeName);
     fprintf(stderr, "\t%s [-l loglevel] clearcache <target_nickname>\n", exeName);
+    fprintf(stderr, "\t%s [-l loglevel] purgekeycache\n", exeName);
+#ifdef ARQ_RESTORE_BENCHMARKS
+    fprintf(stderr, "\n");
+    [BenchmarkCommand printUsageWithExeName:exeName];
+#endif
     fprintf(stderr, "\n");
     fprintf(stderr, "log levels: none, error, warn, info, and debug\n");
     fprintf(stderr, "log output: ~/Library/Logs/arq_restorer\n");
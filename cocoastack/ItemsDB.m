@@ -50,106 +50,82 @@ CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(ItemsDB)
 }
 
 - (Item *)itemAtPath:(NSString *)thePath targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     Item *ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] itemAtPath:thePath error:error];
-    [lock unlock];
     return ret;
 }
 - (NSNumber *)cacheIsLoadedForDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
     NSNumber *ret = nil;
-    [lock lock];
     TargetItemsDB *tidb = [self targetItemsDBForTargetUUID:theTargetUUID error:error];
     if (tidb != nil) {
         ret = [tidb cacheIsLoadedForDirectory:theDirectory error:error];
     }
-    [lock unlock];
     return ret;
 }
 - (NSMutableDictionary *)itemsByNameInDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     NSMutableDictionary *ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] itemsByNameInDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)setItemsByName:(NSDictionary *)theItemsByName inDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] setItemsByName:theItemsByName inDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)clearItemsByNameInDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] clearItemsByNameInDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 
 - (BOOL)destroyForTargetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] destroy:error];
+    [lock lock];
     [targetItemsDBsByUUID removeObjectForKey:theTargetUUID];
     [lock unlock];
     return ret;
 }
 
 - (BOOL)addItem:(Item *)theItem inDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] addItem:theItem inDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)addOrReplaceItem:(Item *)theItem inDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] addOrReplaceItem:theItem inDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)removeItemWithName:(NSString *)theItemName inDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] removeItemWithName:theItemName inDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)moveItem:(Item *)theItem fromDirectory:(NSString *)theFromDirectory toDirectory:(NSString *)theToDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] moveItem:theItem fromDirectory:theFromDirectory toDirectory:theToDirectory error:error];
-    [lock unlock];
     return ret;
 }
 
 - (BOOL)clearReferenceCountsForTargetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] clearReferenceCounts:error];
-    [lock unlock];
     return ret;
 }
 - (BOOL)setReferenceCountOfFileAtPath:(NSString *)thePath targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     BOOL ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] setReferenceCountOfFileAtPath:thePath error:error];
-    [lock unlock];
     return ret;
 }
 - (NSNumber *)totalSizeOfReferencedFilesInDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     NSNumber *ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] totalSizeOfReferencedFilesInDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (NSArray *)pathsOfUnreferencedFilesInDirectory:(NSString *)theDirectory targetUUID:(NSString *)theTargetUUID error:(NSError **)error {
-    [lock lock];
     NSArray *ret = [[self targetItemsDBForTargetUUID:theTargetUUID error:error] pathsOfUnreferencedFilesInDirectory:theDirectory error:error];
-    [lock unlock];
     return ret;
 }
 - (TargetItemsDB *)targetItemsDBForTargetUUID:(NSString *)theTargetUUID error:(NSError **)error {
+    // The lock only guards the dictionary. TargetItemsDB handles its own concurrency through SQLite.
+    [lock lock];
     TargetItemsDB *ret = [targetItemsDBsByUUID objectForKey:theTargetUUID];
     if (ret == nil) {
         ret = [[TargetItemsDB alloc] initWithTargetUUID:theTargetUUID error:error];
-        if (ret == nil) {
-            return nil;
+        if (ret != nil) {
+            [targetItemsDBsByUUID setObject:ret forKey:theTargetUUID];
         }
-        [targetItemsDBsByUUID setObject:ret forKey:theTargetUUID];
     }
+    [lock unlock];
     return ret;
 }
 @end
@@ -30,13 +30,17 @@
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <pthread.h>
+
 @class Item;
-@class FMDatabaseQueue;
 
 @interface TargetItemsDB : NSObject {
     NSString *dbPath;
-    NSString *lockFilePath;
-    FMDatabaseQueue *fmdbq;
+    pthread_key_t threadConnectionKey;
+    NSMutableSet *connections;
+    NSCondition *lock;
+    NSUInteger operationsInProgress;
+    BOOL destroyed;
 }
 - (id)initWithTargetUUID:(NSString *)theTargetUUID error:(NSError **)error;
 
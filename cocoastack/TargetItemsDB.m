@@ -32,6 +32,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <pthread.h>
 #import "sqlite3.h"
 #import "TargetItemsDB.h"
 #import "NSFileManager_extra.h"
@@ -41,34 +42,78 @@
 #import "Item.h"
 #import "NSString_extra.h"
 #import "CacheOwnership.h"
-#import "FlockFile.h"
 #import "FMDatabaseAdditions.h"
 #import "NSString_slashed.h"
 
+
+// How long a connection waits for another thread's or process's write transaction before giving up.
+#define BUSY_TIMEOUT_SECONDS (60.0)
+
+// Rows per multi-row INSERT when loading a directory listing. 10 columns each, under SQLite's 999-variable limit.
+#define INSERT_BATCH_SIZE (90)
+
+#define ITEM_COLUMNS @"name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum"
+
+
+// A thread's connection. It's held by the thread's pthread-specific value and by the TargetItemsDB's
+// set of connections, and closed by whichever lets go first.
+@interface TargetItemsDBConnection : NSObject {
+@public
+    FMDatabase *db;
+    NSCondition *lock;
+    NSMutableSet *connections;
+    BOOL closed;
+}
+@end
+@implementation TargetItemsDBConnection
+@end
+
+// Called with the thread's value when a thread that used the database exits.
+static void closeThreadConnection(void *theValue) {
+    TargetItemsDBConnection *connection = (TargetItemsDBConnection *)CFBridgingRelease(theValue);
+    [connection->lock lock];
+    if (!connection->closed) {
+        [connection->db close];
+        connection->closed = YES;
+    }
+    [connection->connections removeObject:connection];
+    [connection->lock unlock];
+}
+
+
 @implementation TargetItemsDB
 - (id)initWithTargetUUID:(NSString *)theTargetUUID error:(NSError **)error {
     if (self = [super init]) {
         dbPath = [[[UserLibrary arqCachePath] stringByAppendingPathComponent:theTargetUUID] stringByAppendingPathComponent:@"items.db"];
-        lockFilePath = [dbPath stringByAppendingString:@".lock"];
+        lock = [[NSCondition alloc] init];
+        [lock setName:@"TargetItemsDB lock"];
+        int result = pthread_key_create(&threadConnectionKey, closeThreadConnection);
+        if (result != 0) {
+            HSLogError(@"pthread_key_create error %d: %s", result, strerror(result));
+            SETNSERROR(@"UnixErrorDomain", result, @"failed to create thread-specific key for items cache database: %s", strerror(result));
+            return nil;
+        }
+        connections = [[NSMutableSet alloc] init]; // dealloc only deletes the key if this is set.
         if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:dbPath targetUID:[[CacheOwnership sharedCacheOwnership] uid] targetGID:[[CacheOwnership sharedCacheOwnership] gid] error:error]) {
 
             return nil;
         }
 
         NSError *myError = nil;
-        fmdbq = [self setupDB:&myError];
-        if (fmdbq == nil) {
+        BOOL ret = [self setupDB:&myError];
+        if (!ret) {
             HSLogError(@"failed to open items cache database %@: %@", dbPath, myError);
             if ([myError isErrorWithDomain:[ItemsDB errorDomain] code:SQLITE_CORRUPT]) {
                 // Delete the file.
                 HSLogInfo(@"deleting corrupt items cache database %@", dbPath);
-                if (![[NSFileManager defaultManager] removeItemAtPath:dbPath error:&myError]) {
+                [self closeAllDatabases];
+                if (![self deleteDatabaseFiles:&myError]) {
                     HSLogError(@"failed to delete corrupt sqlite database %@: %@", dbPath, myError);
                 }
-                fmdbq = [self setupDB:&myError];
+                ret = [self setupDB:&myError];
             }
         }
-        if (fmdbq == nil) {
+        if (!ret) {
             SETERRORFROMMYERROR;
 
             return nil;
@@ -77,675 +122,566 @@
     return self;
 }
 - (void)dealloc {
-    [fmdbq close];
-
-
-
+    if (connections == nil) {
+        return;
+    }
+    // Connections of threads that are still running get closed below. Once the key is deleted their destructors don't run,
+    // so only those small wrappers outlive us.
+    void *value = pthread_getspecific(threadConnectionKey);
+    if (value != NULL) {
+        pthread_setspecific(threadConnectionKey, NULL);
+        CFBridgingRelease(value);
+    }
+    pthread_key_delete(threadConnectionKey);
+    [self closeAllDatabases];
 }
 
 - (Item *)itemAtPath:(NSString *)thePath error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block Item *ret = nil;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedItemAtPath:thePath error:&blockError]; } error:error]) {
-        ret = nil;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return nil;
     }
-    if (error != NULL) *error = blockError;
+    Item *ret = [self doItemAtPath:thePath database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (NSNumber *)cacheIsLoadedForDirectory:(NSString *)theDirectory error:(NSError **)error {
-    // Don't get a flockfile first for performance reasons.
-
-    __block NSNumber *ret = nil;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        ret = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-    }];
-
-    if (error != NULL) *error = blockError;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return nil;
+    }
+    NSNumber *ret = [self doCacheIsLoadedForDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (NSMutableDictionary *)itemsByNameInDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block NSMutableDictionary *ret = nil;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedItemsByNameInDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = nil;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return nil;
     }
-    if (error != NULL) *error = blockError;
+    NSMutableDictionary *ret = [self doItemsByNameInDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)setItemsByName:(NSDictionary *)theItemsByName inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedSetItemsByName:theItemsByName inDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
+    }
+    BOOL ret = NO;
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in setItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+    } else {
+        ret = [self doSetItemsByName:theItemsByName inDirectory:theDirectory database:db error:error];
+        ret = [self finishTransaction:db succeeded:ret description:@"setItemsByName" error:error];
     }
-    if (error != NULL) *error = blockError;
+    [self endUsingDatabase];
     return ret;
 }
-
 - (BOOL)clearItemsByNameInDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedClearItemsByNameInDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    HSLogDebug(@"deleting cached data for %@ and all subdirectories", theDirectory);
+
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doClearItemsByNameInDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)destroy:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedDestroy:&blockError]; } error:error]) {
-        ret = NO;
+    // Let operations on other threads finish before closing their connections out from under them. Later ones fail.
+    [lock lock];
+    destroyed = YES;
+    while (operationsInProgress > 0) {
+        [lock wait];
     }
-    if (error != NULL) *error = blockError;
-    return ret;
+    [lock unlock];
+    [self closeAllDatabases];
+    return [self deleteDatabaseFiles:error];
 }
 
 - (BOOL)addItem:(Item *)theItem inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedAddItem:theItem inDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doAddItem:theItem inDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)addOrReplaceItem:(Item *)theItem inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedAddOrReplaceItem:theItem inDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doAddOrReplaceItem:theItem inDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)removeItemWithName:(NSString *)theItemName inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedRemoveItemWithName:theItemName inDirectory:theDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doRemoveItemWithName:theItemName inDirectory:theDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)moveItem:(Item *)theItem fromDirectory:(NSString *)theFromDirectory toDirectory:(NSString *)theToDirectory error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedMoveItem:theItem fromDirectory:theFromDirectory toDirectory:theToDirectory error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doMoveItem:theItem fromDirectory:theFromDirectory toDirectory:theToDirectory database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)clearReferenceCounts:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedClearReferenceCounts:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doClearReferenceCountsInDatabase:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (BOOL)setReferenceCountOfFileAtPath:(NSString *)thePath error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedSetReferenceCountOfFileAtPath:thePath error:&blockError]; } error:error]) {
-        ret = NO;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return NO;
     }
-    if (error != NULL) *error = blockError;
+    BOOL ret = [self doSetReferenceCountOfFileAtPath:thePath database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (NSNumber *)totalSizeOfReferencedFilesInDirectory:(NSString *)theDir error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block NSNumber *ret = nil;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedTotalSizeOfReferencedFilesInDirectory:theDir error:&blockError]; } error:error]) {
-        ret = nil;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return nil;
     }
-    if (error != NULL) *error = blockError;
+    NSNumber *ret = [self doTotalSizeOfReferencedFilesInDirectory:theDir database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 - (NSArray *)pathsOfUnreferencedFilesInDirectory:(NSString *)theDir error:(NSError **)error {
-    FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
-    __block NSArray *ret = nil;
-    __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedPathsOfUnreferencedFilesInDirectory:theDir error:&blockError]; } error:error]) {
-        ret = nil;
+    FMDatabase *db = [self beginUsingDatabase:error];
+    if (db == nil) {
+        return nil;
     }
-    if (error != NULL) *error = blockError;
+    NSArray *ret = [self doPathsOfUnreferencedFilesInDirectory:theDir database:db error:error];
+    [self endUsingDatabase];
     return ret;
 }
 
 #pragma mark internal
-- (BOOL)lockedSetReferenceCountOfFileAtPath:(NSString *)thePath error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (![db executeUpdate:@"UPDATE items SET refcount = 1 WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:thePath]]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db update refcount: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-//        if ([db changes] != 0) {
-//            HSLogDebug(@"set refcount for %@", thePath);
-//        }
-        ret = YES;
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
-}
-- (NSNumber *)lockedTotalSizeOfReferencedFilesInDirectory:(NSString *)theDir error:(NSError **)error {
-    __block NSNumber *ret = nil;
-    __block NSError *blockError = nil;
-
-    theDir = [theDir slashed];
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSString *theLikeParam = [theDir stringByAppendingString:@"%"];
-        FMResultSet *rs = [db executeQuery:@"SELECT SUM(file_size) FROM items WHERE refcount > 0 AND slashed_directory LIKE ?" withArgumentsInArray:[NSArray arrayWithObject:theLikeParam]];
-        if (rs == nil) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select sum(file_size): error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        [rs next];
-        unsigned long long total = [rs unsignedLongLongIntForColumnIndex:0];
-        ret = [NSNumber numberWithUnsignedLongLong:total];
-        [rs close];
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
-}
-- (NSArray *)lockedPathsOfUnreferencedFilesInDirectory:(NSString *)theDir error:(NSError **)error {
-    __block NSMutableArray *ret = nil;
-    __block NSError *blockError = nil;
-
-    theDir = [theDir slashed];
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSString *theLikeParam = [theDir stringByAppendingString:@"%"];
-        FMResultSet *rs = [db executeQuery:@"SELECT path FROM items WHERE refcount = 0 AND is_directory = 0 AND slashed_directory LIKE ?" withArgumentsInArray:[NSArray arrayWithObject:theLikeParam]];
-        if (rs == nil) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select unreferenced paths: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [NSMutableArray array];
-        while ([rs next]) {
-            [ret addObject:[rs stringForColumnIndex:0]];
-        }
-        [rs close];
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
-}
-- (Item *)lockedItemAtPath:(NSString *)thePath error:(NSError **)error {
+- (Item *)doItemAtPath:(NSString *)thePath database:(FMDatabase *)db error:(NSError **)error {
     NSString *theDirectory = [thePath stringByDeletingLastPathComponent];
 
-    __block Item *ret = nil;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
+    // Read the loaded flag and the row from one snapshot, so a concurrent clear can't make a loaded directory look empty.
+    if (![self beginReadTransaction:db error:error]) {
+        return nil;
+    }
+    Item *ret = nil;
+    NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:error];
+    if (loaded != nil) {
         if (![loaded boolValue]) {
             SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"itemAtPath: cache not loaded for directory %@", theDirectory);
-            return;
-        }
-
-//        HSLogDebug(@"querying for item at path %@", thePath);
-//        NSTimeInterval theTime = [NSDate timeIntervalSinceReferenceDate];
-        FMResultSet *rs = [db executeQuery:@"SELECT name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum FROM items WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:thePath]];
-//        HSLogDebug(@"query for item at path %@ took %0.2f seconds", thePath, ([NSDate timeIntervalSinceReferenceDate] - theTime));
-        if (rs == nil) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select item at path: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        if (![rs next]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_NOT_FOUND, @"%@ not found", thePath);
-            HSLogDebug(@"%@ not found in cached list of items", thePath);
         } else {
-            ret = [[Item alloc] init];
-            ret.name = [rs stringForColumnIndex:0];
-            ret.itemId = [rs stringForColumnIndex:1];
-            ret.parentId = [rs stringForColumnIndex:2];
-            ret.isDirectory = [rs boolForColumnIndex:3];
-            ret.fileSize = [rs intForColumnIndex:4];
-            ret.fileLastModified = [rs dateForColumnIndex:5];
-            ret.storageClass = [rs stringForColumnIndex:6];
-            ret.checksum = [rs stringForColumnIndex:7];
+            ret = [self itemAtPath:thePath db:db error:error];
+            if (ret == nil) {
+                HSLogDebug(@"%@ not found in cached list of items", thePath);
+            }
         }
-        [rs close];
-    }];
-
-    if (error != NULL) *error = blockError;
+    }
+    [db commit];
     return ret;
 }
-- (NSMutableDictionary *)lockedItemsByNameInDirectory:(NSString *)theDirectory error:(NSError **)error {
-    __block NSMutableDictionary *ret = nil;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
+- (NSNumber *)doCacheIsLoadedForDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    return [self isLoadedForDirectory:theDirectory db:db error:error];
+}
+- (NSMutableDictionary *)doItemsByNameInDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    if (![self beginReadTransaction:db error:error]) {
+        return nil;
+    }
+    NSMutableDictionary *ret = nil;
+    NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:error];
+    if (loaded != nil) {
         if (![loaded boolValue]) {
             SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"itemsByNameInDirectory: cache not loaded for directory %@", theDirectory);
-            return;
-        }
-
-        NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
-
-//        HSLogDebug(@"query for items in directory %@", theDirectory);
-//        NSTimeInterval theTime = [NSDate timeIntervalSinceReferenceDate];
-        FMResultSet *rs = [db executeQuery:@"SELECT name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum FROM items WHERE slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObject:slashedDirectory]];
-//        HSLogDebug(@"query for items in directory %@ took %0.2f seconds", theDirectory, ([NSDate timeIntervalSinceReferenceDate] - theTime));
-        if (rs == nil) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select items: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [NSMutableDictionary dictionary];
-        while ([rs next]) {
-            Item *item = [[Item alloc] init];
-            item.name = [rs stringForColumnIndex:0];
-            item.itemId = [rs stringForColumnIndex:1];
-            item.parentId = [rs stringForColumnIndex:2];
-            item.isDirectory = [rs boolForColumnIndex:3];
-            item.fileSize = [rs intForColumnIndex:4];
-            item.fileLastModified = [rs dateForColumnIndex:5];
-            item.storageClass = [rs stringForColumnIndex:6];
-            item.checksum = [rs stringForColumnIndex:7];
-
-            [ret setObject:item forKey:item.name];
-        }
-        [rs close];
-    }];
-
-    if (error != NULL) *error = blockError;
-    return ret;
-}
-- (BOOL)lockedSetItemsByName:(NSDictionary *)theItemsByName inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (![db beginTransaction]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in setItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [self doSetItemsByName:theItemsByName inDirectory:theDirectory database:db error:&blockError];
-        if (ret) {
-            if (![db commit]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"commit in setItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                ret = NO;
-                return;
-            }
         } else {
-            [db rollback];
+            ret = [self itemsByNameInDirectory:theDirectory db:db error:error];
         }
-    }];
-    if (error != NULL) *error = blockError;
+    }
+    [db commit];
     return ret;
 }
-- (BOOL)doSetItemsByName:(NSDictionary *)theItemsByName inDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+- (BOOL)doClearItemsByNameInDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
     NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
-
-    NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:error];
-    if (loaded == nil) {
-        return NO;
-    }
-    if (![loaded boolValue]) {
-        if (![db executeUpdate:@"INSERT INTO loaded_directories (path) VALUES (?)" withArgumentsInArray:[NSArray arrayWithObject:theDirectory]]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"insert into loaded_directories: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return NO;
-        }
-    }
-    if (![db executeUpdate:@"DELETE FROM items WHERE slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObject:slashedDirectory]]) {
-        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete items: error=%@, db=%@", [db lastErrorMessage], dbPath);
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in clearItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
         return NO;
     }
-    HSLogDebug(@"inserting %ld rows into the cache db for %@", [theItemsByName count], theDirectory);
-    for (Item *item in [theItemsByName allValues]) {
-        if (![self deleteAndInsertItem:item inDirectory:slashedDirectory db:db error:error]) {
-            return NO;
-        }
-    }
-    HSLogDebug(@"inserted %ld rows into the cache db for %@", [theItemsByName count], theDirectory);
-
-    return YES;
-}
-- (BOOL)lockedClearItemsByNameInDirectory:(NSString *)theDirectory error:(NSError **)error {
-    HSLogDebug(@"deleting cached data for %@ and all subdirectories", theDirectory);
-
-    NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
-
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
+    BOOL ret = NO;
+    do {
         // Delete loaded_directories.
-        NSArray *args = [NSArray arrayWithObjects:theDirectory, [slashedDirectory stringByAppendingString:@"%"], nil];
-        if (![db executeUpdate:@"DELETE FROM loaded_directories WHERE path = ? OR path LIKE ?" withArgumentsInArray:args]) {
+        NSArray *args = [NSArray arrayWithObjects:theDirectory, slashedDirectory, [self upperBoundForSlashedDirectory:slashedDirectory], nil];
+        if (![db executeUpdate:@"DELETE FROM loaded_directories WHERE path = ? OR (path >= ? AND path < ?)" withArgumentsInArray:args]) {
             SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from loaded_directories for %@: error=%@, db=%@", theDirectory, [db lastErrorMessage], dbPath);
-            return;
+            break;
         }
 
         // Delete items.
-        if (![db executeUpdate:@"DELETE FROM items WHERE slashed_directory LIKE ?" withArgumentsInArray:[NSArray arrayWithObject:[slashedDirectory stringByAppendingString:@"%"]]]) {
+        args = [NSArray arrayWithObjects:slashedDirectory, [self upperBoundForSlashedDirectory:slashedDirectory], nil];
+        if (![db executeUpdate:@"DELETE FROM items WHERE slashed_directory >= ? AND slashed_directory < ?" withArgumentsInArray:args]) {
             SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from items for %@: error=%@, db=%@", theDirectory, [db lastErrorMessage], dbPath);
-            return;
+            break;
         }
-
         ret = YES;
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
+    } while (0);
+    return [self finishTransaction:db succeeded:ret description:@"clearItemsByName" error:error];
 }
-- (BOOL)lockedDestroy:(NSError **)error {
-    if ([[NSFileManager defaultManager] fileExistsAtPath:dbPath]) {
-        if (![[NSFileManager defaultManager] removeItemAtPath:dbPath error:error]) {
-            return NO;
-        }
+- (BOOL)doAddItem:(Item *)theItem inDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in addItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
     }
-    return YES;
+    BOOL ret = [self requireLoadedDirectory:theDirectory db:db description:@"addItem" error:error]
+    && [self insertItem:theItem inDirectory:theDirectory db:db error:error];
+    return [self finishTransaction:db succeeded:ret description:@"addItem" error:error];
 }
-- (BOOL)lockedAddItem:(Item *)theItem inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
-        if (![loaded boolValue]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"addItem: cache not loaded for directory %@", theDirectory);
-            return;
-        }
-
-        if (![db beginTransaction]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in addItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [self insertItem:theItem inDirectory:theDirectory db:db error:&blockError];
-        if (ret) {
-            if (![db commit]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"commit in addItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                ret = NO;
-                return;
-            }
+- (BOOL)doAddOrReplaceItem:(Item *)theItem inDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in addOrReplaceItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    BOOL ret = [self requireLoadedDirectory:theDirectory db:db description:@"addOrReplaceItem" error:error]
+    && [self insertOrReplaceItems:[NSArray arrayWithObject:theItem] inDirectory:theDirectory db:db error:error];
+    return [self finishTransaction:db succeeded:ret description:@"addOrReplaceItem" error:error];
+}
+- (BOOL)doRemoveItemWithName:(NSString *)theItemName inDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in removeItemWithName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    BOOL ret = NO;
+    if ([self requireLoadedDirectory:theDirectory db:db description:@"removeItemWithName" error:error]) {
+        NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
+        if (![db executeUpdate:@"DELETE FROM items WHERE name = ? AND slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObjects:theItemName, slashedDirectory, nil]]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from items for %@ in %@: error=%@, db=%@", theItemName, theDirectory, [db lastErrorMessage], dbPath);
         } else {
-            [db rollback];
+            ret = YES;
         }
-    }];
-
-    if (error != NULL) *error = blockError;
-    return ret;
+    }
+    return [self finishTransaction:db succeeded:ret description:@"removeItemWithName" error:error];
 }
-- (BOOL)lockedAddOrReplaceItem:(Item *)theItem inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
-        if (![loaded boolValue]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"addOrReplaceItem: cache not loaded for directory %@", theDirectory);
-            return;
-        }
-
-        if (![db beginTransaction]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in addOrReplaceItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [self deleteAndInsertItem:theItem inDirectory:theDirectory db:db error:&blockError];
-        if (ret) {
-            if (![db commit]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"commit in addOrReplaceItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                ret = NO;
-                return;
-            }
+- (BOOL)doMoveItem:(Item *)theItem fromDirectory:(NSString *)theFromDirectory toDirectory:(NSString *)theToDirectory database:(FMDatabase *)db error:(NSError **)error {
+    if (![db beginTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in moveItem failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    BOOL ret = NO;
+    if ([self requireLoadedDirectory:theFromDirectory db:db description:@"moveItem" error:error]
+        && [self requireLoadedDirectory:theToDirectory db:db description:@"moveItem" error:error]) {
+        NSString *slashedFromDirectory = [theFromDirectory stringByAppendingTrailingSlash];
+        if (![db executeUpdate:@"DELETE FROM items WHERE name = ? AND slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObjects:theItem.name, slashedFromDirectory, nil]]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from items for %@ in %@: error=%@, db=%@", theItem.name, theFromDirectory, [db lastErrorMessage], dbPath);
         } else {
-            [db rollback];
+            ret = [self insertItem:theItem inDirectory:theToDirectory db:db error:error];
         }
-    }];
-
-    if (error != NULL) *error = blockError;
+    }
+    return [self finishTransaction:db succeeded:ret description:@"moveItem" error:error];
+}
+- (BOOL)doClearReferenceCountsInDatabase:(FMDatabase *)db error:(NSError **)error {
+    if (![db executeUpdate:@"UPDATE items SET refcount = 0"]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"update refcount to 0 error: %@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    int rowsChanged = [db changes];
+    HSLogDebug(@"set refcount to 0 on %d rows", rowsChanged);
+    return YES;
+}
+- (BOOL)doSetReferenceCountOfFileAtPath:(NSString *)thePath database:(FMDatabase *)db error:(NSError **)error {
+    if (![db executeUpdate:@"UPDATE items SET refcount = 1 WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:thePath]]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db update refcount: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    return YES;
+}
+- (NSNumber *)doTotalSizeOfReferencedFilesInDirectory:(NSString *)theDir database:(FMDatabase *)db error:(NSError **)error {
+    theDir = [theDir slashed];
+    NSArray *args = [NSArray arrayWithObjects:theDir, [self upperBoundForSlashedDirectory:theDir], nil];
+    FMResultSet *rs = [db executeQuery:@"SELECT SUM(file_size) FROM items INDEXED BY items_subtree WHERE slashed_directory >= ? AND slashed_directory < ? AND refcount > 0" withArgumentsInArray:args];
+    if (rs == nil) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select sum(file_size): error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return nil;
+    }
+    [rs next];
+    unsigned long long total = [rs unsignedLongLongIntForColumnIndex:0];
+    [rs close];
+    return [NSNumber numberWithUnsignedLongLong:total];
+}
+- (NSArray *)doPathsOfUnreferencedFilesInDirectory:(NSString *)theDir database:(FMDatabase *)db error:(NSError **)error {
+    theDir = [theDir slashed];
+    NSArray *args = [NSArray arrayWithObjects:theDir, [self upperBoundForSlashedDirectory:theDir], nil];
+    FMResultSet *rs = [db executeQuery:@"SELECT path FROM items INDEXED BY items_subtree WHERE slashed_directory >= ? AND slashed_directory < ? AND refcount = 0 AND is_directory = 0" withArgumentsInArray:args];
+    if (rs == nil) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select unreferenced paths: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return nil;
+    }
+    NSMutableArray *ret = [NSMutableArray array];
+    while ([rs next]) {
+        [ret addObject:[rs stringForColumnIndex:0]];
+    }
+    [rs close];
     return ret;
 }
-- (BOOL)lockedRemoveItemWithName:(NSString *)theItemName inDirectory:(NSString *)theDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
-        if (![loaded boolValue]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"removeItemWithName: cache not loaded for directory %@", theDirectory);
-            return;
-        }
-
-        NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
-        if (![db executeUpdate:@"DELETE FROM items WHERE name = ? AND slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObjects:theItemName, slashedDirectory, nil]]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from items for %@ in %@: error=%@, db=%@", theItemName, theDirectory, [db lastErrorMessage], dbPath);
-            return;
-        }
-
-        ret = YES;
-    }];
-
-    if (error != NULL) *error = blockError;
+- (NSString *)upperBoundForSlashedDirectory:(NSString *)theSlashedDirectory {
+    // Every path under "a/b/" sorts at or after "a/b/" and before "a/b0", because '0' is the character after '/'.
+    // This turns a subtree match into an index range scan. LIKE 'a/b/%' can't use the index with SQLite's
+    // case-insensitive LIKE, and it also treats '_' and '%' in paths as wildcards.
+    NSAssert([theSlashedDirectory hasSuffix:@"/"], @"directory must end in a slash");
+    return [[theSlashedDirectory substringToIndex:[theSlashedDirectory length] - 1] stringByAppendingString:@"0"];
+}
+- (FMDatabase *)beginUsingDatabase:(NSError **)error {
+    [lock lock];
+    if (destroyed) {
+        [lock unlock];
+        SETNSERROR([ItemsDB errorDomain], -1, @"items cache database %@ was deleted", dbPath);
+        return nil;
+    }
+    operationsInProgress++;
+    [lock unlock];
+    
+    FMDatabase *ret = [self database:error];
+    if (ret == nil) {
+        [self endUsingDatabase];
+    }
     return ret;
 }
-- (BOOL)lockedMoveItem:(Item *)theItem fromDirectory:(NSString *)theFromDirectory toDirectory:(NSString *)theToDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (![db beginTransaction]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin transaction in setItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = [self doLockedMoveItem:theItem fromDirectory:theFromDirectory toDirectory:theToDirectory error:&blockError];
-        if (ret) {
-            if (![db commit]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"commit in setItemsByName failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                ret = NO;
-                return;
+- (void)endUsingDatabase {
+    [lock lock];
+    operationsInProgress--;
+    [lock broadcast];
+    [lock unlock];
+}
+- (FMDatabase *)database:(NSError **)error {
+    // One connection per thread: SQLite in WAL mode lets them all read at once while one of them writes.
+    // The connection is closed when the thread exits, so short-lived threads don't pile up open connections.
+    TargetItemsDBConnection *connection = (__bridge TargetItemsDBConnection *)pthread_getspecific(threadConnectionKey);
+    if (connection != nil) {
+        [lock lock];
+        BOOL closed = connection->closed;
+        [lock unlock];
+        if (!closed) {
+            return connection->db;
+        }
+        pthread_setspecific(threadConnectionKey, NULL);
+        CFBridgingRelease((__bridge void *)connection);
+    }
+    
+    FMDatabase *db = [self openDatabase:error];
+    if (db == nil) {
+        return nil;
+    }
+    connection = [[TargetItemsDBConnection alloc] init];
+    connection->db = db;
+    connection->lock = lock;
+    connection->connections = connections;
+    [lock lock];
+    [connections addObject:connection];
+    [lock unlock];
+    pthread_setspecific(threadConnectionKey, CFBridgingRetain(connection));
+    return db;
+}
+- (FMDatabase *)openDatabase:(NSError **)error {
+    FMDatabase *db = [FMDatabase databaseWithPath:dbPath];
+    if (![db open]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db open: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return nil;
+    }
+    [db setShouldCacheStatements:YES];
+    [db setMaxBusyRetryTimeInterval:BUSY_TIMEOUT_SECONDS];
+    // WAL is persistent in the file, but synchronous is per connection. NORMAL is safe in WAL mode; a crash can only lose cache entries.
+    if (![db executeUpdate:@"PRAGMA synchronous = NORMAL"]) {
+        HSLogWarn(@"failed to set synchronous=NORMAL on %@: %@", dbPath, [db lastErrorMessage]);
+    }
+    return db;
+}
+- (void)closeAllDatabases {
+    [lock lock];
+    for (TargetItemsDBConnection *connection in connections) {
+        [connection->db close];
+        connection->closed = YES;
+    }
+    [connections removeAllObjects];
+    [lock unlock];
+}
+- (BOOL)deleteDatabaseFiles:(NSError **)error {
+    NSArray *paths = [NSArray arrayWithObjects:dbPath, [dbPath stringByAppendingString:@"-wal"], [dbPath stringByAppendingString:@"-shm"], nil];
+    for (NSString *path in paths) {
+        if ([[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            if (![[NSFileManager defaultManager] removeItemAtPath:path error:error]) {
+                return NO;
             }
-        } else {
-            [db rollback];
         }
-    }];
-    if (error != NULL) *error = blockError;
+    }
+    return YES;
+}
+- (BOOL)beginReadTransaction:(FMDatabase *)db error:(NSError **)error {
+    if (![db beginDeferredTransaction]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"begin read transaction failed: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    return YES;
+}
+- (BOOL)finishTransaction:(FMDatabase *)db succeeded:(BOOL)theSucceeded description:(NSString *)theDescription error:(NSError **)error {
+    if (!theSucceeded) {
+        [db rollback];
+        return NO;
+    }
+    if (![db commit]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"commit in %@ failed: error=%@, db=%@", theDescription, [db lastErrorMessage], dbPath);
+        [db rollback];
+        return NO;
+    }
+    return YES;
+}
+- (BOOL)requireLoadedDirectory:(NSString *)theDirectory db:(FMDatabase *)db description:(NSString *)theDescription error:(NSError **)error {
+    NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:error];
+    if (loaded == nil) {
+        return NO;
+    }
+    if (![loaded boolValue]) {
+        SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"%@: cache not loaded for directory %@", theDescription, theDirectory);
+        return NO;
+    }
+    return YES;
+}
+- (Item *)itemAtPath:(NSString *)thePath db:(FMDatabase *)db error:(NSError **)error {
+    FMResultSet *rs = [db executeQuery:@"SELECT " ITEM_COLUMNS @" FROM items WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:thePath]];
+    if (rs == nil) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select item at path: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return nil;
+    }
+    Item *ret = nil;
+    if ([rs next]) {
+        ret = [self itemFromResultSet:rs];
+    } else {
+        SETNSERROR([ItemsDB errorDomain], ERROR_NOT_FOUND, @"%@ not found", thePath);
+    }
+    [rs close];
     return ret;
 }
-- (BOOL)doLockedMoveItem:(Item *)theItem fromDirectory:(NSString *)theFromDirectory toDirectory:(NSString *)theToDirectory error:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        NSNumber *loaded = [self isLoadedForDirectory:theFromDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
-        if (![loaded boolValue]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"removeItemWithName: cache not loaded for directory %@", theFromDirectory);
-            return;
-        }
-        loaded = [self isLoadedForDirectory:theToDirectory db:db error:&blockError];
-        if (loaded == nil) {
-            return;
-        }
-        if (![loaded boolValue]) {
-            SETNSERROR([ItemsDB errorDomain], ERROR_CACHE_NOT_LOADED, @"removeItemWithName: cache not loaded for directory %@", theToDirectory);
-            return;
-        }
-
-        NSString *slashedFromDirectory = [theFromDirectory stringByAppendingTrailingSlash];
-        if (![db executeUpdate:@"DELETE FROM items WHERE name = ? AND slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObjects:theItem.name, slashedFromDirectory, nil]]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete from items for %@ in %@: error=%@, db=%@", theItem.name, theFromDirectory, [db lastErrorMessage], dbPath);
-            return;
-        }
-
-        if (![self insertItem:theItem inDirectory:theToDirectory db:db error:&blockError]) {
-            return;
-        }
-        ret = YES;
-    }];
-
-    if (error != NULL) *error = blockError;
+- (NSMutableDictionary *)itemsByNameInDirectory:(NSString *)theDirectory db:(FMDatabase *)db error:(NSError **)error {
+    NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
+    FMResultSet *rs = [db executeQuery:@"SELECT " ITEM_COLUMNS @" FROM items WHERE slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObject:slashedDirectory]];
+    if (rs == nil) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select items: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return nil;
+    }
+    NSMutableDictionary *ret = [NSMutableDictionary dictionary];
+    while ([rs next]) {
+        Item *item = [self itemFromResultSet:rs];
+        [ret setObject:item forKey:item.name];
+    }
+    [rs close];
     return ret;
 }
-- (BOOL)lockedClearReferenceCounts:(NSError **)error {
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
+- (Item *)itemFromResultSet:(FMResultSet *)rs {
+    Item *ret = [[Item alloc] init];
+    ret.name = [rs stringForColumnIndex:0];
+    ret.itemId = [rs stringForColumnIndex:1];
+    ret.parentId = [rs stringForColumnIndex:2];
+    ret.isDirectory = [rs boolForColumnIndex:3];
+    ret.fileSize = [rs unsignedLongLongIntForColumnIndex:4];
+    ret.fileLastModified = [rs dateForColumnIndex:5];
+    ret.storageClass = [rs stringForColumnIndex:6];
+    ret.checksum = [rs stringForColumnIndex:7];
+    return ret;
+}
+- (BOOL)doSetItemsByName:(NSDictionary *)theItemsByName inDirectory:(NSString *)theDirectory database:(FMDatabase *)db error:(NSError **)error {
+    NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
 
-    [fmdbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (![db executeUpdate:@"UPDATE items SET refcount = 0"]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"update refcount to 0 error: %@, db=%@", [db lastErrorMessage], dbPath);
-            return;
+    NSNumber *loaded = [self isLoadedForDirectory:theDirectory db:db error:error];
+    if (loaded == nil) {
+        return NO;
+    }
+    if (![loaded boolValue]) {
+        if (![db executeUpdate:@"INSERT INTO loaded_directories (path) VALUES (?)" withArgumentsInArray:[NSArray arrayWithObject:theDirectory]]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"insert into loaded_directories: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
         }
-        int rowsChanged = [db changes];
-        HSLogDebug(@"set refcount to 0 on %d rows", rowsChanged);
-        ret = YES;
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
+    }
+    if (![db executeUpdate:@"DELETE FROM items WHERE slashed_directory = ?" withArgumentsInArray:[NSArray arrayWithObject:slashedDirectory]]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete items: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    HSLogDebug(@"inserting %ld rows into the cache db for %@", [theItemsByName count], theDirectory);
+    if (![self insertOrReplaceItems:[theItemsByName allValues] inDirectory:theDirectory db:db error:error]) {
+        return NO;
+    }
+    HSLogDebug(@"inserted %ld rows into the cache db for %@", [theItemsByName count], theDirectory);
+
+    return YES;
 }
 - (BOOL)insertItem:(Item *)theItem inDirectory:(NSString *)theDirectory db:(FMDatabase *)db error:(NSError **)error {
     NSAssert([db inTransaction], @"must be in a transaction");
 
     NSString *thePath = [theDirectory stringByAppendingPathComponent:theItem.name];
-    FMResultSet *rs = [db executeQuery:@"SELECT name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum FROM items WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:thePath]];
-    if (rs == nil) {
-        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select item at path: error=%@, db=%@", [db lastErrorMessage], dbPath);
+    NSError *myError = nil;
+    Item *existing = [self itemAtPath:thePath db:db error:&myError];
+    if (existing == nil && [myError code] != ERROR_NOT_FOUND) {
+        SETERRORFROMMYERROR;
         return NO;
     }
-    Item *existing = nil;
-    if ([rs next]) {
-        existing = [[Item alloc] init];
-        existing.name = [rs stringForColumnIndex:0];
-        existing.itemId = [rs stringForColumnIndex:1];
-        existing.parentId = [rs stringForColumnIndex:2];
-        existing.isDirectory = [rs boolForColumnIndex:3];
-        existing.fileSize = [rs intForColumnIndex:4];
-        existing.fileLastModified = [rs dateForColumnIndex:5];
-        existing.storageClass = [rs stringForColumnIndex:6];
-        existing.checksum = [rs stringForColumnIndex:7];
-    }
-    [rs close];
     if (existing != nil) {
         NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
                                   @"item exists", NSLocalizedDescriptionKey,
                                   existing, @"previouslyExistingItem", nil];
-        NSError *myError = [[NSError alloc] initWithDomain:[ItemsDB errorDomain] code:ERROR_ITEM_EXISTS userInfo:userInfo];
+        myError = [[NSError alloc] initWithDomain:[ItemsDB errorDomain] code:ERROR_ITEM_EXISTS userInfo:userInfo];
         HSLogDebug(@"insertItem: %@", myError);
         SETERRORFROMMYERROR;
         return NO;
     }
-
-    /* columns:
-     path
-     slashed_directory
-     name
-     item_id
-     parent_id
-     is_directory
-     file_size
-     file_last_modified
-     storage_class
-     checksum
-     */
-    NSArray *args = [NSArray arrayWithObjects:thePath,
-                     [theDirectory stringByAppendingTrailingSlash],
-                     theItem.name,
-                     (theItem.itemId != nil ? theItem.itemId : [NSNull null]),
-                     (theItem.parentId != nil ? theItem.parentId : [NSNull null]),
-                     [NSNumber numberWithInt:(theItem.isDirectory ? 1 : 0)],
-                     [NSNumber numberWithUnsignedLongLong:theItem.fileSize],
-                     (theItem.fileLastModified != nil ? [NSNumber numberWithDouble:[theItem.fileLastModified timeIntervalSince1970]] : [NSNull null]),
-                     (theItem.storageClass != nil ? theItem.storageClass : [NSNull null]),
-                     (theItem.checksum != nil ? theItem.checksum : [NSNull null]),
-                     nil];
-    if (![db executeUpdate:@"INSERT INTO items (path, slashed_directory, name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)" withArgumentsInArray:args]) {
-        return NO;
-    }
-    return YES;
+    return [self insertOrReplaceItems:[NSArray arrayWithObject:theItem] inDirectory:theDirectory db:db error:error];
 }
-- (BOOL)deleteAndInsertItem:(Item *)theItem inDirectory:(NSString *)theDirectory db:(FMDatabase *)db error:(NSError **)error {
+- (BOOL)insertOrReplaceItems:(NSArray *)theItems inDirectory:(NSString *)theDirectory db:(FMDatabase *)db error:(NSError **)error {
     NSAssert([db inTransaction], @"must be in a transaction");
 
-    NSString *thePath = [theDirectory stringByAppendingPathComponent:theItem.name];
-    if (![db executeUpdate:@"DELETE FROM items WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObjects:thePath, nil]]) {
-        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"delete error: error=%@, db=%@", [db lastErrorMessage], dbPath);
-        return NO;
-    }
-
-    /* columns:
-     path
-     slashed_directory
-     name
-     item_id
-     parent_id
-     is_directory
-     file_size
-     file_last_modified
-     storage_class
-     checksum
-     */
-    NSArray *args = [NSArray arrayWithObjects:thePath,
-                     [theDirectory stringByAppendingTrailingSlash],
-                     theItem.name,
-                     (theItem.itemId != nil ? theItem.itemId : [NSNull null]),
-                     (theItem.parentId != nil ? theItem.parentId : [NSNull null]),
-                     [NSNumber numberWithInt:(theItem.isDirectory ? 1 : 0)],
-                     [NSNumber numberWithUnsignedLongLong:theItem.fileSize],
-                     (theItem.fileLastModified != nil ? [NSNumber numberWithDouble:[theItem.fileLastModified timeIntervalSince1970]] : [NSNull null]),
-                     (theItem.storageClass != nil ? theItem.storageClass : [NSNull null]),
-                     (theItem.checksum != nil ? theItem.checksum : [NSNull null]),
-                     nil];
-    if (![db executeUpdate:@"INSERT INTO items (path, slashed_directory, name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)" withArgumentsInArray:args]) {
-        return NO;
+    // Insert in multi-row statements. Every full batch has the same SQL text, so the cached prepared statement is reused.
+    NSString *slashedDirectory = [theDirectory stringByAppendingTrailingSlash];
+    NSUInteger index = 0;
+    while (index < [theItems count]) {
+        NSUInteger batchCount = MIN(INSERT_BATCH_SIZE, [theItems count] - index);
+        NSMutableString *sql = [NSMutableString stringWithString:@"INSERT OR REPLACE INTO items (path, slashed_directory, name, item_id, parent_id, is_directory, file_size, file_last_modified, storage_class, checksum) VALUES "];
+        NSMutableArray *args = [NSMutableArray arrayWithCapacity:batchCount * 10];
+        for (NSUInteger i = 0; i < batchCount; i++) {
+            Item *item = [theItems objectAtIndex:index + i];
+            [sql appendString:(i == 0 ? @"(?, ?, ?, ?, ?, ?, ?, ?, ?, ?)" : @", (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)")];
+            [args addObject:[theDirectory stringByAppendingPathComponent:item.name]];
+            [args addObject:slashedDirectory];
+            [args addObject:item.name];
+            [args addObject:(item.itemId != nil ? item.itemId : [NSNull null])];
+            [args addObject:(item.parentId != nil ? item.parentId : [NSNull null])];
+            [args addObject:[NSNumber numberWithInt:(item.isDirectory ? 1 : 0)]];
+            [args addObject:[NSNumber numberWithUnsignedLongLong:item.fileSize]];
+            [args addObject:(item.fileLastModified != nil ? [NSNumber numberWithDouble:[item.fileLastModified timeIntervalSince1970]] : [NSNull null])];
+            [args addObject:(item.storageClass != nil ? item.storageClass : [NSNull null])];
+            [args addObject:(item.checksum != nil ? item.checksum : [NSNull null])];
+        }
+        if (![db executeUpdate:sql withArgumentsInArray:args]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db insert items: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
+        }
+        index += batchCount;
     }
     return YES;
 }
 - (NSNumber *)isLoadedForDirectory:(NSString *)theDirectory db:(FMDatabase *)db error:(NSError **)error {
     NSNumber *ret = nil;
 
-//    HSLogDebug(@"query for count of loaded_directories for %@", theDirectory);
-//    NSTimeInterval theTime = [NSDate timeIntervalSinceReferenceDate];
     FMResultSet *rs = [db executeQuery:@"SELECT COUNT(*) AS COUNT FROM loaded_directories WHERE path = ?" withArgumentsInArray:[NSArray arrayWithObject:theDirectory]];
-//    HSLogDebug(@"query for count of loaded_directories for %@ took %0.2f seconds", theDirectory, ([NSDate timeIntervalSinceReferenceDate] - theTime));
     if (rs == nil) {
         SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db select items: error=%@, db=%@", [db lastErrorMessage], dbPath);
         return nil;
@@ -761,150 +697,153 @@
     return ret;
 }
 
-- (FMDatabaseQueue *)setupDB:(NSError **)error {
+- (BOOL)setupDB:(NSError **)error {
     if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:dbPath targetUID:[[CacheOwnership sharedCacheOwnership] uid] targetGID:[[CacheOwnership sharedCacheOwnership] gid] error:error]) {
-        return nil;
+        return NO;
+    }
+
+    FMDatabase *db = [self database:error];
+    if (db == nil) {
+        return NO;
+    }
+    if (chmod([dbPath fileSystemRepresentation], S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH) < 0) {
+        int errnum = errno;
+        HSLogError(@"chmod(%@) error %d: %s", dbPath, errnum, strerror(errnum));
+    }
+    if (chown([dbPath fileSystemRepresentation], [[CacheOwnership sharedCacheOwnership] uid], [[CacheOwnership sharedCacheOwnership] gid]) == -1) {
+        int errnum = errno;
+        SETNSERROR(@"UnixErrorDomain", errnum, @"chown(%@, %d, %d): %s", dbPath, [[CacheOwnership sharedCacheOwnership] uid], [[CacheOwnership sharedCacheOwnership] gid], strerror(errnum));
+        return NO;
+    }
+
+    // WAL lets readers in this and other processes proceed while one connection writes; SQLite's own locking
+    // replaces the lock file we used to take around every call. The -wal and -shm files get the db file's permissions.
+    FMResultSet *rs = [db executeQuery:@"PRAGMA journal_mode = WAL"];
+    if (rs == nil) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db set journal_mode: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    NSString *journalMode = [rs next] ? [rs stringForColumnIndex:0] : nil;
+    [rs close];
+    if (![[journalMode lowercaseString] isEqualToString:@"wal"]) {
+        HSLogWarn(@"items cache database %@ is using journal mode %@ instead of WAL", dbPath, journalMode);
     }
 
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
+    if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS loaded_directories (path TEXT NOT NULL PRIMARY KEY)"]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS items (path TEXT NOT NULL PRIMARY KEY, slashed_directory TEXT NOT NULL, name TEXT NOT NULL, item_id TEXT, parent_id TEXT, is_directory INT, file_size INTEGER, file_last_modified REAL, storage_class TEXT, checksum TEXT)"]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
 
-    FMDatabaseQueue *dbq = [FMDatabaseQueue databaseQueueWithPath:dbPath];
-    [dbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (chmod([dbPath fileSystemRepresentation], S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH) < 0) {
-            int errnum = errno;
-            HSLogError(@"chmod(%@) error %d: %s", dbPath, errnum, strerror(errnum));
+    if (![db columnExists:@"checksum" inTableWithName:@"items"]) {
+        // Update database schema and delete the data.
+        if (![db executeUpdate:@"ALTER TABLE items ADD COLUMN checksum TEXT"]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db alter table: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
         }
-        if (chown([dbPath fileSystemRepresentation], [[CacheOwnership sharedCacheOwnership] uid], [[CacheOwnership sharedCacheOwnership] gid]) == -1) {
-            int errnum = errno;
-            SETNSERROR(@"UnixErrorDomain", errnum, @"chown(%@, %d, %d): %s", dbPath, [[CacheOwnership sharedCacheOwnership] uid], [[CacheOwnership sharedCacheOwnership] gid], strerror(errnum));
-            return;
+        if (![db beginTransaction]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db begin transaction: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
         }
-        if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS loaded_directories (path TEXT NOT NULL PRIMARY KEY)"]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
+        BOOL innerRet = [db executeUpdate:@"DELETE FROM items"]
+        && [db executeUpdate:@"DELETE FROM loaded_directories"];
+        if (innerRet) {
+            [db commit];
+        } else {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db delete: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            [db rollback];
+            return NO;
         }
-        if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS items (path TEXT NOT NULL PRIMARY KEY, slashed_directory TEXT NOT NULL, name TEXT NOT NULL, item_id TEXT, parent_id TEXT, is_directory INT, file_size INTEGER, file_last_modified REAL, storage_class TEXT, checksum TEXT)"]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
+    }
+
+    if (![db columnExists:@"refcount" inTableWithName:@"items"]) {
+        if (![db executeUpdate:@"ALTER TABLE items ADD COLUMN refcount INTEGER NOT NULL DEFAULT 0"]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db alter table: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
         }
-        [db setShouldCacheStatements:YES];
+    }
 
-        if (![db columnExists:@"checksum" inTableWithName:@"items"]) {
-            // Update database schema and delete the data.
-            if (![db executeUpdate:@"ALTER TABLE items ADD COLUMN checksum TEXT"]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db alter table: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
-            if (![db beginTransaction]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db begin transaction: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
-            BOOL innerRet = [db executeUpdate:@"DELETE FROM items"]
-            && [db executeUpdate:@"DELETE FROM loaded_directories"];
-            if (innerRet) {
-                [db commit];
+    if ([self schemaVersionWithDB:db] == 0) {
+        if (![db executeUpdate:@"CREATE INDEX items_slashed_directory ON items (slashed_directory)"]) {
+            NSString *msg = [db lastErrorMessage];
+            if ([msg rangeOfString:@"already exists"].location != NSNotFound) {
+                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_slashed_directory: error=%@, db=%@", [db lastErrorMessage], dbPath);
+                return NO;
             } else {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db delete: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                [db rollback];
-                return;
+                HSLogDebug(@"db create index items_slashed_directory: %@", msg);
             }
         }
-
-        if (![db columnExists:@"refcount" inTableWithName:@"items"]) {
-            if (![db executeUpdate:@"ALTER TABLE items ADD COLUMN refcount INTEGER NOT NULL DEFAULT 0"]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db alter table: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
+        if (![self setSchemaVersion:1 db:db error:error]) {
+            return NO;
         }
-
-        if ([self schemaVersion] == 0) {
-            if (![db executeUpdate:@"CREATE INDEX items_slashed_directory ON items (slashed_directory)"]) {
-                NSString *msg = [db lastErrorMessage];
-                if ([msg rangeOfString:@"already exists"].location != NSNotFound) {
-                    SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_slashed_directory: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                    return;
-                } else {
-                    HSLogDebug(@"db create index items_slashed_directory: %@", msg);
-                }
-            }
-            if (![self setSchemaVersion:1 error:&blockError]) {
-                return;
-            }
+    }
+    if ([self schemaVersionWithDB:db] == 1) {
+        if (![db executeUpdate:@"CREATE INDEX items_is_directory ON items (is_directory)"]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_is_directory: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
         }
-        if ([self schemaVersion] == 1) {
-            if (![db executeUpdate:@"CREATE INDEX items_is_directory ON items (is_directory)"]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_is_directory: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
-            if (![self setSchemaVersion:2 error:&blockError]) {
-                return;
-            }
+        if (![self setSchemaVersion:2 db:db error:error]) {
+            return NO;
         }
-        if ([self schemaVersion] == 2) {
-            if (![db executeUpdate:@"CREATE INDEX items_refcount ON items (refcount)"]) {
-                SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_refcount: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
-            if (![self setSchemaVersion:3 error:&blockError]) {
-                return;
-            }
+    }
+    if ([self schemaVersionWithDB:db] == 2) {
+        if (![db executeUpdate:@"CREATE INDEX items_refcount ON items (refcount)"]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_refcount: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
+        }
+        if (![self setSchemaVersion:3 db:db error:error]) {
+            return NO;
         }
-        ret = YES;
-    }];
-    if (!ret) {
-        if (error != NULL) *error = blockError;
-        return nil;
     }
-    return dbq;
+    if ([self schemaVersionWithDB:db] == 3) {
+        // Subtree aggregates range-scan this index. It also covers SUM(file_size), so that query never touches the table.
+        if (![db executeUpdate:@"CREATE INDEX items_subtree ON items (slashed_directory, refcount, is_directory, file_size)"]) {
+            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db create index items_subtree: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return NO;
+        }
+        if (![self setSchemaVersion:4 db:db error:error]) {
+            return NO;
+        }
+    }
+    return YES;
 }
 
-- (int)schemaVersion {
-    __block int ret = 0;
-
-    FMDatabaseQueue *dbq = [FMDatabaseQueue databaseQueueWithPath:dbPath];
-    [dbq inDatabase:^(FMDatabase *db) {
-        if (![db tableExists:@"items_schema"]) {
-            if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS items_schema (version INTEGER NOT NULL PRIMARY KEY)"]) {
-                HSLogError(@"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
+- (int)schemaVersionWithDB:(FMDatabase *)db {
+    if (![db tableExists:@"items_schema"]) {
+        if (![db executeUpdate:@"CREATE TABLE IF NOT EXISTS items_schema (version INTEGER NOT NULL PRIMARY KEY)"]) {
+            HSLogError(@"db create table: error=%@, db=%@", [db lastErrorMessage], dbPath);
+            return 0;
         }
+    }
 
-        FMResultSet *rs = [db executeQuery:@"SELECT version FROM items_schema" withArgumentsInArray:[NSArray array]];
-        if (rs == nil) {
-            HSLogError(@"db select version: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        if (![rs next]) {
-            if (![db executeUpdate:@"INSERT INTO items_schema VALUES (0)"]) {
-                HSLogError(@"db insert into items_schema: error=%@, db=%@", [db lastErrorMessage], dbPath);
-                return;
-            }
-        } else {
-            ret = [rs intForColumn:@"version"];
-        }
+    int ret = 0;
+    FMResultSet *rs = [db executeQuery:@"SELECT version FROM items_schema" withArgumentsInArray:[NSArray array]];
+    if (rs == nil) {
+        HSLogError(@"db select version: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return 0;
+    }
+    if (![rs next]) {
         [rs close];
-    }];
+        if (![db executeUpdate:@"INSERT INTO items_schema VALUES (0)"]) {
+            HSLogError(@"db insert into items_schema: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        }
+        return 0;
+    }
+    ret = [rs intForColumn:@"version"];
+    [rs close];
     return ret;
 }
-- (BOOL)setSchemaVersion:(int)theSchemaVersion error:(NSError **)error {
-    int currentVersion = [self schemaVersion]; // This creates the table too, if necessary.
+- (BOOL)setSchemaVersion:(int)theSchemaVersion db:(FMDatabase *)db error:(NSError **)error {
+    int currentVersion = [self schemaVersionWithDB:db]; // This creates the table too, if necessary.
     HSLogDebug(@"updating items schema version from %d to %d", currentVersion, theSchemaVersion);
 
-    __block BOOL ret = NO;
-    __block NSError *blockError = nil;
-    FMDatabaseQueue *dbq = [FMDatabaseQueue databaseQueueWithPath:dbPath];
-    [dbq inDatabase:^(FMDatabase *db) {
-        NSError * __strong *error = &blockError;
-        if (![db executeUpdate:@"UPDATE items_schema SET version = ?" withArgumentsInArray:[NSArray arrayWithObject:[NSNumber numberWithInt:theSchemaVersion]]]) {
-            SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db update items_schema: error=%@, db=%@", [db lastErrorMessage], dbPath);
-            return;
-        }
-        ret = YES;
-    }];
-    if (error != NULL) *error = blockError;
-    return ret;
+    if (![db executeUpdate:@"UPDATE items_schema SET version = ?" withArgumentsInArray:[NSArray arrayWithObject:[NSNumber numberWithInt:theSchemaVersion]]]) {
+        SETNSERROR([ItemsDB errorDomain], [db lastErrorCode], @"db update items_schema: error=%@, db=%@", [db lastErrorMessage], dbPath);
+        return NO;
+    }
+    return YES;
 }
 @end
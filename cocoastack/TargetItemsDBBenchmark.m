@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "TargetItemsDBBenchmark.h"
+#import "TargetItemsDB.h"
+#import "Item.h"
+#import "NSString_extra.h"
+
+
+#define BENCHMARK_DIRECTORY_COUNT (256)
+#define REFERENCED_EVERY_NTH_FILE (16)
+
+
+@implementation TargetItemsDBBenchmark
+- (id)initWithRowCount:(NSUInteger)theRowCount {
+    if (self = [super init]) {
+        rowCount = theRowCount;
+        queryResults = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+- (BOOL)run:(NSError **)error {
+    NSString *targetUUID = [@"benchmark-" stringByAppendingString:[NSString stringWithRandomUUID]];
+    TargetItemsDB *tidb = [[TargetItemsDB alloc] initWithTargetUUID:targetUUID error:error];
+    if (tidb == nil) {
+        return NO;
+    }
+    BOOL ret = [self runWithTargetItemsDB:tidb error:error];
+    NSError *myError = nil;
+    if (![tidb destroy:&myError]) {
+        HSLogError(@"failed to delete benchmark items cache: %@", myError);
+    }
+    return ret;
+}
+- (NSTimeInterval)loadTimeInterval {
+    return loadTimeInterval;
+}
+- (NSArray *)queryResults {
+    return queryResults;
+}
+
+#pragma mark internal
+- (BOOL)runWithTargetItemsDB:(TargetItemsDB *)tidb error:(NSError **)error {
+    // Same shape as an Arq 5 objects directory: 256 two-hex-digit subdirectories of SHA1-named files.
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    NSUInteger filesPerDirectory = MAX(1, rowCount / BENCHMARK_DIRECTORY_COUNT);
+    NSDate *now = [NSDate date];
+    for (NSUInteger dirIndex = 0; dirIndex < BENCHMARK_DIRECTORY_COUNT; dirIndex++) {
+        @autoreleasepool {
+            NSString *dir = [NSString stringWithFormat:@"/benchmark/objects/%02lx", (unsigned long)dirIndex];
+            NSMutableDictionary *itemsByName = [NSMutableDictionary dictionaryWithCapacity:filesPerDirectory];
+            for (NSUInteger i = 0; i < filesPerDirectory; i++) {
+                Item *item = [[Item alloc] init];
+                item.name = [NSString stringWithFormat:@"%02lx%038lx", (unsigned long)dirIndex, (unsigned long)i];
+                item.fileSize = 1024 + i;
+                item.fileLastModified = now;
+                item.checksum = @"md5:00000000000000000000000000000000";
+                [itemsByName setObject:item forKey:item.name];
+            }
+            if (![tidb setItemsByName:itemsByName inDirectory:dir error:error]) {
+                return NO;
+            }
+            for (NSUInteger i = 0; i < filesPerDirectory; i += REFERENCED_EVERY_NTH_FILE) {
+                NSString *path = [NSString stringWithFormat:@"%@/%02lx%038lx", dir, (unsigned long)dirIndex, (unsigned long)i];
+                if (![tidb setReferenceCountOfFileAtPath:path error:error]) {
+                    return NO;
+                }
+            }
+        }
+    }
+    loadTimeInterval = [NSDate timeIntervalSinceReferenceDate] - start;
+    HSLogInfo(@"loaded %lu synthetic items in %0.1f seconds", (unsigned long)(filesPerDirectory * BENCHMARK_DIRECTORY_COUNT), loadTimeInterval);
+
+    // "/benchmark/objects/8" is a string prefix of directories 80-8f but contains nothing, so it must report zero.
+    NSArray *dirs = [NSArray arrayWithObjects:@"/benchmark/objects/00", @"/benchmark/objects/8", @"/benchmark/objects", @"/benchmark", nil];
+    for (NSString *dir in dirs) {
+        NSTimeInterval queryStart = [NSDate timeIntervalSinceReferenceDate];
+        NSNumber *total = [tidb totalSizeOfReferencedFilesInDirectory:dir error:error];
+        if (total == nil) {
+            return NO;
+        }
+        [self addQuery:[NSString stringWithFormat:@"totalSizeOfReferencedFilesInDirectory %@", dir] start:queryStart result:[NSString stringWithFormat:@"%@ bytes", total]];
+
+        queryStart = [NSDate timeIntervalSinceReferenceDate];
+        NSArray *paths = [tidb pathsOfUnreferencedFilesInDirectory:dir error:error];
+        if (paths == nil) {
+            return NO;
+        }
+        [self addQuery:[NSString stringWithFormat:@"pathsOfUnreferencedFilesInDirectory %@", dir] start:queryStart result:[NSString stringWithFormat:@"%lu paths", (unsigned long)[paths count]]];
+    }
+    return YES;
+}
+- (void)addQuery:(NSString *)theQuery start:(NSTimeInterval)theStart result:(NSString *)theResult {
+    NSTimeInterval seconds = [NSDate timeIntervalSinceReferenceDate] - theStart;
+    [queryResults addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                             theQuery, @"query",
+                             [NSNumber numberWithDouble:seconds], @"seconds",
+                             theResult, @"result", nil]];
+}
+@end
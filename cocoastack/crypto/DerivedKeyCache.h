@@ -0,0 +1,58 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "CWLSynthesizeSingleton.h"
+
+// Process-wide cache of password-derived keys, so PBKDF2 runs once per salt.
+// If the DerivedKeyCacheTTLSeconds default is set, entries are also kept for that long in a
+// file readable only by the current user, so later invocations skip key stretching too.
+// Entries are looked up by a salted hash of algorithm, salt, rounds and length. Nothing derived
+// from the password is stored, so callers must check a cached key against the data it unlocks
+// (e.g. the encrypted key file's HMAC) and call removeDerivedKey... if it doesn't fit.
+@interface DerivedKeyCache : NSObject {
+    NSLock *lock;
+    NSString *cacheFilePath;
+    NSTimeInterval ttl;
+    NSData *identifierSalt;
+    NSMutableDictionary *entriesByIdentifier;
+    BOOL loadedCacheFile;
+}
+CWL_DECLARE_SINGLETON_FOR_CLASS(DerivedKeyCache);
+
+- (NSData *)derivedKeyForAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds length:(NSUInteger)theLength;
+- (void)setDerivedKey:(NSData *)theDerivedKey forAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds;
+- (void)removeDerivedKeyForAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds length:(NSUInteger)theLength;
+
+// Forgets all cached keys and deletes the cache file.
+- (BOOL)purge:(NSError **)error;
+@end
@@ -0,0 +1,267 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "DerivedKeyCache.h"
+#import "HMACSHA256.h"
+#import "NSString_extra.h"
+#import "UserLibrary_Arq.h"
+#import "NSFileManager_extra.h"
+
+#define FILE_IDENTIFIER_SALT @"identifierSalt"
+#define FILE_ENTRIES @"entries"
+#define ENTRY_KEY @"key"
+#define ENTRY_EXPIRES @"expires"
+#define IDENTIFIER_SALT_LENGTH (32)
+
+
+@implementation DerivedKeyCache
+CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(DerivedKeyCache)
+
+- (id)init {
+    if (self = [super init]) {
+        lock = [[NSLock alloc] init];
+        [lock setName:@"DerivedKeyCache lock"];
+        cacheFilePath = [[UserLibrary arqUserLibraryPath] stringByAppendingPathComponent:@"derived_keys.plist"];
+        ttl = [[NSUserDefaults standardUserDefaults] doubleForKey:@"DerivedKeyCacheTTLSeconds"];
+        identifierSalt = [self randomIdentifierSalt];
+        entriesByIdentifier = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSData *)derivedKeyForAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds length:(NSUInteger)theLength {
+    NSData *ret = nil;
+    [lock lock];
+    [self loadCacheFile];
+    NSString *identifier = [self identifierForAlgorithm:theAlgorithm salt:theSalt rounds:theRounds length:theLength];
+    NSDictionary *entry = [entriesByIdentifier objectForKey:identifier];
+    if (entry != nil) {
+        NSDate *expires = [entry objectForKey:ENTRY_EXPIRES];
+        if (expires != nil && [expires compare:[NSDate date]] != NSOrderedDescending) {
+            [entriesByIdentifier removeObjectForKey:identifier];
+        } else {
+            ret = [entry objectForKey:ENTRY_KEY];
+        }
+    }
+    [lock unlock];
+    if (ret != nil) {
+        HSLogDebug(@"using cached %@ derived key", theAlgorithm);
+    }
+    return ret;
+}
+- (void)setDerivedKey:(NSData *)theDerivedKey forAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds {
+    NSMutableDictionary *entry = [NSMutableDictionary dictionaryWithObject:theDerivedKey forKey:ENTRY_KEY];
+    [lock lock];
+    [self loadCacheFile];
+    if (ttl > 0) {
+        [entry setObject:[NSDate dateWithTimeIntervalSinceNow:ttl] forKey:ENTRY_EXPIRES];
+    }
+    [entriesByIdentifier setObject:entry forKey:[self identifierForAlgorithm:theAlgorithm salt:theSalt rounds:theRounds length:[theDerivedKey length]]];
+    if (ttl > 0) {
+        NSError *myError = nil;
+        if (![self saveCacheFile:&myError]) {
+            HSLogError(@"failed to save derived key cache: %@", myError);
+        }
+    }
+    [lock unlock];
+}
+- (void)removeDerivedKeyForAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds length:(NSUInteger)theLength {
+    [lock lock];
+    [self loadCacheFile];
+    NSString *identifier = [self identifierForAlgorithm:theAlgorithm salt:theSalt rounds:theRounds length:theLength];
+    if ([entriesByIdentifier objectForKey:identifier] != nil) {
+        HSLogDebug(@"removing cached %@ derived key", theAlgorithm);
+        [entriesByIdentifier removeObjectForKey:identifier];
+        if (ttl > 0) {
+            NSError *myError = nil;
+            if (![self saveCacheFile:&myError]) {
+                HSLogError(@"failed to save derived key cache: %@", myError);
+            }
+        }
+    }
+    [lock unlock];
+}
+- (BOOL)purge:(NSError **)error {
+    BOOL ret = YES;
+    [lock lock];
+    [entriesByIdentifier removeAllObjects];
+    identifierSalt = [self randomIdentifierSalt];
+    loadedCacheFile = YES;
+    if (unlink([cacheFilePath fileSystemRepresentation]) == -1 && errno != ENOENT) {
+        int errnum = errno;
+        HSLogError(@"unlink(%@) error %d: %s", cacheFilePath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to delete %@: %s", cacheFilePath, strerror(errnum));
+        ret = NO;
+    }
+    [lock unlock];
+    return ret;
+}
+
+
+#pragma mark internal
+- (NSData *)randomIdentifierSalt {
+    NSMutableData *ret = [NSMutableData dataWithLength:IDENTIFIER_SALT_LENGTH];
+    arc4random_buf([ret mutableBytes], IDENTIFIER_SALT_LENGTH);
+    return ret;
+}
+// Must be called with lock held.
+- (NSString *)identifierForAlgorithm:(NSString *)theAlgorithm salt:(NSData *)theSalt rounds:(unsigned int)theRounds length:(NSUInteger)theLength {
+    // Salted so the cache file doesn't reveal which key files (salts) it holds keys for.
+    NSMutableData *data = [NSMutableData dataWithData:[[NSString stringWithFormat:@"%@:%u:%lu:", theAlgorithm, theRounds, (unsigned long)theLength] dataUsingEncoding:NSUTF8StringEncoding]];
+    if (theSalt != nil) {
+        [data appendData:theSalt];
+    }
+    return [NSString hexStringWithData:[HMACSHA256 digestForKey:identifierSalt data:data]];
+}
+// Must be called with lock held.
+- (void)loadCacheFile {
+    if (loadedCacheFile) {
+        return;
+    }
+    loadedCacheFile = YES;
+    if (ttl <= 0) {
+        return;
+    }
+    int fd = open([cacheFilePath fileSystemRepresentation], O_RDONLY|O_NOFOLLOW);
+    if (fd == -1) {
+        int errnum = errno;
+        if (errnum != ENOENT) {
+            HSLogWarn(@"ignoring derived key cache %@: open error %d: %s", cacheFilePath, errnum, strerror(errnum));
+        }
+        return;
+    }
+    // Only trust a file that nobody but us could have written or read.
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int errnum = errno;
+        HSLogWarn(@"ignoring derived key cache %@: fstat error %d: %s", cacheFilePath, errnum, strerror(errnum));
+        close(fd);
+        return;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 07777) != (S_IRUSR|S_IWUSR)) {
+        HSLogWarn(@"ignoring derived key cache %@: not a regular file owned by uid %d with mode 0600 (uid %d, mode %o)", cacheFilePath, getuid(), st.st_uid, st.st_mode & 07777);
+        close(fd);
+        return;
+    }
+    NSData *data = [[[NSFileHandle alloc] initWithFileDescriptor:fd closeOnDealloc:YES] readDataToEndOfFile];
+    
+    NSError *myError = nil;
+    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data options:NSPropertyListImmutable format:NULL error:&myError];
+    if (![plist isKindOfClass:[NSDictionary class]]) {
+        HSLogWarn(@"ignoring unreadable derived key cache %@: %@", cacheFilePath, myError);
+        return;
+    }
+    NSData *fileIdentifierSalt = [plist objectForKey:FILE_IDENTIFIER_SALT];
+    NSDictionary *entries = [plist objectForKey:FILE_ENTRIES];
+    if (![fileIdentifierSalt isKindOfClass:[NSData class]] || [fileIdentifierSalt length] != IDENTIFIER_SALT_LENGTH || ![entries isKindOfClass:[NSDictionary class]]) {
+        HSLogWarn(@"ignoring derived key cache %@ in an unknown format", cacheFilePath);
+        return;
+    }
+    // Nothing is cached in memory yet (every method loads the file first), so adopt the file's salt.
+    identifierSalt = fileIdentifierSalt;
+    NSDate *now = [NSDate date];
+    for (NSString *identifier in [entries allKeys]) {
+        NSDictionary *entry = [entries objectForKey:identifier];
+        NSDate *expires = [entry objectForKey:ENTRY_EXPIRES];
+        if (expires != nil && [expires compare:now] == NSOrderedDescending) {
+            [entriesByIdentifier setObject:entry forKey:identifier];
+        }
+    }
+}
+// Must be called with lock held.
+- (BOOL)saveCacheFile:(NSError **)error {
+    NSMutableDictionary *entries = [NSMutableDictionary dictionary];
+    for (NSString *identifier in [entriesByIdentifier allKeys]) {
+        NSDictionary *entry = [entriesByIdentifier objectForKey:identifier];
+        if ([entry objectForKey:ENTRY_EXPIRES] != nil) {
+            [entries setObject:entry forKey:identifier];
+        }
+    }
+    NSDictionary *plist = [NSDictionary dictionaryWithObjectsAndKeys:identifierSalt, FILE_IDENTIFIER_SALT, entries, FILE_ENTRIES, nil];
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList:plist format:NSPropertyListBinaryFormat_v1_0 options:0 error:error];
+    if (data == nil) {
+        return NO;
+    }
+    if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:cacheFilePath targetUID:getuid() targetGID:getgid() error:error]) {
+        return NO;
+    }
+    
+    // mkstemp creates a new file (O_EXCL) with a name nobody could have planted a symlink at.
+    // The file holds key material, so make sure it's owner-only before writing anything.
+    NSString *tempPathTemplate = [cacheFilePath stringByAppendingString:@".XXXXXX"];
+    char *tempPathBuf = strdup([tempPathTemplate fileSystemRepresentation]);
+    int fd = mkstemp(tempPathBuf);
+    NSString *tempPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:tempPathBuf length:strlen(tempPathBuf)];
+    free(tempPathBuf);
+    if (fd == -1) {
+        int errnum = errno;
+        HSLogError(@"mkstemp(%@) error %d: %s", tempPathTemplate, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to create temp file for %@: %s", cacheFilePath, strerror(errnum));
+        return NO;
+    }
+    if (fchmod(fd, S_IRUSR|S_IWUSR) == -1) {
+        int errnum = errno;
+        HSLogError(@"fchmod(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to set permissions on %@: %s", tempPath, strerror(errnum));
+        close(fd);
+        unlink([tempPath fileSystemRepresentation]);
+        return NO;
+    }
+    const unsigned char *bytes = (const unsigned char *)[data bytes];
+    NSUInteger written = 0;
+    while (written < [data length]) {
+        ssize_t result = write(fd, bytes + written, [data length] - written);
+        if (result == -1) {
+            int errnum = errno;
+            if (errnum == EINTR) {
+                continue;
+            }
+            HSLogError(@"write(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to write %@: %s", tempPath, strerror(errnum));
+            close(fd);
+            unlink([tempPath fileSystemRepresentation]);
+            return NO;
+        }
+        written += (NSUInteger)result;
+    }
+    close(fd);
+    if (rename([tempPath fileSystemRepresentation], [cacheFilePath fileSystemRepresentation]) == -1) {
+        int errnum = errno;
+        HSLogError(@"rename(%@, %@) error %d: %s", tempPath, cacheFilePath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to rename %@: %s", tempPath, strerror(errnum));
+        unlink([tempPath fileSystemRepresentation]);
+        return NO;
+    }
+    return YES;
+}
+@end
@@ -30,6 +30,9 @@
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+// Hex SHA-256 of zero bytes, the x-amz-content-sha256 of every request without a body.
+#define EMPTY_SHA256_HEX (@"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855")
+
 @interface SHA256Hash : NSObject {
     
 }
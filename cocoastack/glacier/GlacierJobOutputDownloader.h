@@ -0,0 +1,69 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+@class GlacierService;
+
+// Downloads the output of a completed Glacier retrieval job as concurrent byte ranges into a file.
+// Ranges are aligned to tree-hash boundaries so Glacier returns each range's tree hash;
+// every range is checked against it on arrival and only failed ranges are fetched again.
+// A range that comes back without a tree hash fails the download, as does a whole-output
+// tree hash that doesn't match the one the job reported.
+@interface GlacierJobOutputDownloader : NSObject {
+    GlacierService *glacier;
+    NSString *vaultName;
+    NSString *jobId;
+    unsigned long long length;
+    NSString *expectedTreeHash;
+    NSUInteger numThreads;
+    NSCondition *condition;
+    NSMutableArray *pendingRangeIndexes;
+    NSMutableArray *attemptsPerRange;
+    NSMutableArray *rangeTreeHashes;
+    NSUInteger threadsRunning;
+    NSError *downloadError;
+    int fd;
+    NSData *treeHash;
+}
+- (id)initWithGlacierService:(GlacierService *)theGlacier
+                   vaultName:(NSString *)theVaultName
+                       jobId:(NSString *)theJobId
+                      length:(unsigned long long)theLength
+                    treeHash:(NSString *)theExpectedTreeHash
+                  numThreads:(NSUInteger)theNumThreads;
+
+// Writes the job output to theFD with pwrite; ranges arrive in no particular order.
+- (BOOL)downloadToFileDescriptor:(int)theFD error:(NSError **)error;
+
+// The tree hash of the whole job output, available after a successful download.
+- (NSData *)treeHash;
+@end
@@ -0,0 +1,211 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "GlacierJobOutputDownloader.h"
+#import "GlacierService.h"
+#import "SHA256TreeHash.h"
+#import "NSString_extra.h"
+
+// A power-of-two number of MB, so every range is tree-hash aligned.
+#define RANGE_SIZE (16 * 1024 * 1024)
+
+#define MAX_ATTEMPTS_PER_RANGE (10)
+#define RETRY_DELAY (5.0)
+
+
+@implementation GlacierJobOutputDownloader
+- (id)initWithGlacierService:(GlacierService *)theGlacier
+                   vaultName:(NSString *)theVaultName
+                       jobId:(NSString *)theJobId
+                      length:(unsigned long long)theLength
+                    treeHash:(NSString *)theExpectedTreeHash
+                  numThreads:(NSUInteger)theNumThreads {
+    if (self = [super init]) {
+        glacier = theGlacier;
+        vaultName = theVaultName;
+        jobId = theJobId;
+        length = theLength;
+        expectedTreeHash = [theExpectedTreeHash lowercaseString];
+        numThreads = theNumThreads > 0 ? theNumThreads : 1;
+        condition = [[NSCondition alloc] init];
+        [condition setName:@"GlacierJobOutputDownloader"];
+        fd = -1;
+    }
+    return self;
+}
+
+- (BOOL)downloadToFileDescriptor:(int)theFD error:(NSError **)error {
+    fd = theFD;
+    return [self download:error];
+}
+- (NSData *)treeHash {
+    return treeHash;
+}
+
+
+#pragma mark internal
+- (BOOL)download:(NSError **)error {
+    treeHash = nil;
+    if (expectedTreeHash == nil) {
+        SETNSERROR([GlacierService errorDomain], GLACIER_ERROR_UNEXPECTED_RESPONSE, @"no tree hash for job %@ output; can't verify it", jobId);
+        return NO;
+    }
+    if (length == 0) {
+        return [self verifyTreeHash:[SHA256TreeHash treeHashOfData:[NSData data]] error:error];
+    }
+    
+    NSUInteger rangeCount = (NSUInteger)((length + RANGE_SIZE - 1) / RANGE_SIZE);
+    pendingRangeIndexes = [[NSMutableArray alloc] init];
+    attemptsPerRange = [[NSMutableArray alloc] init];
+    rangeTreeHashes = [[NSMutableArray alloc] init];
+    for (NSUInteger i = 0; i < rangeCount; i++) {
+        [pendingRangeIndexes addObject:[NSNumber numberWithUnsignedInteger:i]];
+        [attemptsPerRange addObject:[NSNumber numberWithUnsignedInteger:0]];
+        [rangeTreeHashes addObject:[NSNull null]];
+    }
+    downloadError = nil;
+    
+    NSUInteger threadCount = MIN(numThreads, rangeCount);
+    HSLogDebug(@"downloading %qu bytes of job %@ output in %lu ranges on %lu threads", length, jobId, (unsigned long)rangeCount, (unsigned long)threadCount);
+    
+    [condition lock];
+    threadsRunning = threadCount;
+    [condition unlock];
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        [NSThread detachNewThreadSelector:@selector(run) toTarget:self withObject:nil];
+    }
+    
+    [condition lock];
+    while (threadsRunning > 0) {
+        [condition wait];
+    }
+    NSError *myError = downloadError;
+    [condition unlock];
+    
+    if (myError != nil) {
+        SETERRORFROMMYERROR;
+        return NO;
+    }
+    return [self verifyTreeHash:[SHA256TreeHash treeHashOfSubtreeHashes:rangeTreeHashes] error:error];
+}
+- (BOOL)verifyTreeHash:(NSData *)theTreeHash error:(NSError **)error {
+    if (![[NSString hexStringWithData:theTreeHash] isEqualToString:expectedTreeHash]) {
+        SETNSERROR([GlacierService errorDomain], GLACIER_ERROR_UNEXPECTED_RESPONSE, @"tree hash of job %@ output is %@; expected %@",
+                   jobId, [NSString hexStringWithData:theTreeHash], expectedTreeHash);
+        return NO;
+    }
+    treeHash = theTreeHash;
+    return YES;
+}
+- (void)run {
+    for (;;) {
+        [condition lock];
+        if (downloadError != nil || [pendingRangeIndexes count] == 0) {
+            threadsRunning--;
+            [condition broadcast];
+            [condition unlock];
+            break;
+        }
+        NSUInteger rangeIndex = [[pendingRangeIndexes objectAtIndex:0] unsignedIntegerValue];
+        [pendingRangeIndexes removeObjectAtIndex:0];
+        NSUInteger attempts = [[attemptsPerRange objectAtIndex:rangeIndex] unsignedIntegerValue] + 1;
+        [attemptsPerRange replaceObjectAtIndex:rangeIndex withObject:[NSNumber numberWithUnsignedInteger:attempts]];
+        [condition unlock];
+        
+        unsigned long long offset = (unsigned long long)rangeIndex * RANGE_SIZE;
+        NSRange range = NSMakeRange((NSUInteger)offset, (NSUInteger)MIN((unsigned long long)RANGE_SIZE, length - offset));
+        NSError *myError = nil;
+        BOOL retryable = YES;
+        NSData *rangeTreeHash = nil;
+        @autoreleasepool {
+            rangeTreeHash = [self downloadRange:range retryable:&retryable error:&myError];
+        }
+        
+        [condition lock];
+        if (rangeTreeHash != nil) {
+            [rangeTreeHashes replaceObjectAtIndex:rangeIndex withObject:rangeTreeHash];
+        } else if (retryable && attempts < MAX_ATTEMPTS_PER_RANGE) {
+            HSLogError(@"failed to get bytes %lu-%lu of %@ job %@ output (retrying): %@",
+                       (unsigned long)range.location, (unsigned long)(range.location + range.length - 1), vaultName, jobId, [myError localizedDescription]);
+            [pendingRangeIndexes addObject:[NSNumber numberWithUnsignedInteger:rangeIndex]];
+        } else if (downloadError == nil) {
+            downloadError = myError;
+        }
+        [condition broadcast];
+        [condition unlock];
+        
+        if (rangeTreeHash == nil && retryable) {
+            [NSThread sleepForTimeInterval:RETRY_DELAY];
+        }
+    }
+}
+- (NSData *)downloadRange:(NSRange)theRange retryable:(BOOL *)retryable error:(NSError **)error {
+    *retryable = YES;
+    NSString *rangeTreeHash = nil;
+    NSData *data = [glacier dataForVaultName:vaultName jobId:jobId range:theRange treeHash:&rangeTreeHash error:error];
+    if (data == nil) {
+        return nil;
+    }
+    if (rangeTreeHash == nil) {
+        // Every range is tree-hash aligned, so Glacier should always send one.
+        SETNSERROR([GlacierService errorDomain], GLACIER_ERROR_UNEXPECTED_RESPONSE, @"no x-amz-sha256-tree-hash for bytes %lu-%lu of job %@ output",
+                   (unsigned long)theRange.location, (unsigned long)(theRange.location + theRange.length - 1), jobId);
+        *retryable = NO;
+        return nil;
+    }
+    NSData *ret = [SHA256TreeHash treeHashOfData:data];
+    if (![[NSString hexStringWithData:ret] isEqualToString:[rangeTreeHash lowercaseString]]) {
+        SETNSERROR([GlacierService errorDomain], GLACIER_ERROR_UNEXPECTED_RESPONSE, @"tree hash mismatch for bytes %lu-%lu of job %@ output",
+                   (unsigned long)theRange.location, (unsigned long)(theRange.location + theRange.length - 1), jobId);
+        return nil;
+    }
+    
+    const unsigned char *bytes = (const unsigned char *)[data bytes];
+    NSUInteger written = 0;
+    while (written < [data length]) {
+        ssize_t result = pwrite(fd, bytes + written, [data length] - written, (off_t)(theRange.location + written));
+        if (result == -1) {
+            int errnum = errno;
+            if (errnum == EINTR) {
+                continue;
+            }
+            HSLogError(@"pwrite(%lu bytes at %lu) error %d: %s", (unsigned long)([data length] - written), (unsigned long)(theRange.location + written), errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to write job output: %s", strerror(errnum));
+            *retryable = NO;
+            return nil;
+        }
+        written += (NSUInteger)result;
+    }
+    return ret;
+}
+@end
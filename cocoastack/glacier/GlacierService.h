@@ -62,4 +62,8 @@ enum {
 - (NSString *)initiateInventoryJobForVaultName:(NSString *)theVaultName snsTopicArn:(NSString *)theSNSTopicArn error:(NSError **)error;
 - (NSArray *)jobsForVaultName:(NSString *)theVaultName error:(NSError **)error;
 - (NSData *)dataForVaultName:(NSString *)theVaultName jobId:(NSString *)theJobId retries:(NSUInteger)theRetries error:(NSError **)error;
+
+// Fetches one byte range of the job output. If the range is tree-hash aligned, Glacier returns
+// the range's SHA256 tree hash (hex) in theTreeHash; otherwise theTreeHash is set to nil.
+- (NSData *)dataForVaultName:(NSString *)theVaultName jobId:(NSString *)theJobId range:(NSRange)theRange treeHash:(NSString **)theTreeHash error:(NSError **)error;
 @end
@@ -251,5 +251,25 @@
     }
     return ret;
 }
+- (NSData *)dataForVaultName:(NSString *)theVaultName jobId:(NSString *)theJobId range:(NSRange)theRange treeHash:(NSString **)theTreeHash error:(NSError **)error {
+    NSURL *theURL =[NSURL URLWithString:[NSString stringWithFormat:@"%@/-/vaults/%@/jobs/%@/output", [awsRegion glacierEndpointWithSSL:useSSL], theVaultName, theJobId]];
+    GlacierRequest *req = [[GlacierRequest alloc] initWithMethod:@"GET" url:theURL awsRegion:awsRegion authorizationProvider:gap retryOnTransientError:retryOnTransientError dataTransferDelegate:nil];
+    [req setHeader:@"2012-06-01" forKey:@"x-amz-glacier-version"];
+    [req setHeader:[NSString stringWithFormat:@"bytes=%lu-%lu", (unsigned long)theRange.location, (unsigned long)(theRange.location + theRange.length - 1)] forKey:@"Range"];
+    GlacierResponse *response = [req execute:error];
+    if (response == nil) {
+        return nil;
+    }
+    NSData *ret = [response body];
+    if ([ret length] != theRange.length) {
+        SETNSERROR([GlacierService errorDomain], GLACIER_ERROR_UNEXPECTED_RESPONSE, @"requested %lu bytes at offset %lu of job %@ output but got %lu bytes",
+                   (unsigned long)theRange.length, (unsigned long)theRange.location, theJobId, (unsigned long)[ret length]);
+        return nil;
+    }
+    if (theTreeHash != NULL) {
+        *theTreeHash = [response headerForKey:@"x-amz-sha256-tree-hash"];
+    }
+    return ret;
+}
 
 @end
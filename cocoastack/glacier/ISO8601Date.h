@@ -33,14 +33,14 @@
 #import "CWLSynthesizeSingleton.h"
 
 @interface ISO8601Date : NSObject {
-    NSDateFormatter *dateFormatter;
-    NSDateFormatter *dateTimeFormatter;
     NSLock *lock;
 }
 CWL_DECLARE_SINGLETON_FOR_CLASS(ISO8601Date)
 
 - (NSString *)errorDomain;
 - (NSDate *)dateFromString:(NSString *)str error:(NSError **)error;
+
+// These use a formatter owned by the calling thread, so they never wait on each other.
 - (NSString *)basicDateTimeStringFromDate:(NSDate *)theDate;
 - (NSString *)basicDateStringFromDate:(NSDate *)theDate;
 @end
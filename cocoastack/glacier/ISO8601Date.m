@@ -38,8 +38,6 @@ CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(ISO8601Date)
 
 - (id)init {
     if (self = [super init]) {
-        dateFormatter = [self newDateFormatterWithFormat:@"yyyyMMdd"];
-        dateTimeFormatter = [self newDateFormatterWithFormat:@"yyyyMMdd'T'HHmmss'Z'"];
         lock = [[NSLock alloc] init];
     }
     return self;
@@ -69,26 +67,23 @@ CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(ISO8601Date)
                                timeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
 }
 - (NSString *)basicDateTimeStringFromDate:(NSDate *)theDate {
-    [lock lock];
-    NSString *ret = [self lockedBasicDateTimeStringFromDate:theDate];
-    [lock unlock];
-    return ret;
+    return [[self threadDateFormatterWithFormat:@"yyyyMMdd'T'HHmmss'Z'"] stringFromDate:theDate];
 }
-- (NSString *)lockedBasicDateTimeStringFromDate:(NSDate *)theDate {
-    return [dateTimeFormatter stringFromDate:theDate];
-}
-
 - (NSString *)basicDateStringFromDate:(NSDate *)theDate {
-    [lock lock];
-    NSString *ret = [self lockedBasicDateStringFromDate:theDate];
-    [lock unlock];
-    return ret;
-}
-- (NSString *)lockedBasicDateStringFromDate:(NSDate *)theDate {
-    return [dateFormatter stringFromDate:theDate];
+    return [[self threadDateFormatterWithFormat:@"yyyyMMdd"] stringFromDate:theDate];
 }
 
 #pragma mark internal
+- (NSDateFormatter *)threadDateFormatterWithFormat:(NSString *)theFormat {
+    // NSDateFormatter isn't thread-safe, and S3 request signing formats dates on every transfer thread.
+    NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
+    NSDateFormatter *ret = [threadDictionary objectForKey:theFormat];
+    if (ret == nil) {
+        ret = [self newDateFormatterWithFormat:theFormat];
+        [threadDictionary setObject:ret forKey:theFormat];
+    }
+    return ret;
+}
 - (NSDateFormatter *)newDateFormatterWithFormat:(NSString *)theFormat {
     NSDateFormatter *ret = [[NSDateFormatter alloc] init];
     [ret setDateFormat:theFormat];
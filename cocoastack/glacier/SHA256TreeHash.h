@@ -32,4 +32,9 @@
 
 @interface SHA256TreeHash : NSObject
 + (NSData *)treeHashOfData:(NSData *)data;
++ (NSData *)treeHashOfBytes:(const unsigned char *)bytes length:(NSUInteger)length;
+
+// Combines the tree hashes of consecutive, equal-sized, tree-hash-aligned ranges
+// (each a power-of-two number of MB, except possibly the last) into the tree hash of the whole.
++ (NSData *)treeHashOfSubtreeHashes:(NSArray *)theHashes;
 @end
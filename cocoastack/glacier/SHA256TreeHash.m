@@ -38,14 +38,15 @@
 
 @implementation SHA256TreeHash
 + (NSData *)treeHashOfData:(NSData *)data {
-    if ([data length] == 0) {
-        return [SHA256Hash hashData:data];
+    return [SHA256TreeHash treeHashOfBytes:(const unsigned char *)[data bytes] length:[data length]];
+}
++ (NSData *)treeHashOfBytes:(const unsigned char *)bytes length:(NSUInteger)length {
+    if (length == 0) {
+        return [SHA256Hash hashBytes:bytes length:0];
     }
     
     NSMutableArray *hashes = [NSMutableArray array];
     
-    const unsigned char *bytes = (const unsigned char *)[data bytes];
-    NSUInteger length = [data length];
     NSUInteger index = 0;
     while (index < length) {
         NSUInteger toRead = (index + ONE_MB) > length ? (length - index) : ONE_MB;
@@ -53,7 +54,10 @@
         [hashes addObject:hash];
         index += toRead;
     }
-    
+    return [SHA256TreeHash treeHashOfSubtreeHashes:hashes];
+}
++ (NSData *)treeHashOfSubtreeHashes:(NSArray *)theHashes {
+    NSMutableArray *hashes = [NSMutableArray arrayWithArray:theHashes];
     while ([hashes count] > 1) {
         NSMutableArray *condensed = [NSMutableArray array];
         for (NSUInteger index = 0; index < [hashes count] / 2; index++) {
@@ -33,6 +33,7 @@
 #define ARQ_HTTP_1_1 @"1.1"
 #define ARQ_HTTP_OK (200)
 #define ARQ_HTTP_NO_CONTENT (204)
+#define ARQ_HTTP_NOT_MODIFIED (304)
 #define ARQ_HTTP_INTERNAL_SERVER_ERROR (500)
 #define ARQ_HTTP_FORBIDDEN (403)
 #define ARQ_HTTP_BAD_REQUEST (400)
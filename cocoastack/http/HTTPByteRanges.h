@@ -0,0 +1,53 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Builds multi-range Range headers and splits the reply back into one buffer per requested range.
+// Servers may answer a multi-range request with a multipart/byteranges body (possibly merging
+// adjacent ranges into one part), a single 206 range covering everything asked for, or a 200
+// with the whole entity; all three are handled.
+@interface HTTPByteRanges : NSObject {
+}
++ (NSString *)errorDomain;
+
+// theRanges is an array of NSValue-wrapped NSRanges; returns e.g. "bytes=0-99,4096-8191".
+// Empty ranges can't be expressed in a Range header and are left out; returns nil if every range is empty.
++ (NSString *)rangeHeaderValueForRanges:(NSArray *)theRanges;
+
+// Returns an NSData for each of theRanges, in the same order. Empty ranges get empty NSData.
++ (NSArray *)dataForRanges:(NSArray *)theRanges
+              responseCode:(int)theResponseCode
+               contentType:(NSString *)theContentType
+              contentRange:(NSString *)theContentRange
+                      body:(NSData *)theBody
+                     error:(NSError **)error;
+@end
@@ -0,0 +1,228 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "HTTPByteRanges.h"
+#import "SetNSError.h"
+
+
+@interface HTTPByteRangesPart : NSObject {
+    unsigned long long offset;
+    NSData *data;
+}
+- (id)initWithOffset:(unsigned long long)theOffset data:(NSData *)theData;
+- (unsigned long long)offset;
+- (NSData *)data;
+@end
+
+@implementation HTTPByteRangesPart
+- (id)initWithOffset:(unsigned long long)theOffset data:(NSData *)theData {
+    if (self = [super init]) {
+        offset = theOffset;
+        data = theData;
+    }
+    return self;
+}
+- (unsigned long long)offset {
+    return offset;
+}
+- (NSData *)data {
+    return data;
+}
+@end
+
+
+@interface HTTPByteRanges (internal)
++ (BOOL)parseContentRange:(NSString *)theContentRange start:(unsigned long long *)theStart length:(unsigned long long *)theLength error:(NSError **)error;
++ (NSString *)boundaryForContentType:(NSString *)theContentType;
++ (NSArray *)partsForMultipartBody:(NSData *)theBody contentType:(NSString *)theContentType error:(NSError **)error;
+@end
+
+@implementation HTTPByteRanges
++ (NSString *)errorDomain {
+    return @"HTTPByteRangesErrorDomain";
+}
++ (NSString *)rangeHeaderValueForRanges:(NSArray *)theRanges {
+    NSMutableString *ret = [NSMutableString stringWithString:@"bytes="];
+    BOOL needComma = NO;
+    for (NSValue *value in theRanges) {
+        NSRange range = [value rangeValue];
+        if (range.length == 0) {
+            continue;
+        }
+        if (needComma) {
+            [ret appendString:@","];
+        }
+        needComma = YES;
+        [ret appendFormat:@"%lu-%lu", (unsigned long)range.location, (unsigned long)(range.location + range.length - 1)];
+    }
+    if (!needComma) {
+        return nil;
+    }
+    return ret;
+}
++ (NSArray *)dataForRanges:(NSArray *)theRanges
+              responseCode:(int)theResponseCode
+               contentType:(NSString *)theContentType
+              contentRange:(NSString *)theContentRange
+                      body:(NSData *)theBody
+                     error:(NSError **)error {
+    NSArray *parts = nil;
+    if (theResponseCode == 200) {
+        // Server ignored the Range header and sent the whole thing.
+        parts = [NSArray arrayWithObject:[[HTTPByteRangesPart alloc] initWithOffset:0 data:theBody]];
+    } else if (theResponseCode == 206 && [[theContentType lowercaseString] hasPrefix:@"multipart/byteranges"]) {
+        parts = [HTTPByteRanges partsForMultipartBody:theBody contentType:theContentType error:error];
+    } else if (theResponseCode == 206) {
+        unsigned long long start = 0;
+        unsigned long long length = 0;
+        if (![HTTPByteRanges parseContentRange:theContentRange start:&start length:&length error:error]) {
+            return nil;
+        }
+        if (length != [theBody length]) {
+            SETNSERROR([HTTPByteRanges errorDomain], -1, @"Content-Range %@ doesn't match body length %lu", theContentRange, (unsigned long)[theBody length]);
+            return nil;
+        }
+        parts = [NSArray arrayWithObject:[[HTTPByteRangesPart alloc] initWithOffset:start data:theBody]];
+    } else {
+        SETNSERROR([HTTPByteRanges errorDomain], -1, @"unexpected HTTP status %d for range request", theResponseCode);
+        return nil;
+    }
+    if (parts == nil) {
+        return nil;
+    }
+    
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:[theRanges count]];
+    for (NSValue *value in theRanges) {
+        NSRange range = [value rangeValue];
+        if (range.length == 0) {
+            [ret addObject:[NSData data]];
+            continue;
+        }
+        NSData *rangeData = nil;
+        for (HTTPByteRangesPart *part in parts) {
+            if (range.location >= [part offset] && (unsigned long long)range.location + range.length <= [part offset] + [[part data] length]) {
+                rangeData = [[part data] subdataWithRange:NSMakeRange((NSUInteger)(range.location - [part offset]), range.length)];
+                break;
+            }
+        }
+        if (rangeData == nil) {
+            SETNSERROR([HTTPByteRanges errorDomain], -1, @"response doesn't contain requested range %lu-%lu", (unsigned long)range.location, (unsigned long)(range.location + range.length - 1));
+            return nil;
+        }
+        [ret addObject:rangeData];
+    }
+    return ret;
+}
+
+#pragma mark internal
++ (BOOL)parseContentRange:(NSString *)theContentRange start:(unsigned long long *)theStart length:(unsigned long long *)theLength error:(NSError **)error {
+    // "bytes 100-199/1000" (the total may be "*")
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+    NSString *trimmed = [theContentRange stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if (trimmed == nil || sscanf([trimmed UTF8String], "bytes %llu-%llu", &first, &last) != 2 || last < first) {
+        SETNSERROR([HTTPByteRanges errorDomain], -1, @"invalid Content-Range '%@'", theContentRange);
+        return NO;
+    }
+    *theStart = first;
+    *theLength = last - first + 1;
+    return YES;
+}
++ (NSString *)boundaryForContentType:(NSString *)theContentType {
+    for (NSString *param in [theContentType componentsSeparatedByString:@";"]) {
+        NSString *trimmed = [param stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        if ([[trimmed lowercaseString] hasPrefix:@"boundary="]) {
+            NSString *boundary = [trimmed substringFromIndex:9];
+            if ([boundary length] >= 2 && [boundary hasPrefix:@"\""] && [boundary hasSuffix:@"\""]) {
+                boundary = [boundary substringWithRange:NSMakeRange(1, [boundary length] - 2)];
+            }
+            return boundary;
+        }
+    }
+    return nil;
+}
++ (NSArray *)partsForMultipartBody:(NSData *)theBody contentType:(NSString *)theContentType error:(NSError **)error {
+    NSString *boundary = [HTTPByteRanges boundaryForContentType:theContentType];
+    if ([boundary length] == 0) {
+        SETNSERROR([HTTPByteRanges errorDomain], -1, @"no boundary in Content-Type '%@'", theContentType);
+        return nil;
+    }
+    NSData *delimiter = [[@"--" stringByAppendingString:boundary] dataUsingEncoding:NSUTF8StringEncoding];
+    const char *bytes = (const char *)[theBody bytes];
+    size_t length = [theBody length];
+    
+    NSMutableArray *ret = [NSMutableArray array];
+    size_t pos = 0;
+    for (;;) {
+        // Find the next delimiter line.
+        const char *found = memmem(bytes + pos, length - pos, [delimiter bytes], [delimiter length]);
+        if (found == NULL) {
+            SETNSERROR([HTTPByteRanges errorDomain], -1, @"multipart/byteranges body ends without a closing delimiter");
+            return nil;
+        }
+        pos = (size_t)(found - bytes) + [delimiter length];
+        if (length - pos >= 2 && bytes[pos] == '-' && bytes[pos + 1] == '-') {
+            // Closing delimiter.
+            break;
+        }
+        
+        // Part headers run to the first blank line.
+        const char *headersEnd = memmem(bytes + pos, length - pos, "\r\n\r\n", 4);
+        if (headersEnd == NULL) {
+            SETNSERROR([HTTPByteRanges errorDomain], -1, @"truncated multipart/byteranges part headers");
+            return nil;
+        }
+        NSString *headers = [[NSString alloc] initWithBytes:(bytes + pos) length:(NSUInteger)(headersEnd - (bytes + pos)) encoding:NSISOLatin1StringEncoding];
+        NSString *contentRange = nil;
+        for (NSString *line in [headers componentsSeparatedByString:@"\r\n"]) {
+            NSRange colon = [line rangeOfString:@":"];
+            if (colon.location != NSNotFound && [[[line substringToIndex:colon.location] lowercaseString] isEqualToString:@"content-range"]) {
+                contentRange = [line substringFromIndex:(colon.location + 1)];
+            }
+        }
+        unsigned long long start = 0;
+        unsigned long long partLength = 0;
+        if (![HTTPByteRanges parseContentRange:contentRange start:&start length:&partLength error:error]) {
+            return nil;
+        }
+        size_t dataStart = (size_t)(headersEnd - bytes) + 4;
+        if (partLength > length - dataStart) {
+            SETNSERROR([HTTPByteRanges errorDomain], -1, @"multipart/byteranges part %@ is truncated", contentRange);
+            return nil;
+        }
+        [ret addObject:[[HTTPByteRangesPart alloc] initWithOffset:start data:[theBody subdataWithRange:NSMakeRange(dataStart, (NSUInteger)partLength)]]];
+        pos = dataStart + (size_t)partLength;
+    }
+    return ret;
+}
+@end
@@ -48,6 +48,13 @@
 - (NSString *)requestHeaderForKey:(NSString *)theKey;
 - (NSData *)executeRequest:(NSError **)error;
 - (NSData *)executeRequestWithBody:(NSData *)theBody error:(NSError **)error;
+
+// Makes a request that's running on another thread (or that hasn't started yet) fail with ERROR_ABORT_REQUESTED.
+// The data transfer delegate gets no more messages once this returns.
+- (void)cancel;
+
+// When the response headers arrived, in seconds since the reference date; 0 until then.
+- (NSTimeInterval)responseStartTime;
 - (int)responseCode;
 - (NSDictionary *)responseHeaders;
 - (NSString *)responseHeaderForKey:(NSString *)key;
@@ -37,10 +37,14 @@
 //    NSTimeInterval maxConnectionLifetime;
 //    NSLock *lock;
 //    NSMutableDictionary *connectionMapsByThreadId;
+    NSTimeInterval timeoutSeconds;
 }
 
 + (HTTPConnectionFactory *)theFactory;
 - (id <HTTPConnection>)newHTTPConnectionToURL:(NSURL *)theURL
                                        method:(NSString *)theMethod
                          dataTransferDelegate:(id <DataTransferDelegate>)theDelegate;
+
+// Idle timeout given to every new connection; read once from the HTTPTimeoutSeconds default.
+- (NSTimeInterval)timeoutSeconds;
 @end
@@ -34,6 +34,8 @@
 #import "URLConnection.h"
 #import "System.h"
 
+#define DEFAULT_TIMEOUT_SECONDS (90)
+
 static HTTPConnectionFactory *theFactory = nil;
 
 @implementation HTTPConnectionFactory
@@ -54,12 +56,19 @@ static HTTPConnectionFactory *theFactory = nil;
 
 - (id)init {
     if (self = [super init]) {
+        timeoutSeconds = (NSTimeInterval)[[NSUserDefaults standardUserDefaults] doubleForKey:@"HTTPTimeoutSeconds"];
+        if (timeoutSeconds <= 0) {
+            timeoutSeconds = DEFAULT_TIMEOUT_SECONDS;
+        }
     }
     return self;
 }
 - (id <HTTPConnection>)newHTTPConnectionToURL:(NSURL *)theURL
                                        method:(NSString *)theMethod
                          dataTransferDelegate:(id<DataTransferDelegate>)theDataTransferDelegate {
-    return [[URLConnection alloc] initWithURL:theURL method:theMethod dataTransferDelegate:theDataTransferDelegate];
+    return [[URLConnection alloc] initWithURL:theURL method:theMethod timeoutSeconds:timeoutSeconds dataTransferDelegate:theDataTransferDelegate];
+}
+- (NSTimeInterval)timeoutSeconds {
+    return timeoutSeconds;
 }
 @end
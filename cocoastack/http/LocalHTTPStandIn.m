@@ -0,0 +1,217 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "LocalHTTPStandIn.h"
+#import "SetNSError.h"
+#import "NSErrorCodes.h"
+
+
+@interface LocalHTTPStandInConnection : NSObject <HTTPConnection> {
+    LocalHTTPStandIn *standIn;
+    NSURL *url;
+    NSString *method;
+    NSMutableDictionary *requestHeaders;
+    NSDictionary *responseHeaders;
+    NSDate *date;
+    int responseCode;
+    NSTimeInterval createTime;
+    NSTimeInterval responseStartTime;
+    NSCondition *condition;
+    BOOL cancelled;
+}
+- (id)initWithStandIn:(LocalHTTPStandIn *)theStandIn URL:(NSURL *)theURL method:(NSString *)theMethod;
+@end
+
+
+@implementation LocalHTTPStandIn
+- (id)initWithRequestLatency:(NSTimeInterval)theRequestLatency
+             slowProbability:(double)theSlowProbability
+                 slowLatency:(NSTimeInterval)theSlowLatency
+              responseLength:(NSUInteger)theResponseLength {
+    if (self = [super init]) {
+        requestLatency = theRequestLatency;
+        slowProbability = theSlowProbability;
+        slowLatency = theSlowLatency;
+        responseLength = theResponseLength;
+        lock = [[NSLock alloc] init];
+        [lock setName:@"LocalHTTPStandIn lock"];
+    }
+    return self;
+}
+- (id <HTTPConnection>)newHTTPConnectionToURL:(NSURL *)theURL method:(NSString *)theMethod {
+    return [[LocalHTTPStandInConnection alloc] initWithStandIn:self URL:theURL method:theMethod];
+}
+- (NSTimeInterval)nextResponseLatency {
+    BOOL slow = slowProbability > 0 && ((double)arc4random_uniform(1000000) / 1000000.0) < slowProbability;
+    [lock lock];
+    requestCount++;
+    if (slow) {
+        slowRequestCount++;
+    }
+    [lock unlock];
+    return slow ? slowLatency : requestLatency;
+}
+- (NSData *)responseData {
+    return [NSMutableData dataWithLength:responseLength];
+}
+- (unsigned long long)requestCount {
+    [lock lock];
+    unsigned long long ret = requestCount;
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)slowRequestCount {
+    [lock lock];
+    unsigned long long ret = slowRequestCount;
+    [lock unlock];
+    return ret;
+}
+@end
+
+
+@implementation LocalHTTPStandInConnection
+- (id)initWithStandIn:(LocalHTTPStandIn *)theStandIn URL:(NSURL *)theURL method:(NSString *)theMethod {
+    if (self = [super init]) {
+        standIn = theStandIn;
+        url = theURL;
+        method = theMethod;
+        requestHeaders = [[NSMutableDictionary alloc] init];
+        responseHeaders = [NSDictionary dictionary];
+        createTime = [NSDate timeIntervalSinceReferenceDate];
+        condition = [[NSCondition alloc] init];
+        [condition setName:@"LocalHTTPStandInConnection condition"];
+    }
+    return self;
+}
+
+#pragma mark HTTPConnection
+- (NSString *)errorDomain {
+    return @"LocalHTTPStandInErrorDomain";
+}
+- (NSURL *)URL {
+    return url;
+}
+- (void)setRequestHeader:(NSString *)value forKey:(NSString *)key {
+    [requestHeaders setObject:value forKey:key];
+}
+- (void)setRequestHostHeader {
+    [self setRequestHeader:[url host] forKey:@"Host"];
+}
+- (void)setRequestContentDispositionHeader:(NSString *)downloadName {
+}
+- (void)setRFC822DateRequestHeader {
+    [self setRFC822DateRequestHeader:[NSDate date]];
+}
+- (void)setRFC822DateRequestHeader:(NSDate *)theDate {
+    date = theDate;
+    [self setRequestHeader:[theDate description] forKey:@"Date"];
+}
+- (void)setDate:(NSDate *)theDate {
+    date = theDate;
+}
+- (NSDate *)date {
+    return date;
+}
+- (NSString *)requestMethod {
+    return method;
+}
+- (NSString *)requestPathInfo {
+    return [url path];
+}
+- (NSString *)requestQueryString {
+    return [url query];
+}
+- (NSArray *)requestHeaderKeys {
+    return [requestHeaders allKeys];
+}
+- (NSString *)requestHeaderForKey:(NSString *)theKey {
+    return [requestHeaders objectForKey:theKey];
+}
+- (NSData *)executeRequest:(NSError **)error {
+    return [self executeRequestWithBody:nil error:error];
+}
+- (NSData *)executeRequestWithBody:(NSData *)theBody error:(NSError **)error {
+    NSDate *responseDate = [NSDate dateWithTimeIntervalSinceNow:[standIn nextResponseLatency]];
+    [condition lock];
+    while (!cancelled && [responseDate timeIntervalSinceNow] > 0) {
+        [condition waitUntilDate:responseDate];
+    }
+    BOOL wasCancelled = cancelled;
+    if (!wasCancelled) {
+        // The whole response arrives at once.
+        responseStartTime = [NSDate timeIntervalSinceReferenceDate];
+    }
+    [condition unlock];
+    if (wasCancelled) {
+        SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"%@ %@ was cancelled", method, url);
+        return nil;
+    }
+    NSData *ret = [method isEqualToString:@"HEAD"] ? [NSData data] : [standIn responseData];
+    responseCode = 200;
+    responseHeaders = [NSDictionary dictionaryWithObject:[NSString stringWithFormat:@"%lu", (unsigned long)[ret length]] forKey:@"Content-Length"];
+    return ret;
+}
+- (void)cancel {
+    [condition lock];
+    cancelled = YES;
+    [condition broadcast];
+    [condition unlock];
+}
+- (NSTimeInterval)responseStartTime {
+    [condition lock];
+    NSTimeInterval ret = responseStartTime;
+    [condition unlock];
+    return ret;
+}
+- (int)responseCode {
+    return responseCode;
+}
+- (NSDictionary *)responseHeaders {
+    return responseHeaders;
+}
+- (NSString *)responseHeaderForKey:(NSString *)key {
+    return [responseHeaders objectForKey:key];
+}
+- (NSString *)responseContentType {
+    return @"application/octet-stream";
+}
+- (NSString *)responseDownloadName {
+    return nil;
+}
+- (BOOL)errorOccurred {
+    return NO;
+}
+- (NSTimeInterval)createTime {
+    return createTime;
+}
+@end
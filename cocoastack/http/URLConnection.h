@@ -42,6 +42,7 @@
     NSMutableURLRequest *mutableURLRequest;
     NSURLConnection *urlConnection;
     NSHTTPURLResponse *httpURLResponse;
+    NSTimeInterval responseStartTime;
 
     NSMutableData *responseData;
     BOOL errorOccurred;
@@ -53,7 +54,13 @@
     NSUInteger totalBytesReceived;
     
     HTTPInputStream *httpInputStream;
+    
+    NSTimeInterval timeoutSeconds;
+    dispatch_semaphore_t activity;
+    BOOL finished;
+    BOOL cancelled;
 }
 
-- (id)initWithURL:(NSURL *)theURL method:(NSString *)theMethod dataTransferDelegate:(id <DataTransferDelegate>)theDelegate;
+// theTimeoutSeconds is how long the connection may go without sending or receiving anything.
+- (id)initWithURL:(NSURL *)theURL method:(NSString *)theMethod timeoutSeconds:(NSTimeInterval)theTimeoutSeconds dataTransferDelegate:(id <DataTransferDelegate>)theDelegate;
 @end
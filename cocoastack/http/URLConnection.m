@@ -46,20 +46,33 @@
 #import "System.h"
 #import "HTTPInputStream.h"
 
-static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
-#define DEFAULT_TIMEOUT_SECONDS (90)
+@interface URLConnection (internal)
+- (void)finishWithError:(NSError *)theError;
+@end
 
 @implementation URLConnection
+// NSURLConnection delegate messages for every connection are delivered on this queue, so no thread has to run a run loop.
++ (NSOperationQueue *)delegateQueue {
+    static NSOperationQueue *queue = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        queue = [[NSOperationQueue alloc] init];
+        [queue setName:@"URLConnection delegate queue"];
+    });
+    return queue;
+}
 
-- (id)initWithURL:(NSURL *)theURL method:(NSString *)theMethod dataTransferDelegate:(id<DataTransferDelegate>)theDelegate {
+- (id)initWithURL:(NSURL *)theURL method:(NSString *)theMethod timeoutSeconds:(NSTimeInterval)theTimeoutSeconds dataTransferDelegate:(id<DataTransferDelegate>)theDelegate {
     if (self = [super init]) {
         // Don't retain the delegate.
         delegate = theDelegate;
         method = theMethod;
         url = theURL;
+        timeoutSeconds = theTimeoutSeconds;
         mutableURLRequest = [[NSMutableURLRequest alloc] initWithURL:theURL];
         [mutableURLRequest setHTTPMethod:theMethod];
         [mutableURLRequest setCachePolicy:NSURLRequestReloadIgnoringCacheData];
+        [mutableURLRequest setTimeoutInterval:theTimeoutSeconds];
         
         NSAssert(theURL != nil, @"theURL may not be nil");
         
@@ -69,18 +82,6 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
     }
     return self;
 }
-- (void)dealloc {
-    
-    
-    [urlConnection unscheduleFromRunLoop:[NSRunLoop currentRunLoop] forMode:RUN_LOOP_MODE];
-    
-    
-    
-    
-    
-    
-}
-
 #pragma mark HTTPConnection
 - (NSString *)errorDomain {
     return @"HTTPConnectionErrorDomain";
@@ -153,10 +154,18 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
         [mutableURLRequest setHTTPBody:theBody];
     }
     
-    [responseData setLength:0];
-    urlConnection = [[NSURLConnection alloc] initWithRequest:mutableURLRequest delegate:self startImmediately:NO];
-    [urlConnection scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:RUN_LOOP_MODE];
-    [urlConnection start];
+    @synchronized(self) {
+        if (cancelled) {
+            SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"%@ %@ was cancelled", method, [mutableURLRequest URL]);
+            return nil;
+        }
+        [responseData setLength:0];
+        finished = NO;
+        activity = dispatch_semaphore_create(0);
+        urlConnection = [[NSURLConnection alloc] initWithRequest:mutableURLRequest delegate:self startImmediately:NO];
+        [urlConnection setDelegateQueue:[URLConnection delegateQueue]];
+        [urlConnection start];
+    }
 
     if (theBody != nil) {
         HSLogDebug(@"NSURLConnection started with request body (%ld bytes)", (unsigned long)[theBody length]);
@@ -164,36 +173,33 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
         HSLogDebug(@"NSURLConnection started with no request body");
     }
     
-    [[NSUserDefaults standardUserDefaults] synchronize];
-    NSTimeInterval timeoutInterval = (NSTimeInterval)[[NSUserDefaults standardUserDefaults] doubleForKey:@"HTTPTimeoutSeconds"];
-    if (timeoutInterval == 0) {
-        timeoutInterval = DEFAULT_TIMEOUT_SECONDS;
-    }
-    [mutableURLRequest setTimeoutInterval:timeoutInterval];
-    
-//    HSLogDebug(@"HTTPTimeoutSeconds=%0.3f", timeoutInterval);
-
-    // Loop to read in the whole damn response body because the streaming approach doesn't work reliably with Apple's stupid URL loading system.
-    while (urlConnection != nil) {
-        NSTimeInterval runToInterval = [NSDate timeIntervalSinceReferenceDate] + timeoutInterval;
-
-        [[NSRunLoop currentRunLoop] runMode:RUN_LOOP_MODE beforeDate:[NSDate dateWithTimeIntervalSinceReferenceDate:runToInterval]];
-        
-        if (urlConnection != nil) {
-            NSTimeInterval current = [NSDate timeIntervalSinceReferenceDate];
-            // HSLogDebug(@"elapsed: %0.3f seconds", (current - runToInterval + timeoutInterval)); //FIXME: remove this
-            if ((current - runToInterval) > 0) {
-                HSLogWarn(@"exceeded timeout of %0.3f seconds during %@ %@", timeoutInterval, method, [mutableURLRequest URL]);
+    // Read in the whole response body because the streaming approach doesn't work reliably with Apple's URL loading system.
+    // Every delegate message signals activity; going timeoutSeconds without one is a timeout.
+    for (;;) {
+        long timedOut = dispatch_semaphore_wait(activity, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(timeoutSeconds * NSEC_PER_SEC)));
+        BOOL done = NO;
+        @synchronized(self) {
+            if (timedOut && !finished) {
+                HSLogWarn(@"exceeded timeout of %0.3f seconds during %@ %@", timeoutSeconds, method, [mutableURLRequest URL]);
                 _error = [[NSError alloc] initWithDomain:[self errorDomain] code:ERROR_TIMEOUT description:[NSString stringWithFormat:@"timeout during %@ %@", method, [mutableURLRequest URL]]];
                 errorOccurred = YES;
+                finished = YES;
                 [urlConnection cancel];
-                
-                urlConnection = nil;
             }
+            done = finished;
+        }
+        if (done) {
+            break;
+        }
+    }
+    @synchronized(self) {
+        urlConnection = nil;
+        if (errorOccurred) {
+            [delegate dataTransferDidFail];
         }
     }
+    
     if (errorOccurred) {
-        [delegate dataTransferDidFail];
         if (error != NULL) {
             *error = _error;
         }
@@ -220,7 +226,8 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
             }
         } else {
             /*
-             * FIXME: handle multipart/byteranges media type.
+             * A multipart/byteranges body is returned as-is; callers that asked for several ranges
+             * split it with HTTPByteRanges using the Content-Type boundary.
              * See rfc2616 section 4.4 ("message length").
              */
             HSLogDebug(@"response body with no Transfer-Encoding; responseData is %ld bytes", (unsigned long)[responseData length]);
@@ -274,6 +281,25 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
 - (BOOL)errorOccurred {
     return errorOccurred;
 }
+- (void)cancel {
+    @synchronized(self) {
+        delegate = nil;
+        cancelled = YES;
+        if (urlConnection != nil && !finished) {
+            HSLogDebug(@"cancelling %@ %@", method, [mutableURLRequest URL]);
+            _error = [[NSError alloc] initWithDomain:[self errorDomain] code:ERROR_ABORT_REQUESTED description:[NSString stringWithFormat:@"%@ %@ was cancelled", method, [mutableURLRequest URL]]];
+            errorOccurred = YES;
+            finished = YES;
+            [urlConnection cancel];
+            dispatch_semaphore_signal(activity);
+        }
+    }
+}
+- (NSTimeInterval)responseStartTime {
+    @synchronized(self) {
+        return responseStartTime;
+    }
+}
 - (NSTimeInterval)createTime {
     return createTime;
 }
@@ -292,60 +318,65 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
 }
 - (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
     if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
-        
-        httpURLResponse = (NSHTTPURLResponse *)response;
-        // Docs state "Each time the delegate receives the connection:didReceiveResponse: message, it should reset any progress indication and discard all previously received data.".
-//        HSLogDebug(@"didReceiveResponse; resetting responseData");
-        [responseData setLength:0];
+        @synchronized(self) {
+            httpURLResponse = (NSHTTPURLResponse *)response;
+            if (responseStartTime == 0) {
+                responseStartTime = [NSDate timeIntervalSinceReferenceDate];
+            }
+            // Docs state "Each time the delegate receives the connection:didReceiveResponse: message, it should reset any progress indication and discard all previously received data.".
+            [responseData setLength:0];
+        }
     }
+    dispatch_semaphore_signal(activity);
 }
 - (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)myError {
     HSLogDebug(@"connection didFailWithError: %@", myError);
-    errorOccurred = YES;
-    
-    _error = myError;
-    
-    urlConnection = nil;
+    [self finishWithError:myError];
 }
 - (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data {
     if ([data length] > 0) {
-        [responseData appendData:data];
-        if ([delegate respondsToSelector:@selector(dataTransferDidDownloadBytes:httpThrottle:error:)]) {
-            NSUInteger bytesReceivedThisTime = [data length];
-            HTTPThrottle *httpThrottle = nil;
-            NSError *localError = nil;
-            if (![delegate dataTransferDidDownloadBytes:bytesReceivedThisTime httpThrottle:&httpThrottle error:&localError]) {
-                _error = localError;
-                errorOccurred = YES;
-                [urlConnection cancel];
-                
-                urlConnection = nil;
+        // The delegate is called with the lock held so that cancel can't return while a call is in flight.
+        @synchronized(self) {
+            if (finished) {
+                return;
             }
-            if (httpThrottle != nil) {
-                [httpInputStream setHTTPThrottle:httpThrottle];
+            [responseData appendData:data];
+            if ([delegate respondsToSelector:@selector(dataTransferDidDownloadBytes:httpThrottle:error:)]) {
+                NSUInteger bytesReceivedThisTime = [data length];
+                HTTPThrottle *httpThrottle = nil;
+                NSError *localError = nil;
+                if (![delegate dataTransferDidDownloadBytes:bytesReceivedThisTime httpThrottle:&httpThrottle error:&localError]) {
+                    [connection cancel];
+                    [self finishWithError:localError];
+                    return;
+                }
+                if (httpThrottle != nil) {
+                    [httpInputStream setHTTPThrottle:httpThrottle];
+                }
             }
         }
     }
+    dispatch_semaphore_signal(activity);
 }
 - (void)connection:(NSURLConnection *)connection didSendBodyData:(NSInteger)bytesWritten totalBytesWritten:(NSInteger)theTotalBytesWritten totalBytesExpectedToWrite:(NSInteger)totalBytesExpectedToWrite {
 //    HSLogDebug(@"did send %ld bytes", bytesWritten);
-    if ([delegate respondsToSelector:@selector(dataTransferDidUploadBytes:httpThrottle:error:)]) {
-        NSUInteger bytesSentThisTime = bytesWritten;
-        HTTPThrottle *httpThrottle = nil;
-        NSError *localError = nil;
-        if (![delegate dataTransferDidUploadBytes:bytesSentThisTime httpThrottle:&httpThrottle error:&localError]) {
-            _error = localError;
-            
-            errorOccurred = YES;
-            [urlConnection cancel];
-            
-            urlConnection = nil;
-        }
-        if (httpThrottle != nil) {
-            [httpInputStream setHTTPThrottle:httpThrottle];
+    @synchronized(self) {
+        if ([delegate respondsToSelector:@selector(dataTransferDidUploadBytes:httpThrottle:error:)]) {
+            NSUInteger bytesSentThisTime = bytesWritten;
+            HTTPThrottle *httpThrottle = nil;
+            NSError *localError = nil;
+            if (![delegate dataTransferDidUploadBytes:bytesSentThisTime httpThrottle:&httpThrottle error:&localError]) {
+                [connection cancel];
+                [self finishWithError:localError];
+                return;
+            }
+            if (httpThrottle != nil) {
+                [httpInputStream setHTTPThrottle:httpThrottle];
+            }
         }
     }
     totalBytesSent = theTotalBytesWritten;
+    dispatch_semaphore_signal(activity);
 }
 - (NSCachedURLResponse *)connection:(NSURLConnection *)connection willCacheResponse:(NSCachedURLResponse *)cachedResponse {
     return nil;
@@ -354,9 +385,21 @@ static NSString *RUN_LOOP_MODE = @"HTTPConnectionRunLoopMode";
     return request;
 }
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection {
-//    HSLogDebug(@"connectionDidFinishLoading");
-    
-    urlConnection = nil;
+    [self finishWithError:nil];
+}
+
+#pragma mark internal
+- (void)finishWithError:(NSError *)theError {
+    @synchronized(self) {
+        if (!finished) {
+            if (theError != nil) {
+                _error = theError;
+                errorOccurred = YES;
+            }
+            finished = YES;
+        }
+    }
+    dispatch_semaphore_signal(activity);
 }
 
 #pragma mark NSObject
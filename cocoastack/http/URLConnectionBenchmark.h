@@ -0,0 +1,52 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Sends GETs through URLConnection to a small HTTP/1.1 server on 127.0.0.1, from several threads,
+// to measure the per-request overhead of the HTTP layer itself.
+@interface URLConnectionBenchmark : NSObject {
+    NSUInteger requestCount;
+    NSUInteger threadCount;
+    NSUInteger responseBytes;
+    NSTimeInterval elapsed;
+    NSArray *latencies;
+    NSTimeInterval defaultsReadSeconds;
+}
+- (id)initWithRequestCount:(NSUInteger)theRequestCount threadCount:(NSUInteger)theThreadCount responseBytes:(NSUInteger)theResponseBytes;
+- (BOOL)run:(NSError **)error;
+- (NSTimeInterval)elapsed;
+- (double)requestsPerSecond;
+- (NSTimeInterval)latencyAtPercentile:(double)thePercentile;
+
+// What synchronizing and reading NSUserDefaults cost per call; URLConnection used to do this on every request.
+- (NSTimeInterval)defaultsReadSeconds;
+@end
@@ -0,0 +1,268 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "URLConnectionBenchmark.h"
+#import "HTTPConnectionFactory.h"
+#import "HTTPConnection.h"
+#import "SetNSError.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+
+#define DEFAULTS_READ_ITERATIONS (1000)
+
+
+// Answers every request on a keep-alive connection with a fixed-size 200 response.
+@interface URLConnectionBenchmarkServer : NSObject {
+    int listenFD;
+    unsigned short port;
+    NSData *response;
+}
+- (id)initWithResponseBytes:(NSUInteger)theResponseBytes;
+- (BOOL)start:(NSError **)error;
+- (void)stop;
+- (unsigned short)port;
+@end
+
+@implementation URLConnectionBenchmarkServer
+- (id)initWithResponseBytes:(NSUInteger)theResponseBytes {
+    if (self = [super init]) {
+        listenFD = -1;
+        NSMutableData *data = [NSMutableData dataWithData:[[NSString stringWithFormat:@"HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %lu\r\n\r\n", (unsigned long)theResponseBytes] dataUsingEncoding:NSUTF8StringEncoding]];
+        [data increaseLengthBy:theResponseBytes];
+        response = data;
+    }
+    return self;
+}
+- (BOOL)start:(NSError **)error {
+    listenFD = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFD == -1) {
+        int errnum = errno;
+        SETNSERROR(@"UnixErrorDomain", errnum, @"socket: %s", strerror(errnum));
+        return NO;
+    }
+    int on = 1;
+    setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+    if (bind(listenFD, (struct sockaddr *)&addr, sizeof(addr)) == -1
+        || listen(listenFD, 128) == -1
+        || getsockname(listenFD, (struct sockaddr *)&addr, &addrLen) == -1) {
+        int errnum = errno;
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to listen on 127.0.0.1: %s", strerror(errnum));
+        close(listenFD);
+        listenFD = -1;
+        return NO;
+    }
+    port = ntohs(addr.sin_port);
+    
+    int fd = listenFD;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        for (;;) {
+            int clientFD = accept(fd, NULL, NULL);
+            if (clientFD == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // The listening socket was closed.
+                break;
+            }
+            dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+                [self serveClient:clientFD];
+            });
+        }
+    });
+    return YES;
+}
+- (void)stop {
+    if (listenFD != -1) {
+        shutdown(listenFD, SHUT_RDWR);
+        close(listenFD);
+        listenFD = -1;
+    }
+}
+- (unsigned short)port {
+    return port;
+}
+
+#pragma mark internal
+- (void)serveClient:(int)theFD {
+    char buf[8192];
+    size_t buffered = 0;
+    for (;;) {
+        ssize_t received = read(theFD, buf + buffered, sizeof(buf) - buffered);
+        if (received <= 0) {
+            break;
+        }
+        buffered += (size_t)received;
+        
+        // Answer each complete request in the buffer. The benchmark only sends GETs, which have no body.
+        const char *headersEnd = NULL;
+        while ((headersEnd = memmem(buf, buffered, "\r\n\r\n", 4)) != NULL) {
+            if (![self writeResponseToFD:theFD]) {
+                close(theFD);
+                return;
+            }
+            size_t consumed = (size_t)(headersEnd - buf) + 4;
+            memmove(buf, buf + consumed, buffered - consumed);
+            buffered -= consumed;
+        }
+        if (buffered == sizeof(buf)) {
+            // Request headers too big for this server.
+            break;
+        }
+    }
+    close(theFD);
+}
+- (BOOL)writeResponseToFD:(int)theFD {
+    const unsigned char *bytes = [response bytes];
+    size_t remaining = [response length];
+    while (remaining > 0) {
+        ssize_t written = write(theFD, bytes, remaining);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return NO;
+        }
+        bytes += written;
+        remaining -= (size_t)written;
+    }
+    return YES;
+}
+@end
+
+
+@implementation URLConnectionBenchmark
+- (id)initWithRequestCount:(NSUInteger)theRequestCount threadCount:(NSUInteger)theThreadCount responseBytes:(NSUInteger)theResponseBytes {
+    if (self = [super init]) {
+        requestCount = theRequestCount;
+        threadCount = theThreadCount;
+        responseBytes = theResponseBytes;
+    }
+    return self;
+}
+- (BOOL)run:(NSError **)error {
+    NSTimeInterval defaultsStart = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < DEFAULTS_READ_ITERATIONS; i++) {
+        [[NSUserDefaults standardUserDefaults] synchronize];
+        (void)[[NSUserDefaults standardUserDefaults] doubleForKey:@"HTTPTimeoutSeconds"];
+    }
+    defaultsReadSeconds = ([NSDate timeIntervalSinceReferenceDate] - defaultsStart) / DEFAULTS_READ_ITERATIONS;
+    
+    URLConnectionBenchmarkServer *server = [[URLConnectionBenchmarkServer alloc] initWithResponseBytes:responseBytes];
+    if (![server start:error]) {
+        return NO;
+    }
+    NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%u/benchmark", (unsigned int)[server port]]];
+    
+    NSMutableArray *threadLatencies = [NSMutableArray array];
+    for (NSUInteger i = 0; i < threadCount; i++) {
+        [threadLatencies addObject:[NSMutableArray array]];
+    }
+    __block NSError *firstError = nil;
+    NSLock *errorLock = [[NSLock alloc] init];
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t threadIndex) {
+        NSMutableArray *myLatencies = [threadLatencies objectAtIndex:threadIndex];
+        for (NSUInteger i = threadIndex; i < requestCount; i += threadCount) {
+            @autoreleasepool {
+                NSError *myError = nil;
+                NSTimeInterval requestStart = [NSDate timeIntervalSinceReferenceDate];
+                if (![self getURL:url error:&myError]) {
+                    [errorLock lock];
+                    if (firstError == nil) {
+                        firstError = myError;
+                    }
+                    [errorLock unlock];
+                    return;
+                }
+                [myLatencies addObject:[NSNumber numberWithDouble:([NSDate timeIntervalSinceReferenceDate] - requestStart)]];
+            }
+        }
+    });
+    elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+    [server stop];
+    
+    if (firstError != nil) {
+        if (error != NULL) {
+            *error = firstError;
+        }
+        return NO;
+    }
+    NSMutableArray *all = [NSMutableArray arrayWithCapacity:requestCount];
+    for (NSArray *array in threadLatencies) {
+        [all addObjectsFromArray:array];
+    }
+    latencies = [all sortedArrayUsingSelector:@selector(compare:)];
+    return YES;
+}
+- (NSTimeInterval)elapsed {
+    return elapsed;
+}
+- (double)requestsPerSecond {
+    return elapsed > 0 ? (double)requestCount / elapsed : 0;
+}
+- (NSTimeInterval)latencyAtPercentile:(double)thePercentile {
+    if ([latencies count] == 0) {
+        return 0;
+    }
+    NSUInteger index = (NSUInteger)((thePercentile / 100.0) * (double)([latencies count] - 1));
+    return [[latencies objectAtIndex:index] doubleValue];
+}
+- (NSTimeInterval)defaultsReadSeconds {
+    return defaultsReadSeconds;
+}
+
+#pragma mark internal
+- (BOOL)getURL:(NSURL *)theURL error:(NSError **)error {
+    id <HTTPConnection> conn = [[HTTPConnectionFactory theFactory] newHTTPConnectionToURL:theURL method:@"GET" dataTransferDelegate:nil];
+    [conn setRequestHostHeader];
+    NSData *response = [conn executeRequest:error];
+    if (response == nil) {
+        return NO;
+    }
+    if ([conn responseCode] != 200 || [response length] != responseBytes) {
+        SETNSERROR(@"URLConnectionBenchmarkErrorDomain", -1, @"unexpected response from benchmark server: status %d, %lu bytes", [conn responseCode], (unsigned long)[response length]);
+        return NO;
+    }
+    return YES;
+}
+@end
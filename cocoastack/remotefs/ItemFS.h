@@ -55,6 +55,16 @@
 - (NSNumber *)isObjectRestoredAtPath:(NSString *)thePath targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (BOOL)restoreObjectAtPath:(NSString *)thePath forDays:(NSUInteger)theDays tier:(int)theGlacierRetrievalTier alreadyRestoredOrRestoring:(BOOL *)alreadyRestoredOrRestoring targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (BOOL)removeItemById:(NSString *)theItemId targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
+
+@optional
+// Fetches several ranges of one file in as few requests as the backend allows.
+// Returns an NSData for each NSValue-wrapped NSRange in theRanges, in the same order.
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileItem:(Item *)theItem itemPath:(NSString *)theFullPath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
+
+// Fetches a whole file unless its checksum is still theChecksum (which may be nil), in one request.
+// If it is, sets *notModified and returns empty data. Otherwise returns the contents and sets *theItem
+// to an Item carrying the file's current checksum and size.
+- (NSData *)contentsOfFileAtPath:(NSString *)theFullPath unlessChecksumMatches:(NSString *)theChecksum item:(Item **)theItem notModified:(BOOL *)notModified targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 @end
 
 #endif
@@ -50,6 +50,10 @@
 - (NSDictionary *)itemsByNameInDirectory:(NSString *)thePath useCachedData:(BOOL)theUseCachedData targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (NSData *)contentsOfFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (NSData *)contentsOfRange:(NSRange)theRange ofFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
+// Reads a file unless it still has theChecksum, in which case *notModified is set and empty data is returned.
+// Doesn't take the cache lock. Backends that can't make conditional requests always return the contents, with *theItem nil.
+- (NSData *)contentsOfFileAtPath:(NSString *)thePath unlessChecksumMatches:(NSString *)theChecksum item:(Item **)theItem notModified:(BOOL *)notModified targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (Item *)createFileAtomicallyWithData:(NSData *)theData atPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (BOOL)moveItemAtPath:(NSString *)thePath toPath:(NSString *)theDestinationPath targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
 - (BOOL)removeItemAtPath:(NSString *)theSourcePath targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
@@ -56,6 +56,18 @@
     return [itemFS updateFingerprintWithTargetConnectionDelegate:theTCD error:error];
 }
 - (Item *)itemAtPath:(NSString *)thePath targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    // Answer from the items cache without taking the lock file when we can; the cache database is safe for concurrent readers.
+    if (![thePath isEqualToString:@"/"]) {
+        NSError *myError = nil;
+        Item *cached = [self lockedCachedItemAtPath:thePath error:&myError];
+        if (cached != nil && (![itemFS usesFolderIds] || [cached itemId] != nil)) {
+            return cached;
+        }
+        if (cached == nil && [myError code] == ERROR_NOT_FOUND) {
+            SETNSERROR([self remoteFSErrorDomain], ERROR_NOT_FOUND, @"%@ not found", thePath);
+            return nil;
+        }
+    }
     Item *ret = [self doItemAtPath:thePath targetConnectionDelegate:theTCD error:error];
     return ret;
 }
@@ -63,6 +75,12 @@
     return [self itemsByNameInDirectory:thePath useCachedData:YES targetConnectionDelegate:theTCD error:error];
 }
 - (NSDictionary *)itemsByNameInDirectory:(NSString *)thePath useCachedData:(BOOL)theUseCachedData targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    if (theUseCachedData) {
+        NSDictionary *cached = [self lockedCachedItemsByNameForDirectory:thePath error:NULL];
+        if (cached != nil) {
+            return cached;
+        }
+    }
     FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
     __block NSDictionary *ret = nil;
     __block NSError *blockError = nil;
@@ -91,6 +109,39 @@
     }
     return [itemFS contentsOfRange:theRange ofFileItem:item itemPath:thePath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
 }
+- (NSData *)contentsOfFileAtPath:(NSString *)thePath unlessChecksumMatches:(NSString *)theChecksum item:(Item **)theItem notModified:(BOOL *)notModified targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    *theItem = nil;
+    *notModified = NO;
+    if (![itemFS usesFolderIds] && [itemFS respondsToSelector:@selector(contentsOfFileAtPath:unlessChecksumMatches:item:notModified:targetConnectionDelegate:error:)]) {
+        HSLogDetail(@"getting contents of %@:%@ unless checksum is %@", [itemFS itemFSDescription], thePath, theChecksum);
+        return [itemFS contentsOfFileAtPath:thePath unlessChecksumMatches:theChecksum item:theItem notModified:notModified targetConnectionDelegate:theTCD error:error];
+    }
+    return [self contentsOfFileAtPath:thePath dataTransferDelegate:nil targetConnectionDelegate:theTCD error:error];
+}
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileAtPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    if ([theRanges count] > 1 && [itemFS respondsToSelector:@selector(contentsOfRanges:ofFileItem:itemPath:dataTransferDelegate:targetConnectionDelegate:error:)]) {
+        Item *item = nil;
+        if ([itemFS usesFolderIds]) {
+            item = [self itemAtPath:thePath targetConnectionDelegate:theTCD error:error];
+            if (item == nil) {
+                return nil;
+            }
+        }
+        HSLogDetail(@"getting contents of %ld ranges of %@:%@", (unsigned long)[theRanges count], [itemFS itemFSDescription], thePath);
+        return [itemFS contentsOfRanges:theRanges ofFileItem:item itemPath:thePath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
+    }
+    
+    // One request per range.
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:[theRanges count]];
+    for (NSValue *value in theRanges) {
+        NSData *data = [self contentsOfRange:[value rangeValue] ofFileAtPath:thePath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
+        if (data == nil) {
+            return nil;
+        }
+        [ret addObject:data];
+    }
+    return ret;
+}
 - (Item *)createFileAtomicallyWithData:(NSData *)theData atPath:(NSString *)thePath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
     NSString *directory = [thePath stringByDeletingLastPathComponent];
     NSError *myError = nil;
@@ -0,0 +1,54 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Sends ranged GETs through S3Request to a LocalHTTPStandIn that stalls a fraction of responses,
+// once without hedging and once with hedging at hedgePercentile, and reports the latency
+// distribution and hedge counters for each run. Nothing is sent over the network.
+@interface S3HedgingSimulation : NSObject {
+    NSUInteger requestCount;
+    NSUInteger threadCount;
+    double slowProbability;
+    NSTimeInterval slowLatency;
+    double hedgePercentile;
+    NSMutableArray *results;
+}
+- (id)initWithRequestCount:(NSUInteger)theRequestCount
+               threadCount:(NSUInteger)theThreadCount
+           slowProbability:(double)theSlowProbability
+               slowLatency:(NSTimeInterval)theSlowLatency
+           hedgePercentile:(double)theHedgePercentile;
+- (BOOL)run:(NSError **)error;
+
+// Each entry has "hedgePercentile", "seconds", "p50", "p99", "max", "hedgesFired", "hedgesWon" and "requestsSent" (all NSNumber).
+- (NSArray *)results;
+@end
@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+@class Item;
+@protocol S3ListBucketResultParserDelegate;
+
+
+// Parses a ListBucketResult response with NSXMLParser, handing each object and common prefix
+// to the delegate as soon as its closing tag is read instead of building a DOM for the whole page.
+@interface S3ListBucketResultParser : NSObject <NSXMLParserDelegate> {
+    NSString *s3BucketName;
+    id <S3ListBucketResultParserDelegate> delegate;
+    NSNumberFormatter *numberFormatter;
+    NSMutableArray *elementNames;
+    NSMutableString *currentStringValue;
+    Item *currentItem;
+    NSError *parseError;
+    BOOL isTruncated;
+    NSString *nextMarker;
+    NSString *lastKey;
+}
+- (id)initWithS3BucketName:(NSString *)theS3BucketName delegate:(id <S3ListBucketResultParserDelegate>)theDelegate;
+- (BOOL)parse:(NSData *)theData error:(NSError **)error;
+
+// Only valid after a successful parse:.
+- (BOOL)isTruncated;
+
+// NextMarker if the response had one (S3 only includes it when a delimiter was given), otherwise the last key or common prefix seen.
+- (NSString *)nextMarker;
+@end
+
+
+@protocol S3ListBucketResultParserDelegate <NSObject>
+- (BOOL)parser:(S3ListBucketResultParser *)theParser didFindItem:(Item *)theItem error:(NSError **)error;
+@end
@@ -0,0 +1,155 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "S3ListBucketResultParser.h"
+#import "S3Service.h"
+#import "Item.h"
+#import "RFC822.h"
+
+
+@implementation S3ListBucketResultParser
+- (id)initWithS3BucketName:(NSString *)theS3BucketName delegate:(id<S3ListBucketResultParserDelegate>)theDelegate {
+    if (self = [super init]) {
+        s3BucketName = theS3BucketName;
+        delegate = theDelegate;
+        numberFormatter = [[NSNumberFormatter alloc] init];
+        elementNames = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+- (BOOL)parse:(NSData *)theData error:(NSError **)error {
+    [elementNames removeAllObjects];
+    currentStringValue = nil;
+    currentItem = nil;
+    parseError = nil;
+    isTruncated = NO;
+    nextMarker = nil;
+    lastKey = nil;
+
+    NSXMLParser *parser = [[NSXMLParser alloc] initWithData:theData];
+    [parser setDelegate:self];
+    BOOL ret = [parser parse];
+    if (parseError != nil) {
+        if (error != NULL) {
+            *error = parseError;
+        }
+        return NO;
+    }
+    if (!ret) {
+        SETNSERROR([S3Service errorDomain], [[parser parserError] code], @"error parsing List Objects XML response: %@", [parser parserError]);
+        return NO;
+    }
+    if (nextMarker == nil) {
+        nextMarker = lastKey;
+    }
+    return YES;
+}
+- (BOOL)isTruncated {
+    return isTruncated;
+}
+- (NSString *)nextMarker {
+    return nextMarker;
+}
+
+#pragma mark NSXMLParserDelegate
+- (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qualifiedName attributes:(NSDictionary *)attributeDict {
+    if ([elementNames count] == 1 && [elementName isEqualToString:@"Contents"]) {
+        currentItem = [[Item alloc] init];
+        currentItem.isDirectory = NO;
+    }
+    [elementNames addObject:elementName];
+    currentStringValue = nil;
+}
+- (void)parser:(NSXMLParser *)parser foundCharacters:(NSString *)string {
+    if (currentStringValue == nil) {
+        currentStringValue = [[NSMutableString alloc] init];
+    }
+    [currentStringValue appendString:string];
+}
+- (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName {
+    @autoreleasepool {
+        NSUInteger depth = [elementNames count];
+        NSString *parentName = depth >= 2 ? [elementNames objectAtIndex:(depth - 2)] : nil;
+        NSString *value = currentStringValue != nil ? currentStringValue : @"";
+        currentStringValue = nil;
+        NSError *myError = nil;
+        BOOL ok = YES;
+
+        if (depth == 2) {
+            if ([elementName isEqualToString:@"IsTruncated"]) {
+                isTruncated = [value isEqualToString:@"true"];
+            } else if ([elementName isEqualToString:@"NextMarker"]) {
+                nextMarker = [value copy];
+            } else if ([elementName isEqualToString:@"Contents"] && currentItem != nil) {
+                if (currentItem.storageClass == nil) {
+                    currentItem.storageClass = @"STANDARD";
+                }
+                ok = [delegate parser:self didFindItem:currentItem error:&myError];
+                currentItem = nil;
+            }
+        } else if (depth == 3 && [parentName isEqualToString:@"CommonPrefixes"] && [elementName isEqualToString:@"Prefix"]) {
+            lastKey = [value copy];
+            Item *item = [[Item alloc] init];
+            item.isDirectory = YES;
+            NSString *thePrefix = [value hasSuffix:@"/"] ? [value substringToIndex:([value length] - 1)] : value;
+            item.name = [[NSString stringWithFormat:@"/%@/%@", s3BucketName, thePrefix] lastPathComponent];
+            ok = [delegate parser:self didFindItem:item error:&myError];
+        } else if (depth == 3 && [parentName isEqualToString:@"Contents"] && currentItem != nil) {
+            if ([elementName isEqualToString:@"Key"]) {
+                lastKey = [value copy];
+                currentItem.name = [[NSString stringWithFormat:@"/%@/%@", s3BucketName, value] lastPathComponent];
+            } else if ([elementName isEqualToString:@"LastModified"]) {
+                NSDate *lastModified = [RFC822 dateFromString:value error:&myError];
+                ok = lastModified != nil;
+                currentItem.fileLastModified = lastModified;
+            } else if ([elementName isEqualToString:@"Size"]) {
+                currentItem.fileSize = [[numberFormatter numberFromString:value] unsignedLongLongValue];
+            } else if ([elementName isEqualToString:@"StorageClass"]) {
+                currentItem.storageClass = [value copy];
+            } else if ([elementName isEqualToString:@"ETag"]) {
+                NSString *etag = value;
+                if ([etag hasPrefix:@"\""] && [etag hasSuffix:@"\""] && [etag length] >= 2) {
+                    etag = [etag substringWithRange:NSMakeRange(1, [etag length] - 2)];
+                }
+                currentItem.checksum = [@"md5:" stringByAppendingString:etag];
+            }
+        }
+        [elementNames removeLastObject];
+
+        if (!ok) {
+            parseError = myError;
+            [parser abortParsing];
+        }
+    }
+}
+@end
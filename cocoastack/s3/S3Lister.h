@@ -31,22 +31,24 @@
  */
 
 #import "S3Receiver.h"
+#import "S3ListBucketResultParser.h"
+@class Item;
 @protocol S3AuthorizationProvider;
 @protocol TargetConnectionDelegate;
 
-@interface S3Lister : NSObject {
+@interface S3Lister : NSObject <S3ListBucketResultParserDelegate> {
     id <S3AuthorizationProvider>sap;
     NSURL *endpoint;
 	NSString *path;
     NSString *delimiter;
     id <TargetConnectionDelegate> targetConnectionDelegate;
 
-    NSNumberFormatter *numberFormatter;
     NSString *s3BucketName;
     NSString *s3Path;
     NSString *escapedS3ObjectPathPrefix;
 	BOOL isTruncated;
 	NSString *marker;
+    NSMutableDictionary *foundItemsByName;
 }
 - (id)initWithS3AuthorizationProvider:(id <S3AuthorizationProvider>)theSAP
                              endpoint:(NSURL *)theEndpoint
@@ -30,16 +30,19 @@
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#import "RFC2616DateFormatter.h"
 #import "S3AuthorizationProvider.h"
 #import "S3Lister.h"
 #import "HTTP.h"
 #import "S3Service.h"
 #import "S3Request.h"
 #import "Item.h"
-#import "RFC822.h"
 #import "TargetConnection.h"
 
+
+// The largest page ListObjects will return.
+#define MAX_KEYS_PER_PAGE (1000)
+
+
 @implementation S3Lister
 - (id)initWithS3AuthorizationProvider:(id <S3AuthorizationProvider>)theSAP
                              endpoint:(NSURL *)theEndpoint
@@ -52,8 +55,6 @@
 		path = thePath;
         delimiter = theDelimiter;
         targetConnectionDelegate = theTCD;
-
-        numberFormatter = [[NSNumberFormatter alloc] init];
         
 		isTruncated = YES;
     }
@@ -73,27 +74,27 @@
     s3BucketName = [strippedPrefix substringToIndex:range.location];
     s3Path = [[NSString alloc] initWithFormat:@"/%@/", s3BucketName];
     escapedS3ObjectPathPrefix = [[strippedPrefix substringFromIndex:(range.location + 1)] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    foundItemsByName = [NSMutableDictionary dictionary];
     
-    
-    NSMutableDictionary *ret = [NSMutableDictionary dictionary];
+    S3ListBucketResultParser *parser = [[S3ListBucketResultParser alloc] initWithS3BucketName:s3BucketName delegate:self];
 	while (isTruncated) {
-        NSArray *items = [self nextPage:error];
-        if (items == nil) {
-            ret = nil;
-            break;
-        }
-        for (Item *item in items) {
-            [ret setObject:item forKey:item.name];
+        if (![self nextPageWithParser:parser error:error]) {
+            return nil;
         }
     }
-    
-    return ret;
+    return foundItemsByName;
+}
+
+#pragma mark S3ListBucketResultParserDelegate
+- (BOOL)parser:(S3ListBucketResultParser *)theParser didFindItem:(Item *)theItem error:(NSError **)error {
+    [foundItemsByName setObject:theItem forKey:theItem.name];
+    return YES;
 }
 
 #pragma mark internal
-- (NSArray *)nextPage:(NSError **)error {
+- (BOOL)nextPageWithParser:(S3ListBucketResultParser *)theParser error:(NSError **)error {
     if (targetConnectionDelegate != nil && ![targetConnectionDelegate targetConnectionShouldRetryOnTransientError:error]) {
-        return nil;
+        return NO;
     }
     
     NSMutableString *queryString = [NSMutableString stringWithFormat:@"prefix=%@", escapedS3ObjectPathPrefix];
@@ -101,14 +102,12 @@
         [queryString appendFormat:@"&delimiter=%@", [delimiter stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
     }
     if (marker != nil) {
-        NSAssert([marker hasPrefix:s3BucketName], @"marker must start with S3 bucket name");
-        NSString *suffix = [marker substringFromIndex:([s3BucketName length] + 1)];
-        [queryString appendFormat:@"&marker=%@", [suffix stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+        [queryString appendFormat:@"&marker=%@", [marker stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
     }
-    [queryString appendString:@"&max-keys=500"];
-    S3Request *s3r = [[S3Request alloc] initWithMethod:@"GET" endpoint:endpoint path:[NSString stringWithFormat:@"/%@/", s3BucketName] queryString:queryString authorizationProvider:sap error:error];
+    [queryString appendFormat:@"&max-keys=%d", MAX_KEYS_PER_PAGE];
+    S3Request *s3r = [[S3Request alloc] initWithMethod:@"GET" endpoint:endpoint path:s3Path queryString:queryString authorizationProvider:sap error:error];
     if (s3r == nil) {
-        return nil;
+        return NO;
     }
     NSError *myError = nil;
     NSData *response = [s3r dataWithTargetConnectionDelegate:targetConnectionDelegate error:&myError];
@@ -116,130 +115,25 @@
         if ([myError isErrorWithDomain:[S3Service errorDomain] code:ERROR_NOT_FOUND]) {
             // minio (S3-compatible server) returns not found instead of an empty result set.
             isTruncated = NO;
-            return [NSArray array];
+            return YES;
         }
         SETERRORFROMMYERROR;
-        return nil;
-    }
-    NSArray *foundPrefixes = nil;
-    NSArray *listBucketResultContents = [self parseXMLResponse:response foundPrefixes:&foundPrefixes error:&myError];
-    if (listBucketResultContents == nil && myError == nil) {
-        [NSThread sleepForTimeInterval:0.2];
-        listBucketResultContents = [self parseXMLResponse:response foundPrefixes:&foundPrefixes error:&myError];
+        return NO;
     }
-    if (listBucketResultContents == nil) {
-        if (myError == nil) {
-            myError = [[NSError alloc] initWithDomain:[S3Service errorDomain] code:-1 description:@"Failed to parse ListBucketResult XML response"];
-        }
+    if (![theParser parse:response error:&myError]) {
         HSLogDebug(@"response was %@", [[NSString alloc] initWithData:response encoding:NSUTF8StringEncoding]);
-        HSLogError(@"error getting //ListBucketResult/Contents nodes: %@", myError);
-        SETERRORFROMMYERROR;
-        return nil;
-    }
-    
-    NSString *lastObjectPath = nil;
-    NSMutableArray *ret = [NSMutableArray array];
-    
-    for (NSString *foundPrefix in foundPrefixes) {
-        Item *item = [[Item alloc] init];
-        item.isDirectory = YES;
-        item.name = [foundPrefix lastPathComponent];
-        [ret addObject:item];
-    }
-    
-    for (NSXMLNode *objectNode in listBucketResultContents) {
-        Item *item = [[Item alloc] init];
-        item.isDirectory = NO;
-        
-        NSXMLNode *keyNode = [[objectNode nodesForXPath:@"Key" error:error] lastObject];
-        if (keyNode == nil) {
-            return nil;
-        }
-        NSString *objectPath = [NSString stringWithFormat:@"/%@/%@", s3BucketName, [keyNode stringValue]];
-        item.name = [objectPath lastPathComponent];
-        lastObjectPath = objectPath;
-        
-        NSXMLNode *lastModifiedNode = [[objectNode nodesForXPath:@"LastModified" error:error] lastObject];
-        if (lastModifiedNode == nil) {
-            return nil;
-        }
-        NSDate *lastModified = [RFC822 dateFromString:[lastModifiedNode stringValue] error:error];
-        if (lastModified == nil) {
-            return nil;
-        }
-        item.fileLastModified = lastModified;
-        
-        NSXMLNode *sizeNode = [[objectNode nodesForXPath:@"Size" error:error] lastObject];
-        if (sizeNode == nil) {
-            return nil;
-        }
-        unsigned long long size = [[numberFormatter numberFromString:[sizeNode stringValue]] unsignedLongLongValue];
-        item.fileSize = size;
-        
-        NSArray *nodes = [objectNode nodesForXPath:@"StorageClass" error:error];
-        if (nodes == nil) {
-            return nil;
-        }
-        NSString *storageClass = [[nodes lastObject] stringValue];
-        if (storageClass == nil) {
-            storageClass = @"STANDARD";
-        }
-        item.storageClass = storageClass;
-        
-        NSString *etag = [[[objectNode nodesForXPath:@"ETag" error:NULL] lastObject] stringValue];
-        if (etag != nil) {
-            if ([etag hasPrefix:@"\""] && [etag hasSuffix:@"\""]) {
-                etag = [etag substringWithRange:NSMakeRange(1, [etag length] - 2)];
-            }
-            item.checksum = [@"md5:" stringByAppendingString:etag];
-        }
-        
-        [ret addObject:item];
-        
-    }
-    if (lastObjectPath != nil) {
-        
-        marker = [lastObjectPath substringFromIndex:1];
-    }
-    return ret;
-}
-
-- (NSArray *)parseXMLResponse:(NSData *)response foundPrefixes:(NSArray **)foundPrefixes error:(NSError **)error {
-    NSError *myError = nil;
-    NSXMLDocument *xmlDoc = [[NSXMLDocument alloc] initWithData:response options:0 error:&myError];
-    if (!xmlDoc) {
-        HSLogDebug(@"list Objects XML data: %@", [[NSString alloc] initWithData:response encoding:NSUTF8StringEncoding]);
-        SETNSERROR([S3Service errorDomain], [myError code], @"error parsing List Objects XML response: %@", myError);
-        return nil;
-    }
-    NSXMLElement *rootElement = [xmlDoc rootElement];
-    NSArray *isTruncatedNodes = [rootElement nodesForXPath:@"//ListBucketResult/IsTruncated" error:&myError];
-    if (isTruncatedNodes == nil) {
-        HSLogError(@"nodesForXPath: %@", myError);
+        HSLogError(@"error parsing ListBucketResult response: %@", myError);
         SETERRORFROMMYERROR;
-        return nil;
-    }
-    if ([isTruncatedNodes count] == 0) {
-        isTruncated = NO;
-    } else {
-        isTruncated = [[[isTruncatedNodes objectAtIndex:0] stringValue] isEqualToString:@"true"];
+        return NO;
     }
-    NSArray *prefixNodes = [rootElement nodesForXPath:@"//ListBucketResult/CommonPrefixes/Prefix" error:error];
-    if (prefixNodes == nil) {
-        if (error != NULL) {
-            HSLogError(@"error getting //ListBucketResult/CommonPrefixes/Prefix nodes: %@", *error);
+    isTruncated = [theParser isTruncated];
+    if (isTruncated) {
+        if ([theParser nextMarker] == nil || [[theParser nextMarker] isEqualToString:marker]) {
+            SETNSERROR([S3Service errorDomain], -1, @"truncated ListBucketResult response has no new marker");
+            return NO;
         }
-        return nil;
-    }
-    NSMutableArray *theFoundPrefixes = [NSMutableArray array];
-    for (NSXMLNode *prefixNode in prefixNodes) {
-        NSString *thePrefix = [prefixNode stringValue];
-        thePrefix = [thePrefix substringToIndex:([thePrefix length] - 1)];
-        [theFoundPrefixes addObject:[NSString stringWithFormat:@"/%@/%@", s3BucketName, thePrefix]];
-    }
-    if (foundPrefixes != NULL) {
-        *foundPrefixes = theFoundPrefixes;
+        marker = [theParser nextMarker];
     }
-    return [rootElement nodesForXPath:@"//ListBucketResult/Contents" error:error];
+    return YES;
 }
 @end
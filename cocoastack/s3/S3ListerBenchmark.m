@@ -0,0 +1,171 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "S3ListerBenchmark.h"
+#import "S3ListBucketResultParser.h"
+#import "Item.h"
+#import "RFC822.h"
+
+
+#define BENCHMARK_S3_BUCKET_NAME @"benchmark-bucket"
+#define BENCHMARK_OLD_PAGE_SIZE (500)
+#define BENCHMARK_NEW_PAGE_SIZE (1000)
+
+
+@interface S3ListerBenchmarkCounter : NSObject <S3ListBucketResultParserDelegate> {
+    NSUInteger count;
+}
+- (NSUInteger)count;
+@end
+
+@implementation S3ListerBenchmarkCounter
+- (NSUInteger)count {
+    return count;
+}
+- (BOOL)parser:(S3ListBucketResultParser *)theParser didFindItem:(Item *)theItem error:(NSError **)error {
+    count++;
+    return YES;
+}
+@end
+
+
+@implementation S3ListerBenchmark
+- (id)initWithObjectCount:(NSUInteger)theObjectCount {
+    if (self = [super init]) {
+        objectCount = theObjectCount;
+        results = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+- (BOOL)run:(NSError **)error {
+    NSArray *keys = [self sortedKeys];
+
+    NSArray *oldPages = [self pagesForKeys:keys pageSize:BENCHMARK_OLD_PAGE_SIZE];
+    NSUInteger itemCount = 0;
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSData *page in oldPages) {
+        @autoreleasepool {
+            NSInteger count = [self domItemCountForPage:page error:error];
+            if (count < 0) {
+                return NO;
+            }
+            itemCount += (NSUInteger)count;
+        }
+    }
+    [self addResultWithMethod:@"NSXMLDocument, 500 keys per page" pages:[oldPages count] items:itemCount seconds:([NSDate timeIntervalSinceReferenceDate] - start)];
+    oldPages = nil;
+
+    NSArray *newPages = [self pagesForKeys:keys pageSize:BENCHMARK_NEW_PAGE_SIZE];
+    S3ListerBenchmarkCounter *counter = [[S3ListerBenchmarkCounter alloc] init];
+    S3ListBucketResultParser *parser = [[S3ListBucketResultParser alloc] initWithS3BucketName:BENCHMARK_S3_BUCKET_NAME delegate:counter];
+    start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSData *page in newPages) {
+        @autoreleasepool {
+            if (![parser parse:page error:error]) {
+                return NO;
+            }
+        }
+    }
+    [self addResultWithMethod:@"NSXMLParser, 1000 keys per page" pages:[newPages count] items:[counter count] seconds:([NSDate timeIntervalSinceReferenceDate] - start)];
+    return YES;
+}
+- (NSArray *)results {
+    return results;
+}
+
+#pragma mark internal
+- (NSArray *)sortedKeys {
+    // Same shape as an Arq 5 objects prefix: <computer UUID>/objects/<sha1>.
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:objectCount];
+    for (NSUInteger i = 0; i < objectCount; i++) {
+        [ret addObject:[NSString stringWithFormat:@"B0B1F3E6-6A3C-4E59-9C4D-3C1D6D0E3A72/objects/%08x%08x%08x%08x%08x", arc4random(), arc4random(), arc4random(), arc4random(), arc4random()]];
+    }
+    [ret sortUsingSelector:@selector(compare:)];
+    return ret;
+}
+- (NSArray *)pagesForKeys:(NSArray *)theKeys pageSize:(NSUInteger)thePageSize {
+    NSMutableArray *ret = [NSMutableArray array];
+    for (NSUInteger pageStart = 0; pageStart == 0 || pageStart < [theKeys count]; pageStart += thePageSize) {
+        @autoreleasepool {
+            NSUInteger pageEnd = MIN([theKeys count], pageStart + thePageSize);
+            NSMutableString *xml = [NSMutableString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Name>%@</Name><Prefix>B0B1F3E6-6A3C-4E59-9C4D-3C1D6D0E3A72/objects/</Prefix><Marker></Marker><MaxKeys>%lu</MaxKeys><IsTruncated>%@</IsTruncated>",
+                                    BENCHMARK_S3_BUCKET_NAME, (unsigned long)thePageSize, (pageEnd < [theKeys count] ? @"true" : @"false")];
+            for (NSUInteger i = pageStart; i < pageEnd; i++) {
+                [xml appendFormat:@"<Contents><Key>%@</Key><LastModified>2024-03-01T12:34:56.000Z</LastModified><ETag>&quot;%08x%08x%08x%08x&quot;</ETag><Size>%u</Size><Owner><ID>0123456789abcdef</ID><DisplayName>benchmark</DisplayName></Owner><StorageClass>STANDARD</StorageClass></Contents>",
+                 [theKeys objectAtIndex:i], arc4random(), arc4random(), arc4random(), arc4random(), arc4random_uniform(10000000)];
+            }
+            [xml appendString:@"</ListBucketResult>"];
+            [ret addObject:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+        }
+    }
+    return ret;
+}
+- (NSInteger)domItemCountForPage:(NSData *)thePage error:(NSError **)error {
+    // What S3Lister used to do with each response.
+    NSXMLDocument *xmlDoc = [[NSXMLDocument alloc] initWithData:thePage options:0 error:error];
+    if (xmlDoc == nil) {
+        return -1;
+    }
+    NSXMLElement *rootElement = [xmlDoc rootElement];
+    if ([rootElement nodesForXPath:@"//ListBucketResult/IsTruncated" error:error] == nil) {
+        return -1;
+    }
+    if ([rootElement nodesForXPath:@"//ListBucketResult/CommonPrefixes/Prefix" error:error] == nil) {
+        return -1;
+    }
+    NSArray *contents = [rootElement nodesForXPath:@"//ListBucketResult/Contents" error:error];
+    if (contents == nil) {
+        return -1;
+    }
+    NSNumberFormatter *numberFormatter = [[NSNumberFormatter alloc] init];
+    for (NSXMLNode *objectNode in contents) {
+        Item *item = [[Item alloc] init];
+        item.name = [[[[objectNode nodesForXPath:@"Key" error:error] lastObject] stringValue] lastPathComponent];
+        item.fileLastModified = [RFC822 dateFromString:[[[objectNode nodesForXPath:@"LastModified" error:error] lastObject] stringValue] error:error];
+        if (item.fileLastModified == nil) {
+            return -1;
+        }
+        item.fileSize = [[numberFormatter numberFromString:[[[objectNode nodesForXPath:@"Size" error:error] lastObject] stringValue]] unsignedLongLongValue];
+        item.storageClass = [[[objectNode nodesForXPath:@"StorageClass" error:error] lastObject] stringValue];
+        item.checksum = [[[objectNode nodesForXPath:@"ETag" error:error] lastObject] stringValue];
+    }
+    return (NSInteger)[contents count];
+}
+- (void)addResultWithMethod:(NSString *)theMethod pages:(NSUInteger)thePages items:(NSUInteger)theItems seconds:(NSTimeInterval)theSeconds {
+    [results addObject:[NSDictionary dictionaryWithObjectsAndKeys:
+                        theMethod, @"method",
+                        [NSNumber numberWithUnsignedInteger:thePages], @"pages",
+                        [NSNumber numberWithUnsignedInteger:theItems], @"items",
+                        [NSNumber numberWithDouble:theSeconds], @"seconds", nil]];
+}
+@end
@@ -33,6 +33,7 @@
 @protocol S3AuthorizationProvider;
 @protocol DataTransferDelegate;
 @protocol TargetConnectionDelegate;
+@class LocalHTTPStandIn;
 
 @interface S3Request : NSObject {
     NSString *method;
@@ -44,11 +45,32 @@
     unsigned long long bytesUploaded;
     int httpResponseCode;
     NSMutableDictionary *responseHeaders;
+    NSTimeInterval deadline;
+    LocalHTTPStandIn *localHTTPStandIn;
 }
+// If a GET or HEAD hasn't started receiving its response by this percentile of recent GETs' times to first byte,
+// a duplicate is sent and the first response wins; the other one is cancelled. Time to first byte doesn't depend on
+// how much is being downloaded, so large GETs aren't hedged merely for being large; a response that stalls part way
+// through is left to the deadline instead.
+// From the S3HedgePercentile default; 0 (the default) turns hedging off.
++ (double)hedgePercentile;
++ (void)setHedgePercentile:(double)thePercentile;
+
+// How long dataWithTargetConnectionDelegate:error: may take for a GET or HEAD, retries included, before failing with ERROR_TIMEOUT.
+// Other methods aren't safe to abandon part way through, so they have no deadline.
+// From the S3RequestDeadlineSeconds default; 0 (the default) means no deadline.
++ (NSTimeInterval)deadlineSeconds;
++ (void)setDeadlineSeconds:(NSTimeInterval)theDeadlineSeconds;
+
 - (id)initWithMethod:(NSString *)theMethod endpoint:(NSURL *)theEndpoint path:(NSString *)thePath queryString:(NSString *)theQueryString authorizationProvider:(id <S3AuthorizationProvider>)theSAP error:(NSError **)error;
 - (id)initWithMethod:(NSString *)theMethod endpoint:(NSURL *)theEndpoint path:(NSString *)thePath queryString:(NSString *)theQueryString authorizationProvider:(id <S3AuthorizationProvider>)theSAP dataTransferDelegate:(id <DataTransferDelegate>)theDelegate error:(NSError **)error;
 - (void)setRequestBody:(NSData *)theRequestBody;
 - (void)setRequestHeader:(NSString *)value forKey:(NSString *)key;
+
+// Answers this request's connections with theStandIn instead of going over the network. Used by S3HedgingSimulation.
+- (void)setLocalHTTPStandIn:(LocalHTTPStandIn *)theStandIn;
+
+// 304 (Not Modified) counts as success, with an empty response; it only comes back if an If-None-Match header was set.
 - (int)httpResponseCode;
 - (NSArray *)responseHeaderKeys;
 - (NSString *)responseHeaderForKey:(NSString *)theKey;
@@ -44,12 +44,127 @@
 #import "ISO8601Date.h"
 #import "SHA256Hash.h"
 #import "NSString_extra.h"
+#import "S3RequestMetrics.h"
+#import "LocalHTTPStandIn.h"
 
 #define INITIAL_RETRY_SLEEP (0.5)
 #define RETRY_SLEEP_GROWTH_FACTOR (1.5)
 #define MAX_RETRY_SLEEP (5.0)
 
+// Don't hedge sooner than this, however fast recent requests were.
+#define MIN_HEDGE_DELAY (0.05)
+
+
+static double g_hedgePercentile = 0;
+static NSTimeInterval g_deadlineSeconds = 0;
+static dispatch_once_t g_settingsOnce;
+
+static void loadSettings(void) {
+    dispatch_once(&g_settingsOnce, ^{
+        g_hedgePercentile = [[NSUserDefaults standardUserDefaults] doubleForKey:@"S3HedgePercentile"];
+        g_deadlineSeconds = [[NSUserDefaults standardUserDefaults] doubleForKey:@"S3RequestDeadlineSeconds"];
+    });
+}
+
+
+// One execution of a request on its own thread. Fields other than the connection are guarded by the shared NSCondition.
+@interface S3RequestAttempt : NSObject {
+    id <HTTPConnection> conn;
+    NSData *body;
+    NSCondition *condition;
+    NSString *stringToSign;
+    NSString *canonicalRequest;
+    NSTimeInterval startTime;
+    BOOL finished;
+    NSData *response;
+    NSError *error;
+}
+- (id)initWithConnection:(id <HTTPConnection>)theConn body:(NSData *)theBody condition:(NSCondition *)theCondition stringToSign:(NSString *)theStringToSign canonicalRequest:(NSString *)theCanonicalRequest;
+- (void)start;
+- (void)cancel;
+- (id <HTTPConnection>)conn;
+- (NSString *)stringToSign;
+- (NSString *)canonicalRequest;
+- (NSTimeInterval)startTime;
+- (BOOL)finished;
+- (NSData *)response;
+- (NSError *)error;
+@end
+
+@implementation S3RequestAttempt
+- (id)initWithConnection:(id <HTTPConnection>)theConn body:(NSData *)theBody condition:(NSCondition *)theCondition stringToSign:(NSString *)theStringToSign canonicalRequest:(NSString *)theCanonicalRequest {
+    if (self = [super init]) {
+        conn = theConn;
+        body = theBody;
+        condition = theCondition;
+        stringToSign = theStringToSign;
+        canonicalRequest = theCanonicalRequest;
+    }
+    return self;
+}
+- (void)start {
+    startTime = [NSDate timeIntervalSinceReferenceDate];
+    [NSThread detachNewThreadSelector:@selector(run) toTarget:self withObject:nil];
+}
+- (void)cancel {
+    [conn cancel];
+}
+- (id <HTTPConnection>)conn {
+    return conn;
+}
+- (NSString *)stringToSign {
+    return stringToSign;
+}
+- (NSString *)canonicalRequest {
+    return canonicalRequest;
+}
+- (NSTimeInterval)startTime {
+    return startTime;
+}
+- (BOOL)finished {
+    return finished;
+}
+- (NSData *)response {
+    return response;
+}
+- (NSError *)error {
+    return error;
+}
+
+#pragma mark internal
+- (void)run {
+    @autoreleasepool {
+        NSError *myError = nil;
+        NSData *theResponse = [conn executeRequestWithBody:body error:&myError];
+        [condition lock];
+        response = theResponse;
+        error = myError;
+        finished = YES;
+        [condition broadcast];
+        [condition unlock];
+    }
+}
+@end
+
+
 @implementation S3Request
++ (double)hedgePercentile {
+    loadSettings();
+    return g_hedgePercentile;
+}
++ (void)setHedgePercentile:(double)thePercentile {
+    loadSettings();
+    g_hedgePercentile = thePercentile;
+}
++ (NSTimeInterval)deadlineSeconds {
+    loadSettings();
+    return g_deadlineSeconds;
+}
++ (void)setDeadlineSeconds:(NSTimeInterval)theDeadlineSeconds {
+    loadSettings();
+    g_deadlineSeconds = theDeadlineSeconds;
+}
+
 - (id)initWithMethod:(NSString *)theMethod endpoint:(NSURL *)theEndpoint path:(NSString *)thePath queryString:(NSString *)theQueryString authorizationProvider:(id <S3AuthorizationProvider>)theSAP error:(NSError **)error {
     return [self initWithMethod:theMethod endpoint:theEndpoint path:thePath queryString:theQueryString authorizationProvider:theSAP dataTransferDelegate:nil error:error];
 }
@@ -86,6 +201,9 @@
 - (void)setRequestHeader:(NSString *)value forKey:(NSString *)key {
     [extraRequestHeaders setObject:value forKey:key];
 }
+- (void)setLocalHTTPStandIn:(LocalHTTPStandIn *)theStandIn {
+    localHTTPStandIn = theStandIn;
+}
 - (int)httpResponseCode {
     return httpResponseCode;
 }
@@ -96,6 +214,8 @@
     return [responseHeaders objectForKey:theKey];
 }
 - (NSData *)dataWithTargetConnectionDelegate:(id<TargetConnectionDelegate>)theDelegate error:(NSError **)error {
+    NSTimeInterval deadlineSeconds = [S3Request deadlineSeconds];
+    deadline = (deadlineSeconds > 0 && [self isReadOnly]) ? [NSDate timeIntervalSinceReferenceDate] + deadlineSeconds : 0;
     NSTimeInterval sleepTime = INITIAL_RETRY_SLEEP;
     NSData *responseData = nil;
     NSError *myError = nil;
@@ -113,6 +233,13 @@
         if ([myError isErrorWithDomain:[S3Service errorDomain] code:ERROR_NOT_FOUND]) {
             break;
         }
+        if (deadline > 0 && [NSDate timeIntervalSinceReferenceDate] >= deadline) {
+            if (![myError isErrorWithDomain:[S3Service errorDomain] code:ERROR_TIMEOUT]) {
+                [[S3RequestMetrics sharedS3RequestMetrics] recordDeadlineExceeded];
+                myError = [[NSError alloc] initWithDomain:[S3Service errorDomain] code:ERROR_TIMEOUT description:[NSString stringWithFormat:@"%@ %@ did not succeed within %0.1f seconds: %@", method, url, deadlineSeconds, [myError localizedDescription]]];
+            }
+            break;
+        }
         BOOL is500Error = NO;
         if ([myError isErrorWithDomain:[S3Service errorDomain] code:ERROR_TEMPORARY_REDIRECT]) {
             NSString *location = [[myError userInfo] objectForKey:@"location"];
@@ -157,8 +284,14 @@
         }
         
         HSLogDetail(@"retrying %@ %@: %@", method, url, myError);
+        [[S3RequestMetrics sharedS3RequestMetrics] recordRetry];
         if (needSleep) {
-            [NSThread sleepForTimeInterval:sleepTime];
+            // Jitter the sleep so workers that failed together don't all retry together.
+            NSTimeInterval jitteredSleepTime = sleepTime / 2.0 + (sleepTime / 2.0) * ((double)arc4random_uniform(1001) / 1000.0);
+            if (deadline > 0) {
+                jitteredSleepTime = MIN(jitteredSleepTime, MAX(0, deadline - [NSDate timeIntervalSinceReferenceDate]));
+            }
+            [NSThread sleepForTimeInterval:jitteredSleepTime];
             sleepTime *= RETRY_SLEEP_GROWTH_FACTOR;
             if (sleepTime > MAX_RETRY_SLEEP) {
                 sleepTime = MAX_RETRY_SLEEP;
@@ -178,8 +311,48 @@
 }
 
 #pragma mark internal
+- (BOOL)isReadOnly {
+    // Only these are safe to send twice or to abandon part way through.
+    return ([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"]) && requestBody == nil;
+}
 - (NSData *)dataOnce:(NSError **)error {
-    id <HTTPConnection> conn = [[HTTPConnectionFactory theFactory] newHTTPConnectionToURL:url method:method dataTransferDelegate:dataTransferDelegate];
+    NSTimeInterval hedgeDelay = 0;
+    if ([self isReadOnly] && [S3Request hedgePercentile] > 0) {
+        hedgeDelay = [[S3RequestMetrics sharedS3RequestMetrics] latencyAtPercentile:[S3Request hedgePercentile]];
+        if (hedgeDelay > 0 && hedgeDelay < MIN_HEDGE_DELAY) {
+            hedgeDelay = MIN_HEDGE_DELAY;
+        }
+    }
+    if (hedgeDelay > 0 || deadline > 0) {
+        return [self dataFromAttemptsWithHedgeDelay:hedgeDelay error:error];
+    }
+    
+    NSString *stringToSign = nil;
+    NSString *canonicalRequest = nil;
+    id <HTTPConnection> conn = [self newSignedConnectionWithDataTransferDelegate:dataTransferDelegate stringToSign:&stringToSign canonicalRequest:&canonicalRequest error:error];
+    if (conn == nil) {
+        return nil;
+    }
+    
+    bytesUploaded = 0;
+    
+//    HSLogDebug(@"%@ %@", method, url);
+    
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    NSData *response = [conn executeRequestWithBody:requestBody error:error];
+    if (response == nil) {
+        return nil;
+    }
+    [self recordTimeToFirstByteForConnection:conn startTime:startTime];
+    return [self dataForResponse:response connection:conn stringToSign:stringToSign canonicalRequest:canonicalRequest error:error];
+}
+- (id <HTTPConnection>)newSignedConnectionWithDataTransferDelegate:(id <DataTransferDelegate>)theDTD stringToSign:(NSString **)outStringToSign canonicalRequest:(NSString **)outCanonicalRequest error:(NSError **)error {
+    id <HTTPConnection> conn = nil;
+    if (localHTTPStandIn != nil) {
+        conn = [localHTTPStandIn newHTTPConnectionToURL:url method:method];
+    } else {
+        conn = [[HTTPConnectionFactory theFactory] newHTTPConnectionToURL:url method:method dataTransferDelegate:theDTD];
+    }
     if (conn == nil) {
         return nil;
     }
@@ -192,7 +365,7 @@
         [conn setRequestHeader:[NSString stringWithFormat:@"%lu", (unsigned long)[requestBody length]] forKey:@"Content-Length"];
         contentSHA256 = [NSString hexStringWithData:[SHA256Hash hashData:requestBody]];
     } else {
-        contentSHA256 = [NSString hexStringWithData:[SHA256Hash hashData:[@"" dataUsingEncoding:NSUTF8StringEncoding]]];
+        contentSHA256 = EMPTY_SHA256_HEX;
     }
     
     if ([sap signatureVersion] == 4) {
@@ -206,21 +379,110 @@
         [conn setRequestHeader:[extraRequestHeaders objectForKey:headerKey] forKey:headerKey];
     }
     
+    if (![sap setAuthorizationOnHTTPConnection:conn contentSHA256:contentSHA256 now:now stringToSign:outStringToSign canonicalRequest:outCanonicalRequest error:error]) {
+        return nil;
+    }
+    return conn;
+}
+- (S3RequestAttempt *)startAttemptWithDataTransferDelegate:(id <DataTransferDelegate>)theDTD condition:(NSCondition *)theCondition error:(NSError **)error {
     NSString *stringToSign = nil;
     NSString *canonicalRequest = nil;
-    if (![sap setAuthorizationOnHTTPConnection:conn contentSHA256:contentSHA256 now:now stringToSign:&stringToSign canonicalRequest:&canonicalRequest error:error]) {
+    id <HTTPConnection> conn = [self newSignedConnectionWithDataTransferDelegate:theDTD stringToSign:&stringToSign canonicalRequest:&canonicalRequest error:error];
+    if (conn == nil) {
         return nil;
     }
-    
+    S3RequestAttempt *attempt = [[S3RequestAttempt alloc] initWithConnection:conn body:requestBody condition:theCondition stringToSign:stringToSign canonicalRequest:canonicalRequest];
+    [attempt start];
+    return attempt;
+}
+- (NSData *)dataFromAttemptsWithHedgeDelay:(NSTimeInterval)theHedgeDelay error:(NSError **)error {
+    // Run the request on its own thread so we can give up at the deadline, and send a duplicate
+    // if it's slower than theHedgeDelay. The first attempt to get an HTTP response wins; an attempt
+    // that's abandoned is cancelled, so it stops using the network and calling the data transfer delegate.
+    NSCondition *condition = [[NSCondition alloc] init];
     bytesUploaded = 0;
+    S3RequestAttempt *primary = [self startAttemptWithDataTransferDelegate:dataTransferDelegate condition:condition error:error];
+    if (primary == nil) {
+        return nil;
+    }
+    S3RequestAttempt *hedge = nil;
+    S3RequestAttempt *winner = nil;
+    BOOL deadlineExceeded = NO;
     
-//    HSLogDebug(@"%@ %@", method, url);
+    [condition lock];
+    for (;;) {
+        if ([primary finished] && [primary response] != nil) {
+            winner = primary;
+            break;
+        }
+        if (hedge != nil && [hedge finished] && [hedge response] != nil) {
+            winner = hedge;
+            break;
+        }
+        if ([primary finished] && (hedge == nil || [hedge finished])) {
+            winner = primary;
+            break;
+        }
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        if (deadline > 0 && now >= deadline) {
+            deadlineExceeded = YES;
+            break;
+        }
+        // Once the primary's response has started arriving it's only a matter of transfer time, which a duplicate wouldn't shorten.
+        BOOL mayHedge = theHedgeDelay > 0 && hedge == nil && ![primary finished] && [[primary conn] responseStartTime] == 0;
+        NSTimeInterval hedgeTime = [primary startTime] + theHedgeDelay;
+        if (mayHedge && now >= hedgeTime) {
+            [condition unlock];
+            HSLogDetail(@"%@ %@ has no response after %0.3f seconds; sending a hedged request", method, url, theHedgeDelay);
+            [[S3RequestMetrics sharedS3RequestMetrics] recordHedgeFired];
+            NSError *myError = nil;
+            // Progress is reported only by the primary attempt.
+            hedge = [self startAttemptWithDataTransferDelegate:nil condition:condition error:&myError];
+            if (hedge == nil) {
+                HSLogWarn(@"failed to send hedged request for %@ %@: %@", method, url, myError);
+            }
+            [condition lock];
+            continue;
+        }
+        NSTimeInterval wakeTime = deadline > 0 ? deadline : [[NSDate distantFuture] timeIntervalSinceReferenceDate];
+        if (mayHedge && hedgeTime < wakeTime) {
+            wakeTime = hedgeTime;
+        }
+        [condition waitUntilDate:[NSDate dateWithTimeIntervalSinceReferenceDate:wakeTime]];
+    }
+    [condition unlock];
     
-    NSData *response = [conn executeRequestWithBody:requestBody error:error];
-    if (response == nil) {
+    if (primary != winner) {
+        [primary cancel];
+    }
+    if (hedge != nil && hedge != winner) {
+        [hedge cancel];
+    }
+    if (deadlineExceeded) {
+        [[S3RequestMetrics sharedS3RequestMetrics] recordDeadlineExceeded];
+        SETNSERROR([S3Service errorDomain], ERROR_TIMEOUT, @"%@ %@ did not finish within %0.1f seconds", method, url, [S3Request deadlineSeconds]);
         return nil;
     }
-    
+    if (winner == hedge) {
+        HSLogDetail(@"hedged request won for %@ %@", method, url);
+        [[S3RequestMetrics sharedS3RequestMetrics] recordHedgeWon];
+    }
+    if ([winner response] == nil) {
+        if (error != NULL) {
+            *error = [winner error];
+        }
+        return nil;
+    }
+    [self recordTimeToFirstByteForConnection:[winner conn] startTime:[winner startTime]];
+    return [self dataForResponse:[winner response] connection:[winner conn] stringToSign:[winner stringToSign] canonicalRequest:[winner canonicalRequest] error:error];
+}
+- (void)recordTimeToFirstByteForConnection:(id <HTTPConnection>)theConn startTime:(NSTimeInterval)theStartTime {
+    NSTimeInterval responseStartTime = [theConn responseStartTime];
+    if ([method isEqualToString:@"GET"] && [theConn responseCode] >= 200 && [theConn responseCode] <= 299 && responseStartTime > 0) {
+        [[S3RequestMetrics sharedS3RequestMetrics] recordLatency:(responseStartTime - theStartTime)];
+    }
+}
+- (NSData *)dataForResponse:(NSData *)response connection:(id <HTTPConnection>)conn stringToSign:(NSString *)stringToSign canonicalRequest:(NSString *)canonicalRequest error:(NSError **)error {
     [responseHeaders setDictionary:[conn responseHeaders]];
     
     httpResponseCode = [conn responseCode];
@@ -228,6 +490,11 @@
         HSLogDebug(@"HTTP %d; returning response length=%ld", httpResponseCode, (long)[response length]);
         return response;
     }
+    if (httpResponseCode == ARQ_HTTP_NOT_MODIFIED) {
+        // Only sent in answer to a conditional request; the caller checks httpResponseCode.
+        HSLogDebug(@"HTTP %d; not modified", httpResponseCode);
+        return response;
+    }
     HSLogDebug(@"HTTP %d; response length=%ld", httpResponseCode, (long)[response length]);
     
     NSString *responseString = [[NSString alloc] initWithBytes:[response bytes] length:[response length] encoding:NSUTF8StringEncoding];
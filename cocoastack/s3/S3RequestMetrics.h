@@ -0,0 +1,71 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "CWLSynthesizeSingleton.h"
+
+
+#define S3_REQUEST_LATENCY_SAMPLE_COUNT (512)
+
+
+// Process-wide time-to-first-byte samples for successful S3 GETs, used to decide when to hedge,
+// and counters for retries, hedged requests and missed deadlines.
+@interface S3RequestMetrics : NSObject {
+    NSLock *lock;
+    NSTimeInterval latencies[S3_REQUEST_LATENCY_SAMPLE_COUNT];
+    NSUInteger latencyCount;
+    NSUInteger nextLatencyIndex;
+    unsigned long long hedgesFired;
+    unsigned long long hedgesWon;
+    unsigned long long deadlinesExceeded;
+    unsigned long long retries;
+}
+CWL_DECLARE_SINGLETON_FOR_CLASS(S3RequestMetrics)
+
+- (void)recordLatency:(NSTimeInterval)theLatency;
+
+// Returns 0 until enough latencies have been recorded to be meaningful.
+- (NSTimeInterval)latencyAtPercentile:(double)thePercentile;
+
+- (void)recordHedgeFired;
+- (void)recordHedgeWon;
+- (void)recordDeadlineExceeded;
+- (void)recordRetry;
+
+- (unsigned long long)hedgesFired;
+- (unsigned long long)hedgesWon;
+- (unsigned long long)deadlinesExceeded;
+- (unsigned long long)retries;
+
+// Forgets the latency samples and zeroes the counters.
+- (void)reset;
+@end
@@ -0,0 +1,134 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "S3RequestMetrics.h"
+
+
+#define MIN_LATENCY_SAMPLES_FOR_PERCENTILE (20)
+
+
+@implementation S3RequestMetrics
+CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(S3RequestMetrics)
+
+- (id)init {
+    if (self = [super init]) {
+        lock = [[NSLock alloc] init];
+        [lock setName:@"S3RequestMetrics lock"];
+    }
+    return self;
+}
+- (void)recordLatency:(NSTimeInterval)theLatency {
+    [lock lock];
+    latencies[nextLatencyIndex] = theLatency;
+    nextLatencyIndex = (nextLatencyIndex + 1) % S3_REQUEST_LATENCY_SAMPLE_COUNT;
+    if (latencyCount < S3_REQUEST_LATENCY_SAMPLE_COUNT) {
+        latencyCount++;
+    }
+    [lock unlock];
+}
+- (NSTimeInterval)latencyAtPercentile:(double)thePercentile {
+    NSTimeInterval sorted[S3_REQUEST_LATENCY_SAMPLE_COUNT];
+    [lock lock];
+    NSUInteger count = latencyCount;
+    memcpy(sorted, latencies, sizeof(NSTimeInterval) * count);
+    [lock unlock];
+    
+    if (count < MIN_LATENCY_SAMPLES_FOR_PERCENTILE) {
+        return 0;
+    }
+    qsort_b(sorted, count, sizeof(NSTimeInterval), ^int(const void *a, const void *b) {
+        NSTimeInterval lhs = *(const NSTimeInterval *)a;
+        NSTimeInterval rhs = *(const NSTimeInterval *)b;
+        return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+    });
+    NSUInteger index = (NSUInteger)((thePercentile / 100.0) * (double)(count - 1) + 0.5);
+    if (index >= count) {
+        index = count - 1;
+    }
+    return sorted[index];
+}
+- (void)recordHedgeFired {
+    [lock lock];
+    hedgesFired++;
+    [lock unlock];
+}
+- (void)recordHedgeWon {
+    [lock lock];
+    hedgesWon++;
+    [lock unlock];
+}
+- (void)recordDeadlineExceeded {
+    [lock lock];
+    deadlinesExceeded++;
+    [lock unlock];
+}
+- (void)recordRetry {
+    [lock lock];
+    retries++;
+    [lock unlock];
+}
+- (unsigned long long)hedgesFired {
+    [lock lock];
+    unsigned long long ret = hedgesFired;
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)hedgesWon {
+    [lock lock];
+    unsigned long long ret = hedgesWon;
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)deadlinesExceeded {
+    [lock lock];
+    unsigned long long ret = deadlinesExceeded;
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)retries {
+    [lock lock];
+    unsigned long long ret = retries;
+    [lock unlock];
+    return ret;
+}
+- (void)reset {
+    [lock lock];
+    latencyCount = 0;
+    nextLatencyIndex = 0;
+    hedgesFired = 0;
+    hedgesWon = 0;
+    deadlinesExceeded = 0;
+    retries = 0;
+    [lock unlock];
+}
+@end
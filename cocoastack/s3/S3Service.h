@@ -43,6 +43,7 @@
 #define S3_INITIAL_RETRY_SLEEP (0.5)
 #define S3_RETRY_SLEEP_GROWTH_FACTOR (1.5)
 #define S3_MAX_RETRY (5)
+#define S3_MAX_RANGES_PER_REQUEST (32)
 
 extern NSString *kS3StorageClassStandard;
 extern NSString *kS3StorageClassReducedRedundancy;
@@ -62,9 +63,17 @@ enum {
 @interface S3Service : NSObject <ItemFS, NSCopying> {
     id <S3AuthorizationProvider> sap;
     NSURL *endpoint;
+    NSLock *lock;
+    BOOL multiRangeRequestsIgnored;
 }
 + (NSString *)errorDomain;
 
+// Whether contentsOfRanges: asks for several ranges in one GET (the S3MultiRangeRequests default).
+// Off by default: AWS S3 ignores multi-range requests and sends the whole object, so the first batch would download
+// the entire pack. Only worth enabling for S3-compatible servers that support them.
++ (BOOL)multiRangeRequestsEnabled;
++ (void)setMultiRangeRequestsEnabled:(BOOL)theEnabled;
+
 - (id)initWithS3AuthorizationProvider:(id <S3AuthorizationProvider>)theSAP endpoint:(NSURL *)theEndpoint;
 
 - (S3Owner *)s3OwnerWithTargetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error;
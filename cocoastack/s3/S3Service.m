@@ -54,10 +54,20 @@
 #import "ISO8601Date.h"
 #import "Item.h"
 #import "S3ObjectsLister.h"
+#import "HTTPByteRanges.h"
 
 NSString *kS3StorageClassStandard = @"STANDARD";
 NSString *kS3StorageClassReducedRedundancy = @"REDUCED_REDUNDANCY";
 
+static BOOL g_multiRangeRequestsEnabled = NO;
+static dispatch_once_t g_multiRangeRequestsOnce;
+
+static void loadMultiRangeRequestsSetting(void) {
+    dispatch_once(&g_multiRangeRequestsOnce, ^{
+        g_multiRangeRequestsEnabled = [[NSUserDefaults standardUserDefaults] boolForKey:@"S3MultiRangeRequests"];
+    });
+}
+
 /*
  * WARNING:
  * This class *must* be reentrant!
@@ -67,11 +77,21 @@ NSString *kS3StorageClassReducedRedundancy = @"REDUCED_REDUNDANCY";
 + (NSString *)errorDomain {
     return @"S3ServiceErrorDomain";
 }
++ (BOOL)multiRangeRequestsEnabled {
+    loadMultiRangeRequestsSetting();
+    return g_multiRangeRequestsEnabled;
+}
++ (void)setMultiRangeRequestsEnabled:(BOOL)theEnabled {
+    loadMultiRangeRequestsSetting();
+    g_multiRangeRequestsEnabled = theEnabled;
+}
 
 - (id)initWithS3AuthorizationProvider:(id <S3AuthorizationProvider>)theSAP endpoint:(NSURL *)theEndpoint {
 	if (self = [super init]) {
 		sap = theSAP;
         endpoint = theEndpoint;
+        lock = [[NSLock alloc] init];
+        [lock setName:@"S3Service lock"];
     }
     return self;
 }
@@ -134,7 +154,7 @@ NSString *kS3StorageClassReducedRedundancy = @"REDUCED_REDUNDANCY";
     id <HTTPConnection> conn = [[HTTPConnectionFactory theFactory] newHTTPConnectionToURL:url method:@"GET" dataTransferDelegate:nil];
     [conn setRequestHostHeader];
     NSDate *now = [NSDate date];
-    NSString *contentSHA256 = [NSString hexStringWithData:[SHA256Hash hashData:[@"" dataUsingEncoding:NSUTF8StringEncoding]]];
+    NSString *contentSHA256 = EMPTY_SHA256_HEX;
     if ([sap signatureVersion] == 4) {
         [conn setRequestHeader:[[ISO8601Date sharedISO8601Date] basicDateTimeStringFromDate:now] forKey:@"x-amz-date"];
         [conn setRequestHeader:contentSHA256 forKey:@"x-amz-content-sha256"];
@@ -272,6 +292,83 @@ NSString *kS3StorageClassReducedRedundancy = @"REDUCED_REDUNDANCY";
     }
     return ret;
 }
+- (NSArray *)contentsOfRanges:(NSArray *)theRanges ofFileItem:(Item *)theItem itemPath:(NSString *)theFullPath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    if (![S3Service multiRangeRequestsEnabled]) {
+        return [self contentsOfRangesOneAtATime:theRanges ofFileItem:theItem itemPath:theFullPath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
+    }
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:[theRanges count]];
+    for (NSUInteger index = 0; index < [theRanges count]; index += S3_MAX_RANGES_PER_REQUEST) {
+        NSArray *batch = [theRanges subarrayWithRange:NSMakeRange(index, MIN((NSUInteger)S3_MAX_RANGES_PER_REQUEST, [theRanges count] - index))];
+        NSString *rangeHeader = [HTTPByteRanges rangeHeaderValueForRanges:batch];
+        if (rangeHeader == nil || [self multiRangeRequestsIgnored]) {
+            NSArray *datas = [self contentsOfRangesOneAtATime:batch ofFileItem:theItem itemPath:theFullPath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
+            if (datas == nil) {
+                return nil;
+            }
+            [ret addObjectsFromArray:datas];
+            continue;
+        }
+        
+        S3Request *s3r = [[S3Request alloc] initWithMethod:@"GET" endpoint:endpoint path:theFullPath queryString:nil authorizationProvider:sap dataTransferDelegate:theDTD error:error];
+        if (s3r == nil) {
+            return nil;
+        }
+        [s3r setRequestHeader:rangeHeader forKey:@"Range"];
+        NSData *body = [s3r dataWithTargetConnectionDelegate:theTCD error:error];
+        if (body == nil) {
+            return nil;
+        }
+        if ([s3r httpResponseCode] == 200 && [batch count] > 1) {
+            // The server sent the whole object instead. We can still slice this one, but don't ask again.
+            HSLogWarn(@"%@ doesn't support multi-range requests; falling back to one request per range", endpoint);
+            [self setMultiRangeRequestsIgnored];
+        }
+        NSArray *datas = [HTTPByteRanges dataForRanges:batch
+                                          responseCode:[s3r httpResponseCode]
+                                           contentType:[s3r responseHeaderForKey:@"Content-Type"]
+                                          contentRange:[s3r responseHeaderForKey:@"Content-Range"]
+                                                  body:body
+                                                 error:error];
+        if (datas == nil) {
+            return nil;
+        }
+        [ret addObjectsFromArray:datas];
+    }
+    return ret;
+}
+- (NSData *)contentsOfFileAtPath:(NSString *)theFullPath unlessChecksumMatches:(NSString *)theChecksum item:(Item **)theItem notModified:(BOOL *)notModified targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    S3Request *s3r = [[S3Request alloc] initWithMethod:@"GET" endpoint:endpoint path:theFullPath queryString:nil authorizationProvider:sap error:error];
+    if (s3r == nil) {
+        return nil;
+    }
+    if ([theChecksum hasPrefix:@"md5:"]) {
+        [s3r setRequestHeader:[NSString stringWithFormat:@"\"%@\"", [theChecksum substringFromIndex:4]] forKey:@"If-None-Match"];
+    }
+    NSData *ret = [s3r dataWithTargetConnectionDelegate:theTCD error:error];
+    if (ret == nil) {
+        return nil;
+    }
+    *notModified = ([s3r httpResponseCode] == ARQ_HTTP_NOT_MODIFIED);
+    if (*notModified) {
+        return [NSData data];
+    }
+    NSString *etag = [s3r responseHeaderForKey:@"ETag"];
+    if (etag == nil) {
+        etag = [s3r responseHeaderForKey:@"Etag"];
+    }
+    Item *item = [[Item alloc] init];
+    item.name = [theFullPath lastPathComponent];
+    item.isDirectory = NO;
+    item.fileSize = [ret length];
+    if (etag != nil) {
+        if ([etag hasPrefix:@"\""] && [etag hasSuffix:@"\""]) {
+            etag = [etag substringWithRange:NSMakeRange(1, [etag length] - 2)];
+        }
+        item.checksum = [@"md5:" stringByAppendingString:etag];
+    }
+    *theItem = item;
+    return ret;
+}
 - (Item *)createFileWithData:(NSData *)theData name:(NSString *)theName inDirectoryItem:(Item *)theDirectoryItem existingItem:(Item *)theExistingItem itemPath:(NSString *)theFullPath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
     if (![theFullPath hasPrefix:@"/"]) {
         SETNSERROR([S3Service errorDomain], S3SERVICE_INVALID_PARAMETERS, @"path must begin with '/'");
@@ -444,6 +541,32 @@ NSString *kS3StorageClassReducedRedundancy = @"REDUCED_REDUNDANCY";
 }
 
 #pragma mark internal
+- (BOOL)multiRangeRequestsIgnored {
+    [lock lock];
+    BOOL ret = multiRangeRequestsIgnored;
+    [lock unlock];
+    return ret;
+}
+- (void)setMultiRangeRequestsIgnored {
+    [lock lock];
+    multiRangeRequestsIgnored = YES;
+    [lock unlock];
+}
+- (NSArray *)contentsOfRangesOneAtATime:(NSArray *)theRanges ofFileItem:(Item *)theItem itemPath:(NSString *)theFullPath dataTransferDelegate:(id <DataTransferDelegate>)theDTD targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD error:(NSError **)error {
+    NSMutableArray *ret = [NSMutableArray arrayWithCapacity:[theRanges count]];
+    for (NSValue *value in theRanges) {
+        if ([value rangeValue].length == 0) {
+            [ret addObject:[NSData data]];
+            continue;
+        }
+        NSData *data = [self contentsOfRange:[value rangeValue] ofFileItem:theItem itemPath:theFullPath dataTransferDelegate:theDTD targetConnectionDelegate:theTCD error:error];
+        if (data == nil) {
+            return nil;
+        }
+        [ret addObject:data];
+    }
+    return ret;
+}
 - (NSXMLDocument *)listBucketsWithTargetConnectionDelegate:(id <TargetConnectionDelegate>)theDelegate error:(NSError **)error {
     S3Request *s3r = [[S3Request alloc] initWithMethod:@"GET" endpoint:endpoint path:@"/" queryString:nil authorizationProvider:sap error:error];
     if (s3r == nil) {
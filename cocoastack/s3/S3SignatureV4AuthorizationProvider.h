@@ -37,8 +37,7 @@
     NSString *accessKey;
     NSString *secretKey;
     AWSRegion *awsRegion;
-    NSMutableDictionary *signingKeysByDateString;
-    NSLock *signingKeysLock;
+    NSString *regionName;
 }
 - (id)initWithAccessKey:(NSString *)access secretKey:(NSString *)secret awsRegion:(AWSRegion *)theAWSRegion;
 
@@ -38,20 +38,63 @@
 #import "NSString_extra.h"
 #import "HTTPConnection.h"
 
-static NSDateFormatter *g_dateFormatter = nil;
+
+// Appends theString's UTF-8 bytes to theData without making an intermediate NSData or C string.
+static void appendUTF8(NSMutableData *theData, NSString *theString) {
+    NSUInteger maxLength = [theString maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger oldLength = [theData length];
+    [theData setLength:oldLength + maxLength];
+    NSUInteger usedLength = 0;
+    [theString getBytes:((char *)[theData mutableBytes] + oldLength) maxLength:maxLength usedLength:&usedLength encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [theString length]) remainingRange:NULL];
+    [theData setLength:oldLength + usedLength];
+}
+static void appendBytes(NSMutableData *theData, const char *theCString) {
+    [theData appendBytes:theCString length:strlen(theCString)];
+}
+
+
+// The signing key for one UTC day. Never mutated, so threads can share one without locking.
+@interface S3SignatureV4SigningKey : NSObject {
+    NSString *dateString;
+    NSData *keyData;
+}
+- (id)initWithDateString:(NSString *)theDateString keyData:(NSData *)theKeyData;
+- (NSString *)dateString;
+- (NSData *)keyData;
+@end
+
+@implementation S3SignatureV4SigningKey
+- (id)initWithDateString:(NSString *)theDateString keyData:(NSData *)theKeyData {
+    if (self = [super init]) {
+        dateString = theDateString;
+        keyData = theKeyData;
+    }
+    return self;
+}
+- (NSString *)dateString {
+    return dateString;
+}
+- (NSData *)keyData {
+    return keyData;
+}
+@end
+
+
+@interface S3SignatureV4AuthorizationProvider ()
+// Swapped (atomically) when the UTC date changes; readers just take whichever key is current.
+@property (atomic, strong) S3SignatureV4SigningKey *currentSigningKey;
+@end
+
 
 @implementation S3SignatureV4AuthorizationProvider
+@synthesize currentSigningKey;
+
 - (id)initWithAccessKey:(NSString *)access secretKey:(NSString *)secret awsRegion:(AWSRegion *)theAWSRegion {
     if (self = [super init]) {
         accessKey = access;
         secretKey = secret;
         awsRegion = theAWSRegion;
-        signingKeysByDateString = [[NSMutableDictionary alloc] init];
-        if (g_dateFormatter == nil) {
-            g_dateFormatter = [[NSDateFormatter alloc] init];
-            [g_dateFormatter setDateFormat:@"yyyyMMdd"];
-        }
-        signingKeysLock = [[NSLock alloc] init];
+        regionName = [theAWSRegion regionName];
     }
     return self;
 }
@@ -60,32 +103,31 @@ static NSDateFormatter *g_dateFormatter = nil;
     return 4;
 }
 - (BOOL)setAuthorizationOnHTTPConnection:(id<HTTPConnection>)conn contentSHA256:(NSString *)theContentSHA256 now:(NSDate *)now stringToSign:(NSString **)outStringToSign canonicalRequest:(NSString **)outCanonicalRequest error:(NSError **)error {
+    NSString *dateString = [[ISO8601Date sharedISO8601Date] basicDateStringFromDate:now];
+
+    // Both are built as UTF-8 bytes and hashed as they are; the NSString forms are only made for callers that ask for them.
     NSString *signedHeaders = nil;
-    NSString *canonicalRequest = [self canonicalRequestForConnection:conn contentSHA256:theContentSHA256 signedHeaders:&signedHeaders];
+    NSData *canonicalRequest = [self canonicalRequestForConnection:conn contentSHA256:theContentSHA256 signedHeaders:&signedHeaders];
     if (outCanonicalRequest != NULL) {
-        *outCanonicalRequest = canonicalRequest;
+        *outCanonicalRequest = [[NSString alloc] initWithData:canonicalRequest encoding:NSUTF8StringEncoding];
     }
-    NSString *theString = [self stringToSignForConnection:conn canonicalRequest:canonicalRequest contentSHA256:theContentSHA256 now:now];
+    NSData *stringToSign = [self stringToSignForConnection:conn canonicalRequest:canonicalRequest dateString:dateString now:now];
     if (outStringToSign != NULL) {
-        *outStringToSign = theString;
+        *outStringToSign = [[NSString alloc] initWithData:stringToSign encoding:NSUTF8StringEncoding];
     }
     
-    [signingKeysLock lock];
-    // Lock before using g_dateFormatter because it's not thread-safe!
-    NSString *dateString = [g_dateFormatter stringFromDate:now];
-    
-    NSData *signingKey = [signingKeysByDateString objectForKey:dateString];
-    if (signingKey == nil) {
-        signingKey = [self makeSigningKeyForDateString:dateString];
-        [signingKeysByDateString setObject:signingKey forKey:dateString];
+    S3SignatureV4SigningKey *signingKey = [self currentSigningKey];
+    if (signingKey == nil || ![[signingKey dateString] isEqualToString:dateString]) {
+        // Threads that cross midnight together may each derive the key; they all derive the same bytes.
+        signingKey = [[S3SignatureV4SigningKey alloc] initWithDateString:dateString keyData:[self makeSigningKeyForDateString:dateString]];
+        [self setCurrentSigningKey:signingKey];
     }
-    [signingKeysLock unlock];
     
-    NSData *signatureData = [HMACSHA256 digestForKey:signingKey data:[theString dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *signatureData = [HMACSHA256 digestForKey:[signingKey keyData] data:stringToSign];
     NSString *signature = [NSString hexStringWithData:signatureData];
     
     NSString *authorization = [NSString stringWithFormat:@"AWS4-HMAC-SHA256 Credential=%@/%@/%@/s3/aws4_request,SignedHeaders=%@,Signature=%@",
-                               accessKey, dateString, [awsRegion regionName], signedHeaders, signature];
+                               accessKey, dateString, regionName, signedHeaders, signature];
     [conn setRequestHeader:authorization forKey:@"Authorization"];
     
     return YES;
@@ -97,7 +139,7 @@ static NSDateFormatter *g_dateFormatter = nil;
     
     NSData *dateKey = [HMACSHA256 digestForKey:[secret dataUsingEncoding:NSUTF8StringEncoding] data:[theDateString dataUsingEncoding:NSUTF8StringEncoding]];
 
-    NSData *dateRegionKey = [HMACSHA256 digestForKey:dateKey data:[[awsRegion regionName] dataUsingEncoding:NSUTF8StringEncoding]];
+    NSData *dateRegionKey = [HMACSHA256 digestForKey:dateKey data:[regionName dataUsingEncoding:NSUTF8StringEncoding]];
     
     NSData *dateRegionServiceKey = [HMACSHA256 digestForKey:dateRegionKey data:[@"s3" dataUsingEncoding:NSUTF8StringEncoding]];
     
@@ -105,31 +147,23 @@ static NSDateFormatter *g_dateFormatter = nil;
 
     return signingKey;
 }
-- (NSString *)stringToSignForConnection:(id<HTTPConnection>)theConnection canonicalRequest:(NSString *)canonicalRequest contentSHA256:(NSString *)theContentSHA256 now:(NSDate *)now {
-    
+- (NSData *)stringToSignForConnection:(id<HTTPConnection>)theConnection canonicalRequest:(NSData *)canonicalRequest dateString:(NSString *)theDateString now:(NSDate *)now {
+    NSMutableData *ret = [[NSMutableData alloc] initWithCapacity:160];
+    appendBytes(ret, "AWS4-HMAC-SHA256\n");
+    appendUTF8(ret, [[ISO8601Date sharedISO8601Date] basicDateTimeStringFromDate:now]);
+    appendBytes(ret, "\n");
+
     // Scope
-    NSMutableString *scope = [[NSMutableString alloc] init];
-    [signingKeysLock lock];
-    // Lock before using g_dateFormatter because it's not thread-safe!
-    [scope appendString:[g_dateFormatter stringFromDate:now]];
-    [signingKeysLock unlock];
-
-    [scope appendString:@"/"];
-    [scope appendString:[awsRegion regionName]];
-    [scope appendString:@"/s3/aws4_request"];
-    
-    // String to sign
-    NSMutableString *ret = [[NSMutableString alloc] init];
-    [ret appendString:@"AWS4-HMAC-SHA256\n"];
-    [ret appendString:[[ISO8601Date sharedISO8601Date] basicDateTimeStringFromDate:now]];
-    [ret appendString:@"\n"];
-    [ret appendString:scope];
-    [ret appendString:@"\n"];
-    [ret appendString:[NSString hexStringWithData:[SHA256Hash hashData:[canonicalRequest dataUsingEncoding:NSUTF8StringEncoding]]]];
+    appendUTF8(ret, theDateString);
+    appendBytes(ret, "/");
+    appendUTF8(ret, regionName);
+    appendBytes(ret, "/s3/aws4_request\n");
+
+    appendUTF8(ret, [NSString hexStringWithData:[SHA256Hash hashData:canonicalRequest]]);
     
 #if 0
-    HSLogDebug(@"v4 stringtosign: %@", ret);
-    NSData *stringToSignData = [ret dataUsingEncoding:NSUTF8StringEncoding];
+    HSLogDebug(@"v4 stringtosign: %@", [[NSString alloc] initWithData:ret encoding:NSUTF8StringEncoding]);
+    NSData *stringToSignData = ret;
     unsigned char *bytes = (unsigned char *)[stringToSignData bytes];
     NSMutableString *debugBuf = [NSMutableString string];
     for (NSUInteger i = 0; i < [stringToSignData length]; i++) {
@@ -140,7 +174,7 @@ static NSDateFormatter *g_dateFormatter = nil;
     
     return ret;
 }
-- (NSString *)canonicalRequestForConnection:(id <HTTPConnection>)theConnection contentSHA256:(NSString *)theContentSHA256 signedHeaders:(NSString **)theSignedHeaders {
+- (NSData *)canonicalRequestForConnection:(id <HTTPConnection>)theConnection contentSHA256:(NSString *)theContentSHA256 signedHeaders:(NSString **)theSignedHeaders {
     /*
      <HTTPMethod>\n
      <CanonicalURI>\n
@@ -150,15 +184,15 @@ static NSDateFormatter *g_dateFormatter = nil;
      <HashedPayload>
      */
     
-    NSMutableString *buf = [[NSMutableString alloc] init];
+    NSMutableData *buf = [[NSMutableData alloc] initWithCapacity:512];
     
     // HTTPMethod
-    [buf appendString:[theConnection requestMethod]];
-    [buf appendString:@"\n"];
+    appendUTF8(buf, [theConnection requestMethod]);
+    appendBytes(buf, "\n");
     
     // CanonicalURI
-    [buf appendString:[theConnection requestPathInfo]];
-    [buf appendString:@"\n"];
+    appendUTF8(buf, [theConnection requestPathInfo]);
+    appendBytes(buf, "\n");
     
     // CanonicalQueryString
     NSArray *queryStringComponents = [[theConnection requestQueryString] componentsSeparatedByString:@"&"];
@@ -185,13 +219,13 @@ static NSDateFormatter *g_dateFormatter = nil;
         if (!addAmpersand) {
             addAmpersand = YES;
         } else {
-            [buf appendString:@"&"];
+            appendBytes(buf, "&");
         }
-        [buf appendString:key];
-        [buf appendString:@"="];
-        [buf appendString:[encodedComponents objectForKey:key]];
+        appendUTF8(buf, key);
+        appendBytes(buf, "=");
+        appendUTF8(buf, [encodedComponents objectForKey:key]);
     }
-    [buf appendString:@"\n"];
+    appendBytes(buf, "\n");
     
     NSMutableDictionary *lcHeaders = [NSMutableDictionary dictionary];
     for (NSString *headerName in [theConnection requestHeaderKeys]) {
@@ -201,12 +235,12 @@ static NSDateFormatter *g_dateFormatter = nil;
 
     // CanonicalHeaders
     for (NSString *headerName in sortedLCHeaderNames) {
-        [buf appendString:[headerName lowercaseString]];
-        [buf appendString:@":"];
-        [buf appendString:[[lcHeaders objectForKey:headerName] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]];
-        [buf appendString:@"\n"];
+        appendUTF8(buf, headerName);
+        appendBytes(buf, ":");
+        appendUTF8(buf, [[lcHeaders objectForKey:headerName] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]);
+        appendBytes(buf, "\n");
     }
-    [buf appendString:@"\n"];
+    appendBytes(buf, "\n");
     
     // SignedHeaders
     NSMutableString *headerNameString = [[NSMutableString alloc] init];
@@ -220,15 +254,15 @@ static NSDateFormatter *g_dateFormatter = nil;
         [headerNameString appendString:lcHeaderName];
     }
     *theSignedHeaders = headerNameString;
-    [buf appendString:headerNameString];
-    [buf appendString:@"\n"];
+    appendUTF8(buf, headerNameString);
+    appendBytes(buf, "\n");
     
     // HashedPayload
-    [buf appendString:theContentSHA256];
+    appendUTF8(buf, theContentSHA256);
     
 #if 0
-    HSLogDebug(@"v4 canonical request: %@", buf);
-    NSData *canonicalRequestData = [buf dataUsingEncoding:NSUTF8StringEncoding];
+    HSLogDebug(@"v4 canonical request: %@", [[NSString alloc] initWithData:buf encoding:NSUTF8StringEncoding]);
+    NSData *canonicalRequestData = buf;
     unsigned char *bytes = (unsigned char *)[canonicalRequestData bytes];
     NSMutableString *debugBuf = [NSMutableString string];
     for (NSUInteger i = 0; i < [canonicalRequestData length]; i++) {
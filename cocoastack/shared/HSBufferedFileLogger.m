@@ -0,0 +1,113 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "HSBufferedFileLogger.h"
+
+
+#define FLUSH_THRESHOLD_BYTES (64 * 1024)
+#define FLUSH_INTERVAL_SECONDS (1)
+
+// Private to DDFileLogger; declared here so the buffered writes go through the same file handle and size-based rolling.
+@interface DDFileLogger (HSBufferedFileLogger)
+- (NSFileHandle *)currentLogFileHandle;
+- (void)maybeRollLogFileDueToSize;
+@end
+
+@interface HSBufferedFileLogger (internal)
+- (void)flushBuffer;
+@end
+
+@implementation HSBufferedFileLogger
+- (instancetype)initWithLogFileManager:(id <DDLogFileManager>)theLogFileManager {
+    if (self = [super initWithLogFileManager:theLogFileManager]) {
+        buffer = [[NSMutableData alloc] initWithCapacity:(FLUSH_THRESHOLD_BYTES * 2)];
+        
+        __weak HSBufferedFileLogger *weakSelf = self;
+        flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _loggerQueue);
+        dispatch_source_set_timer(flushTimer, dispatch_time(DISPATCH_TIME_NOW, FLUSH_INTERVAL_SECONDS * NSEC_PER_SEC), FLUSH_INTERVAL_SECONDS * NSEC_PER_SEC, NSEC_PER_SEC / 10);
+        dispatch_source_set_event_handler(flushTimer, ^{
+            [weakSelf flushBuffer];
+        });
+        dispatch_resume(flushTimer);
+    }
+    return self;
+}
+- (void)dealloc {
+    if (flushTimer != nil) {
+        dispatch_source_cancel(flushTimer);
+    }
+}
+
+#pragma mark DDLogger
+- (void)logMessage:(DDLogMessage *)logMessage {
+    // Called on the logger queue, same as DDFileLogger's own logMessage:.
+    NSString *message = logMessage->_message;
+    BOOL isFormatted = NO;
+    if (_logFormatter) {
+        message = [_logFormatter formatLogMessage:logMessage];
+        isFormatted = message != logMessage->_message;
+    }
+    if (message == nil) {
+        return;
+    }
+    if ((!isFormatted || self.automaticallyAppendNewlineForCustomFormatters) && ![message hasSuffix:@"\n"]) {
+        message = [message stringByAppendingString:@"\n"];
+    }
+    [buffer appendData:[message dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    if ([buffer length] >= FLUSH_THRESHOLD_BYTES || (logMessage->_flag & DDLogFlagError)) {
+        [self flushBuffer];
+    }
+}
+- (void)flush {
+    [self flushBuffer];
+}
+- (void)willRemoveLogger {
+    [self flushBuffer];
+    [super willRemoveLogger];
+}
+
+#pragma mark internal
+- (void)flushBuffer {
+    if ([buffer length] == 0) {
+        return;
+    }
+    @try {
+        [[self currentLogFileHandle] writeData:buffer];
+        [self maybeRollLogFileDueToSize];
+    } @catch (NSException *exception) {
+        NSLog(@"HSBufferedFileLogger: failed to write log file: %@", exception);
+    }
+    [buffer setLength:0];
+}
+@end
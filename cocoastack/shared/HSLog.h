@@ -42,11 +42,13 @@
 #define HSLOG_LEVEL_ERROR (1)
 #define HSLOG_LEVEL_NONE (0)
 
-#define HSLogDebug( s, ... ) DDLogVerbose(@"DEBUG [thread %x] %p %@:%d %@", pthread_mach_thread_np(pthread_self()), self, [@__FILE__ lastPathComponent], __LINE__, [NSString stringWithFormat:(s), ##__VA_ARGS__]);
-#define HSLogDetail( s, ... ) DDLogDebug(@"DETAIL [thread %x] %@", pthread_mach_thread_np(pthread_self()), [NSString stringWithFormat:(s), ##__VA_ARGS__]);
-#define HSLogInfo( s, ... ) DDLogInfo(@"INFO [thread %x] %@", pthread_mach_thread_np(pthread_self()), [NSString stringWithFormat:(s), ##__VA_ARGS__]);
-#define HSLogWarn( s, ... ) DDLogWarn(@"WARN [thread %x] %@", pthread_mach_thread_np(pthread_self()), [NSString stringWithFormat:(s), ##__VA_ARGS__]);
-#define HSLogError( s, ... ) DDLogError(@"ERROR [thread %x] %@", pthread_mach_thread_np(pthread_self()), [NSString stringWithFormat:(s), ##__VA_ARGS__]);
+// The level test in DDLog's macros runs before any argument is evaluated, so disabled levels cost one comparison.
+// The caller's format (always a string literal) is appended to the prefix, so each message is formatted once.
+#define HSLogDebug( s, ... ) DDLogVerbose(@"DEBUG [thread %x] %p %@:%d " s, pthread_mach_thread_np(pthread_self()), self, [@__FILE__ lastPathComponent], __LINE__, ##__VA_ARGS__);
+#define HSLogDetail( s, ... ) DDLogDebug(@"DETAIL [thread %x] " s, pthread_mach_thread_np(pthread_self()), ##__VA_ARGS__);
+#define HSLogInfo( s, ... ) DDLogInfo(@"INFO [thread %x] " s, pthread_mach_thread_np(pthread_self()), ##__VA_ARGS__);
+#define HSLogWarn( s, ... ) DDLogWarn(@"WARN [thread %x] " s, pthread_mach_thread_np(pthread_self()), ##__VA_ARGS__);
+#define HSLogError( s, ... ) DDLogError(@"ERROR [thread %x] " s, pthread_mach_thread_np(pthread_self()), ##__VA_ARGS__);
 
 extern DDLogLevel ddLogLevel;
 
@@ -35,6 +35,7 @@
 #import "System.h"
 #import "NSFileManager_extra.h"
 #import "HSLogFileManager.h"
+#import "HSBufferedFileLogger.h"
 
 int global_hslog_level = -1;
 
@@ -77,7 +78,7 @@ CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(HSLog)
     if (self = [super init]) {
         logFileManager = [[HSLogFileManager alloc] init];
         
-        fileLogger = [[DDFileLogger alloc] initWithLogFileManager:logFileManager];
+        fileLogger = [[HSBufferedFileLogger alloc] initWithLogFileManager:logFileManager];
         fileLogger.rollingFrequency = 0; // Do not roll based on time.
         fileLogger.maximumFileSize = 100000000; // 100MB
         fileLogger.logFileManager.maximumNumberOfLogFiles = 10;
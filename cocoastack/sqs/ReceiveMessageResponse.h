@@ -39,5 +39,6 @@
     NSString *body;
 }
 - (id)initWithQueueURL:(NSURL *)theQueueURL data:(NSData *)theData;
+- (id)initWithQueueURL:(NSURL *)theQueueURL messages:(NSArray *)theMessages;
 - (NSArray *)messages;
 @end
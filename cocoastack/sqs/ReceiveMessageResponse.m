@@ -45,6 +45,13 @@
     }
     return self;
 }
+- (id)initWithQueueURL:(NSURL *)theQueueURL messages:(NSArray *)theMessages {
+    if (self = [super init]) {
+        queueURL = theQueueURL;
+        messages = [[NSMutableArray alloc] initWithArray:theMessages];
+    }
+    return self;
+}
 - (NSArray *)messages {
     return messages;
 }
@@ -48,7 +48,13 @@
 - (NSString *)queueArnForQueueURL:(NSURL *)theURL error:(NSError **)error;
 - (BOOL)setSendMessagePermissionToQueueURL:(NSURL *)theQueueURL queueArn:(NSString *)theQueueArn forSourceArn:(NSString *)theSourceArn error:(NSError **)error;
 - (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages error:(NSError **)error;
+
+// Long-polls for up to theWaitTimeSeconds (at most 20) until at least one message is available.
+- (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages waitTimeSeconds:(NSUInteger)theWaitTimeSeconds error:(NSError **)error;
 - (BOOL)deleteMessageWithQueueURL:(NSURL *)theURL receiptHandle:(NSString *)theReceiptHandle error:(NSError **)error;
+
+// Deletes the messages using DeleteMessageBatch, 10 at a time.
+- (BOOL)deleteMessagesWithQueueURL:(NSURL *)theURL receiptHandles:(NSArray *)theReceiptHandles error:(NSError **)error;
 - (NSArray *)queueURLs:(NSError **)error;
 - (BOOL)deleteQueue:(NSURL *)theQueueURL error:(NSError **)error;
 @end
@@ -41,6 +41,9 @@
 #import "ReceiveMessageResponse.h"
 #import "ListQueuesResponse.h"
 
+#define MAX_MESSAGES_PER_REQUEST (10)
+#define MAX_WAIT_TIME_SECONDS (20)
+
 @implementation SQS
 + (NSString *)errorDomain {
     return @"SQSErrorDomain";
@@ -147,9 +150,15 @@
     return YES;
 }
 - (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages error:(NSError **)error {
-    if (theMaxMessages > 10) {
+    return [self receiveMessagesForQueueURL:theURL maxMessages:theMaxMessages waitTimeSeconds:0 error:error];
+}
+- (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages waitTimeSeconds:(NSUInteger)theWaitTimeSeconds error:(NSError **)error {
+    if (theMaxMessages > MAX_MESSAGES_PER_REQUEST) {
         // SQS only accepts a value between 1 and 10.
-        theMaxMessages = 10;
+        theMaxMessages = MAX_MESSAGES_PER_REQUEST;
+    }
+    if (theWaitTimeSeconds > MAX_WAIT_TIME_SECONDS) {
+        theWaitTimeSeconds = MAX_WAIT_TIME_SECONDS;
     }
     NSDateFormatter *formatter = [self dateFormatter];
     
@@ -161,7 +170,13 @@
     [str appendFormat:@"&SignatureMethod=HmacSHA256"];
     [str appendFormat:@"&SignatureVersion=2"];
     [str appendFormat:@"&Timestamp=%@", [[formatter stringFromDate:[NSDate date]] stringByEscapingURLCharacters]];
-    [str appendFormat:@"&Version=2009-02-01"];
+    if (theWaitTimeSeconds > 0) {
+        // WaitTimeSeconds was added in API version 2012-11-05.
+        [str appendFormat:@"&Version=2012-11-05"];
+        [str appendFormat:@"&WaitTimeSeconds=%lu", (unsigned long)theWaitTimeSeconds];
+    } else {
+        [str appendFormat:@"&Version=2009-02-01"];
+    }
     NSURL *url = [NSURL URLWithString:str];
     NSAssert(url != nil, @"url may not be nil!");
     NSString *signature = [sap signatureForHTTPMethod:@"GET" url:url];
@@ -200,6 +215,49 @@
     }
     return YES;
 }
+- (BOOL)deleteMessagesWithQueueURL:(NSURL *)theURL receiptHandles:(NSArray *)theReceiptHandles error:(NSError **)error {
+    for (NSUInteger start = 0; start < [theReceiptHandles count]; start += MAX_MESSAGES_PER_REQUEST) {
+        NSUInteger count = MIN(MAX_MESSAGES_PER_REQUEST, [theReceiptHandles count] - start);
+        NSDateFormatter *formatter = [self dateFormatter];
+        
+        // Parameters must be in sorted order for the signature.
+        NSMutableArray *entryParams = [NSMutableArray array];
+        for (NSUInteger i = 0; i < count; i++) {
+            NSString *receiptHandle = [theReceiptHandles objectAtIndex:(start + i)];
+            [entryParams addObject:[NSString stringWithFormat:@"DeleteMessageBatchRequestEntry.%lu.Id=msg%lu", (unsigned long)(i + 1), (unsigned long)(i + 1)]];
+            [entryParams addObject:[NSString stringWithFormat:@"DeleteMessageBatchRequestEntry.%lu.ReceiptHandle=%@", (unsigned long)(i + 1), [receiptHandle stringByEscapingURLCharacters]]];
+        }
+        [entryParams sortUsingSelector:@selector(compare:)];
+        
+        NSMutableString *str = [NSMutableString stringWithFormat:@"%@?", [theURL description]];
+        [str appendFormat:@"AWSAccessKeyId=%@", [accessKey stringByEscapingURLCharacters]];
+        [str appendFormat:@"&Action=DeleteMessageBatch"];
+        for (NSString *entryParam in entryParams) {
+            [str appendFormat:@"&%@", entryParam];
+        }
+        [str appendFormat:@"&SignatureMethod=HmacSHA256"];
+        [str appendFormat:@"&SignatureVersion=2"];
+        [str appendFormat:@"&Timestamp=%@", [[formatter stringFromDate:[NSDate date]] stringByEscapingURLCharacters]];
+        [str appendFormat:@"&Version=2012-11-05"];
+        NSURL *url = [NSURL URLWithString:str];
+        NSAssert(url != nil, @"url may not be nil!");
+        NSString *signature = [sap signatureForHTTPMethod:@"GET" url:url];
+        [str appendFormat:@"&Signature=%@", [signature stringByEscapingURLCharacters]];
+        
+        NSURL *urlWithSignature = [NSURL URLWithString:str];
+        AWSQueryRequest *req = [[AWSQueryRequest alloc] initWithMethod:@"GET" url:urlWithSignature retryOnTransientError:retryOnTransientError];
+        AWSQueryResponse *response = [req execute:error];
+        if (response == nil) {
+            return NO;
+        }
+        NSString *body = [[NSString alloc] initWithData:[response body] encoding:NSUTF8StringEncoding];
+        if ([body rangeOfString:@"<BatchResultErrorEntry>"].location != NSNotFound) {
+            SETNSERROR([SQS errorDomain], -1, @"DeleteMessageBatch failed for some messages: %@", body);
+            return NO;
+        }
+    }
+    return YES;
+}
 - (NSArray *)queueURLs:(NSError **)error {
     //FIXME: This only returns up to 1000 queues.
     
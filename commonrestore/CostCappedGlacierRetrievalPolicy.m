@@ -0,0 +1,59 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "CostCappedGlacierRetrievalPolicy.h"
+
+@implementation CostCappedGlacierRetrievalPolicy
+- (id)initWithDownloadBytesPerSecond:(unsigned long long)theDownloadBytesPerSecond maxBytesPerDay:(unsigned long long)theMaxBytesPerDay roundTimeInterval:(NSTimeInterval)theRoundTimeInterval {
+    if (self = [super init]) {
+        downloadBytesPerSecond = theDownloadBytesPerSecond;
+        maxBytesPerDay = theMaxBytesPerDay;
+        roundTimeInterval = theRoundTimeInterval;
+    }
+    return self;
+}
+
+#pragma mark GlacierRetrievalPolicy
+- (NSString *)name {
+    return @"costcapped";
+}
+- (NSTimeInterval)roundTimeInterval {
+    return roundTimeInterval;
+}
+- (unsigned long long)bytesToRequestInRoundStartingAt:(NSDate *)theRoundStartDate bytesRemaining:(unsigned long long)theBytesRemaining {
+    double throughputBytes = (double)downloadBytesPerSecond * roundTimeInterval;
+    double cappedBytes = (double)maxBytesPerDay * roundTimeInterval / (24.0 * 60 * 60);
+    unsigned long long ret = (unsigned long long)MIN(throughputBytes, cappedBytes);
+    return ret > 0 ? ret : 1;
+}
+@end
@@ -0,0 +1,68 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "GlacierRetrievalClock.h"
+#import "GlacierRetrievalPolicy.h"
+
+// Paces Glacier retrieval requests in rounds. Each round may request as many bytes as the
+// policy allows; the next round starts one round interval after the previous one, and only
+// once most of the data requested before the previous round has been downloaded.
+// Bytes given back with -removeBytesRequested: come off whichever rounds requested them.
+// If nothing is downloaded for a couple of round intervals while waiting on that, the
+// wait is abandoned, so data that will never arrive (skipped or failed items) can't stall
+// the restore.
+@interface GlacierRetrievalScheduler : NSObject {
+    id <GlacierRetrievalPolicy> policy;
+    id <GlacierRetrievalClock> clock;
+    NSDate *roundStartDate;
+    unsigned long long bytesToRequestThisRound;
+    unsigned long long bytesRequestedThisRound;
+    unsigned long long bytesRequested;
+    unsigned long long totalBytesToRequest;
+    NSMutableArray *bytesRequestedPerCompletedRound;
+    NSDate *waitingForTransfersSinceDate;
+    unsigned long long bytesTransferredWhenWaitStarted;
+}
+- (id)initWithPolicy:(id <GlacierRetrievalPolicy>)thePolicy clock:(id <GlacierRetrievalClock>)theClock;
+
+- (id <GlacierRetrievalPolicy>)policy;
+- (id <GlacierRetrievalClock>)clock;
+- (void)setTotalBytesToRequest:(unsigned long long)theTotalBytesToRequest;
+- (BOOL)shouldRequestMoreWithBytesTransferred:(unsigned long long)theBytesTransferred;
+- (BOOL)roundHasRoom;
+- (void)addBytesRequested:(unsigned long long)theBytes;
+- (void)removeBytesRequested:(unsigned long long)theBytes;
+- (NSDate *)roundStartDate;
+- (NSUInteger)roundsCompleted;
+- (NSArray *)bytesRequestedPerRound;
+@end
@@ -0,0 +1,147 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "GlacierRetrievalScheduler.h"
+
+
+// Round intervals without any download progress after which we stop waiting for earlier rounds' data.
+#define STALLED_ROUNDS_BEFORE_PROCEEDING (2)
+
+
+@implementation GlacierRetrievalScheduler
+- (id)initWithPolicy:(id <GlacierRetrievalPolicy>)thePolicy clock:(id <GlacierRetrievalClock>)theClock {
+    if (self = [super init]) {
+        policy = thePolicy;
+        clock = theClock;
+        roundStartDate = [clock now];
+        bytesRequestedPerCompletedRound = [[NSMutableArray alloc] init];
+        bytesToRequestThisRound = [policy bytesToRequestInRoundStartingAt:roundStartDate bytesRemaining:0];
+    }
+    return self;
+}
+
+- (id <GlacierRetrievalPolicy>)policy {
+    return policy;
+}
+- (id <GlacierRetrievalClock>)clock {
+    return clock;
+}
+- (void)setTotalBytesToRequest:(unsigned long long)theTotalBytesToRequest {
+    totalBytesToRequest = theTotalBytesToRequest;
+    if (bytesRequestedThisRound == 0) {
+        bytesToRequestThisRound = [policy bytesToRequestInRoundStartingAt:roundStartDate bytesRemaining:[self bytesRemaining]];
+    }
+}
+- (BOOL)shouldRequestMoreWithBytesTransferred:(unsigned long long)theBytesTransferred {
+    if (bytesRequestedThisRound >= bytesToRequestThisRound) {
+        [self startNextRound];
+    }
+    
+    // Make sure we've transferred most of the bytes from all but the most recent round of requests.
+    unsigned long long bytesRequestedBeforePreviousRound = 0;
+    NSUInteger count = [bytesRequestedPerCompletedRound count];
+    for (NSUInteger i = 0; i + 1 < count; i++) {
+        bytesRequestedBeforePreviousRound += [[bytesRequestedPerCompletedRound objectAtIndex:i] unsignedLongLongValue];
+    }
+    unsigned long long minimumBytesToHaveTransferred = (unsigned long long)((double)bytesRequestedBeforePreviousRound * .9);
+    
+    return bytesRequestedThisRound < bytesToRequestThisRound
+    && [self haveTransferred:theBytesTransferred ofMinimum:minimumBytesToHaveTransferred]
+    && [[clock now] compare:roundStartDate] != NSOrderedAscending;
+}
+- (BOOL)roundHasRoom {
+    return bytesRequestedThisRound < bytesToRequestThisRound;
+}
+- (void)addBytesRequested:(unsigned long long)theBytes {
+    bytesRequestedThisRound += theBytes;
+    bytesRequested += theBytes;
+}
+- (void)removeBytesRequested:(unsigned long long)theBytes {
+    bytesRequested -= MIN(theBytes, bytesRequested);
+    unsigned long long fromThisRound = MIN(theBytes, bytesRequestedThisRound);
+    bytesRequestedThisRound -= fromThisRound;
+    
+    // The rest was requested in earlier rounds; take it off those so it isn't waited for.
+    unsigned long long remaining = theBytes - fromThisRound;
+    for (NSUInteger i = [bytesRequestedPerCompletedRound count]; i > 0 && remaining > 0; i--) {
+        unsigned long long roundBytes = [[bytesRequestedPerCompletedRound objectAtIndex:i - 1] unsignedLongLongValue];
+        unsigned long long fromRound = MIN(remaining, roundBytes);
+        [bytesRequestedPerCompletedRound replaceObjectAtIndex:i - 1 withObject:[NSNumber numberWithUnsignedLongLong:roundBytes - fromRound]];
+        remaining -= fromRound;
+    }
+}
+- (NSDate *)roundStartDate {
+    return roundStartDate;
+}
+- (NSUInteger)roundsCompleted {
+    return [bytesRequestedPerCompletedRound count];
+}
+- (NSArray *)bytesRequestedPerRound {
+    NSMutableArray *ret = [NSMutableArray arrayWithArray:bytesRequestedPerCompletedRound];
+    if (bytesRequestedThisRound > 0) {
+        [ret addObject:[NSNumber numberWithUnsignedLongLong:bytesRequestedThisRound]];
+    }
+    return ret;
+}
+
+
+#pragma mark internal
+- (BOOL)haveTransferred:(unsigned long long)theBytesTransferred ofMinimum:(unsigned long long)theMinimum {
+    if (theBytesTransferred >= theMinimum) {
+        waitingForTransfersSinceDate = nil;
+        return YES;
+    }
+    NSDate *now = [clock now];
+    if (waitingForTransfersSinceDate == nil || theBytesTransferred != bytesTransferredWhenWaitStarted) {
+        waitingForTransfersSinceDate = now;
+        bytesTransferredWhenWaitStarted = theBytesTransferred;
+        return NO;
+    }
+    if ([now timeIntervalSinceDate:waitingForTransfersSinceDate] < [policy roundTimeInterval] * STALLED_ROUNDS_BEFORE_PROCEEDING) {
+        return NO;
+    }
+    HSLogWarn(@"no data downloaded since %@ (%qu of %qu bytes from earlier rounds); requesting more anyway", waitingForTransfersSinceDate, theBytesTransferred, theMinimum);
+    waitingForTransfersSinceDate = nil;
+    return YES;
+}
+- (void)startNextRound {
+    [bytesRequestedPerCompletedRound addObject:[NSNumber numberWithUnsignedLongLong:bytesRequestedThisRound]];
+    bytesRequestedThisRound = 0;
+    roundStartDate = [roundStartDate dateByAddingTimeInterval:[policy roundTimeInterval]];
+    bytesToRequestThisRound = [policy bytesToRequestInRoundStartingAt:roundStartDate bytesRemaining:[self bytesRemaining]];
+    HSLogDebug(@"next %@ retrieval round starts %@; %qu bytes may be requested", [policy name], roundStartDate, bytesToRequestThisRound);
+}
+- (unsigned long long)bytesRemaining {
+    return totalBytesToRequest > bytesRequested ? (totalBytesToRequest - bytesRequested) : 0;
+}
+@end
@@ -0,0 +1,116 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "GlacierRetrievalSimulation.h"
+#import "GlacierRetrievalScheduler.h"
+
+#define IDLE_INTERVAL (60.0)
+
+
+@implementation GlacierRetrievalSimulation
+- (id)initWithObjectSizes:(NSArray *)theObjectSizes
+                scheduler:(GlacierRetrievalScheduler *)theScheduler
+   downloadBytesPerSecond:(unsigned long long)theDownloadBytesPerSecond
+         thawTimeInterval:(NSTimeInterval)theThawTimeInterval {
+    if (self = [super init]) {
+        objectSizes = theObjectSizes;
+        scheduler = theScheduler;
+        downloadBytesPerSecond = theDownloadBytesPerSecond;
+        thawTimeInterval = theThawTimeInterval;
+    }
+    return self;
+}
+
+- (void)run {
+    NSAssert(downloadBytesPerSecond > 0, @"downloadBytesPerSecond must be > 0");
+    id <GlacierRetrievalClock> clock = [scheduler clock];
+    NSDate *startDate = [clock now];
+    
+    unsigned long long total = 0;
+    for (NSNumber *size in objectSizes) {
+        total += [size unsignedLongLongValue];
+    }
+    [scheduler setTotalBytesToRequest:total];
+    
+    NSMutableArray *readyDates = [NSMutableArray array];
+    NSMutableArray *thawingSizes = [NSMutableArray array];
+    NSUInteger nextIndex = 0;
+    unsigned long long bytesTransferred = 0;
+    NSUInteger count = [objectSizes count];
+    while (nextIndex < count || [thawingSizes count] > 0) {
+        if (nextIndex < count && [scheduler shouldRequestMoreWithBytesTransferred:bytesTransferred]) {
+            while (nextIndex < count && [scheduler roundHasRoom]) {
+                NSNumber *size = [objectSizes objectAtIndex:nextIndex];
+                [scheduler addBytesRequested:[size unsignedLongLongValue]];
+                [readyDates addObject:[[clock now] dateByAddingTimeInterval:thawTimeInterval]];
+                [thawingSizes addObject:size];
+                nextIndex++;
+            }
+        }
+        
+        // Download the oldest request if it has thawed.
+        if ([thawingSizes count] > 0 && [[readyDates objectAtIndex:0] compare:[clock now]] != NSOrderedDescending) {
+            unsigned long long size = [[thawingSizes objectAtIndex:0] unsignedLongLongValue];
+            [clock sleepForTimeInterval:((double)size / (double)downloadBytesPerSecond)];
+            bytesTransferred += size;
+            [readyDates removeObjectAtIndex:0];
+            [thawingSizes removeObjectAtIndex:0];
+            continue;
+        }
+        
+        // Nothing to do until the next object thaws or the next round starts.
+        NSDate *wakeDate = nil;
+        if ([readyDates count] > 0) {
+            wakeDate = [readyDates objectAtIndex:0];
+        }
+        if (nextIndex < count && [[scheduler roundStartDate] compare:[clock now]] == NSOrderedDescending) {
+            wakeDate = (wakeDate == nil) ? [scheduler roundStartDate] : [wakeDate earlierDate:[scheduler roundStartDate]];
+        }
+        NSTimeInterval interval = (wakeDate == nil) ? 0 : [wakeDate timeIntervalSinceDate:[clock now]];
+        if (interval <= 0) {
+            interval = IDLE_INTERVAL;
+        }
+        [clock sleepForTimeInterval:interval];
+    }
+    projectedDuration = [[clock now] timeIntervalSinceDate:startDate];
+}
+- (NSTimeInterval)projectedDuration {
+    return projectedDuration;
+}
+- (NSArray *)bytesRequestedPerRound {
+    return [scheduler bytesRequestedPerRound];
+}
+@end
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Tracks the first restored path of each hardlinked file so the other members of its
+// group can be linked to it instead of being restored again.
+//
+// Entries are keyed by (st_dev, 64-bit st_ino) in an open-addressed table of plain structs,
+// and hold an index into a table of paths rather than boxed numbers and strings per key.
+// An entry is dropped once all st_nlink members of its group have been linked, so the
+// map only holds the groups that are still partly restored.
+
+typedef struct HardlinkMapEntry HardlinkMapEntry;
+
+@interface HardlinkMap : NSObject {
+    HardlinkMapEntry *entries;
+    NSUInteger capacity;
+    NSUInteger count;
+    NSUInteger tombstoneCount;
+    NSMutableArray *paths;
+    NSMutableIndexSet *freePathIndexes;
+}
+- (id)init;
+
+// Returns the path of an already-restored member of the group and counts the caller's file as linked,
+// or nil if no member has been restored yet.
+- (NSString *)pathToLinkForDevice:(int32_t)theDevice inode:(uint64_t)theInode;
+
+// Records thePath as restored for a group of theLinkCount members; the other members will be linked to it.
+- (void)setPath:(NSString *)thePath forDevice:(int32_t)theDevice inode:(uint64_t)theInode linkCount:(uint16_t)theLinkCount;
+
+- (NSUInteger)count;
+@end
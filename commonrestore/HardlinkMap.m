@@ -0,0 +1,163 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "HardlinkMap.h"
+
+
+#define INITIAL_CAPACITY (64)
+#define ENTRY_EMPTY (0)
+#define ENTRY_USED (1)
+#define ENTRY_REMOVED (2)
+
+
+struct HardlinkMapEntry {
+    uint64_t inode;
+    int32_t device;
+    uint32_t pathIndex;
+    uint16_t linksRemaining;
+    uint8_t state;
+};
+
+
+@implementation HardlinkMap
+- (id)init {
+    if (self = [super init]) {
+        capacity = INITIAL_CAPACITY;
+        entries = (HardlinkMapEntry *)calloc(capacity, sizeof(HardlinkMapEntry));
+        paths = [[NSMutableArray alloc] init];
+        freePathIndexes = [[NSMutableIndexSet alloc] init];
+    }
+    return self;
+}
+- (void)dealloc {
+    free(entries);
+}
+
+- (NSString *)pathToLinkForDevice:(int32_t)theDevice inode:(uint64_t)theInode {
+    HardlinkMapEntry *entry = [self entryForDevice:theDevice inode:theInode];
+    if (entry == NULL) {
+        return nil;
+    }
+    NSString *ret = [paths objectAtIndex:entry->pathIndex];
+    if (entry->linksRemaining > 0) {
+        entry->linksRemaining--;
+    }
+    if (entry->linksRemaining == 0) {
+        // Every member of the group exists now; nothing will ask for this one again.
+        [paths replaceObjectAtIndex:entry->pathIndex withObject:[NSNull null]];
+        [freePathIndexes addIndex:entry->pathIndex];
+        entry->state = ENTRY_REMOVED;
+        count--;
+        tombstoneCount++;
+    }
+    return ret;
+}
+- (void)setPath:(NSString *)thePath forDevice:(int32_t)theDevice inode:(uint64_t)theInode linkCount:(uint16_t)theLinkCount {
+    if (theLinkCount < 2) {
+        return;
+    }
+    HardlinkMapEntry *entry = [self entryForDevice:theDevice inode:theInode];
+    if (entry != NULL) {
+        [paths replaceObjectAtIndex:entry->pathIndex withObject:thePath];
+        return;
+    }
+    if ((count + tombstoneCount + 1) * 4 > capacity * 3) {
+        [self resizeTo:(count + 1) * 2 > capacity / 2 ? capacity * 2 : capacity];
+    }
+    uint32_t pathIndex = 0;
+    if ([freePathIndexes count] > 0) {
+        pathIndex = (uint32_t)[freePathIndexes firstIndex];
+        [freePathIndexes removeIndex:pathIndex];
+        [paths replaceObjectAtIndex:pathIndex withObject:thePath];
+    } else {
+        pathIndex = (uint32_t)[paths count];
+        [paths addObject:thePath];
+    }
+    NSUInteger i = [self slotForDevice:theDevice inode:theInode];
+    while (entries[i].state == ENTRY_USED) {
+        i = (i + 1) & (capacity - 1);
+    }
+    if (entries[i].state == ENTRY_REMOVED) {
+        tombstoneCount--;
+    }
+    entries[i].inode = theInode;
+    entries[i].device = theDevice;
+    entries[i].pathIndex = pathIndex;
+    entries[i].linksRemaining = theLinkCount - 1;
+    entries[i].state = ENTRY_USED;
+    count++;
+}
+- (NSUInteger)count {
+    return count;
+}
+
+
+#pragma mark internal
+- (NSUInteger)slotForDevice:(int32_t)theDevice inode:(uint64_t)theInode {
+    uint64_t h = theInode ^ ((uint64_t)(uint32_t)theDevice << 32);
+    // 64-bit mix (from MurmurHash3's finalizer) so sequential inodes spread across the table.
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (NSUInteger)h & (capacity - 1);
+}
+- (HardlinkMapEntry *)entryForDevice:(int32_t)theDevice inode:(uint64_t)theInode {
+    NSUInteger i = [self slotForDevice:theDevice inode:theInode];
+    while (entries[i].state != ENTRY_EMPTY) {
+        if (entries[i].state == ENTRY_USED && entries[i].inode == theInode && entries[i].device == theDevice) {
+            return &entries[i];
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+    return NULL;
+}
+- (void)resizeTo:(NSUInteger)theCapacity {
+    // Rehashing also clears out the removed entries.
+    HardlinkMapEntry *oldEntries = entries;
+    NSUInteger oldCapacity = capacity;
+    capacity = theCapacity;
+    entries = (HardlinkMapEntry *)calloc(capacity, sizeof(HardlinkMapEntry));
+    tombstoneCount = 0;
+    for (NSUInteger j = 0; j < oldCapacity; j++) {
+        if (oldEntries[j].state == ENTRY_USED) {
+            NSUInteger i = [self slotForDevice:oldEntries[j].device inode:oldEntries[j].inode];
+            while (entries[i].state != ENTRY_EMPTY) {
+                i = (i + 1) & (capacity - 1);
+            }
+            entries[i] = oldEntries[j];
+        }
+    }
+    free(oldEntries);
+}
+@end
@@ -0,0 +1,66 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Writes restored file data with positional I/O.
+//
+// The file is truncated and, when the final size is known, preallocated and
+// extended to that size up front so large files don't fragment. All-zero blocks
+// aren't written; their preallocated blocks are punched out so sparse files stay
+// sparse. -finish: truncates the file to the
+// exact number of bytes written.
+
+@interface RestoreFileWriter : NSObject {
+    NSString *path;
+    int directoryFD;
+    NSString *name;
+    unsigned long long expectedSize;
+    int fd;
+    BOOL preallocated;
+    unsigned long long offset;
+    unsigned long long holeBytes;
+}
+- (id)initWithPath:(NSString *)thePath expectedSize:(unsigned long long)theExpectedSize;
+
+// Opens theName relative to theDirectoryFD with openat() instead of resolving the full path again.
+- (id)initWithDirectoryFD:(int)theDirectoryFD name:(NSString *)theName path:(NSString *)thePath expectedSize:(unsigned long long)theExpectedSize;
+
+- (BOOL)open:(NSError **)error;
+- (BOOL)writeData:(NSData *)theData error:(NSError **)error;
+- (BOOL)writeBytes:(const unsigned char *)theBytes length:(NSUInteger)theLength error:(NSError **)error;
+- (BOOL)finish:(NSError **)error;
+- (void)close;
+
+- (NSString *)path;
+- (int)fd;
+- (unsigned long long)bytesWritten;
+- (unsigned long long)holeBytes;
+@end
@@ -0,0 +1,196 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/stat.h>
+#include <sys/mount.h>
+#import "RestoreFileWriter.h"
+
+
+@implementation RestoreFileWriter
+- (id)initWithPath:(NSString *)thePath expectedSize:(unsigned long long)theExpectedSize {
+    if (self = [super init]) {
+        path = [thePath copy];
+        directoryFD = -1;
+        expectedSize = theExpectedSize;
+        fd = -1;
+    }
+    return self;
+}
+- (id)initWithDirectoryFD:(int)theDirectoryFD name:(NSString *)theName path:(NSString *)thePath expectedSize:(unsigned long long)theExpectedSize {
+    if (self = [self initWithPath:thePath expectedSize:theExpectedSize]) {
+        directoryFD = theDirectoryFD;
+        name = [theName copy];
+    }
+    return self;
+}
+- (void)dealloc {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+- (BOOL)open:(NSError **)error {
+    // O_TRUNC so that nothing from a previous (larger) file survives in the ranges we leave as holes.
+    int oflag = O_WRONLY|O_CREAT|O_TRUNC;
+    mode_t mode = S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH;
+    if (directoryFD != -1) {
+        fd = openat(directoryFD, [name fileSystemRepresentation], oflag, mode);
+    } else {
+        fd = open([path fileSystemRepresentation], oflag, mode);
+    }
+    if (fd == -1) {
+        int errnum = errno;
+        HSLogError(@"open(%@) error %d: %s", path, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to open %@: %s", path, strerror(errnum));
+        return NO;
+    }
+    if (expectedSize > 0) {
+        // macOS has no fallocate(); F_PREALLOCATE is the equivalent. Try for contiguous space first.
+        fstore_t fst;
+        fst.fst_flags = F_ALLOCATECONTIG|F_ALLOCATEALL;
+        fst.fst_posmode = F_PEOFPOSMODE;
+        fst.fst_offset = 0;
+        fst.fst_length = (off_t)expectedSize;
+        fst.fst_bytesalloc = 0;
+        if (fcntl(fd, F_PREALLOCATE, &fst) == -1) {
+            fst.fst_flags = F_ALLOCATEALL;
+            if (fcntl(fd, F_PREALLOCATE, &fst) == -1) {
+                HSLogDebug(@"F_PREALLOCATE(%@, %qu) failed: %s", path, expectedSize, strerror(errno));
+            } else {
+                preallocated = YES;
+            }
+        } else {
+            preallocated = YES;
+        }
+        if (preallocated && ftruncate(fd, (off_t)expectedSize) == -1) {
+            // F_PREALLOCATE reserves blocks past EOF, and F_PUNCHHOLE does nothing there. Extend the file over the
+            // reserved space so zero ranges can be punched out; -finish: sets the final size.
+            HSLogDebug(@"ftruncate(%@, %qu) failed: %s; not punching holes", path, expectedSize, strerror(errno));
+            preallocated = NO;
+        }
+    }
+    return YES;
+}
+- (BOOL)writeData:(NSData *)theData error:(NSError **)error {
+    return [self writeBytes:(const unsigned char *)[theData bytes] length:[theData length] error:error];
+}
+- (BOOL)writeBytes:(const unsigned char *)theBytes length:(NSUInteger)theLength error:(NSError **)error {
+    if (fd == -1 && ![self open:error]) {
+        return NO;
+    }
+    if (theLength == 0) {
+        return YES;
+    }
+    if (theBytes[0] == 0 && memcmp(theBytes, theBytes + 1, theLength - 1) == 0) {
+        // Leave a hole; the final ftruncate() makes sure the file covers this range.
+        if (preallocated) {
+            [self punchHoleAtOffset:offset length:theLength];
+        }
+        offset += theLength;
+        holeBytes += theLength;
+        return YES;
+    }
+    NSUInteger written = 0;
+    while (written < theLength) {
+        ssize_t ret = pwrite(fd, theBytes + written, theLength - written, (off_t)(offset + written));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            int errnum = errno;
+            HSLogError(@"pwrite(%@) error %d: %s", path, errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"error writing to %@: %s", path, strerror(errnum));
+            return NO;
+        }
+        written += (NSUInteger)ret;
+    }
+    offset += theLength;
+    return YES;
+}
+- (BOOL)finish:(NSError **)error {
+    if (fd == -1 && ![self open:error]) {
+        return NO;
+    }
+    if (ftruncate(fd, (off_t)offset) == -1) {
+        int errnum = errno;
+        HSLogError(@"ftruncate(%@, %qu) error %d: %s", path, offset, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to set size of %@: %s", path, strerror(errnum));
+        return NO;
+    }
+    if (expectedSize > 0 && offset != expectedSize) {
+        HSLogWarn(@"%@: wrote %qu bytes; expected %qu", path, offset, expectedSize);
+    }
+    return YES;
+}
+- (void)close {
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+- (NSString *)path {
+    return path;
+}
+- (int)fd {
+    return fd;
+}
+- (unsigned long long)bytesWritten {
+    return offset;
+}
+- (unsigned long long)holeBytes {
+    return holeBytes;
+}
+
+
+#pragma mark internal
+- (void)punchHoleAtOffset:(unsigned long long)theOffset length:(unsigned long long)theLength {
+    // Give back the preallocated blocks under an all-zero range. F_PUNCHHOLE only works on whole filesystem blocks.
+    struct statfs sfs;
+    if (fstatfs(fd, &sfs) == -1 || sfs.f_bsize == 0) {
+        return;
+    }
+    unsigned long long blockSize = sfs.f_bsize;
+    unsigned long long start = ((theOffset + blockSize - 1) / blockSize) * blockSize;
+    unsigned long long end = ((theOffset + theLength) / blockSize) * blockSize;
+    if (end <= start) {
+        return;
+    }
+    fpunchhole_t punch;
+    memset(&punch, 0, sizeof(punch));
+    punch.fp_offset = (off_t)start;
+    punch.fp_length = (off_t)(end - start);
+    if (fcntl(fd, F_PUNCHHOLE, &punch) == -1) {
+        HSLogDebug(@"F_PUNCHHOLE(%@, %qu, %qu) failed: %s", path, start, end - start, strerror(errno));
+    }
+}
+@end
@@ -53,4 +53,7 @@
 - (NSString *)path;
 - (BOOL)restoreWithHardlinks:(NSMutableDictionary *)theHardlinks restorer:(id <Restorer>)theRestorer error:(NSError **)error;
 - (NSArray *)nextItemsWithRepo:(Repo *)theRepo error:(NSError **)error;
+- (NSArray *)blobKeysNeededWithRestorer:(id <Restorer>)theRestorer;
+- (BOOL)appliesTreeMetadata;
+- (BOOL)isHardlinked;
 @end
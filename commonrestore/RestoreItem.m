@@ -137,6 +137,49 @@ enum {
     }
     return ret;
 }
+- (NSArray *)blobKeysNeededWithRestorer:(id <Restorer>)theRestorer {
+    // The blobs that must be downloadable for the next restoreWithHardlinks:restorer:error: call to succeed.
+    NSMutableArray *ret = [NSMutableArray array];
+    switch (restoreAction) {
+        case kRestoreActionRestoreNode:
+            if ([node xattrsBlobKey] != nil) {
+                [ret addObject:[node xattrsBlobKey]];
+            }
+            if ([node aclBlobKey] != nil) {
+                [ret addObject:[node aclBlobKey]];
+            }
+            if (![theRestorer shouldSkipFile:path] && [[node dataBlobKeys] count] > 0) {
+                if (S_ISLNK([node mode])) {
+                    [ret addObjectsFromArray:[node dataBlobKeys]];
+                } else if ([node uncompressedDataSize] > 0) {
+                    [ret addObject:[[node dataBlobKeys] objectAtIndex:0]];
+                }
+            }
+            break;
+        case kRestoreActionApplyTree:
+            if ([tree xattrsBlobKey] != nil) {
+                [ret addObject:[tree xattrsBlobKey]];
+            }
+            if ([tree aclBlobKey] != nil) {
+                [ret addObject:[tree aclBlobKey]];
+            }
+            break;
+        case kRestoreActionRestoreFileData:
+            if (dataBlobKeyIndex < [[node dataBlobKeys] count]) {
+                [ret addObject:[[node dataBlobKeys] objectAtIndex:dataBlobKeyIndex]];
+            }
+            break;
+        default:
+            break;
+    }
+    return ret;
+}
+- (BOOL)appliesTreeMetadata {
+    return restoreAction == kRestoreActionApplyTree;
+}
+- (BOOL)isHardlinked {
+    return restoreAction == kRestoreActionRestoreNode && [node st_nlink] > 1;
+}
 
 #pragma mark internal
 - (id)initApplyItemWithTree:(Tree *)theTree path:(NSString *)thePath {
@@ -0,0 +1,83 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "CWLSynthesizeSingleton.h"
+
+
+typedef enum {
+    RestoreStageNetwork = 0,
+    RestoreStageDecrypt = 1,
+    RestoreStageDecompress = 2,
+    RestoreStageTreeDecode = 3,
+    RestoreStageFileWrite = 4,
+    RestoreStageMetadata = 5
+} RestoreStage;
+
+#define RESTORE_STAGE_COUNT (6)
+#define RESTORE_LATENCY_BUCKET_COUNT (14)
+
+
+// Process-wide counters for where restore time goes. Each stage counts operations, bytes and seconds
+// and keeps a histogram of operation latencies. Queue depths are gauges set by whoever owns the queue.
+// Nothing is recorded until setEnabled:YES, so callers don't pay for the lock when no one is reporting.
+@interface RestoreMetrics : NSObject {
+    volatile BOOL enabled;
+    NSLock *lock;
+    NSTimeInterval startTime;
+    unsigned long long counts[RESTORE_STAGE_COUNT];
+    unsigned long long bytes[RESTORE_STAGE_COUNT];
+    double seconds[RESTORE_STAGE_COUNT];
+    unsigned long long bucketCounts[RESTORE_STAGE_COUNT][RESTORE_LATENCY_BUCKET_COUNT + 1];
+    NSMutableDictionary *queueDepths;
+}
+CWL_DECLARE_SINGLETON_FOR_CLASS(RestoreMetrics)
+
++ (NSString *)nameOfStage:(RestoreStage)theStage;
+
+- (void)setEnabled:(BOOL)theEnabled;
+
+// Records one operation of theStage that began at theStartTime (a timeIntervalSinceReferenceDate) and ended now.
+- (void)recordStage:(RestoreStage)theStage startTime:(NSTimeInterval)theStartTime bytes:(unsigned long long)theBytes;
+- (void)recordStage:(RestoreStage)theStage seconds:(NSTimeInterval)theSeconds bytes:(unsigned long long)theBytes;
+
+- (void)setDepth:(NSUInteger)theDepth ofQueueNamed:(NSString *)theQueueName;
+
+// A snapshot of the counters as a single line of JSON (without the trailing newline).
+- (NSString *)jsonLine;
+
+// A snapshot of the counters in the Prometheus text exposition format.
+- (NSString *)prometheusText;
+
+// Zeroes the counters and forgets the queues.
+- (void)reset;
+@end
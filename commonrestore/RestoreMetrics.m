@@ -0,0 +1,188 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "RestoreMetrics.h"
+#import "S3RequestMetrics.h"
+
+
+// Upper bounds (in seconds) of the latency histogram buckets; the last bucket holds everything slower.
+static const double latencyBucketBounds[RESTORE_LATENCY_BUCKET_COUNT] = {
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+
+@implementation RestoreMetrics
+CWL_SYNTHESIZE_SINGLETON_FOR_CLASS(RestoreMetrics)
+
++ (NSString *)nameOfStage:(RestoreStage)theStage {
+    switch (theStage) {
+        case RestoreStageNetwork:
+            return @"network";
+        case RestoreStageDecrypt:
+            return @"decrypt";
+        case RestoreStageDecompress:
+            return @"decompress";
+        case RestoreStageTreeDecode:
+            return @"tree_decode";
+        case RestoreStageFileWrite:
+            return @"file_write";
+        case RestoreStageMetadata:
+            return @"metadata";
+    }
+    return @"unknown";
+}
+
+- (id)init {
+    if (self = [super init]) {
+        lock = [[NSLock alloc] init];
+        [lock setName:@"RestoreMetrics lock"];
+        queueDepths = [[NSMutableDictionary alloc] init];
+        startTime = [NSDate timeIntervalSinceReferenceDate];
+    }
+    return self;
+}
+- (void)setEnabled:(BOOL)theEnabled {
+    [lock lock];
+    enabled = theEnabled;
+    [lock unlock];
+}
+- (void)recordStage:(RestoreStage)theStage startTime:(NSTimeInterval)theStartTime bytes:(unsigned long long)theBytes {
+    if (!enabled) {
+        return;
+    }
+    [self recordStage:theStage seconds:([NSDate timeIntervalSinceReferenceDate] - theStartTime) bytes:theBytes];
+}
+- (void)recordStage:(RestoreStage)theStage seconds:(NSTimeInterval)theSeconds bytes:(unsigned long long)theBytes {
+    if (!enabled) {
+        return;
+    }
+    NSUInteger bucket = 0;
+    while (bucket < RESTORE_LATENCY_BUCKET_COUNT && theSeconds > latencyBucketBounds[bucket]) {
+        bucket++;
+    }
+    [lock lock];
+    counts[theStage]++;
+    bytes[theStage] += theBytes;
+    seconds[theStage] += theSeconds;
+    bucketCounts[theStage][bucket]++;
+    [lock unlock];
+}
+- (void)setDepth:(NSUInteger)theDepth ofQueueNamed:(NSString *)theQueueName {
+    if (!enabled) {
+        return;
+    }
+    [lock lock];
+    [queueDepths setObject:[NSNumber numberWithUnsignedInteger:theDepth] forKey:theQueueName];
+    [lock unlock];
+}
+- (NSString *)jsonLine {
+    S3RequestMetrics *s3Metrics = [S3RequestMetrics sharedS3RequestMetrics];
+    NSMutableString *ret = [NSMutableString string];
+    
+    [lock lock];
+    [ret appendFormat:@"{\"time\":%.3f,\"elapsed_seconds\":%.3f,\"stages\":{", [[NSDate date] timeIntervalSince1970], [NSDate timeIntervalSinceReferenceDate] - startTime];
+    for (int stage = 0; stage < RESTORE_STAGE_COUNT; stage++) {
+        [ret appendFormat:@"%@\"%@\":{\"count\":%qu,\"bytes\":%qu,\"seconds\":%.6f,\"latency_buckets\":[",
+         (stage > 0 ? @"," : @""), [RestoreMetrics nameOfStage:stage], counts[stage], bytes[stage], seconds[stage]];
+        for (int bucket = 0; bucket <= RESTORE_LATENCY_BUCKET_COUNT; bucket++) {
+            [ret appendFormat:@"%@%qu", (bucket > 0 ? @"," : @""), bucketCounts[stage][bucket]];
+        }
+        [ret appendString:@"]}"];
+    }
+    [ret appendString:@"},\"queue_depths\":{"];
+    NSArray *queueNames = [[queueDepths allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    for (NSUInteger index = 0; index < [queueNames count]; index++) {
+        NSString *queueName = [queueNames objectAtIndex:index];
+        [ret appendFormat:@"%@\"%@\":%lu", (index > 0 ? @"," : @""), queueName, (unsigned long)[[queueDepths objectForKey:queueName] unsignedIntegerValue]];
+    }
+    [lock unlock];
+    
+    [ret appendFormat:@"},\"s3\":{\"retries\":%qu,\"hedges_fired\":%qu,\"hedges_won\":%qu,\"deadlines_exceeded\":%qu}}",
+     [s3Metrics retries], [s3Metrics hedgesFired], [s3Metrics hedgesWon], [s3Metrics deadlinesExceeded]];
+    return ret;
+}
+- (NSString *)prometheusText {
+    S3RequestMetrics *s3Metrics = [S3RequestMetrics sharedS3RequestMetrics];
+    NSMutableString *ret = [NSMutableString string];
+    
+    [lock lock];
+    [ret appendString:@"# HELP arq_restore_stage_seconds Latency of restore operations by stage.\n"];
+    [ret appendString:@"# TYPE arq_restore_stage_seconds histogram\n"];
+    for (int stage = 0; stage < RESTORE_STAGE_COUNT; stage++) {
+        NSString *name = [RestoreMetrics nameOfStage:stage];
+        unsigned long long cumulative = 0;
+        for (int bucket = 0; bucket < RESTORE_LATENCY_BUCKET_COUNT; bucket++) {
+            cumulative += bucketCounts[stage][bucket];
+            [ret appendFormat:@"arq_restore_stage_seconds_bucket{stage=\"%@\",le=\"%g\"} %qu\n", name, latencyBucketBounds[bucket], cumulative];
+        }
+        [ret appendFormat:@"arq_restore_stage_seconds_bucket{stage=\"%@\",le=\"+Inf\"} %qu\n", name, counts[stage]];
+        [ret appendFormat:@"arq_restore_stage_seconds_sum{stage=\"%@\"} %.6f\n", name, seconds[stage]];
+        [ret appendFormat:@"arq_restore_stage_seconds_count{stage=\"%@\"} %qu\n", name, counts[stage]];
+    }
+    [ret appendString:@"# HELP arq_restore_stage_bytes_total Bytes handled by each restore stage.\n"];
+    [ret appendString:@"# TYPE arq_restore_stage_bytes_total counter\n"];
+    for (int stage = 0; stage < RESTORE_STAGE_COUNT; stage++) {
+        [ret appendFormat:@"arq_restore_stage_bytes_total{stage=\"%@\"} %qu\n", [RestoreMetrics nameOfStage:stage], bytes[stage]];
+    }
+    [ret appendString:@"# HELP arq_restore_queue_depth Items waiting in each restore queue.\n"];
+    [ret appendString:@"# TYPE arq_restore_queue_depth gauge\n"];
+    for (NSString *queueName in [[queueDepths allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        [ret appendFormat:@"arq_restore_queue_depth{queue=\"%@\"} %lu\n", queueName, (unsigned long)[[queueDepths objectForKey:queueName] unsignedIntegerValue]];
+    }
+    [lock unlock];
+    
+    [ret appendString:@"# HELP arq_restore_s3_retries_total S3 requests retried after a transient error.\n"];
+    [ret appendString:@"# TYPE arq_restore_s3_retries_total counter\n"];
+    [ret appendFormat:@"arq_restore_s3_retries_total %qu\n", [s3Metrics retries]];
+    [ret appendString:@"# HELP arq_restore_s3_hedges_fired_total Hedged S3 requests sent.\n"];
+    [ret appendString:@"# TYPE arq_restore_s3_hedges_fired_total counter\n"];
+    [ret appendFormat:@"arq_restore_s3_hedges_fired_total %qu\n", [s3Metrics hedgesFired]];
+    [ret appendString:@"# HELP arq_restore_s3_hedges_won_total Hedged S3 requests that finished first.\n"];
+    [ret appendString:@"# TYPE arq_restore_s3_hedges_won_total counter\n"];
+    [ret appendFormat:@"arq_restore_s3_hedges_won_total %qu\n", [s3Metrics hedgesWon]];
+    [ret appendString:@"# HELP arq_restore_s3_deadlines_exceeded_total S3 requests that missed their deadline.\n"];
+    [ret appendString:@"# TYPE arq_restore_s3_deadlines_exceeded_total counter\n"];
+    [ret appendFormat:@"arq_restore_s3_deadlines_exceeded_total %qu\n", [s3Metrics deadlinesExceeded]];
+    return ret;
+}
+- (void)reset {
+    [lock lock];
+    startTime = [NSDate timeIntervalSinceReferenceDate];
+    memset(counts, 0, sizeof(counts));
+    memset(bytes, 0, sizeof(bytes));
+    memset(seconds, 0, sizeof(seconds));
+    memset(bucketCounts, 0, sizeof(bucketCounts));
+    [queueDepths removeAllObjects];
+    [lock unlock];
+}
+@end
@@ -0,0 +1,54 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Reports RestoreMetrics while a restore runs. Every RestoreMetricsIntervalSeconds (default 5) a snapshot is written
+// as one JSON line to the file named by the RestoreMetricsPath default (appended to) or to the already-open
+// descriptor named by RestoreMetricsFD. If RestoreMetricsPrometheusPort is set, the same counters are served in the
+// Prometheus text format on 127.0.0.1 at that port. With none of these set, start and stop do nothing.
+@interface RestoreMetricsReporter : NSObject {
+    NSTimeInterval interval;
+    NSString *outputPath;
+    int outputFD;
+    BOOL closeOutputFD;
+    unsigned short prometheusPort;
+    int listenFD;
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+}
+- (id)init;
+- (NSString *)errorDomain;
+- (BOOL)start:(NSError **)error;
+
+// Writes a final line and closes the output and the socket.
+- (void)stop;
+@end
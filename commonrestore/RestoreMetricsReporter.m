@@ -0,0 +1,228 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "RestoreMetricsReporter.h"
+#import "RestoreMetrics.h"
+#import "SetNSError.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+
+#define DEFAULT_INTERVAL_SECONDS (5)
+#define CLIENT_TIMEOUT_SECONDS (5)
+
+
+@interface RestoreMetricsReporter (internal)
+- (BOOL)openOutput:(NSError **)error;
+- (BOOL)startPrometheusListener:(NSError **)error;
+- (void)writeLine;
+- (void)serveClient:(int)theFD;
+- (BOOL)writeString:(NSString *)theString toFD:(int)theFD;
+@end
+
+@implementation RestoreMetricsReporter
+- (id)init {
+    if (self = [super init]) {
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        interval = [defaults doubleForKey:@"RestoreMetricsIntervalSeconds"];
+        if (interval <= 0) {
+            interval = DEFAULT_INTERVAL_SECONDS;
+        }
+        outputPath = [defaults stringForKey:@"RestoreMetricsPath"];
+        outputFD = -1;
+        if (outputPath == nil && [defaults objectForKey:@"RestoreMetricsFD"] != nil) {
+            outputFD = (int)[defaults integerForKey:@"RestoreMetricsFD"];
+        }
+        prometheusPort = (unsigned short)[defaults integerForKey:@"RestoreMetricsPrometheusPort"];
+        listenFD = -1;
+        queue = dispatch_queue_create("RestoreMetricsReporter", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+- (NSString *)errorDomain {
+    return @"RestoreMetricsReporterErrorDomain";
+}
+- (BOOL)start:(NSError **)error {
+    if (outputPath == nil && outputFD == -1 && prometheusPort == 0) {
+        return YES;
+    }
+    [[RestoreMetrics sharedRestoreMetrics] reset];
+    
+    if (![self openOutput:error]) {
+        return NO;
+    }
+    if (prometheusPort != 0 && ![self startPrometheusListener:error]) {
+        if (closeOutputFD) {
+            close(outputFD);
+        }
+        outputFD = -1;
+        return NO;
+    }
+    [[RestoreMetrics sharedRestoreMetrics] setEnabled:YES];
+    if (outputFD != -1) {
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(interval * NSEC_PER_SEC)), (uint64_t)(interval * NSEC_PER_SEC), NSEC_PER_SEC / 10);
+        dispatch_source_set_event_handler(timer, ^{
+            [self writeLine];
+        });
+        dispatch_resume(timer);
+    }
+    return YES;
+}
+- (void)stop {
+    [[RestoreMetrics sharedRestoreMetrics] setEnabled:NO];
+    if (timer != nil) {
+        dispatch_source_cancel(timer);
+        timer = nil;
+    }
+    dispatch_sync(queue, ^{
+        if (outputFD != -1) {
+            [self writeLine];
+            if (closeOutputFD) {
+                close(outputFD);
+            }
+            outputFD = -1;
+        }
+    });
+    if (listenFD != -1) {
+        shutdown(listenFD, SHUT_RDWR);
+        close(listenFD);
+        listenFD = -1;
+    }
+}
+@end
+
+@implementation RestoreMetricsReporter (internal)
+- (BOOL)openOutput:(NSError **)error {
+    if (outputPath != nil) {
+        outputFD = open([outputPath fileSystemRepresentation], O_WRONLY|O_CREAT|O_APPEND, 0644);
+        if (outputFD == -1) {
+            int errnum = errno;
+            HSLogError(@"open(%@): %s", outputPath, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to open %@: %s", outputPath, strerror(errnum));
+            return NO;
+        }
+        closeOutputFD = YES;
+    } else if (outputFD != -1 && fcntl(outputFD, F_GETFD) == -1) {
+        int errnum = errno;
+        SETNSERROR([self errorDomain], errnum, @"RestoreMetricsFD %d is not an open file descriptor: %s", outputFD, strerror(errnum));
+        outputFD = -1;
+        return NO;
+    }
+    return YES;
+}
+- (BOOL)startPrometheusListener:(NSError **)error {
+    listenFD = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFD == -1) {
+        int errnum = errno;
+        SETNSERROR(@"UnixErrorDomain", errnum, @"socket: %s", strerror(errnum));
+        return NO;
+    }
+    int on = 1;
+    setsockopt(listenFD, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(prometheusPort);
+    if (bind(listenFD, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listenFD, 16) == -1) {
+        int errnum = errno;
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to listen on 127.0.0.1:%u: %s", (unsigned int)prometheusPort, strerror(errnum));
+        close(listenFD);
+        listenFD = -1;
+        return NO;
+    }
+    HSLogInfo(@"serving restore metrics on http://127.0.0.1:%u/metrics", (unsigned int)prometheusPort);
+    
+    int fd = listenFD;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        for (;;) {
+            int clientFD = accept(fd, NULL, NULL);
+            if (clientFD == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // The listening socket was closed.
+                break;
+            }
+            [self serveClient:clientFD];
+        }
+    });
+    return YES;
+}
+- (void)writeLine {
+    NSString *line = [[[RestoreMetrics sharedRestoreMetrics] jsonLine] stringByAppendingString:@"\n"];
+    if (![self writeString:line toFD:outputFD]) {
+        HSLogWarn(@"failed to write restore metrics: %s", strerror(errno));
+    }
+}
+- (void)serveClient:(int)theFD {
+    int on = 1;
+    setsockopt(theFD, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    
+    // Clients are served on the accept thread, so don't let one that never sends or never reads hold it up.
+    struct timeval timeout = { CLIENT_TIMEOUT_SECONDS, 0 };
+    setsockopt(theFD, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(theFD, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    
+    // Any request gets the metrics; read just enough of it to not reset the connection on close.
+    char buf[4096];
+    (void)read(theFD, buf, sizeof(buf));
+    
+    NSString *body = [[RestoreMetrics sharedRestoreMetrics] prometheusText];
+    NSUInteger bodyLength = [body lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    NSString *response = [NSString stringWithFormat:@"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n%@", (unsigned long)bodyLength, body];
+    [self writeString:response toFD:theFD];
+    close(theFD);
+}
+- (BOOL)writeString:(NSString *)theString toFD:(int)theFD {
+    NSData *data = [theString dataUsingEncoding:NSUTF8StringEncoding];
+    const unsigned char *bytes = (const unsigned char *)[data bytes];
+    NSUInteger written = 0;
+    while (written < [data length]) {
+        ssize_t ret = write(theFD, bytes + written, [data length] - written);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NO;
+        }
+        written += (NSUInteger)ret;
+    }
+    return YES;
+}
+@end
@@ -0,0 +1,82 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "RestoreProgressPrinter.h"
+
+
+#define MIN_PRINT_INTERVAL_SECONDS (0.1)
+
+
+@implementation RestoreProgressPrinter
+- (id)init {
+    if (self = [super init]) {
+        printAll = [[NSUserDefaults standardUserDefaults] boolForKey:@"PrintAllRestoredPaths"];
+        lock = [[NSLock alloc] init];
+        [lock setName:@"RestoreProgressPrinter lock"];
+    }
+    return self;
+}
+- (void)didRestorePath:(NSString *)thePath {
+    [lock lock];
+    restoredCount++;
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (!printAll && now - lastPrintTime < MIN_PRINT_INTERVAL_SECONDS) {
+        unprintedCount++;
+        [lock unlock];
+        return;
+    }
+    if (unprintedCount > 0) {
+        printf("restored %s (and %qu more)\n", [thePath UTF8String], unprintedCount);
+    } else {
+        printf("restored %s\n", [thePath UTF8String]);
+    }
+    unprintedCount = 0;
+    lastPrintTime = now;
+    [lock unlock];
+}
+- (void)didTransferBytes:(unsigned long long)theBytes ofTotal:(unsigned long long)theTotal {
+    [lock lock];
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    if (printAll || theBytes >= theTotal || now - lastPrintTime >= MIN_PRINT_INTERVAL_SECONDS) {
+        printf("restored %qu of %qu\n", theBytes, theTotal);
+        lastPrintTime = now;
+    }
+    [lock unlock];
+}
+- (void)restoreDidFinish {
+    [lock lock];
+    printf("restored %qu items\n", restoredCount);
+    fflush(stdout);
+    [lock unlock];
+}
+@end
@@ -0,0 +1,65 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Remembers where each blob was first written during a restore so that later
+// references to the same blob can be satisfied from the local copy instead of
+// fetching and decoding it again.
+//
+// Blobs are keyed by a SHA-256 digest of their content identifier (the Arq7 blob
+// identifier or the Arq5 BlobKey sha1), and whole files by a digest of their
+// identifier list. Both maps stop taking new entries once they're full. Entries
+// must only be added once the file containing them has been fully written and
+// closed.
+
+@interface RestoredBlobMap : NSObject {
+    NSMutableDictionary *locationsByBlobDigest;
+    NSMutableDictionary *pathsByBlobListDigest;
+    NSLock *lock;
+    unsigned long long bytesReused;
+}
+- (id)init;
+
+- (void)addBlobIdentifier:(NSString *)theBlobIdentifier path:(NSString *)thePath offset:(unsigned long long)theOffset length:(unsigned long long)theLength;
+
+// Returns the blob's contents read from the file it was first restored to, or nil if it hasn't been restored yet or can't be read.
+- (NSData *)dataForBlobIdentifier:(NSString *)theBlobIdentifier;
+
+// Whole-file duplicates: files whose data is exactly the same sequence of blobs.
+- (void)addPath:(NSString *)thePath forFileWithBlobIdentifiers:(NSArray *)theBlobIdentifiers;
+- (NSString *)pathOfFileWithBlobIdentifiers:(NSArray *)theBlobIdentifiers;
+
+// Creates thePath with the same data as theExistingPath, using a copy-on-write clone where the filesystem supports it.
+// The copy has none of the original's extended attributes, ACL or flags; the caller applies the node's own.
++ (BOOL)cloneFileAtPath:(NSString *)theExistingPath toPath:(NSString *)thePath error:(NSError **)error;
+
+- (unsigned long long)bytesReused;
+@end
@@ -0,0 +1,271 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <copyfile.h>
+#include <sys/xattr.h>
+#include <sys/acl.h>
+#include <CommonCrypto/CommonDigest.h>
+#import "RestoredBlobMap.h"
+
+
+// Enough for every blob of a large restore; past this, repeated blobs are simply fetched again.
+#define MAX_BLOB_LOCATIONS (2000000)
+#define MAX_DUPLICATE_FILES (500000)
+
+
+@interface RestoredBlobLocation : NSObject {
+@public
+    NSString *path;
+    unsigned long long offset;
+    unsigned long long length;
+}
+@end
+
+@implementation RestoredBlobLocation
+@end
+
+
+@interface RestoredBlobMap (internal)
++ (NSData *)digestForBlobIdentifier:(NSString *)theBlobIdentifier;
++ (NSData *)digestForBlobIdentifiers:(NSArray *)theBlobIdentifiers;
++ (BOOL)removeMetadataAtPath:(NSString *)thePath error:(NSError **)error;
+@end
+
+
+@implementation RestoredBlobMap
++ (NSString *)errorDomain {
+    return @"RestoredBlobMapErrorDomain";
+}
+
+- (id)init {
+    if (self = [super init]) {
+        locationsByBlobDigest = [[NSMutableDictionary alloc] init];
+        pathsByBlobListDigest = [[NSMutableDictionary alloc] init];
+        lock = [[NSLock alloc] init];
+        [lock setName:@"RestoredBlobMap lock"];
+    }
+    return self;
+}
+
+- (void)addBlobIdentifier:(NSString *)theBlobIdentifier path:(NSString *)thePath offset:(unsigned long long)theOffset length:(unsigned long long)theLength {
+    if (theBlobIdentifier == nil || theLength == 0) {
+        return;
+    }
+    NSData *digest = [RestoredBlobMap digestForBlobIdentifier:theBlobIdentifier];
+    [lock lock];
+    if ([locationsByBlobDigest count] < MAX_BLOB_LOCATIONS && [locationsByBlobDigest objectForKey:digest] == nil) {
+        RestoredBlobLocation *loc = [[RestoredBlobLocation alloc] init];
+        loc->path = thePath;
+        loc->offset = theOffset;
+        loc->length = theLength;
+        [locationsByBlobDigest setObject:loc forKey:digest];
+    }
+    [lock unlock];
+}
+- (NSData *)dataForBlobIdentifier:(NSString *)theBlobIdentifier {
+    if (theBlobIdentifier == nil) {
+        return nil;
+    }
+    NSData *digest = [RestoredBlobMap digestForBlobIdentifier:theBlobIdentifier];
+    [lock lock];
+    RestoredBlobLocation *loc = [locationsByBlobDigest objectForKey:digest];
+    [lock unlock];
+    if (loc == nil) {
+        return nil;
+    }
+    
+    int fd = open([loc->path fileSystemRepresentation], O_RDONLY);
+    if (fd == -1) {
+        HSLogDebug(@"open(%@): %s; fetching blob %@ again", loc->path, strerror(errno), theBlobIdentifier);
+        return nil;
+    }
+    NSMutableData *ret = [NSMutableData dataWithLength:(NSUInteger)loc->length];
+    unsigned char *buf = (unsigned char *)[ret mutableBytes];
+    unsigned long long received = 0;
+    while (received < loc->length) {
+        ssize_t num = pread(fd, buf + received, (size_t)(loc->length - received), (off_t)(loc->offset + received));
+        if (num == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num <= 0) {
+            break;
+        }
+        received += num;
+    }
+    close(fd);
+    if (received != loc->length) {
+        HSLogDebug(@"short read of blob %@ from %@; fetching it again", theBlobIdentifier, loc->path);
+        return nil;
+    }
+    
+    [lock lock];
+    bytesReused += loc->length;
+    [lock unlock];
+    HSLogDebug(@"reusing blob %@ from %@ at offset %qu", theBlobIdentifier, loc->path, loc->offset);
+    return ret;
+}
+
+- (void)addPath:(NSString *)thePath forFileWithBlobIdentifiers:(NSArray *)theBlobIdentifiers {
+    if ([theBlobIdentifiers count] == 0) {
+        return;
+    }
+    NSData *digest = [RestoredBlobMap digestForBlobIdentifiers:theBlobIdentifiers];
+    [lock lock];
+    if ([pathsByBlobListDigest count] < MAX_DUPLICATE_FILES && [pathsByBlobListDigest objectForKey:digest] == nil) {
+        [pathsByBlobListDigest setObject:thePath forKey:digest];
+    }
+    [lock unlock];
+}
+- (NSString *)pathOfFileWithBlobIdentifiers:(NSArray *)theBlobIdentifiers {
+    if ([theBlobIdentifiers count] == 0) {
+        return nil;
+    }
+    NSData *digest = [RestoredBlobMap digestForBlobIdentifiers:theBlobIdentifiers];
+    [lock lock];
+    NSString *ret = [pathsByBlobListDigest objectForKey:digest];
+    [lock unlock];
+    return ret;
+}
+
++ (BOOL)cloneFileAtPath:(NSString *)theExistingPath toPath:(NSString *)thePath error:(NSError **)error {
+    // The copy is created exclusively, so remove anything in the way first.
+    if (unlink([thePath fileSystemRepresentation]) == -1 && errno != ENOENT) {
+        int errnum = errno;
+        SETNSERROR([RestoredBlobMap errorDomain], errnum, @"unlink(%@): %s", thePath, strerror(errnum));
+        return NO;
+    }
+    // COPYFILE_CLONE clones where the filesystem supports it and copies otherwise.
+    if (copyfile([theExistingPath fileSystemRepresentation], [thePath fileSystemRepresentation], NULL, COPYFILE_DATA|COPYFILE_CLONE) == -1) {
+        int errnum = errno;
+        HSLogError(@"copyfile(%@, %@): %s", theExistingPath, thePath, strerror(errnum));
+        SETNSERROR([RestoredBlobMap errorDomain], errnum, @"copyfile(%@, %@): %s", theExistingPath, thePath, strerror(errnum));
+        return NO;
+    }
+    // A clone carries the original's xattrs, ACL and flags along with its data. Drop them so metadata the node
+    // doesn't set itself can't leak from one file to another.
+    if (![RestoredBlobMap removeMetadataAtPath:thePath error:error]) {
+        unlink([thePath fileSystemRepresentation]);
+        return NO;
+    }
+    return YES;
+}
+
+- (unsigned long long)bytesReused {
+    [lock lock];
+    unsigned long long ret = bytesReused;
+    [lock unlock];
+    return ret;
+}
+
+
+#pragma mark internal
++ (NSData *)digestForBlobIdentifier:(NSString *)theBlobIdentifier {
+    const char *str = [theBlobIdentifier UTF8String];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256(str, (CC_LONG)strlen(str), digest);
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
++ (NSData *)digestForBlobIdentifiers:(NSArray *)theBlobIdentifiers {
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    for (NSString *blobIdentifier in theBlobIdentifiers) {
+        const char *str = [blobIdentifier UTF8String];
+        CC_SHA256_Update(&ctx, str, (CC_LONG)strlen(str));
+        CC_SHA256_Update(&ctx, ",", 1);
+    }
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(digest, &ctx);
+    return [NSData dataWithBytes:digest length:CC_SHA256_DIGEST_LENGTH];
+}
++ (BOOL)removeMetadataAtPath:(NSString *)thePath error:(NSError **)error {
+    int fd = open([thePath fileSystemRepresentation], O_RDONLY|O_NOFOLLOW);
+    if (fd == -1) {
+        int errnum = errno;
+        SETNSERROR([RestoredBlobMap errorDomain], errnum, @"open(%@): %s", thePath, strerror(errnum));
+        return NO;
+    }
+    BOOL ret = NO;
+    char *names = NULL;
+    filesec_t fsec = NULL;
+    do {
+        // Clear flags first; uchg and friends would stop the other changes.
+        if (fchflags(fd, 0) == -1) {
+            int errnum = errno;
+            SETNSERROR([RestoredBlobMap errorDomain], errnum, @"fchflags(%@): %s", thePath, strerror(errnum));
+            break;
+        }
+        
+        ssize_t namesLen = flistxattr(fd, NULL, 0, XATTR_NOFOLLOW);
+        if (namesLen == -1) {
+            int errnum = errno;
+            SETNSERROR([RestoredBlobMap errorDomain], errnum, @"flistxattr(%@): %s", thePath, strerror(errnum));
+            break;
+        }
+        if (namesLen > 0) {
+            names = (char *)malloc((size_t)namesLen);
+            namesLen = flistxattr(fd, names, (size_t)namesLen, XATTR_NOFOLLOW);
+            if (namesLen == -1) {
+                int errnum = errno;
+                SETNSERROR([RestoredBlobMap errorDomain], errnum, @"flistxattr(%@): %s", thePath, strerror(errnum));
+                break;
+            }
+        }
+        BOOL removedAll = YES;
+        for (char *name = names; name != NULL && name < names + namesLen; name += strlen(name) + 1) {
+            if (fremovexattr(fd, name, XATTR_NOFOLLOW) == -1 && errno != ENOATTR) {
+                int errnum = errno;
+                SETNSERROR([RestoredBlobMap errorDomain], errnum, @"fremovexattr(%@, %s): %s", thePath, name, strerror(errnum));
+                removedAll = NO;
+                break;
+            }
+        }
+        if (!removedAll) {
+            break;
+        }
+        
+        fsec = filesec_init();
+        filesec_set_property(fsec, FILESEC_ACL, _FILESEC_REMOVE_ACL);
+        if (fchmodx_np(fd, fsec) == -1) {
+            int errnum = errno;
+            SETNSERROR([RestoredBlobMap errorDomain], errnum, @"fchmodx_np(%@): %s", thePath, strerror(errnum));
+            break;
+        }
+        ret = YES;
+    } while (0);
+    if (fsec != NULL) {
+        filesec_free(fsec);
+    }
+    free(names);
+    close(fd);
+    return ret;
+}
+@end
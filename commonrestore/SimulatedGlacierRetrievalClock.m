@@ -0,0 +1,63 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "SimulatedGlacierRetrievalClock.h"
+
+@implementation SimulatedGlacierRetrievalClock
+- (id)initWithStartDate:(NSDate *)theStartDate {
+    if (self = [super init]) {
+        now = theStartDate;
+    }
+    return self;
+}
+
+#pragma mark GlacierRetrievalClock
+- (NSDate *)now {
+    return now;
+}
+- (void)sleepForTimeInterval:(NSTimeInterval)theInterval {
+    if (theInterval > 0) {
+        now = [now dateByAddingTimeInterval:theInterval];
+    }
+}
+- (BOOL)waitOnCondition:(NSCondition *)theCondition untilDate:(NSDate *)theDate {
+    // Nothing else moves simulated time, so no signal can arrive before theDate.
+    if ([theDate compare:now] == NSOrderedDescending) {
+        now = theDate;
+    }
+    return NO;
+}
+@end
+
+#endif
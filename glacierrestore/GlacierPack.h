@@ -31,6 +31,7 @@
  */
 
 @class Target;
+@class GlacierJobOutputDownloader;
 
 @interface GlacierPack : NSObject {
     NSString *s3BucketName;
@@ -54,5 +55,6 @@
 - (NSString *)archiveId;
 - (unsigned long long)packSize;
 - (BOOL)cachePackDataToDisk:(NSData *)thePackData error:(NSError **)error;
+- (BOOL)cachePackDataFromDownloader:(GlacierJobOutputDownloader *)theDownloader error:(NSError **)error;
 - (NSData *)cachedDataForObjectAtOffset:(unsigned long long)offset error:(NSError **)error;
 @end
@@ -40,6 +40,7 @@
 #import "Streams.h"
 #import "Target.h"
 #import "CacheOwnership.h"
+#import "GlacierJobOutputDownloader.h"
 
 @implementation GlacierPack
 - (id)initWithTarget:(Target *)theTarget
@@ -77,6 +78,54 @@
     }
     return [Streams writeData:thePackData atomicallyToFile:localPath targetUID:[[CacheOwnership sharedCacheOwnership] uid] targetGID:[[CacheOwnership sharedCacheOwnership] gid] bytesWritten:NULL error:error];
 }
+- (BOOL)cachePackDataFromDownloader:(GlacierJobOutputDownloader *)theDownloader error:(NSError **)error {
+    uid_t uid = [[CacheOwnership sharedCacheOwnership] uid];
+    gid_t gid = [[CacheOwnership sharedCacheOwnership] gid];
+    if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:localPath targetUID:uid targetGID:gid error:error]) {
+        return NO;
+    }
+    
+    // Stream the ranges into a temp file and rename it into place once every range has been verified.
+    char *tempPathCString = strdup([[localPath stringByAppendingString:@".XXXXXX"] fileSystemRepresentation]);
+    int fd = mkstemp(tempPathCString);
+    NSString *tempPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:tempPathCString length:strlen(tempPathCString)];
+    free(tempPathCString);
+    if (fd == -1) {
+        int errnum = errno;
+        HSLogError(@"mkstemp(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to make temp file for %@: %s", localPath, strerror(errnum));
+        return NO;
+    }
+    BOOL ret = NO;
+    do {
+        if ((uid != getuid() || gid != getgid()) && fchown(fd, uid, gid) == -1) {
+            int errnum = errno;
+            HSLogError(@"fchown(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to change ownership of %@: %s", tempPath, strerror(errnum));
+            break;
+        }
+        if (fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH) == -1) {
+            int errnum = errno;
+            HSLogError(@"fchmod(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+        }
+        if (![theDownloader downloadToFileDescriptor:fd error:error]) {
+            break;
+        }
+        ret = YES;
+    } while (0);
+    close(fd);
+    
+    if (ret && rename([tempPath fileSystemRepresentation], [localPath fileSystemRepresentation]) == -1) {
+        int errnum = errno;
+        HSLogError(@"rename(%@, %@) error %d: %s", tempPath, localPath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to rename %@ to %@: %s", tempPath, localPath, strerror(errnum));
+        ret = NO;
+    }
+    if (!ret) {
+        unlink([tempPath fileSystemRepresentation]);
+    }
+    return ret;
+}
 - (NSData *)cachedDataForObjectAtOffset:(unsigned long long)offset error:(NSError **)error {
     int fd = open([localPath fileSystemRepresentation], O_RDONLY);
     if (fd == -1) {
@@ -43,13 +43,17 @@
 @class Commit;
 @class Tree;
 @class BlobKey;
+@class GlacierRetrievalScheduler;
+@class LocalGlacierEnvironment;
 
 @interface GlacierRestorer : NSObject <Restorer, TargetConnectionDelegate> {
     GlacierRestorerParamSet *paramSet;
     id <GlacierRestorerDelegate> delegate;
     
-    unsigned long long bytesToRequestPerRound;
-    NSDate *dateToResumeRequesting;
+    GlacierRetrievalScheduler *retrievalScheduler;
+#ifdef ARQ_RESTORE_BENCHMARKS
+    LocalGlacierEnvironment *localEnvironment;
+#endif
     NSString *skipFilesRoot;
     NSMutableDictionary *hardlinks;
     NSString *jobUUID;
@@ -71,12 +75,22 @@
     NSString *queueArn;
     NSString *subscriptionArn;
 
+    NSCondition *queueCondition;
+    NSMutableDictionary *completedJobIdsByArchiveId;
+    NSMutableDictionary *treeHashesByJobId;
+    BOOL jobsCompletedSinceLastWait;
+    BOOL queueReaderStopRequested;
+    NSError *queueReaderError;
+    NSMutableArray *packDownloadQueue;
+    NSMutableSet *queuedPackSHA1s;
+    NSMutableArray *downloadedPacks;
+    NSError *downloadError;
+    BOOL downloadStopRequested;
+
     Repo *repo;
     Commit *commit;
     NSString *commitDescription;
     Tree *rootTree;
-    NSUInteger roundsCompleted;
-    unsigned long long bytesRequestedThisRound;
     unsigned long long bytesRequested;
     unsigned long long totalBytesToRequest;
     
@@ -87,6 +101,21 @@
 }
 - (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
                              delegate:(id <GlacierRestorerDelegate>)theDelegate;
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                   retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler;
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+// Glacier, SNS and SQS calls go to theLocalEnvironment instead of AWS, and retrieval pacing runs on its clock.
+// Only the glacierrestore benchmark uses these.
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                     localEnvironment:(LocalGlacierEnvironment *)theLocalEnvironment;
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                   retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler
+                     localEnvironment:(LocalGlacierEnvironment *)theLocalEnvironment;
+#endif
 
 - (void)run;
 @end
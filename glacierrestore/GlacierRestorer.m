@@ -73,23 +73,63 @@
 #import "GlacierPackIndex.h"
 #import "AWSRegion.h"
 #import "Streams.h"
+#import "GlacierRetrievalScheduler.h"
+#import "ThroughputGlacierRetrievalPolicy.h"
+#import "SystemGlacierRetrievalClock.h"
+#ifdef ARQ_RESTORE_BENCHMARKS
+#import "LocalGlacierEnvironment.h"
+#import "LocalSNS.h"
+#import "LocalSQS.h"
+#import "LocalGlacierService.h"
+#endif
+#import "GlacierJobOutputDownloader.h"
 
-#define WAIT_TIME (3.0)
-#define SLEEP_CYCLES (2)
+#define WAIT_TIME (6.0)
 #define MAX_QUEUE_MESSAGES_TO_READ (10)
+#define QUEUE_WAIT_TIME_SECONDS (20)
 #define MAX_GLACIER_RETRIES (10)
+#define NUM_DOWNLOAD_THREADS (4)
+#define NUM_PACK_DOWNLOAD_THREADS (2)
 
 #define RESTORE_DAYS (10)
 
 @implementation GlacierRestorer
++ (GlacierRetrievalScheduler *)defaultRetrievalSchedulerWithParamSet:(GlacierRestorerParamSet *)theParamSet clock:(id <GlacierRetrievalClock>)theClock {
+    // Request 4 hours' worth of data at the preferred download rate every 4 hours.
+    ThroughputGlacierRetrievalPolicy *policy = [[ThroughputGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:theParamSet.downloadBytesPerSecond
+                                                                                                      roundTimeInterval:(60 * 60 * 4)];
+    return [[GlacierRetrievalScheduler alloc] initWithPolicy:policy clock:theClock];
+}
 - (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
                              delegate:(id <GlacierRestorerDelegate>)theDelegate {
+    GlacierRetrievalScheduler *scheduler = [GlacierRestorer defaultRetrievalSchedulerWithParamSet:theParamSet clock:[[SystemGlacierRetrievalClock alloc] init]];
+    return [self initWithGlacierRestorerParamSet:theParamSet delegate:theDelegate retrievalScheduler:scheduler];
+}
+#ifdef ARQ_RESTORE_BENCHMARKS
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                     localEnvironment:(LocalGlacierEnvironment *)theLocalEnvironment {
+    GlacierRetrievalScheduler *scheduler = [GlacierRestorer defaultRetrievalSchedulerWithParamSet:theParamSet clock:[theLocalEnvironment clock]];
+    return [self initWithGlacierRestorerParamSet:theParamSet delegate:theDelegate retrievalScheduler:scheduler localEnvironment:theLocalEnvironment];
+}
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                   retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler
+                     localEnvironment:(LocalGlacierEnvironment *)theLocalEnvironment {
+    if (self = [self initWithGlacierRestorerParamSet:theParamSet delegate:theDelegate retrievalScheduler:theRetrievalScheduler]) {
+        localEnvironment = theLocalEnvironment;
+    }
+    return self;
+}
+#endif
+- (id)initWithGlacierRestorerParamSet:(GlacierRestorerParamSet *)theParamSet
+                             delegate:(id <GlacierRestorerDelegate>)theDelegate
+                   retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler {
     if (self = [super init]) {
         paramSet = theParamSet;
         delegate = theDelegate; // Don't retain it.
 
-        bytesToRequestPerRound = paramSet.downloadBytesPerSecond * 60 * 60 * 4; // 4 hours at preferred download rate
-        dateToResumeRequesting = [NSDate date];
+        retrievalScheduler = theRetrievalScheduler;
         skipFilesRoot = [[UserLibrary arqUserLibraryPath] stringByAppendingFormat:@"/RestoreJobSkipFiles/%f", [NSDate timeIntervalSinceReferenceDate]];
         hardlinks = [[NSMutableDictionary alloc] init];        
         jobUUID = [NSString stringWithRandomUUID];
@@ -100,6 +140,13 @@
         glacierRequestItems = [[NSMutableArray alloc] init];
         restoreItems = [[NSMutableArray alloc] init];
         requestedArchiveIds = [[NSMutableSet alloc] init];
+        queueCondition = [[NSCondition alloc] init];
+        [queueCondition setName:@"GlacierRestorer queue condition"];
+        completedJobIdsByArchiveId = [[NSMutableDictionary alloc] init];
+        treeHashesByJobId = [[NSMutableDictionary alloc] init];
+        packDownloadQueue = [[NSMutableArray alloc] init];
+        queuedPackSHA1s = [[NSMutableSet alloc] init];
+        downloadedPacks = [[NSMutableArray alloc] init];
     }
     return self;
 }
@@ -114,8 +161,21 @@
         [delegate glacierRestorerDidSucceed];
     }
     
+    [queueCondition lock];
+    queueReaderStopRequested = YES;
+    downloadStopRequested = YES;
+    [queueCondition broadcast];
+    [queueCondition unlock];
+    
     [self deleteTopic];
     [self deleteQueue];
+    
+#ifdef ARQ_RESTORE_BENCHMARKS
+    if (localEnvironment != nil) {
+        HSLogInfo(@"local glacier environment: calls %@; %qu injected failures; %qu bytes downloaded",
+                  [localEnvironment callCountsByAction], [localEnvironment injectedFailureCount], [localEnvironment bytesDownloaded]);
+    }
+#endif
 
     NSError *removeError = nil;
     if ([[NSFileManager defaultManager] fileExistsAtPath:skipFilesRoot] && ![[NSFileManager defaultManager] removeItemAtPath:skipFilesRoot error:&removeError]) {
@@ -262,7 +322,20 @@
         if (completedJobId == nil) {
             return nil;
         }
-        ret = [glacier dataForVaultName:[[paramSet bucket] vaultName] jobId:completedJobId retries:MAX_GLACIER_RETRIES error:error];
+        if ([theBlobKey archiveSize] > 0) {
+            [queueCondition lock];
+            NSString *treeHash = [treeHashesByJobId objectForKey:completedJobId];
+            [queueCondition unlock];
+            GlacierJobOutputDownloader *downloader = [[GlacierJobOutputDownloader alloc] initWithGlacierService:glacier
+                                                                                                     vaultName:[[paramSet bucket] vaultName]
+                                                                                                         jobId:completedJobId
+                                                                                                        length:[theBlobKey archiveSize]
+                                                                                                      treeHash:treeHash
+                                                                                                    numThreads:NUM_DOWNLOAD_THREADS];
+            ret = [self dataFromDownloader:downloader forArchiveId:[theBlobKey archiveId] error:error];
+        } else {
+            ret = [glacier dataForVaultName:[[paramSet bucket] vaultName] jobId:completedJobId retries:MAX_GLACIER_RETRIES error:error];
+        }
         if (ret != nil) {
             if (![self addToBytesTransferred:[ret length] error:error]) {
                 return nil;
@@ -343,26 +416,17 @@
         }
     }
     
+    // Job-completion notifications are read on their own thread so downloads never wait on a queue poll.
+    // The reader hands each pack whose job completes to the download threads.
+    [NSThread detachNewThreadSelector:@selector(readQueueLoop) toTarget:self withObject:nil];
+    for (NSUInteger i = 0; i < NUM_PACK_DOWNLOAD_THREADS; i++) {
+        [NSThread detachNewThreadSelector:@selector(downloadLoop) toTarget:self withObject:nil];
+    }
     
     BOOL restoredAnItem = NO;
     BOOL ret = YES;
     for (;;) {
-        // Reset counters if necessary.
-        if (bytesRequestedThisRound >= bytesToRequestPerRound) {
-            roundsCompleted++;
-            bytesRequestedThisRound = 0;
-            NSDate *nextResumeDate = [dateToResumeRequesting dateByAddingTimeInterval:(60 * 60 * 4)];
-            
-            dateToResumeRequesting = nextResumeDate;
-            HSLogDebug(@"reset next request resume date to %@", nextResumeDate);
-        }
-        
-        // Make sure we've transferred all the bytes from all but the most recent round of requests.
-        double theMinimum = (roundsCompleted = 0) ? 0 : ((double)bytesToRequestPerRound * (double)(roundsCompleted - 1)) * .9;
-        unsigned long long minimumBytesToHaveTransferred = (unsigned long long)theMinimum;
-        if ((bytesRequestedThisRound < bytesToRequestPerRound)
-            && (bytesTransferred >= minimumBytesToHaveTransferred)
-            && ([[NSDate date] earlierDate:dateToResumeRequesting] == dateToResumeRequesting)) {
+        if ([retrievalScheduler shouldRequestMoreWithBytesTransferred:bytesTransferred]) {
             
             // Request more Glacier items.
             if ([glacierRequestItems count] > 0) {
@@ -377,13 +441,15 @@
             }
         }
         
-        if (!restoredAnItem) {
-            // Read any available items from the queue.
-            HSLogDebug(@"reading queue");
-            if (![self readQueue:error]) {
-                ret = NO;
-                break;
+        [queueCondition lock];
+        NSError *readerError = queueReaderError != nil ? queueReaderError : downloadError;
+        [queueCondition unlock];
+        if (readerError != nil) {
+            if (error != NULL) {
+                *error = readerError;
             }
+            ret = NO;
+            break;
         }
         
         if ([glacierPacksToDownload count] == 0 && [restoreItems count] == 0) {
@@ -400,40 +466,25 @@
         // Restore an item if possible.
         
         if ([glacierPacksToDownload count] > 0) {
-            GlacierPack *glacierPack = [glacierPacksToDownload objectAtIndex:0];
-            NSError *myError = nil;
-            NSString *completedJobId = [self completedJobIdForArchiveId:[glacierPack archiveId] error:&myError];
-            if (completedJobId == nil) {
-                if ([myError code] != ERROR_GLACIER_OBJECT_NOT_AVAILABLE) {
-                    SETERRORFROMMYERROR;
-                    ret = NO;
-                    break;
-                }
-                HSLogDebug(@"%@ not available yet", glacierPack);
-                restoredAnItem = NO;
-            } else {
-                HSLogDebug(@"downloading %@", glacierPack);
-                if ([delegate glacierRestorerMessageDidChange:@"Downloading pack file"]) {
-                    SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
-                    return NO;
-                }
-                NSData *packData = [glacier dataForVaultName:[[paramSet bucket] vaultName] jobId:completedJobId retries:MAX_GLACIER_RETRIES error:error];
-                if (packData == nil) {
-                    ret = NO;
-                    break;
-                }
-                restoredAnItem = YES;
-                if (![self addToBytesTransferred:[packData length] error:error]) {
-                    ret = NO;
-                    break;
-                }
-                if (![glacierPack cachePackDataToDisk:packData error:error]) {
+            // The download threads fetch packs as their jobs complete; account for the ones they've finished.
+            [queueCondition lock];
+            NSArray *finishedPacks = [NSArray arrayWithArray:downloadedPacks];
+            [downloadedPacks removeAllObjects];
+            [glacierPacksToDownload removeObjectsInArray:finishedPacks];
+            [queueCondition unlock];
+            for (GlacierPack *glacierPack in finishedPacks) {
+                HSLogDebug(@"downloaded %@", glacierPack);
+                if (![self addToBytesTransferred:[glacierPack packSize] error:error]) {
                     ret = NO;
                     break;
                 }
-                HSLogDebug(@"downloaded %@", glacierPack);
-                [glacierPacksToDownload removeObject:glacierPack];
-                restoredAnItem = YES;
+            }
+            if (!ret) {
+                break;
+            }
+            restoredAnItem = [finishedPacks count] > 0;
+            if (!restoredAnItem) {
+                HSLogDebug(@"none of the %lu remaining pack files has been downloaded yet", (unsigned long)[glacierPacksToDownload count]);
             }
 
         } else {
@@ -478,14 +529,22 @@
                 return NO;
             }
 
-            HSLogDebug(@"sleeping");
-            for (NSUInteger i = 0; i < SLEEP_CYCLES; i++) {
-                if (![self addToBytesTransferred:0 error:error]) {
-                    ret = NO;
-                    break;
-                }
-                [NSThread sleepForTimeInterval:3.0];
+            if (![self addToBytesTransferred:0 error:error]) {
+                ret = NO;
+                break;
+            }
+            HSLogDebug(@"waiting for job completion notifications and pack downloads");
+            // The queue reader and download threads broadcast queueCondition when a job completes, a pack finishes or they fail.
+            // Wait on the scheduler's clock so a simulated restore doesn't sit through real time.
+            id <GlacierRetrievalClock> clock = [retrievalScheduler clock];
+            NSDate *waitUntilDate = [[clock now] dateByAddingTimeInterval:WAIT_TIME];
+            [queueCondition lock];
+            while (!jobsCompletedSinceLastWait && [downloadedPacks count] == 0 && queueReaderError == nil && downloadError == nil
+                   && [[clock now] compare:waitUntilDate] == NSOrderedAscending) {
+                [clock waitOnCondition:queueCondition untilDate:waitUntilDate];
             }
+            jobsCompletedSinceLastWait = NO;
+            [queueCondition unlock];
         }
         if (!ret) {
             break;
@@ -494,24 +553,24 @@
     return ret;
 }
 - (BOOL)setUp:(NSError **)error {
-    NSString *secretAccessKey = [[[paramSet bucket] target] secret:error];
-    if (secretAccessKey == nil) {
+#ifdef ARQ_RESTORE_BENCHMARKS
+    if (localEnvironment != nil) {
+        HSLogInfo(@"using local Glacier/SNS/SQS stand-in");
+        sns = [[LocalSNS alloc] initWithEnvironment:localEnvironment];
+        sqs = [[LocalSQS alloc] initWithEnvironment:localEnvironment];
+        glacier = [[LocalGlacierService alloc] initWithEnvironment:localEnvironment];
+    } else if (![self setUpAWSServices:error]) {
         return NO;
     }
-    
-    AWSRegion *awsRegion = [AWSRegion regionWithS3Endpoint:[[[paramSet bucket] target] endpoint]];
-    if (awsRegion == nil) {
-        SETNSERROR([self errorDomain], -1, @"unknown AWS region %@", [[[paramSet bucket] target] endpoint]);
+#else
+    if (![self setUpAWSServices:error]) {
         return NO;
     }
-    sns = [[SNS alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey awsRegion:awsRegion retryOnTransientError:YES];
-    sqs = [[SQS alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey awsRegion:awsRegion retryOnTransientError:YES];
+#endif
     s3 = [[[paramSet bucket] target] s3:error];
     if (s3 == nil) {
         return NO;
     }
-    GlacierAuthorizationProvider *gap = [[GlacierAuthorizationProvider alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey];
-    glacier = [[GlacierService alloc] initWithGlacierAuthorizationProvider:gap awsRegion:awsRegion useSSL:YES retryOnTransientError:YES];
     glacierPackSet = [[GlacierPackSet alloc] initWithTarget:[[paramSet bucket] target]
                                                          s3:s3
                                                     glacier:glacier
@@ -586,6 +645,23 @@
 
     return YES;
 }
+- (BOOL)setUpAWSServices:(NSError **)error {
+    NSString *secretAccessKey = [[[paramSet bucket] target] secret:error];
+    if (secretAccessKey == nil) {
+        return NO;
+    }
+    
+    AWSRegion *awsRegion = [AWSRegion regionWithS3Endpoint:[[[paramSet bucket] target] endpoint]];
+    if (awsRegion == nil) {
+        SETNSERROR([self errorDomain], -1, @"unknown AWS region %@", [[[paramSet bucket] target] endpoint]);
+        return NO;
+    }
+    sns = [[SNS alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey awsRegion:awsRegion retryOnTransientError:YES];
+    sqs = [[SQS alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey awsRegion:awsRegion retryOnTransientError:YES];
+    GlacierAuthorizationProvider *gap = [[GlacierAuthorizationProvider alloc] initWithAccessKey:[[[[paramSet bucket] target] endpoint] user] secretKey:secretAccessKey];
+    glacier = [[GlacierService alloc] initWithGlacierAuthorizationProvider:gap awsRegion:awsRegion useSSL:YES retryOnTransientError:YES];
+    return YES;
+}
 - (BOOL)calculateSizes:(NSError **)error {
     BOOL ret = YES;
     while ([calculateItems count] > 0) {
@@ -747,31 +823,51 @@
     return YES;
 }
 
-- (BOOL)readQueue:(NSError **)error {
-    BOOL ret = YES;
-    for (;;) {
-        ReceiveMessageResponse *response = [sqs receiveMessagesForQueueURL:queueURL maxMessages:MAX_QUEUE_MESSAGES_TO_READ error:error];
-        if (response == nil) {
-            ret = NO;
-            break;
-        }
-        HSLogDebug(@"got %lu messages from queue", (unsigned long)[[response messages] count]);
-        if ([[response messages] count] == 0) {
-            break;
+- (void)readQueueLoop {
+    @autoreleasepool {
+        HSLogDebug(@"queue reader starting");
+        for (;;) {
+            [queueCondition lock];
+            BOOL stopRequested = queueReaderStopRequested;
+            [queueCondition unlock];
+            if (stopRequested) {
+                break;
+            }
+            NSError *myError = nil;
+            if (![self readQueue:&myError]) {
+                [queueCondition lock];
+                if (!queueReaderStopRequested) {
+                    HSLogError(@"error reading queue %@: %@", queueURL, myError);
+                    queueReaderError = myError;
+                    [queueCondition broadcast];
+                }
+                [queueCondition unlock];
+                break;
+            }
         }
-        
-        if ([delegate glacierRestorerMessageDidChange:@"Processing message queue"]) {
-            SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
+        HSLogDebug(@"queue reader finished");
+    }
+}
+- (BOOL)readQueue:(NSError **)error {
+    ReceiveMessageResponse *response = [sqs receiveMessagesForQueueURL:queueURL maxMessages:MAX_QUEUE_MESSAGES_TO_READ waitTimeSeconds:QUEUE_WAIT_TIME_SECONDS error:error];
+    if (response == nil) {
+        return NO;
+    }
+    HSLogDebug(@"got %lu messages from queue", (unsigned long)[[response messages] count]);
+    NSMutableArray *receiptHandles = [NSMutableArray array];
+    for (SQSMessage *msg in [response messages]) {
+        if (![self processMessage:msg error:error]) {
             return NO;
         }
-        for (SQSMessage *msg in [response messages]) {
-            if (![self processMessage:msg error:error]) {
-                ret = NO;
-                break;
-            }
+        [receiptHandles addObject:[msg receiptHandle]];
+    }
+    if ([receiptHandles count] > 0) {
+        NSError *myError = nil;
+        if (![sqs deleteMessagesWithQueueURL:queueURL receiptHandles:receiptHandles error:&myError]) {
+            HSLogError(@"error deleting %lu messages from queue %@: %@", (unsigned long)[receiptHandles count], queueURL, myError);
         }
     }
-    return ret;
+    return YES;
 }
 - (BOOL)processMessage:(SQSMessage *)theMessage error:(NSError **)error {
     NSDictionary *json = [[theMessage body] JSONValue:error];
@@ -791,6 +887,13 @@
     
     NSString *archiveId = [msgDict objectForKey:@"ArchiveId"];
     NSString *jobId = [msgDict objectForKey:@"JobId"];
+    NSString *treeHash = [msgDict objectForKey:@"SHA256TreeHash"];
+    if (treeHash == nil || [treeHash isKindOfClass:[NSNull class]]) {
+        treeHash = [msgDict objectForKey:@"ArchiveSHA256TreeHash"];
+    }
+    if ([treeHash isKindOfClass:[NSNull class]]) {
+        treeHash = nil;
+    }
     NSNumber *completed = [msgDict objectForKey:@"Completed"];
     NSAssert([completed boolValue], @"Completed must be YES");
     
@@ -800,15 +903,92 @@
         return NO;
     }
     
-    NSError *myError = nil;
-    if (![sqs deleteMessageWithQueueURL:queueURL receiptHandle:[theMessage receiptHandle] error:&myError]) {
-        HSLogError(@"error deleting message %@ from queue %@: %@", [theMessage receiptHandle], queueURL, myError);
-    }
+    [queueCondition lock];
+    [completedJobIdsByArchiveId setObject:jobId forKey:archiveId];
+    if (treeHash != nil) {
+        [treeHashesByJobId setObject:treeHash forKey:jobId];
+    }
+    jobsCompletedSinceLastWait = YES;
+    [self queueCompletedPacksForDownload];
+    [queueCondition broadcast];
+    [queueCondition unlock];
     return YES;
 }
+
+// Must be called with queueCondition locked.
+- (void)queueCompletedPacksForDownload {
+    for (GlacierPack *glacierPack in glacierPacksToDownload) {
+        if (![queuedPackSHA1s containsObject:[glacierPack packSHA1]] && [completedJobIdsByArchiveId objectForKey:[glacierPack archiveId]] != nil) {
+            [queuedPackSHA1s addObject:[glacierPack packSHA1]];
+            [packDownloadQueue addObject:glacierPack];
+        }
+    }
+}
+- (void)downloadLoop {
+    @autoreleasepool {
+        for (;;) {
+            [queueCondition lock];
+            while (!downloadStopRequested && downloadError == nil && [packDownloadQueue count] == 0) {
+                [queueCondition wait];
+            }
+            if (downloadStopRequested || downloadError != nil) {
+                [queueCondition unlock];
+                break;
+            }
+            GlacierPack *glacierPack = [packDownloadQueue objectAtIndex:0];
+            [packDownloadQueue removeObjectAtIndex:0];
+            NSString *completedJobId = [completedJobIdsByArchiveId objectForKey:[glacierPack archiveId]];
+            NSString *treeHash = [treeHashesByJobId objectForKey:completedJobId];
+            [queueCondition unlock];
+            
+            HSLogDebug(@"downloading %@", glacierPack);
+            GlacierJobOutputDownloader *downloader = [[GlacierJobOutputDownloader alloc] initWithGlacierService:glacier
+                                                                                                     vaultName:[[paramSet bucket] vaultName]
+                                                                                                         jobId:completedJobId
+                                                                                                        length:[glacierPack packSize]
+                                                                                                      treeHash:treeHash
+                                                                                                    numThreads:NUM_DOWNLOAD_THREADS];
+            NSError *myError = nil;
+            BOOL downloaded = [glacierPack cachePackDataFromDownloader:downloader error:&myError];
+            
+            [queueCondition lock];
+            if (downloaded) {
+                [downloadedPacks addObject:glacierPack];
+            } else if (downloadError == nil && !downloadStopRequested) {
+                HSLogError(@"error downloading %@: %@", glacierPack, myError);
+                downloadError = myError;
+            }
+            [queueCondition broadcast];
+            [queueCondition unlock];
+        }
+    }
+}
+- (NSData *)dataFromDownloader:(GlacierJobOutputDownloader *)theDownloader forArchiveId:(NSString *)theArchiveId error:(NSError **)error {
+    // Stream the ranges into a temp file next to the job status file instead of holding the whole archive in memory while it downloads.
+    NSString *statusPath = [self statusPathForArchiveId:theArchiveId];
+    char *tempPathCString = strdup([[statusPath stringByAppendingString:@".output.XXXXXX"] fileSystemRepresentation]);
+    int fd = mkstemp(tempPathCString);
+    NSString *tempPath = [[NSFileManager defaultManager] stringWithFileSystemRepresentation:tempPathCString length:strlen(tempPathCString)];
+    free(tempPathCString);
+    if (fd == -1) {
+        int errnum = errno;
+        HSLogError(@"mkstemp(%@) error %d: %s", tempPath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to make temp file for archive %@: %s", theArchiveId, strerror(errnum));
+        return nil;
+    }
+    NSData *ret = nil;
+    if ([theDownloader downloadToFileDescriptor:fd error:error]) {
+        ret = [NSData dataWithContentsOfFile:tempPath options:NSDataReadingMappedAlways error:error];
+    }
+    close(fd);
+    
+    // The mapping stays valid after the unlink.
+    unlink([tempPath fileSystemRepresentation]);
+    return ret;
+}
 - (BOOL)requestMoreGlacierItems:(NSError **)error {
     BOOL ret = YES;
-    while (bytesRequestedThisRound < bytesToRequestPerRound && [glacierRequestItems count] > 0) {
+    while ([retrievalScheduler roundHasRoom] && [glacierRequestItems count] > 0) {
         GlacierRequestItem *item = [glacierRequestItems objectAtIndex:0];
         NSArray *nextItems = [item requestWithRestorer:self repo:repo error:error];
         if (nextItems == nil) {
@@ -871,7 +1051,7 @@
 }
 - (BOOL)addToBytesRequested:(unsigned long long)length error:(NSError **)error {
     bytesRequested += length;
-    bytesRequestedThisRound += length;
+    [retrievalScheduler addBytesRequested:length];
     if ([delegate glacierRestorerBytesRequestedDidChange:[NSNumber numberWithUnsignedLongLong:bytesRequested]]) {
         SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
         return NO;
@@ -880,6 +1060,7 @@
 }
 - (BOOL)addToTotalBytesToRequest:(unsigned long long)length error:(NSError **)error {
     totalBytesToRequest += length;
+    [retrievalScheduler setTotalBytesToRequest:totalBytesToRequest];
     if ([delegate glacierRestorerTotalBytesToRequestDidChange:[NSNumber numberWithUnsignedLongLong:totalBytesToRequest]]) {
         SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
         return NO;
@@ -0,0 +1,86 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "GlacierRetrievalClock.h"
+
+// In-process stand-in for the parts of Glacier, SNS and SQS that GlacierRestorer uses.
+// Archives are read from files named by archive ID in a local directory. Retrieval jobs
+// complete after a configurable delay (measured on the given clock), and their completion
+// notifications are published to the subscribed queues the way SNS delivers them.
+// Every call can be given a fixed latency and a probability of failing with a transient error.
+// LocalSNS, LocalSQS and LocalGlacierService share one environment.
+@interface LocalGlacierEnvironment : NSObject {
+    NSString *archiveDirectory;
+    id <GlacierRetrievalClock> clock;
+    NSTimeInterval jobCompletionTimeInterval;
+    NSTimeInterval requestLatency;
+    double failureProbability;
+    NSLock *lock;
+    NSMutableDictionary *queueArnsByTopicArn;
+    NSMutableDictionary *queuesByQueueURL;
+    NSMutableArray *pendingJobs;
+    NSMutableDictionary *completedJobsByJobId;
+    NSMutableDictionary *callCountsByAction;
+    unsigned long long injectedFailureCount;
+    unsigned long long bytesDownloaded;
+}
+- (id)initWithArchiveDirectory:(NSString *)theArchiveDirectory
+                         clock:(id <GlacierRetrievalClock>)theClock
+     jobCompletionTimeInterval:(NSTimeInterval)theJobCompletionTimeInterval
+                requestLatency:(NSTimeInterval)theRequestLatency
+            failureProbability:(double)theFailureProbability;
+
+- (id <GlacierRetrievalClock>)clock;
+
+// Applies the request latency and failure injection for one call, retrying injected failures
+// up to theRetries times. Returns NO with an ERROR_TIMEOUT error in theErrorDomain if every attempt failed.
+- (BOOL)performAction:(NSString *)theAction errorDomain:(NSString *)theErrorDomain retries:(NSUInteger)theRetries error:(NSError **)error;
+
+- (NSString *)createTopicWithName:(NSString *)theName;
+- (BOOL)subscribeQueueArn:(NSString *)theQueueArn toTopicArn:(NSString *)theTopicArn error:(NSError **)error;
+- (void)deleteTopicWithArn:(NSString *)theTopicArn;
+
+- (NSURL *)createQueueWithName:(NSString *)theName;
+- (NSString *)queueArnForQueueURL:(NSURL *)theQueueURL error:(NSError **)error;
+- (NSArray *)receiveMessagesForQueueURL:(NSURL *)theQueueURL maxMessages:(NSUInteger)theMaxMessages waitTimeSeconds:(NSUInteger)theWaitTimeSeconds error:(NSError **)error;
+- (BOOL)deleteMessageWithQueueURL:(NSURL *)theQueueURL receiptHandle:(NSString *)theReceiptHandle error:(NSError **)error;
+- (void)deleteQueue:(NSURL *)theQueueURL;
+
+- (NSString *)initiateRetrievalJobForArchiveId:(NSString *)theArchiveId tier:(int)theGlacierRetrievalTier snsTopicArn:(NSString *)theSNSTopicArn error:(NSError **)error;
+- (NSData *)dataForJobId:(NSString *)theJobId error:(NSError **)error;
+- (NSData *)dataForJobId:(NSString *)theJobId range:(NSRange)theRange treeHash:(NSString **)theTreeHash error:(NSError **)error;
+
+- (NSDictionary *)callCountsByAction;
+- (unsigned long long)injectedFailureCount;
+- (unsigned long long)bytesDownloaded;
+@end
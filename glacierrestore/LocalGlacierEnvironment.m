@@ -0,0 +1,391 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "LocalGlacierEnvironment.h"
+#import "SQSMessage.h"
+#import "NSString_extra.h"
+#import "NSObject+SBJSON.h"
+#import "SHA256TreeHash.h"
+
+#define LOCAL_ACCOUNT_ID @"000000000000"
+#define LOCAL_REGION @"local"
+
+// Job completion times are spread uniformly over +/- this fraction of jobCompletionTimeInterval.
+#define JOB_COMPLETION_JITTER (0.25)
+
+// Same default as SQS.
+#define MESSAGE_VISIBILITY_TIMEOUT (30.0)
+
+// SQS returns at most 10 messages per ReceiveMessage call.
+#define MAX_MESSAGES_PER_RECEIVE (10)
+
+
+@interface LocalGlacierJob : NSObject {
+@public
+    NSString *jobId;
+    NSString *archiveId;
+    NSString *snsTopicArn;
+    NSString *treeHash;
+    int tier;
+    NSDate *completionDate;
+}
+@end
+@implementation LocalGlacierJob
+@end
+
+
+@interface LocalSQSQueueMessage : NSObject {
+@public
+    NSString *body;
+    NSString *receiptHandle;
+    NSDate *visibleDate;
+}
+@end
+@implementation LocalSQSQueueMessage
+@end
+
+
+@interface LocalSQSQueue : NSObject {
+@public
+    NSString *queueArn;
+    NSMutableArray *messages;
+}
+@end
+@implementation LocalSQSQueue
+@end
+
+
+@implementation LocalGlacierEnvironment
+- (id)initWithArchiveDirectory:(NSString *)theArchiveDirectory
+                         clock:(id <GlacierRetrievalClock>)theClock
+     jobCompletionTimeInterval:(NSTimeInterval)theJobCompletionTimeInterval
+                requestLatency:(NSTimeInterval)theRequestLatency
+            failureProbability:(double)theFailureProbability {
+    if (self = [super init]) {
+        archiveDirectory = theArchiveDirectory;
+        clock = theClock;
+        jobCompletionTimeInterval = theJobCompletionTimeInterval;
+        requestLatency = theRequestLatency;
+        failureProbability = theFailureProbability;
+        lock = [[NSLock alloc] init];
+        [lock setName:@"LocalGlacierEnvironment lock"];
+        queueArnsByTopicArn = [[NSMutableDictionary alloc] init];
+        queuesByQueueURL = [[NSMutableDictionary alloc] init];
+        pendingJobs = [[NSMutableArray alloc] init];
+        completedJobsByJobId = [[NSMutableDictionary alloc] init];
+        callCountsByAction = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (id <GlacierRetrievalClock>)clock {
+    return clock;
+}
+- (BOOL)performAction:(NSString *)theAction errorDomain:(NSString *)theErrorDomain retries:(NSUInteger)theRetries error:(NSError **)error {
+    for (NSUInteger attempt = 0; ; attempt++) {
+        if (requestLatency > 0) {
+            [clock sleepForTimeInterval:requestLatency];
+        }
+        BOOL failed = failureProbability > 0 && ((double)arc4random_uniform(1000000) / 1000000.0) < failureProbability;
+        
+        [lock lock];
+        NSNumber *count = [callCountsByAction objectForKey:theAction];
+        [callCountsByAction setObject:[NSNumber numberWithUnsignedLongLong:[count unsignedLongLongValue] + 1] forKey:theAction];
+        if (failed) {
+            injectedFailureCount++;
+        }
+        [lock unlock];
+        
+        if (!failed) {
+            return YES;
+        }
+        HSLogDebug(@"injected failure for %@ (attempt %lu)", theAction, (unsigned long)(attempt + 1));
+        if (attempt >= theRetries) {
+            SETNSERROR(theErrorDomain, ERROR_TIMEOUT, @"%@: injected transient failure", theAction);
+            return NO;
+        }
+    }
+}
+
+- (NSString *)createTopicWithName:(NSString *)theName {
+    NSString *ret = [NSString stringWithFormat:@"arn:aws:sns:%@:%@:%@", LOCAL_REGION, LOCAL_ACCOUNT_ID, theName];
+    [lock lock];
+    if ([queueArnsByTopicArn objectForKey:ret] == nil) {
+        [queueArnsByTopicArn setObject:[NSMutableArray array] forKey:ret];
+    }
+    [lock unlock];
+    return ret;
+}
+- (BOOL)subscribeQueueArn:(NSString *)theQueueArn toTopicArn:(NSString *)theTopicArn error:(NSError **)error {
+    BOOL ret = YES;
+    [lock lock];
+    NSMutableArray *queueArns = [queueArnsByTopicArn objectForKey:theTopicArn];
+    if (queueArns == nil) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_NOT_FOUND, @"topic %@ not found", theTopicArn);
+        ret = NO;
+    } else if (![queueArns containsObject:theQueueArn]) {
+        [queueArns addObject:theQueueArn];
+    }
+    [lock unlock];
+    return ret;
+}
+- (void)deleteTopicWithArn:(NSString *)theTopicArn {
+    [lock lock];
+    [queueArnsByTopicArn removeObjectForKey:theTopicArn];
+    [lock unlock];
+}
+
+- (NSURL *)createQueueWithName:(NSString *)theName {
+    NSURL *ret = [NSURL URLWithString:[NSString stringWithFormat:@"http://localhost/%@/%@", LOCAL_ACCOUNT_ID, theName]];
+    [lock lock];
+    if ([queuesByQueueURL objectForKey:ret] == nil) {
+        LocalSQSQueue *queue = [[LocalSQSQueue alloc] init];
+        queue->queueArn = [NSString stringWithFormat:@"arn:aws:sqs:%@:%@:%@", LOCAL_REGION, LOCAL_ACCOUNT_ID, theName];
+        queue->messages = [[NSMutableArray alloc] init];
+        [queuesByQueueURL setObject:queue forKey:ret];
+    }
+    [lock unlock];
+    return ret;
+}
+- (NSString *)queueArnForQueueURL:(NSURL *)theQueueURL error:(NSError **)error {
+    [lock lock];
+    LocalSQSQueue *queue = [queuesByQueueURL objectForKey:theQueueURL];
+    [lock unlock];
+    if (queue == nil) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_NOT_FOUND, @"queue %@ not found", theQueueURL);
+        return nil;
+    }
+    return queue->queueArn;
+}
+- (NSArray *)receiveMessagesForQueueURL:(NSURL *)theQueueURL maxMessages:(NSUInteger)theMaxMessages waitTimeSeconds:(NSUInteger)theWaitTimeSeconds error:(NSError **)error {
+    NSUInteger waited = 0;
+    for (;;) {
+        NSArray *ret = [self receiveVisibleMessagesForQueueURL:theQueueURL maxMessages:theMaxMessages error:error];
+        if (ret == nil || [ret count] > 0 || waited >= theWaitTimeSeconds) {
+            return ret;
+        }
+        [clock sleepForTimeInterval:1.0];
+        waited++;
+    }
+}
+- (BOOL)deleteMessageWithQueueURL:(NSURL *)theQueueURL receiptHandle:(NSString *)theReceiptHandle error:(NSError **)error {
+    [lock lock];
+    LocalSQSQueue *queue = [queuesByQueueURL objectForKey:theQueueURL];
+    if (queue == nil) {
+        [lock unlock];
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_NOT_FOUND, @"queue %@ not found", theQueueURL);
+        return NO;
+    }
+    NSUInteger index = [queue->messages indexOfObjectPassingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+        return [((LocalSQSQueueMessage *)obj)->receiptHandle isEqualToString:theReceiptHandle];
+    }];
+    if (index != NSNotFound) {
+        [queue->messages removeObjectAtIndex:index];
+    }
+    [lock unlock];
+    return YES;
+}
+- (void)deleteQueue:(NSURL *)theQueueURL {
+    [lock lock];
+    [queuesByQueueURL removeObjectForKey:theQueueURL];
+    [lock unlock];
+}
+
+- (NSString *)initiateRetrievalJobForArchiveId:(NSString *)theArchiveId tier:(int)theGlacierRetrievalTier snsTopicArn:(NSString *)theSNSTopicArn error:(NSError **)error {
+    NSString *archivePath = [archiveDirectory stringByAppendingPathComponent:theArchiveId];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:archivePath]) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_NOT_FOUND, @"archive %@ not found", theArchiveId);
+        return nil;
+    }
+    // Glacier reports the archive's tree hash in the job-completion notification.
+    NSData *archiveData = [NSData dataWithContentsOfFile:archivePath options:NSDataReadingMappedIfSafe error:error];
+    if (archiveData == nil) {
+        return nil;
+    }
+    double jitter = ((double)arc4random_uniform(1000) / 1000.0) * 2.0 - 1.0;
+    
+    LocalGlacierJob *job = [[LocalGlacierJob alloc] init];
+    job->jobId = [NSString stringWithRandomUUID];
+    job->archiveId = theArchiveId;
+    job->snsTopicArn = theSNSTopicArn;
+    job->treeHash = [NSString hexStringWithData:[SHA256TreeHash treeHashOfData:archiveData]];
+    job->tier = theGlacierRetrievalTier;
+    job->completionDate = [[clock now] dateByAddingTimeInterval:jobCompletionTimeInterval * (1.0 + jitter * JOB_COMPLETION_JITTER)];
+    
+    [lock lock];
+    [pendingJobs addObject:job];
+    [lock unlock];
+    
+    HSLogDebug(@"local glacier job %@ for archive %@ completes at %@", job->jobId, theArchiveId, job->completionDate);
+    return job->jobId;
+}
+- (NSData *)dataForJobId:(NSString *)theJobId error:(NSError **)error {
+    [lock lock];
+    [self publishCompletedJobs:[clock now]];
+    LocalGlacierJob *job = [completedJobsByJobId objectForKey:theJobId];
+    [lock unlock];
+    if (job == nil) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_GLACIER_OBJECT_NOT_AVAILABLE, @"job %@ not found or not complete", theJobId);
+        return nil;
+    }
+    NSString *archivePath = [archiveDirectory stringByAppendingPathComponent:job->archiveId];
+    NSData *ret = [NSData dataWithContentsOfFile:archivePath options:NSUncachedRead error:error];
+    if (ret != nil) {
+        [lock lock];
+        bytesDownloaded += [ret length];
+        [lock unlock];
+    }
+    return ret;
+}
+- (NSData *)dataForJobId:(NSString *)theJobId range:(NSRange)theRange treeHash:(NSString **)theTreeHash error:(NSError **)error {
+    [lock lock];
+    [self publishCompletedJobs:[clock now]];
+    LocalGlacierJob *job = [completedJobsByJobId objectForKey:theJobId];
+    [lock unlock];
+    if (job == nil) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_GLACIER_OBJECT_NOT_AVAILABLE, @"job %@ not found or not complete", theJobId);
+        return nil;
+    }
+    NSString *archivePath = [archiveDirectory stringByAppendingPathComponent:job->archiveId];
+    NSData *archiveData = [NSData dataWithContentsOfFile:archivePath options:NSDataReadingMappedIfSafe error:error];
+    if (archiveData == nil) {
+        return nil;
+    }
+    if (NSMaxRange(theRange) > [archiveData length]) {
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", -1, @"range %lu-%lu is past the end of archive %@ (%lu bytes)",
+                   (unsigned long)theRange.location, (unsigned long)(NSMaxRange(theRange) - 1), job->archiveId, (unsigned long)[archiveData length]);
+        return nil;
+    }
+    NSData *ret = [archiveData subdataWithRange:theRange];
+    if (theTreeHash != NULL) {
+        *theTreeHash = [NSString hexStringWithData:[SHA256TreeHash treeHashOfData:ret]];
+    }
+    [lock lock];
+    bytesDownloaded += [ret length];
+    [lock unlock];
+    return ret;
+}
+
+- (NSDictionary *)callCountsByAction {
+    [lock lock];
+    NSDictionary *ret = [NSDictionary dictionaryWithDictionary:callCountsByAction];
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)injectedFailureCount {
+    [lock lock];
+    unsigned long long ret = injectedFailureCount;
+    [lock unlock];
+    return ret;
+}
+- (unsigned long long)bytesDownloaded {
+    [lock lock];
+    unsigned long long ret = bytesDownloaded;
+    [lock unlock];
+    return ret;
+}
+
+#pragma mark internal
+- (NSArray *)receiveVisibleMessagesForQueueURL:(NSURL *)theQueueURL maxMessages:(NSUInteger)theMaxMessages error:(NSError **)error {
+    NSMutableArray *ret = [NSMutableArray array];
+    NSDate *now = [clock now];
+    [lock lock];
+    [self publishCompletedJobs:now];
+    LocalSQSQueue *queue = [queuesByQueueURL objectForKey:theQueueURL];
+    if (queue == nil) {
+        [lock unlock];
+        SETNSERROR(@"LocalGlacierEnvironmentErrorDomain", ERROR_NOT_FOUND, @"queue %@ not found", theQueueURL);
+        return nil;
+    }
+    NSUInteger maxMessages = MIN(theMaxMessages, MAX_MESSAGES_PER_RECEIVE);
+    for (LocalSQSQueueMessage *msg in queue->messages) {
+        if ([ret count] >= maxMessages) {
+            break;
+        }
+        if ([msg->visibleDate compare:now] == NSOrderedDescending) {
+            continue;
+        }
+        // Each receive gets a new receipt handle, like SQS, so a stale handle can't delete a redelivered message.
+        msg->receiptHandle = [NSString stringWithRandomUUID];
+        msg->visibleDate = [now dateByAddingTimeInterval:MESSAGE_VISIBILITY_TIMEOUT];
+        [ret addObject:[[SQSMessage alloc] initWithQueueURL:theQueueURL body:msg->body receiptHandle:msg->receiptHandle]];
+    }
+    [lock unlock];
+    return ret;
+}
+// Must be called with lock held.
+- (void)publishCompletedJobs:(NSDate *)theNow {
+    NSMutableArray *completed = [NSMutableArray array];
+    for (LocalGlacierJob *job in pendingJobs) {
+        if ([job->completionDate compare:theNow] != NSOrderedDescending) {
+            [completed addObject:job];
+        }
+    }
+    for (LocalGlacierJob *job in completed) {
+        [pendingJobs removeObject:job];
+        [completedJobsByJobId setObject:job forKey:job->jobId];
+        
+        NSDictionary *jobDescription = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        job->jobId, @"JobId",
+                                        job->archiveId, @"ArchiveId",
+                                        @"ArchiveRetrieval", @"Action",
+                                        [NSNumber numberWithBool:YES], @"Completed",
+                                        @"Succeeded", @"StatusCode",
+                                        job->treeHash, @"SHA256TreeHash",
+                                        job->snsTopicArn, @"SNSTopic",
+                                        nil];
+        NSString *message = [jobDescription JSONRepresentation:NULL];
+        NSDictionary *notification = [NSDictionary dictionaryWithObjectsAndKeys:
+                                      @"Notification", @"Type",
+                                      [NSString stringWithRandomUUID], @"MessageId",
+                                      job->snsTopicArn, @"TopicArn",
+                                      message, @"Message",
+                                      nil];
+        NSString *body = [notification JSONRepresentation:NULL];
+        
+        for (NSString *queueArn in [queueArnsByTopicArn objectForKey:job->snsTopicArn]) {
+            for (LocalSQSQueue *queue in [queuesByQueueURL allValues]) {
+                if ([queue->queueArn isEqualToString:queueArn]) {
+                    LocalSQSQueueMessage *msg = [[LocalSQSQueueMessage alloc] init];
+                    msg->body = body;
+                    msg->visibleDate = job->completionDate;
+                    [queue->messages addObject:msg];
+                }
+            }
+        }
+    }
+}
+@end
+
+#endif
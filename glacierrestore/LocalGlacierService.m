@@ -0,0 +1,70 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "LocalGlacierService.h"
+#import "LocalGlacierEnvironment.h"
+
+#define MAX_RETRIES (5)
+
+@implementation LocalGlacierService
+- (id)initWithEnvironment:(LocalGlacierEnvironment *)theEnvironment {
+    if (self = [super init]) {
+        environment = theEnvironment;
+    }
+    return self;
+}
+
+#pragma mark GlacierService
+- (NSString *)initiateRetrievalJobForVaultName:(NSString *)theVaultName archiveId:(NSString *)theArchiveId tier:(int)theGlacierRetrievalTier snsTopicArn:(NSString *)theSNSTopicArn error:(NSError **)error {
+    if (![environment performAction:@"Glacier.InitiateJob" errorDomain:[GlacierService errorDomain] retries:MAX_RETRIES error:error]) {
+        return nil;
+    }
+    return [environment initiateRetrievalJobForArchiveId:theArchiveId tier:theGlacierRetrievalTier snsTopicArn:theSNSTopicArn error:error];
+}
+- (NSData *)dataForVaultName:(NSString *)theVaultName jobId:(NSString *)theJobId retries:(NSUInteger)theRetries error:(NSError **)error {
+    if (![environment performAction:@"Glacier.GetJobOutput" errorDomain:[GlacierService errorDomain] retries:theRetries error:error]) {
+        return nil;
+    }
+    return [environment dataForJobId:theJobId error:error];
+}
+- (NSData *)dataForVaultName:(NSString *)theVaultName jobId:(NSString *)theJobId range:(NSRange)theRange treeHash:(NSString **)theTreeHash error:(NSError **)error {
+    // No retries here, so injected failures reach the caller's per-range retry logic.
+    if (![environment performAction:@"Glacier.GetJobOutputRange" errorDomain:[GlacierService errorDomain] retries:0 error:error]) {
+        return nil;
+    }
+    return [environment dataForJobId:theJobId range:theRange treeHash:theTreeHash error:error];
+}
+@end
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "LocalSNS.h"
+#import "LocalGlacierEnvironment.h"
+
+#define MAX_RETRIES (5)
+
+@implementation LocalSNS
+- (id)initWithEnvironment:(LocalGlacierEnvironment *)theEnvironment {
+    if (self = [super init]) {
+        environment = theEnvironment;
+    }
+    return self;
+}
+
+#pragma mark SNS
+- (NSString *)createTopic:(NSString *)theName error:(NSError **)error {
+    if (![environment performAction:@"SNS.CreateTopic" errorDomain:[SNS errorDomain] retries:MAX_RETRIES error:error]) {
+        return nil;
+    }
+    return [environment createTopicWithName:theName];
+}
+- (NSString *)subscribeQueueArn:(NSString *)theQueueArn toTopicArn:(NSString *)theTopicArn error:(NSError **)error {
+    if (![environment performAction:@"SNS.Subscribe" errorDomain:[SNS errorDomain] retries:MAX_RETRIES error:error]
+        || ![environment subscribeQueueArn:theQueueArn toTopicArn:theTopicArn error:error]) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"%@:%@", theTopicArn, [theQueueArn lastPathComponent]];
+}
+- (NSArray *)topicArns:(NSError **)error {
+    SETNSERROR([SNS errorDomain], -1, @"ListTopics is not supported by LocalSNS");
+    return nil;
+}
+- (BOOL)deleteTopicWithArn:(NSString *)theTopicArn error:(NSError **)error {
+    if (![environment performAction:@"SNS.DeleteTopic" errorDomain:[SNS errorDomain] retries:MAX_RETRIES error:error]) {
+        return NO;
+    }
+    [environment deleteTopicWithArn:theTopicArn];
+    return YES;
+}
+@end
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef ARQ_RESTORE_BENCHMARKS
+
+#import "LocalSQS.h"
+#import "LocalGlacierEnvironment.h"
+#import "ReceiveMessageResponse.h"
+
+#define MAX_RETRIES (5)
+
+@implementation LocalSQS
+- (id)initWithEnvironment:(LocalGlacierEnvironment *)theEnvironment {
+    if (self = [super init]) {
+        environment = theEnvironment;
+    }
+    return self;
+}
+
+#pragma mark SQS
+- (NSURL *)createQueueWithName:(NSString *)theName error:(NSError **)error {
+    if (![environment performAction:@"SQS.CreateQueue" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]) {
+        return nil;
+    }
+    return [environment createQueueWithName:theName];
+}
+- (NSString *)queueArnForQueueURL:(NSURL *)theURL error:(NSError **)error {
+    if (![environment performAction:@"SQS.GetQueueAttributes" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]) {
+        return nil;
+    }
+    return [environment queueArnForQueueURL:theURL error:error];
+}
+- (BOOL)setSendMessagePermissionToQueueURL:(NSURL *)theQueueURL queueArn:(NSString *)theQueueArn forSourceArn:(NSString *)theSourceArn error:(NSError **)error {
+    // The local environment doesn't check permissions.
+    return [environment performAction:@"SQS.SetQueueAttributes" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error];
+}
+- (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages error:(NSError **)error {
+    return [self receiveMessagesForQueueURL:theURL maxMessages:theMaxMessages waitTimeSeconds:0 error:error];
+}
+- (ReceiveMessageResponse *)receiveMessagesForQueueURL:(NSURL *)theURL maxMessages:(NSUInteger)theMaxMessages waitTimeSeconds:(NSUInteger)theWaitTimeSeconds error:(NSError **)error {
+    if (![environment performAction:@"SQS.ReceiveMessage" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]) {
+        return nil;
+    }
+    NSArray *messages = [environment receiveMessagesForQueueURL:theURL maxMessages:theMaxMessages waitTimeSeconds:MIN(theWaitTimeSeconds, 20) error:error];
+    if (messages == nil) {
+        return nil;
+    }
+    return [[ReceiveMessageResponse alloc] initWithQueueURL:theURL messages:messages];
+}
+- (BOOL)deleteMessageWithQueueURL:(NSURL *)theURL receiptHandle:(NSString *)theReceiptHandle error:(NSError **)error {
+    return [environment performAction:@"SQS.DeleteMessage" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]
+    && [environment deleteMessageWithQueueURL:theURL receiptHandle:theReceiptHandle error:error];
+}
+- (BOOL)deleteMessagesWithQueueURL:(NSURL *)theURL receiptHandles:(NSArray *)theReceiptHandles error:(NSError **)error {
+    for (NSUInteger start = 0; start < [theReceiptHandles count]; start += 10) {
+        if (![environment performAction:@"SQS.DeleteMessageBatch" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]) {
+            return NO;
+        }
+        NSUInteger end = MIN(start + 10, [theReceiptHandles count]);
+        for (NSUInteger i = start; i < end; i++) {
+            if (![environment deleteMessageWithQueueURL:theURL receiptHandle:[theReceiptHandles objectAtIndex:i] error:error]) {
+                return NO;
+            }
+        }
+    }
+    return YES;
+}
+- (NSArray *)queueURLs:(NSError **)error {
+    SETNSERROR([SQS errorDomain], -1, @"ListQueues is not supported by LocalSQS");
+    return nil;
+}
+- (BOOL)deleteQueue:(NSURL *)theQueueURL error:(NSError **)error {
+    if (![environment performAction:@"SQS.DeleteQueue" errorDomain:[SQS errorDomain] retries:MAX_RETRIES error:error]) {
+        return NO;
+    }
+    [environment deleteQueue:theQueueURL];
+    return YES;
+}
+@end
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "CommitIndex.h"
+#import "Commit.h"
+#import "BlobKey.h"
+#import "Repo.h"
+#import "Bucket.h"
+#import "Target.h"
+#import "UserLibrary_Arq.h"
+#import "NSFileManager_extra.h"
+#import "CacheOwnership.h"
+
+
+#define COMMIT_INDEX_VERSION (1)
+
+
+@interface CommitIndexEntry (internal)
+- (id)initWithPlist:(NSDictionary *)thePlist error:(NSError **)error;
+- (NSDictionary *)toPlist;
++ (NSDictionary *)plistFromBlobKey:(BlobKey *)theBlobKey;
++ (BlobKey *)blobKeyFromPlist:(NSDictionary *)thePlist error:(NSError **)error;
+@end
+
+
+@interface CommitIndex (internal)
+- (NSArray *)loadEntries;
+- (BOOL)saveEntries:(NSArray *)theEntries error:(NSError **)error;
+@end
+
+
+@implementation CommitIndexEntry
+- (id)initWithCommitBlobKey:(BlobKey *)theCommitBlobKey commit:(Commit *)theCommit {
+    if (self = [super init]) {
+        commitBlobKey = theCommitBlobKey;
+        creationDate = [theCommit creationDate];
+        treeBlobKey = [theCommit treeBlobKey];
+        failedFileCount = [[theCommit commitFailedFiles] count];
+        parentCommitBlobKey = [theCommit parentCommitBlobKey];
+    }
+    return self;
+}
+- (BlobKey *)commitBlobKey {
+    return commitBlobKey;
+}
+- (NSDate *)creationDate {
+    return creationDate;
+}
+- (BlobKey *)treeBlobKey {
+    return treeBlobKey;
+}
+- (NSUInteger)failedFileCount {
+    return failedFileCount;
+}
+- (BlobKey *)parentCommitBlobKey {
+    return parentCommitBlobKey;
+}
+
+#pragma mark internal
+- (id)initWithPlist:(NSDictionary *)thePlist error:(NSError **)error {
+    if (self = [super init]) {
+        commitBlobKey = [CommitIndexEntry blobKeyFromPlist:[thePlist objectForKey:@"commitBlobKey"] error:error];
+        if (commitBlobKey == nil) {
+            return nil;
+        }
+        treeBlobKey = [CommitIndexEntry blobKeyFromPlist:[thePlist objectForKey:@"treeBlobKey"] error:error];
+        if (treeBlobKey == nil) {
+            return nil;
+        }
+        NSDictionary *parentPlist = [thePlist objectForKey:@"parentCommitBlobKey"];
+        if (parentPlist != nil) {
+            parentCommitBlobKey = [CommitIndexEntry blobKeyFromPlist:parentPlist error:error];
+            if (parentCommitBlobKey == nil) {
+                return nil;
+            }
+        }
+        creationDate = [thePlist objectForKey:@"creationDate"];
+        failedFileCount = [[thePlist objectForKey:@"failedFileCount"] unsignedIntegerValue];
+    }
+    return self;
+}
+- (NSDictionary *)toPlist {
+    NSMutableDictionary *ret = [NSMutableDictionary dictionary];
+    [ret setObject:[CommitIndexEntry plistFromBlobKey:commitBlobKey] forKey:@"commitBlobKey"];
+    [ret setObject:[CommitIndexEntry plistFromBlobKey:treeBlobKey] forKey:@"treeBlobKey"];
+    if (parentCommitBlobKey != nil) {
+        [ret setObject:[CommitIndexEntry plistFromBlobKey:parentCommitBlobKey] forKey:@"parentCommitBlobKey"];
+    }
+    if (creationDate != nil) {
+        [ret setObject:creationDate forKey:@"creationDate"];
+    }
+    [ret setObject:[NSNumber numberWithUnsignedInteger:failedFileCount] forKey:@"failedFileCount"];
+    return ret;
+}
++ (NSDictionary *)plistFromBlobKey:(BlobKey *)theBlobKey {
+    // Every BlobKey field is kept, so a key read back from the index is indistinguishable from one read from the commit.
+    NSMutableDictionary *ret = [NSMutableDictionary dictionary];
+    [ret setObject:[theBlobKey sha1] forKey:@"sha1"];
+    [ret setObject:[NSNumber numberWithInt:(int)[theBlobKey storageType]] forKey:@"storageType"];
+    [ret setObject:[NSNumber numberWithBool:[theBlobKey stretchEncryptionKey]] forKey:@"stretchEncryptionKey"];
+    [ret setObject:[NSNumber numberWithInt:(int)[theBlobKey compressionType]] forKey:@"compressionType"];
+    [ret setObject:[NSNumber numberWithUnsignedLongLong:[theBlobKey archiveSize]] forKey:@"archiveSize"];
+    if ([theBlobKey archiveId] != nil) {
+        [ret setObject:[theBlobKey archiveId] forKey:@"archiveId"];
+    }
+    if ([theBlobKey archiveUploadedDate] != nil) {
+        [ret setObject:[theBlobKey archiveUploadedDate] forKey:@"archiveUploadedDate"];
+    }
+    return ret;
+}
++ (BlobKey *)blobKeyFromPlist:(NSDictionary *)thePlist error:(NSError **)error {
+    NSString *sha1 = [thePlist objectForKey:@"sha1"];
+    if (![sha1 isKindOfClass:[NSString class]]) {
+        SETNSERROR(@"CommitIndexErrorDomain", -1, @"invalid blob key in commit index");
+        return nil;
+    }
+    return [[BlobKey alloc] initWithStorageType:(StorageType)[[thePlist objectForKey:@"storageType"] intValue]
+                                      archiveId:[thePlist objectForKey:@"archiveId"]
+                                    archiveSize:[[thePlist objectForKey:@"archiveSize"] unsignedLongLongValue]
+                            archiveUploadedDate:[thePlist objectForKey:@"archiveUploadedDate"]
+                                           sha1:sha1
+                           stretchEncryptionKey:[[thePlist objectForKey:@"stretchEncryptionKey"] boolValue]
+                                compressionType:(BlobKeyCompressionType)[[thePlist objectForKey:@"compressionType"] intValue]
+                                          error:error];
+}
+@end
+
+
+@implementation CommitIndex
+- (id)initWithRepo:(Repo *)theRepo {
+    if (self = [super init]) {
+        repo = theRepo;
+        Bucket *bucket = [theRepo bucket];
+        indexPath = [NSString stringWithFormat:@"%@/%@/%@/commitindex/%@.plist", [UserLibrary arqCachePath], [[bucket target] targetUUID], [bucket computerUUID], [bucket bucketUUID]];
+    }
+    return self;
+}
+- (NSString *)errorDomain {
+    return @"CommitIndexErrorDomain";
+}
+- (NSArray *)entries:(NSError **)error {
+    NSError *myError = nil;
+    BlobKey *headBlobKey = [repo headBlobKey:&myError];
+    if (headBlobKey == nil) {
+        if (![myError isErrorWithDomain:[repo errorDomain] code:ERROR_NOT_FOUND]) {
+            SETERRORFROMMYERROR;
+            return nil;
+        }
+        return [NSArray array];
+    }
+
+    NSArray *cachedEntries = [self loadEntries];
+    NSMutableDictionary *cachedIndexesBySHA1 = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < [cachedEntries count]; i++) {
+        [cachedIndexesBySHA1 setObject:[NSNumber numberWithUnsignedInteger:i] forKey:[[[cachedEntries objectAtIndex:i] commitBlobKey] sha1]];
+    }
+
+    // Walk back from the head until we reach a commit the index already has; everything older is already cached.
+    NSMutableArray *ret = [NSMutableArray array];
+    NSUInteger fetchedCount = 0;
+    BlobKey *commitBlobKey = headBlobKey;
+    while (commitBlobKey != nil) {
+        NSNumber *cachedIndex = [cachedIndexesBySHA1 objectForKey:[commitBlobKey sha1]];
+        if (cachedIndex != nil) {
+            CommitIndexEntry *cachedEntry = [cachedEntries objectAtIndex:[cachedIndex unsignedIntegerValue]];
+            if ([[cachedEntry commitBlobKey] isEqualToBlobKey:commitBlobKey]) {
+                [ret addObjectsFromArray:[cachedEntries subarrayWithRange:NSMakeRange([cachedIndex unsignedIntegerValue], [cachedEntries count] - [cachedIndex unsignedIntegerValue])]];
+                break;
+            }
+        }
+        Commit *commit = [repo commitForBlobKey:commitBlobKey error:error];
+        if (commit == nil) {
+            return nil;
+        }
+        fetchedCount++;
+        [ret addObject:[[CommitIndexEntry alloc] initWithCommitBlobKey:commitBlobKey commit:commit]];
+        commitBlobKey = [commit parentCommitBlobKey];
+    }
+    HSLogDebug(@"commit index for bucket %@: %lu commits, %lu fetched", [[repo bucket] bucketUUID], (unsigned long)[ret count], (unsigned long)fetchedCount);
+
+    if (fetchedCount > 0 || [ret count] != [cachedEntries count]) {
+        if (![self saveEntries:ret error:&myError]) {
+            HSLogError(@"failed to save commit index %@: %@", indexPath, myError);
+        }
+    }
+    return ret;
+}
+
+#pragma mark internal
+- (NSArray *)loadEntries {
+    NSDictionary *plist = [NSDictionary dictionaryWithContentsOfFile:indexPath];
+    if (plist == nil) {
+        return [NSArray array];
+    }
+    if ([[plist objectForKey:@"version"] intValue] != COMMIT_INDEX_VERSION) {
+        HSLogDebug(@"ignoring commit index %@ with version %@", indexPath, [plist objectForKey:@"version"]);
+        return [NSArray array];
+    }
+    NSMutableArray *ret = [NSMutableArray array];
+    for (NSDictionary *entryPlist in [plist objectForKey:@"entries"]) {
+        NSError *myError = nil;
+        CommitIndexEntry *entry = [[CommitIndexEntry alloc] initWithPlist:entryPlist error:&myError];
+        if (entry == nil) {
+            HSLogWarn(@"ignoring invalid commit index %@: %@", indexPath, myError);
+            return [NSArray array];
+        }
+        [ret addObject:entry];
+    }
+    return ret;
+}
+- (BOOL)saveEntries:(NSArray *)theEntries error:(NSError **)error {
+    if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:indexPath targetUID:[[CacheOwnership sharedCacheOwnership] uid] targetGID:[[CacheOwnership sharedCacheOwnership] gid] error:error]) {
+        return NO;
+    }
+    NSMutableArray *entryPlists = [NSMutableArray arrayWithCapacity:[theEntries count]];
+    for (CommitIndexEntry *entry in theEntries) {
+        [entryPlists addObject:[entry toPlist]];
+    }
+    NSDictionary *plist = [NSDictionary dictionaryWithObjectsAndKeys:
+                           [NSNumber numberWithInt:COMMIT_INDEX_VERSION], @"version",
+                           entryPlists, @"entries", nil];
+    if (![plist writeToFile:indexPath atomically:YES]) {
+        SETNSERROR([self errorDomain], -1, @"failed to write %@", indexPath);
+        return NO;
+    }
+    return YES;
+}
+@end
@@ -45,6 +45,7 @@
 #import "NSData-Random.h"
 #import "CacheOwnership.h"
 #import "Streams.h"
+#import "DerivedKeyCache.h"
 
 #define SALT_LENGTH (8)
 #define IV_LENGTH (16)
@@ -294,25 +295,32 @@
     }
     
     // Derive 64-byte encryption key from theEncryptionPassword.
-    NSData *thePasswordData = [encryptionPassword dataUsingEncoding:NSUTF8StringEncoding];
     void *derivedEncryptionKey = malloc(kCCKeySizeAES256 * 2);
     const unsigned char *salt = bytes + strlen(HEADER);
-    CCKeyDerivationPBKDF(kCCPBKDF2, [thePasswordData bytes], [thePasswordData length], salt, SALT_LENGTH, kCCPRFHmacAlgSHA1, KEY_DERIVATION_ROUNDS, derivedEncryptionKey, kCCKeySizeAES256 * 2);
-    void *derivedHMACKey = derivedEncryptionKey + kCCKeySizeAES256;
-    
-    // Calculate HMACSHA256 of IV + encrypted master keys, using derivedHMACKey.
-    unsigned char hmacSHA256[CC_SHA256_DIGEST_LENGTH];
-    CCHmacContext hmacContext;
-    CCHmacInit(&hmacContext, kCCHmacAlgSHA256, derivedHMACKey, kCCKeySizeAES256);
-    const unsigned char *iv = bytes + strlen(HEADER) + SALT_LENGTH + CC_SHA256_DIGEST_LENGTH;
-    CCHmacUpdate(&hmacContext, bytes + strlen(HEADER) + SALT_LENGTH + CC_SHA256_DIGEST_LENGTH, [data length] - strlen(HEADER) - SALT_LENGTH - CC_SHA256_DIGEST_LENGTH);
-    CCHmacFinal(&hmacContext, hmacSHA256);
-    
-    if (memcmp(hmacSHA256, bytes + strlen(HEADER) + SALT_LENGTH, CC_SHA256_DIGEST_LENGTH)) {
-        free(derivedEncryptionKey);
-        SETNSERROR([self errorDomain], -1, @"HMACSHA256 does not match");
-        return NO;
+    NSData *saltData = [NSData dataWithBytes:salt length:SALT_LENGTH];
+    NSData *cachedDerivedKey = [[DerivedKeyCache sharedDerivedKeyCache] derivedKeyForAlgorithm:@"PBKDF2-SHA1" salt:saltData rounds:KEY_DERIVATION_ROUNDS length:(kCCKeySizeAES256 * 2)];
+    if (cachedDerivedKey != nil) {
+        memcpy(derivedEncryptionKey, [cachedDerivedKey bytes], kCCKeySizeAES256 * 2);
+        if (![self hmacMatchesForDerivedEncryptionKey:derivedEncryptionKey]) {
+            // The cache doesn't know which password its key came from; this one doesn't fit the file.
+            [[DerivedKeyCache sharedDerivedKeyCache] removeDerivedKeyForAlgorithm:@"PBKDF2-SHA1" salt:saltData rounds:KEY_DERIVATION_ROUNDS length:(kCCKeySizeAES256 * 2)];
+            cachedDerivedKey = nil;
+        }
+    }
+    if (cachedDerivedKey == nil) {
+        NSData *thePasswordData = [encryptionPassword dataUsingEncoding:NSUTF8StringEncoding];
+        CCKeyDerivationPBKDF(kCCPBKDF2, [thePasswordData bytes], [thePasswordData length], salt, SALT_LENGTH, kCCPRFHmacAlgSHA1, KEY_DERIVATION_ROUNDS, derivedEncryptionKey, kCCKeySizeAES256 * 2);
+        if (![self hmacMatchesForDerivedEncryptionKey:derivedEncryptionKey]) {
+            free(derivedEncryptionKey);
+            SETNSERROR([self errorDomain], -1, @"HMACSHA256 does not match");
+            return NO;
+        }
+        [[DerivedKeyCache sharedDerivedKeyCache] setDerivedKey:[NSData dataWithBytes:derivedEncryptionKey length:(kCCKeySizeAES256 * 2)]
+                                                  forAlgorithm:@"PBKDF2-SHA1"
+                                                          salt:saltData
+                                                        rounds:KEY_DERIVATION_ROUNDS];
     }
+    const unsigned char *iv = bytes + strlen(HEADER) + SALT_LENGTH + CC_SHA256_DIGEST_LENGTH;
     
     // Decrypt master keys.
     NSUInteger expectedKeysLen = (encryptionVersion == 3) ? (kCCKeySizeAES256 * 3) : (kCCKeySizeAES256 * 2);
@@ -352,6 +360,19 @@
     return YES;
 }
 
+- (BOOL)hmacMatchesForDerivedEncryptionKey:(const void *)theDerivedEncryptionKey {
+    const unsigned char *bytes = (const unsigned char *)[data bytes];
+    const unsigned char *derivedHMACKey = (const unsigned char *)theDerivedEncryptionKey + kCCKeySizeAES256;
+    
+    // Calculate HMACSHA256 of IV + encrypted master keys, using derivedHMACKey.
+    unsigned char hmacSHA256[CC_SHA256_DIGEST_LENGTH];
+    CCHmacContext hmacContext;
+    CCHmacInit(&hmacContext, kCCHmacAlgSHA256, derivedHMACKey, kCCKeySizeAES256);
+    CCHmacUpdate(&hmacContext, bytes + strlen(HEADER) + SALT_LENGTH + CC_SHA256_DIGEST_LENGTH, [data length] - strlen(HEADER) - SALT_LENGTH - CC_SHA256_DIGEST_LENGTH);
+    CCHmacFinal(&hmacContext, hmacSHA256);
+    
+    return memcmp(hmacSHA256, bytes + strlen(HEADER) + SALT_LENGTH, CC_SHA256_DIGEST_LENGTH) == 0;
+}
 - (NSString *)cachePath {
     return [NSString stringWithFormat:@"%@/%@/%@/encryptionv%d.dat", [UserLibrary arqCachePath], [target targetUUID], computerUUID, encryptionVersion];
 }
@@ -64,4 +64,10 @@ OSStatus SymlinkPathMakeRef(const UInt8 *path, FSRef *ref, Boolean *isDirectory)
 + (BOOL)applyMode:(int)mode toPath:(NSString *)thePath isDirectory:(BOOL)isDirectory error:(NSError **)error;
 + (BOOL)applyMTimeSec:(int64_t)mtime_sec mTimeNSec:(int64_t)mtime_nsec toPath:(NSString *)thePath error:(NSError **)error;
 + (BOOL)applyCreateTimeSec:(int64_t)theCreateTime_sec createTimeNSec:(int64_t)theCreateTime_nsec to:(FSRef *)fsRef error:(NSError **)error;
+
+// Descriptor-based variants, for files that are already open; thePath is only used in log and error messages.
++ (BOOL)applyUID:(int)uid gid:(int)gid toFD:(int)fd path:(NSString *)thePath error:(NSError **)error;
++ (BOOL)applyMode:(int)mode toFD:(int)fd path:(NSString *)thePath error:(NSError **)error;
++ (BOOL)applyFlags:(unsigned long)flags toFD:(int)fd path:(NSString *)thePath error:(NSError **)error;
++ (BOOL)applyMTimeSec:(int64_t)mtime_sec mTimeNSec:(int64_t)mtime_nsec toFD:(int)fd path:(NSString *)thePath error:(NSError **)error;
 @end
@@ -365,6 +365,48 @@ OSStatus SymlinkPathMakeRef(const UInt8 *path, FSRef *ref, Boolean *isDirectory)
     }
     return YES;
 }
++ (BOOL)applyUID:(int)uid gid:(int)gid toFD:(int)fd path:(NSString *)thePath error:(NSError **)error {
+    if (fchown(fd, uid, gid) == -1) {
+        int errnum = errno;
+        HSLogError(@"fchown(%@) error %d: %s", thePath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"error changing ownership of %@: %s", thePath, strerror(errnum));
+        return NO;
+    }
+    HSLogDebug(@"fchown(%@, %d, %d); euid=%d", thePath, uid, gid, geteuid());
+    return YES;
+}
++ (BOOL)applyMode:(int)mode toFD:(int)fd path:(NSString *)thePath error:(NSError **)error {
+    if (fchmod(fd, mode) == -1) {
+        int errnum = errno;
+        HSLogError(@"fchmod(%@) error %d: %s", thePath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to set permissions on %@: %s", thePath, strerror(errnum));
+        return NO;
+    }
+    HSLogDebug(@"fchmod(%@, 0%6o)", thePath, mode);
+    return YES;
+}
++ (BOOL)applyFlags:(unsigned long)flags toFD:(int)fd path:(NSString *)thePath error:(NSError **)error {
+    if (fchflags(fd, (unsigned int)flags) == -1) {
+        int errnum = errno;
+        HSLogError(@"fchflags(%@, %ld) error %d: %s", thePath, flags, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"error changing flags of %@: %s", thePath, strerror(errnum));
+        return NO;
+    }
+    return YES;
+}
++ (BOOL)applyMTimeSec:(int64_t)mtime_sec mTimeNSec:(int64_t)mtime_nsec toFD:(int)fd path:(NSString *)thePath error:(NSError **)error {
+    struct timespec times[2];
+    times[0].tv_sec = (__darwin_time_t)mtime_sec; // Just use mtime because we don't have atime, nor do we care about atime.
+    times[0].tv_nsec = (long)mtime_nsec;
+    times[1] = times[0];
+    if (futimens(fd, times) == -1) {
+        int errnum = errno;
+        HSLogError(@"futimens(%@) error %d: %s", thePath, errnum, strerror(errnum));
+        SETNSERROR(@"UnixErrorDomain", errnum, @"failed to set timestamps on %@: %s", thePath, strerror(errnum));
+        return NO;
+    }
+    return YES;
+}
 + (BOOL)applyCreateTimeSec:(int64_t)theCreateTime_sec createTimeNSec:(int64_t)theCreateTime_nsec to:(FSRef *)fsRef error:(NSError **)error {
     FSCatalogInfo catalogInfo;
     OSErr oserr = FSGetCatalogInfo(fsRef, kFSCatInfoCreateDate, &catalogInfo, NULL, NULL, NULL);
@@ -35,17 +35,27 @@
 @class Fark;
 
 @protocol PIELoaderDelegate <NSObject>
-- (BOOL)pieLoaderDidLoadPackIndexEntries:(NSArray *)thePIEs forPackId:(PackId *)thePackId index:(NSUInteger)theIndex total:(NSUInteger)theTotal error:(NSError **)error;
+// Called on the PIELoader's writer thread only, with the entries of one or more packs.
+// thePIEArrays holds an NSArray of PackIndexEntry for each PackId in thePackIds.
+- (BOOL)pieLoaderDidLoadPackIndexEntries:(NSArray *)thePIEArrays forPackIds:(NSArray *)thePackIds loadedCount:(NSUInteger)theLoadedCount total:(NSUInteger)theTotal error:(NSError **)error;
 
 @end
 
+// Downloads and parses pack indexes on several worker threads (the PIELoaderThreadCount default, 5 if unset)
+// and hands the parsed entries to one writer thread, which passes them to the delegate in batches.
 @interface PIELoader : NSObject {
     dispatch_semaphore_t workerThreadSemaphore;
+    dispatch_semaphore_t writerThreadSemaphore;
+    NSUInteger workerCount;
+    NSUInteger finishedWorkerCount;
     NSArray *packIds;
     NSUInteger packIdIndex;
     id <PIELoaderDelegate> delegate;
     Fark *fark;
-    NSLock *lock;
+    NSCondition *condition;
+    NSMutableArray *pendingPackIds;
+    NSMutableArray *pendingPIEArrays;
+    NSUInteger pendingEntryCount;
     NSUInteger loadedCount;
     BOOL loadErrorOccurred;
     NSError *loadError;
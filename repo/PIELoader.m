@@ -32,37 +32,44 @@
 
 #import "PIELoader.h"
 #import "PIELoaderWorker.h"
+#import "RestoreMetrics.h"
+
+#define DEFAULT_WORKER_THREADS (5)
+
+// Workers block once this many parsed entries are waiting for the writer.
+#define MAX_PENDING_ENTRIES (250000)
 
-#define NUM_WORKER_THREADS (5)
 
 @implementation PIELoader
 - (id)initWithDelegate:(id <PIELoaderDelegate>)theDelegate packIds:(NSArray *)thePackIds fark:(Fark *)theFark storageType:(StorageType)theStorageType {
     if (self = [super init]) {
         workerThreadSemaphore = dispatch_semaphore_create(0);
+        writerThreadSemaphore = dispatch_semaphore_create(0);
         packIds = thePackIds;
         fark = theFark;
         delegate = theDelegate;
-        lock = [[NSLock alloc] init];
-        [lock setName:@"PIELoader"];
+        condition = [[NSCondition alloc] init];
+        [condition setName:@"PIELoader"];
+        pendingPackIds = [[NSMutableArray alloc] init];
+        pendingPIEArrays = [[NSMutableArray alloc] init];
         
-        HSLogDetail(@"saving entries from %ld packs to database", [thePackIds count]);
+        NSInteger threadCount = [[NSUserDefaults standardUserDefaults] integerForKey:@"PIELoaderThreadCount"];
+        workerCount = threadCount > 0 ? (NSUInteger)threadCount : DEFAULT_WORKER_THREADS;
         
+        HSLogDetail(@"saving entries from %ld packs to database using %ld loader threads", [thePackIds count], (unsigned long)workerCount);
         
-        for (NSUInteger i = 0; i < NUM_WORKER_THREADS; i++) {
+        [NSThread detachNewThreadSelector:@selector(runWriter) toTarget:self withObject:nil];
+        for (NSUInteger i = 0; i < workerCount; i++) {
             (void)[[PIELoaderWorker alloc] initWithPIELoader:self fark:fark storageType:theStorageType];
         }
     }
     return self;
-}
-- (void)dealloc {
-    
-    
-    
 }
 - (BOOL)waitForCompletion:(NSError **)error {
-    for (NSUInteger i = 0; i < NUM_WORKER_THREADS; i++) {
+    for (NSUInteger i = 0; i < workerCount; i++) {
         dispatch_semaphore_wait(workerThreadSemaphore, DISPATCH_TIME_FOREVER);
     }
+    dispatch_semaphore_wait(writerThreadSemaphore, DISPATCH_TIME_FOREVER);
     if (loadErrorOccurred) {
         if (error != NULL) {
             *error = loadError;
@@ -73,35 +80,78 @@
 }
 - (PackId *)nextPackId {
     PackId *ret = nil;
-    [lock lock];
+    [condition lock];
     if (!loadErrorOccurred) {
         if (packIdIndex < [packIds count]) {
             ret = [packIds objectAtIndex:packIdIndex];
             packIdIndex++;
         }
     }
-    [lock unlock];
+    [condition unlock];
     return ret;
 }
 - (void)packIndexEntries:(NSArray *)thePIES wereLoadedForPackId:(PackId *)thePackId {
-    [lock lock];
-    loadedCount++;
-    NSError *theLoadError = nil;
-    if (![delegate pieLoaderDidLoadPackIndexEntries:thePIES forPackId:thePackId index:loadedCount total:[packIds count] error:&theLoadError]) {
-        loadError = theLoadError;
-        loadErrorOccurred = YES;
-        
+    [condition lock];
+    while (pendingEntryCount >= MAX_PENDING_ENTRIES && !loadErrorOccurred) {
+        [condition wait];
+    }
+    if (!loadErrorOccurred) {
+        [pendingPackIds addObject:thePackId];
+        [pendingPIEArrays addObject:thePIES];
+        pendingEntryCount += [thePIES count];
+        [condition broadcast];
     }
-    [lock unlock];
+    NSUInteger pendingCount = pendingEntryCount;
+    [condition unlock];
+    [[RestoreMetrics sharedRestoreMetrics] setDepth:pendingCount ofQueueNamed:@"pack_index_entries"];
 }
 - (void)errorDidOccur:(NSError *)theError {
-    [lock lock];
+    [condition lock];
     loadErrorOccurred = YES;
     loadError = theError;
     HSLogError(@"PIELoader: load error occurred: %@", loadError);
-    [lock unlock];
+    [condition broadcast];
+    [condition unlock];
 }
 - (void)workerDidFinish {
+    [condition lock];
+    finishedWorkerCount++;
+    [condition broadcast];
+    [condition unlock];
     dispatch_semaphore_signal(workerThreadSemaphore);
 }
+
+#pragma mark internal
+- (void)runWriter {
+    for (;;) {
+        @autoreleasepool {
+            // Take everything the workers have queued since the last batch, so that the batch grows while the database is busy.
+            [condition lock];
+            while ([pendingPackIds count] == 0 && finishedWorkerCount < workerCount && !loadErrorOccurred) {
+                [condition wait];
+            }
+            if (loadErrorOccurred || [pendingPackIds count] == 0) {
+                [condition unlock];
+                break;
+            }
+            NSArray *batchPackIds = [NSArray arrayWithArray:pendingPackIds];
+            NSArray *batchPIEArrays = [NSArray arrayWithArray:pendingPIEArrays];
+            [pendingPackIds removeAllObjects];
+            [pendingPIEArrays removeAllObjects];
+            pendingEntryCount = 0;
+            [condition broadcast];
+            [condition unlock];
+            [[RestoreMetrics sharedRestoreMetrics] setDepth:0 ofQueueNamed:@"pack_index_entries"];
+            
+            // Write without holding the lock, so workers keep downloading and parsing meanwhile.
+            loadedCount += [batchPackIds count];
+            NSError *myError = nil;
+            if (![delegate pieLoaderDidLoadPackIndexEntries:batchPIEArrays forPackIds:batchPackIds loadedCount:loadedCount total:[packIds count] error:&myError]) {
+                [self errorDidOccur:myError];
+                break;
+            }
+        }
+    }
+    dispatch_semaphore_signal(writerThreadSemaphore);
+}
 @end
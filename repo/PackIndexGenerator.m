@@ -30,13 +30,26 @@
  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#import <CommonCrypto/CommonDigest.h>
+#include <libkern/OSByteOrder.h>
 #import "PackIndexGenerator.h"
-#import "DataInputStream.h"
-#import "BufferedInputStream.h"
-#import "IntegerIO.h"
-#import "StringIO.h"
-#import "SHA1Hash.h"
-#import "NSString_extra.h"
+
+
+#define PACK_INDEX_MAGIC_NUMBER (0xff744f63)
+#define PACK_INDEX_VERSION (2)
+#define PACK_HEADER_LENGTH (16)
+
+// One object found in the pack. Sorting these by sha1 gives the index order.
+typedef struct pack_object {
+    unsigned char sha1[CC_SHA1_DIGEST_LENGTH];
+    uint64_t offset;
+    uint64_t length;
+} pack_object;
+
+static int compare_pack_objects(const void *a, const void *b) {
+    return memcmp(((const pack_object *)a)->sha1, ((const pack_object *)b)->sha1, CC_SHA1_DIGEST_LENGTH);
+}
+
 
 @implementation PackIndexGenerator
 - (id)initWithPackId:(PackId *)thePackId packData:(NSData *)thePackData {
@@ -58,115 +71,127 @@
     }
     return ret;
 }
+
+#pragma mark internal
 - (NSData *)doIndexData:(NSError **)error {
-    DataInputStream *dis = [[DataInputStream alloc] initWithData:packData description:@"pack"];
-    BufferedInputStream *bis = [[BufferedInputStream alloc] initWithUnderlyingStream:dis];
-    NSMutableData *indexData = [NSMutableData data];
-    [IntegerIO writeUInt32:0xff744f63 to:indexData]; // Magic number
-    [IntegerIO writeUInt32:0x00000002 to:indexData]; // Version 2
-    
-    uint32_t packLabel = 0;
-    if (![IntegerIO readUInt32:&packLabel from:bis error:error]) {
+    // Walk the pack in place: each object is hashed straight out of packData, and only its sha1, offset and length are kept.
+    const unsigned char *bytes = (const unsigned char *)[packData bytes];
+    uint64_t packLength = (uint64_t)[packData length];
+    if (packLength < PACK_HEADER_LENGTH) {
+        SETNSERROR([self errorDomain], -1, @"pack is too short (%llu bytes)", packLength);
         return nil;
     }
-    if (packLabel != 0x5041434b) {
+    if (OSReadBigInt32(bytes, 0) != 0x5041434b) {
         SETNSERROR([self errorDomain], -1, @"PACK header doesn't say 'PACK'");
         return nil;
     }
-    uint32_t packVersion = 0;
-    if (![IntegerIO readUInt32:&packVersion from:bis error:error]) {
-        return nil;
-    }
+    uint32_t packVersion = OSReadBigInt32(bytes, 4);
     if (packVersion != 2) {
         SETNSERROR([self errorDomain], -1, @"unknown pack version %ld", (unsigned long)packVersion);
         return nil;
     }
-    uint64_t objectCount = 0;
-    if (![IntegerIO readUInt64:&objectCount from:bis error:error]) {
+    uint64_t objectCount = OSReadBigInt64(bytes, 8);
+    // Every object takes at least 10 bytes (2 nil strings and a length), which bounds objectCount.
+    if (objectCount > (packLength - PACK_HEADER_LENGTH) / 10) {
+        SETNSERROR([self errorDomain], -1, @"invalid object count %llu for a pack of %llu bytes", objectCount, packLength);
         return nil;
     }
     
-    NSMutableDictionary *lengthsBySHA1 = [NSMutableDictionary dictionary];
+    NSMutableData *objectsData = [NSMutableData dataWithLength:(NSUInteger)(objectCount * sizeof(pack_object))];
+    pack_object *objects = (pack_object *)[objectsData mutableBytes];
+    uint64_t pos = PACK_HEADER_LENGTH;
     for (uint64_t index = 0; index < objectCount; index++) {
-        NSString *mimeType;
-        NSString *downloadName;
-        if (![StringIO read:&mimeType from:bis error:error] || ![StringIO read:&downloadName from:bis error:error]) {
+        objects[index].offset = pos;
+        
+        // Skip the mimeType and downloadName strings.
+        for (int i = 0; i < 2; i++) {
+            if (![self skipStringAt:&pos bytes:bytes length:packLength error:error]) {
+                return nil;
+            }
+        }
+        if (packLength - pos < 8) {
+            SETNSERROR([self errorDomain], -1, @"pack truncated at object %llu", index);
             return nil;
         }
-        uint64_t dataLen = 0;
-        if (![IntegerIO readUInt64:&dataLen from:bis error:error]) {
+        uint64_t dataLen = OSReadBigInt64(bytes, (uintptr_t)pos);
+        pos += 8;
+        if (dataLen > packLength - pos) {
+            SETNSERROR([self errorDomain], -1, @"object %llu length %llu runs past the end of the pack", index, dataLen);
             return nil;
         }
-        NSData *data = nil;
-        if (dataLen > 0) {
-            unsigned char *buf = (unsigned char *)malloc((size_t)dataLen);
-            if (![bis readExactly:(NSUInteger)dataLen into:buf error:error]) {
-                free(buf);
-                return nil;
-            }
-            data = [NSData dataWithBytesNoCopy:buf length:(NSUInteger)dataLen];
-        } else {
-            data = [NSData data];
+        CC_SHA1_CTX ctx;
+        CC_SHA1_Init(&ctx);
+        for (uint64_t hashed = 0; hashed < dataLen;) {
+            CC_LONG chunk = (CC_LONG)MIN(dataLen - hashed, (uint64_t)0x40000000);
+            CC_SHA1_Update(&ctx, bytes + pos + hashed, chunk);
+            hashed += chunk;
+        }
+        CC_SHA1_Final(objects[index].sha1, &ctx);
+        objects[index].length = dataLen;
+        pos += dataLen;
+    }
+    
+    qsort(objects, (size_t)objectCount, sizeof(pack_object), compare_pack_objects);
+    
+    // Drop duplicate objects; any copy will do since they're identical.
+    uint64_t uniqueCount = 0;
+    for (uint64_t index = 0; index < objectCount; index++) {
+        if (uniqueCount > 0 && memcmp(objects[uniqueCount - 1].sha1, objects[index].sha1, CC_SHA1_DIGEST_LENGTH) == 0) {
+            continue;
         }
-        NSString *sha1 = [SHA1Hash hashData:data];
-        [lengthsBySHA1 setObject:[NSNumber numberWithUnsignedLongLong:dataLen] forKey:sha1];
+        objects[uniqueCount++] = objects[index];
     }
-    NSMutableArray *sortedKeys = [NSMutableArray arrayWithArray:[lengthsBySHA1 allKeys]];
-    [sortedKeys sortUsingSelector:@selector(compare:)];
     
-    // Set fanout table values.
+    // Magic number, version, 256 fanout entries, then 40 bytes per object: offset, length, sha1 and 4 bytes of alignment.
+    NSUInteger indexLength = 8 + 256 * 4 + (NSUInteger)uniqueCount * 40;
+    NSMutableData *indexData = [NSMutableData dataWithLength:indexLength];
+    unsigned char *out = (unsigned char *)[indexData mutableBytes];
+    OSWriteBigInt32(out, 0, PACK_INDEX_MAGIC_NUMBER);
+    OSWriteBigInt32(out, 4, PACK_INDEX_VERSION);
+    
     uint32_t fanoutTable[256];
     memset(fanoutTable, 0, sizeof(fanoutTable));
-    for (NSUInteger index = 0; index < [sortedKeys count]; index++) {
-        NSString *sha1 = [sortedKeys objectAtIndex:index];
-        NSData *sha1HexData = [sha1 hexStringToData:error];
-        if (sha1HexData == nil) {
-            return nil;
-        }
-        if ([sha1HexData length] != 20) {
-            SETNSERROR([self errorDomain], -1, @"invalid SHA1 '%@' (must be 20 bytes)", sha1);
-            return nil;
-        }
-        unsigned char firstSHA1Byte = ((unsigned char *)[sha1HexData bytes])[0];
-        // Increment fanoutTable entry.
-        fanoutTable[firstSHA1Byte] += 1;
+    for (uint64_t index = 0; index < uniqueCount; index++) {
+        fanoutTable[objects[index].sha1[0]] += 1;
     }
-    // Accumulate fanout numbers.
     uint32_t fanoutTotal = 0;
     for (uint32_t index = 0; index < 256; index++) {
         fanoutTotal += fanoutTable[index];
-        fanoutTable[index] = fanoutTotal;
+        OSWriteBigInt32(out, 8 + index * 4, fanoutTotal);
     }
-    // Write fanout table to index.
-    for (uint32_t index = 0; index < 256; index++) {
-        [IntegerIO writeUInt32:fanoutTable[index] to:indexData];
+    unsigned char *entry = out + 8 + 256 * 4;
+    for (uint64_t index = 0; index < uniqueCount; index++) {
+        OSWriteBigInt64(entry, 0, objects[index].offset);
+        OSWriteBigInt64(entry, 8, objects[index].length);
+        memcpy(entry + 16, objects[index].sha1, CC_SHA1_DIGEST_LENGTH);
+        // The last 4 bytes stay zero.
+        entry += 40;
     }
-    uint64_t offset = (uint64_t)16;
-    for (NSUInteger index = 0; index < [sortedKeys count]; index++) {
-        NSString *sha1 = [sortedKeys objectAtIndex:index];
-        uint64_t length = [[lengthsBySHA1 objectForKey:sha1] unsignedLongLongValue];
-        
-        // Write offset to index.
-        [IntegerIO writeUInt64:offset to:indexData];
-        
-        // Write data length to index.
-        [IntegerIO writeUInt64:length to:indexData];
-        
-        // Write 20-byte sha1 to index.
-        NSData *sha1Data = [sha1 hexStringToData:error];
-        if (sha1Data == nil) {
-            return nil;
+    return indexData;
+}
+- (BOOL)skipStringAt:(uint64_t *)thePos bytes:(const unsigned char *)theBytes length:(uint64_t)theLength error:(NSError **)error {
+    // A string is a 1-byte not-nil flag, then (if not nil) an 8-byte length and the UTF-8 bytes.
+    uint64_t pos = *thePos;
+    if (pos >= theLength) {
+        SETNSERROR([self errorDomain], -1, @"pack truncated at offset %llu", pos);
+        return NO;
+    }
+    BOOL isNotNil = theBytes[pos] != 0;
+    pos += 1;
+    if (isNotNil) {
+        if (theLength - pos < 8) {
+            SETNSERROR([self errorDomain], -1, @"pack truncated at offset %llu", pos);
+            return NO;
         }
-        [indexData appendBytes:[sha1Data bytes] length:[sha1Data length]];
-        
-        // Write 4 bytes (for alignment) to index.
-        [IntegerIO writeUInt32:0 to:indexData];
-        
-        offset += 1; // 1 byte for the nil mimeType stored in the pack
-        offset += 1; // 1 byte for the nil downloadName stored in the pack
-        offset += 8; // 8 bytes for the data length stored in the pack
-        offset += length;
+        uint64_t len = OSReadBigInt64(theBytes, (uintptr_t)pos);
+        pos += 8;
+        if (len > theLength - pos) {
+            SETNSERROR([self errorDomain], -1, @"string length %llu at offset %llu runs past the end of the pack", len, pos);
+            return NO;
+        }
+        pos += len;
     }
-    return indexData;
+    *thePos = pos;
+    return YES;
 }
 @end
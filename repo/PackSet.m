@@ -490,8 +490,8 @@ cachePackFilesToDisk:(BOOL)theCachePackFilesToDisk
 }
 
 #pragma mark PIELoaderDelegate
-- (BOOL)pieLoaderDidLoadPackIndexEntries:(NSArray *)thePIEs forPackId:(PackId *)thePackId index:(NSUInteger)theIndex total:(NSUInteger)theTotal error:(NSError **)error {
-    [activityListener packSetActivity:[NSString stringWithFormat:@"Caching pack index %ld of %ld", theIndex, theTotal]];
-    return [packSetDB insertPackId:thePackId packIndexEntries:thePIEs error:error];
+- (BOOL)pieLoaderDidLoadPackIndexEntries:(NSArray *)thePIEArrays forPackIds:(NSArray *)thePackIds loadedCount:(NSUInteger)theLoadedCount total:(NSUInteger)theTotal error:(NSError **)error {
+    [activityListener packSetActivity:[NSString stringWithFormat:@"Caching pack index %ld of %ld", theLoadedCount, theTotal]];
+    return [packSetDB insertPackIds:thePackIds packIndexEntries:thePIEArrays error:error];
 }
 @end
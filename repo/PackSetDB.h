@@ -48,6 +48,9 @@
 - (PackId *)firstPackIdWithPackSizeBelow:(NSUInteger)theMaxSize error:(NSError **)error;
 - (NSNumber *)containsPackId:(PackId *)thePackId error:(NSError **)error;
 - (BOOL)insertPackId:(PackId *)thePackId packIndexEntries:(NSArray *)thePIES error:(NSError **)error;
+
+// Inserts several packs in one transaction. thePIEArrays holds an NSArray of PackIndexEntry for each PackId in thePackIds.
+- (BOOL)insertPackIds:(NSArray *)thePackIds packIndexEntries:(NSArray *)thePIEArrays error:(NSError **)error;
 - (BOOL)deletePackId:(PackId *)thePackId error:(NSError **)error;
 - (PackIndexEntry *)packIndexEntryForSHA1:(NSString *)theSHA1 error:(NSError **)error;
 @end
@@ -114,11 +114,18 @@
     return ret;
 }
 - (BOOL)insertPackId:(PackId *)thePackId packIndexEntries:(NSArray *)thePIES error:(NSError **)error {
-    HSLogDetail(@"inserting %@ entries into cache db (%ld entries)", thePackId, (unsigned long)[thePIES count]);
+    return [self insertPackIds:[NSArray arrayWithObject:thePackId] packIndexEntries:[NSArray arrayWithObject:thePIES] error:error];
+}
+- (BOOL)insertPackIds:(NSArray *)thePackIds packIndexEntries:(NSArray *)thePIEArrays error:(NSError **)error {
+    NSUInteger entryCount = 0;
+    for (NSArray *pies in thePIEArrays) {
+        entryCount += [pies count];
+    }
+    HSLogDetail(@"inserting entries for %ld packs into cache db (%ld entries)", (unsigned long)[thePackIds count], (unsigned long)entryCount);
     FlockFile *ff = [[FlockFile alloc] initWithPath:lockFilePath];
     __block BOOL ret = NO;
     __block NSError *blockError = nil;
-    if (![ff lockAndExecute:^void() { ret = [self lockedInsertPackId:thePackId packIndexEntries:thePIES error:&blockError]; } error:error]) {
+    if (![ff lockAndExecute:^void() { ret = [self lockedInsertPackIds:thePackIds packIndexEntries:thePIEArrays error:&blockError]; } error:error]) {
         ret = NO;
     }
     if (error != NULL) *error = blockError;
@@ -242,7 +249,7 @@
     if (error != NULL) *error = blockError;
     return ret;
 }
-- (BOOL)lockedInsertPackId:(PackId *)thePackId packIndexEntries:(NSArray *)thePIEs error:(NSError **)error {
+- (BOOL)lockedInsertPackIds:(NSArray *)thePackIds packIndexEntries:(NSArray *)thePIEArrays error:(NSError **)error {
     __block BOOL ret = NO;
     __block NSError *blockError = nil;
     [fmdbq inDatabase:^(FMDatabase *db) {
@@ -258,7 +265,13 @@
             return;
         }
         
-        ret = [self doLockedInsertPackId:thePackId packIndexEntries:thePIEs database:db error:&blockError];
+        BOOL oldShouldCacheStatements = [db shouldCacheStatements];
+        [db setShouldCacheStatements:YES];
+        ret = YES;
+        for (NSUInteger i = 0; ret && i < [thePackIds count]; i++) {
+            ret = [self doLockedInsertPackId:[thePackIds objectAtIndex:i] packIndexEntries:[thePIEArrays objectAtIndex:i] database:db error:&blockError];
+        }
+        [db setShouldCacheStatements:oldShouldCacheStatements];
 
         // Commit.
         if (ret) {
@@ -286,18 +299,14 @@
         return NO;
     }
     
-    // Delete existing pack_index_entries if any and insert new pack_index_entries.
+    // Insert new pack_index_entries, replacing any existing entry for the same object (object_sha1 is the primary key).
     for (PackIndexEntry *pie in thePIEs) {
-        if (![db executeUpdate:@"DELETE FROM pack_index_entries WHERE object_sha1 = ?" withArgumentsInArray:[NSArray arrayWithObject:[pie objectSHA1]]]) {
-            SETNSERROR([PackSetDB errorDomain], [db lastErrorCode], @"delete from pack_index_entries for object error: %@", [db lastErrorMessage]);
-            return NO;
-        }
         NSArray *args = [NSArray arrayWithObjects:[pie objectSHA1],
                          [thePackId packSHA1],
                          [NSNumber numberWithUnsignedLongLong:[pie offset]],
                          [NSNumber numberWithUnsignedLongLong:[pie dataLength]],
                          nil];
-        if (![db executeUpdate:@"INSERT INTO pack_index_entries (object_sha1, pack_sha1, offset, length) VALUES (?, ?, ?, ?)" withArgumentsInArray:args]) {
+        if (![db executeUpdate:@"INSERT OR REPLACE INTO pack_index_entries (object_sha1, pack_sha1, offset, length) VALUES (?, ?, ?, ?)" withArgumentsInArray:args]) {
             SETNSERROR([PackSetDB errorDomain], [db lastErrorCode], @"insert into pack_index_entries error: %@", [db lastErrorMessage]);
             return NO;
         }
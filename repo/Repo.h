@@ -81,6 +81,7 @@ targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD
 - (Bucket *)bucket;
 - (BlobKey *)headBlobKey:(NSError **)error;
 - (NSArray *)allCommitBlobKeys:(NSError **)error;
+- (NSArray *)commitIndexEntries:(NSError **)error;
 - (Commit *)commitForBlobKey:(BlobKey *)treeBlobKey error:(NSError **)error;
 - (Commit *)commitForBlobKey:(BlobKey *)treeBlobKey dataSize:(unsigned long long *)dataSize error:(NSError **)error;
 - (Tree *)treeForBlobKey:(BlobKey *)treeBlobKey error:(NSError **)error;
@@ -93,6 +94,9 @@ targetConnectionDelegate:(id <TargetConnectionDelegate>)theTCD
 - (BOOL)restoreObjectForBlobKey:(BlobKey *)theBlobKey forDays:(NSUInteger)theDays tier:(int)theGlacierRetrievalTier alreadyRestoredOrRestoring:(BOOL *)alreadyRestoredOrRestoring error:(NSError **)error;
 - (NSData *)dataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error;
 
+// Fetches the blob only if it's stored as its own object, without consulting (or loading) the list of packs.
+- (NSData *)unpackedDataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error;
+
 - (BOOL)setHeadBlobKey:(BlobKey *)theBlobKey rewrite:(BOOL)rewrite error:(NSError **)error;
 - (BOOL)deleteHeadBlobKey:(NSError **)error;
 
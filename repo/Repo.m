@@ -40,6 +40,7 @@
 #import "BufferedInputStream.h"
 #import "Target.h"
 #import "Commit.h"
+#import "CommitIndex.h"
 #import "Tree.h"
 #import "PackSet.h"
 #import "NSData-Compress.h"
@@ -53,6 +54,7 @@
 #import "PackIndexEntry.h"
 #import "PackId.h"
 #import "StorageType.h"
+#import "RestoreMetrics.h"
 
 #define MAX_CONSISTENCY_TRIES (20)
 #define ENCRYPTED_OBJECT_HEADER_LEN (116)
@@ -145,25 +147,20 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
     return ret;
 }
 - (NSArray *)allCommitBlobKeys:(NSError **)error {
-    NSError *myError = nil;
-    BlobKey *commitBlobKey = [self headBlobKey:&myError];
-    if (commitBlobKey == nil && ![myError isErrorWithDomain:[self errorDomain] code:ERROR_NOT_FOUND]) {
-        if (error != NULL) {
-            *error = myError;
-        }
+    NSArray *entries = [self commitIndexEntries:error];
+    if (entries == nil) {
         return nil;
     }
-    NSMutableArray *commitBlobKeys = [NSMutableArray array];
-    while (commitBlobKey != nil) {
-        [commitBlobKeys addObject:commitBlobKey];
-        Commit *commit = [self commitForBlobKey:commitBlobKey error:error];
-        if (commit == nil) {
-            return nil;
-        }
-        commitBlobKey = [commit parentCommitBlobKey];
+    NSMutableArray *commitBlobKeys = [NSMutableArray arrayWithCapacity:[entries count]];
+    for (CommitIndexEntry *entry in entries) {
+        [commitBlobKeys addObject:[entry commitBlobKey]];
     }
     return commitBlobKeys;
 }
+- (NSArray *)commitIndexEntries:(NSError **)error {
+    CommitIndex *commitIndex = [[CommitIndex alloc] initWithRepo:self];
+    return [commitIndex entries:error];
+}
 - (Commit *)commitForBlobKey:(BlobKey *)commitBlobKey error:(NSError **)error {
     return [self commitForBlobKey:commitBlobKey dataSize:NULL error:error];
 }
@@ -294,6 +291,27 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
     NSData *ret = [self doDataForBlobKey:theBlobKey error:error];
     return ret;
 }
+- (NSData *)unpackedDataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error {
+    if ([theBlobKey storageType] == StorageTypeGlacier) {
+        SETNSERROR([self errorDomain], -1, @"invalid method unpackedDataForBlobKey: for Glacier BlobKey");
+        return nil;
+    }
+    
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    NSError *myError = nil;
+    NSData *data = [fark dataForSHA1:[theBlobKey sha1] storageType:[theBlobKey storageType] error:&myError];
+    if (data == nil) {
+        if ([myError isErrorWithDomain:[fark errorDomain] code:ERROR_NOT_DOWNLOADABLE]) {
+            SETNSERROR([self errorDomain], ERROR_NOT_DOWNLOADABLE, @"%@", [myError localizedDescription]);
+        } else if ([myError isErrorWithDomain:[fark errorDomain] code:ERROR_NOT_FOUND]) {
+            SETNSERROR([self errorDomain], ERROR_NOT_FOUND, @"unpacked object not found for %@", [theBlobKey sha1]);
+        } else {
+            SETERRORFROMMYERROR;
+        }
+        return nil;
+    }
+    return [self decryptedDataForFetchedData:data blobKey:theBlobKey startTime:startTime];
+}
 
 - (BOOL)setHeadBlobKey:(BlobKey *)theHeadBlobKey rewrite:(BOOL)rewrite error:(NSError **)error {
     HSLogDebug(@"entered setHeadBlobKey:%@ rewrite:%@", theHeadBlobKey, (rewrite ? @"YES" : @"NO"));
@@ -490,6 +508,8 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
     return commit;
 }
 - (Tree *)doTreeForBlobKey:(BlobKey *)blobKey dataSize:(unsigned long long *)dataSize error:(NSError **)error {
+    RestoreMetrics *metrics = [RestoreMetrics sharedRestoreMetrics];
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
     NSError *myError = nil;
     NSData *data = [treesPackSet dataForSHA1:[blobKey sha1] withRetry:YES error:&myError];
     if (data == nil) {
@@ -504,15 +524,21 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
         }
         return nil;
     }
+    [metrics recordStage:RestoreStageNetwork startTime:startTime bytes:[data length]];
+    
+    startTime = [NSDate timeIntervalSinceReferenceDate];
     data = [self decryptData:data forBlobKey:blobKey error:error];
     if (data == nil) {
         return nil;
     }
+    [metrics recordStage:RestoreStageDecrypt startTime:startTime bytes:[data length]];
     if ([blobKey compressionType] != BlobKeyCompressionNone) {
+        startTime = [NSDate timeIntervalSinceReferenceDate];
         data = [data uncompress:[blobKey compressionType] error:error];
         if (data == nil) {
             return nil;
         }
+        [metrics recordStage:RestoreStageDecompress startTime:startTime bytes:[data length]];
     }
     
     if (dataSize != NULL) {
@@ -521,7 +547,11 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
     
     DataInputStream *dis = [[DataInputStream alloc] initWithData:data description:[NSString stringWithFormat:@"Tree %@", [blobKey description]]];
     BufferedInputStream *bis = [[BufferedInputStream alloc] initWithUnderlyingStream:dis];
+    startTime = [NSDate timeIntervalSinceReferenceDate];
     Tree *tree = [[Tree alloc] initWithBufferedInputStream:bis error:error];
+    if (tree != nil) {
+        [metrics recordStage:RestoreStageTreeDecode startTime:startTime bytes:[data length]];
+    }
     return tree;
 }
 - (NSData *)doDataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error {
@@ -530,6 +560,7 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
         return nil;
     }
     
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
     NSError *myError = nil;
     
     // Try packset.
@@ -594,13 +625,22 @@ targetConnectionDelegate:(id<TargetConnectionDelegate>)theTCD
     }
     
     NSAssert(data != nil, @"data can't be nil at this point");
+    return [self decryptedDataForFetchedData:data blobKey:theBlobKey startTime:startTime];
+}
+- (NSData *)decryptedDataForFetchedData:(NSData *)data blobKey:(BlobKey *)theBlobKey startTime:(NSTimeInterval)startTime {
+    NSError *myError = nil;
+    RestoreMetrics *metrics = [RestoreMetrics sharedRestoreMetrics];
+    [metrics recordStage:RestoreStageNetwork startTime:startTime bytes:[data length]];
     
+    startTime = [NSDate timeIntervalSinceReferenceDate];
     NSData *decrypted = [self decryptData:data forBlobKey:theBlobKey error:&myError];
     if (decrypted == nil) {
         HSLogDebug(@"decrypt problem: %@", myError);
         // Between Arq 5.0.0.0 and 5.0.0.64, we didn't save the encrypted compressed buffer; we saved the compressed buffer!
         // So, if the decryption fails, it probably wasn't encrypted.
         decrypted = data;
+    } else {
+        [metrics recordStage:RestoreStageDecrypt startTime:startTime bytes:[decrypted length]];
     }
     
     return decrypted;
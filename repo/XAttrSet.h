@@ -44,4 +44,5 @@
 - (unsigned long long)dataLength;
 - (NSArray *)names;
 - (BOOL)applyToFile:(NSString *)path error:(NSError **)error;
+- (BOOL)applyToFD:(int)fd path:(NSString *)thePath error:(NSError **)error;
 @end
@@ -141,6 +141,34 @@
     }
     return YES;
 }
+- (BOOL)applyToFD:(int)fd path:(NSString *)thePath error:(NSError **)error {
+    ssize_t namesLen = flistxattr(fd, NULL, 0, 0);
+    if (namesLen > 0) {
+        NSMutableData *names = [NSMutableData dataWithLength:(NSUInteger)namesLen];
+        namesLen = flistxattr(fd, (char *)[names mutableBytes], (size_t)namesLen, 0);
+        const char *name = (const char *)[names bytes];
+        const char *end = name + (namesLen > 0 ? namesLen : 0);
+        while (name < end) {
+            if (fremovexattr(fd, name, 0) == -1) {
+                int errnum = errno;
+                HSLogError(@"fremovexattr(%@, %s) error %d: %s", thePath, name, errnum, strerror(errnum));
+                SETNSERROR(@"UnixErrorDomain", errnum, @"failed to remove extended attribute %s from %@: %s", name, thePath, strerror(errnum));
+                return NO;
+            }
+            name += strlen(name) + 1;
+        }
+    }
+    for (NSString *key in [xattrs allKeys]) {
+        NSData *value = [xattrs objectForKey:key];
+        if (fsetxattr(fd, [key UTF8String], [value bytes], [value length], 0, 0) == -1) {
+            int errnum = errno;
+            HSLogError(@"fsetxattr(%@, %@) error %d: %s", thePath, key, errnum, strerror(errnum));
+            SETNSERROR(@"UnixErrorDomain", errnum, @"failed to set extended attribute %@ on %@: %s", key, thePath, strerror(errnum));
+            return NO;
+        }
+    }
+    return YES;
+}
 @end
 
 @implementation XAttrSet (internal)
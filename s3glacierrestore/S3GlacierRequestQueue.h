@@ -0,0 +1,67 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+@class Repo;
+@class BlobKey;
+
+// Issues S3 Glacier restore requests and polls for object availability on a
+// bounded pool of threads, so neither blocks the restorer's main loop.
+// Availability checks back off per object; the first check is scheduled from
+// how long earlier objects actually took to become downloadable.
+@interface S3GlacierRequestQueue : NSObject {
+    Repo *repo;
+    int glacierRetrievalTier;
+    NSUInteger restoreDays;
+    NSCondition *condition;
+    NSMutableArray *entriesToRequest;
+    NSMutableArray *entriesToCheck;
+    NSMutableDictionary *entriesBySHA1;
+    NSMutableSet *availableSHA1s;
+    NSTimeInterval minCheckInterval;
+    NSTimeInterval maxCheckInterval;
+    NSTimeInterval expectedTimeToAvailable;
+    NSTimeInterval errorBackoffInterval;
+    NSDate *pauseUntilDate;
+    unsigned long long bytesAlreadyRestored;
+    NSError *requestError;
+    BOOL stopRequested;
+}
+- (id)initWithRepo:(Repo *)theRepo glacierRetrievalTier:(int)theGlacierRetrievalTier restoreDays:(NSUInteger)theRestoreDays numThreads:(NSUInteger)theNumThreads;
+
+- (void)requestBlobKey:(BlobKey *)theBlobKey dataSize:(unsigned long long)theDataSize;
+- (void)watchBlobKey:(BlobKey *)theBlobKey;
+- (BOOL)isBlobKeyAvailable:(BlobKey *)theBlobKey;
+- (BOOL)takeBytesAlreadyRestored:(unsigned long long *)theBytes error:(NSError **)error;
+- (NSUInteger)requestsOutstanding;
+- (void)stop;
+@end
@@ -0,0 +1,297 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "S3GlacierRequestQueue.h"
+#import "Repo.h"
+#import "BlobKey.h"
+#import "S3Service.h"
+
+#define MAX_ERROR_BACKOFF_INTERVAL (60.0)
+
+
+@interface S3GlacierRequestQueueEntry : NSObject {
+@public
+    BlobKey *blobKey;
+    unsigned long long dataSize;
+    NSDate *requestDate;
+    NSDate *nextCheckDate;
+    NSTimeInterval checkInterval;
+    BOOL wasAlreadyRestored;
+    NSUInteger failedChecks;
+}
+@end
+
+@implementation S3GlacierRequestQueueEntry
+@end
+
+
+@implementation S3GlacierRequestQueue
+- (id)initWithRepo:(Repo *)theRepo glacierRetrievalTier:(int)theGlacierRetrievalTier restoreDays:(NSUInteger)theRestoreDays numThreads:(NSUInteger)theNumThreads {
+    if (self = [super init]) {
+        repo = theRepo;
+        glacierRetrievalTier = theGlacierRetrievalTier;
+        restoreDays = theRestoreDays;
+        condition = [[NSCondition alloc] init];
+        [condition setName:@"S3GlacierRequestQueue"];
+        entriesToRequest = [[NSMutableArray alloc] init];
+        entriesToCheck = [[NSMutableArray alloc] init];
+        entriesBySHA1 = [[NSMutableDictionary alloc] init];
+        availableSHA1s = [[NSMutableSet alloc] init];
+        
+        switch (theGlacierRetrievalTier) {
+            case GLACIER_RETRIEVAL_TIER_BULK:
+                minCheckInterval = 60;
+                maxCheckInterval = 30 * 60;
+                expectedTimeToAvailable = 5 * 60 * 60; // bulk is 5-12 hours
+                break;
+            case GLACIER_RETRIEVAL_TIER_EXPEDITED:
+                minCheckInterval = 15;
+                maxCheckInterval = 2 * 60;
+                expectedTimeToAvailable = 60; // expedited is 1-5 minutes
+                break;
+            default:
+                minCheckInterval = 60;
+                maxCheckInterval = 15 * 60;
+                expectedTimeToAvailable = 3 * 60 * 60; // standard is 3-5 hours
+                break;
+        }
+        
+        for (NSUInteger i = 0; i < theNumThreads; i++) {
+            [NSThread detachNewThreadSelector:@selector(run) toTarget:self withObject:nil];
+        }
+    }
+    return self;
+}
+
+- (void)requestBlobKey:(BlobKey *)theBlobKey dataSize:(unsigned long long)theDataSize {
+    [condition lock];
+    if ([entriesBySHA1 objectForKey:[theBlobKey sha1]] == nil) {
+        S3GlacierRequestQueueEntry *entry = [[S3GlacierRequestQueueEntry alloc] init];
+        entry->blobKey = theBlobKey;
+        entry->dataSize = theDataSize;
+        [entriesBySHA1 setObject:entry forKey:[theBlobKey sha1]];
+        [entriesToRequest addObject:entry];
+        [condition signal];
+    }
+    [condition unlock];
+}
+- (void)watchBlobKey:(BlobKey *)theBlobKey {
+    [condition lock];
+    if ([entriesBySHA1 objectForKey:[theBlobKey sha1]] == nil) {
+        // Not requested by us; maybe it was restored earlier. Check it right away.
+        S3GlacierRequestQueueEntry *entry = [[S3GlacierRequestQueueEntry alloc] init];
+        entry->blobKey = theBlobKey;
+        entry->requestDate = [NSDate date];
+        entry->nextCheckDate = entry->requestDate;
+        entry->checkInterval = minCheckInterval;
+        entry->wasAlreadyRestored = YES;
+        [entriesBySHA1 setObject:entry forKey:[theBlobKey sha1]];
+        [self lockedScheduleCheck:entry];
+    }
+    [condition unlock];
+}
+- (BOOL)isBlobKeyAvailable:(BlobKey *)theBlobKey {
+    [condition lock];
+    BOOL ret = [availableSHA1s containsObject:[theBlobKey sha1]];
+    [condition unlock];
+    return ret;
+}
+- (BOOL)takeBytesAlreadyRestored:(unsigned long long *)theBytes error:(NSError **)error {
+    [condition lock];
+    *theBytes = bytesAlreadyRestored;
+    bytesAlreadyRestored = 0;
+    NSError *theError = requestError;
+    [condition unlock];
+    if (theError != nil) {
+        if (error != NULL) {
+            *error = theError;
+        }
+        return NO;
+    }
+    return YES;
+}
+- (NSUInteger)requestsOutstanding {
+    [condition lock];
+    NSUInteger ret = [entriesToRequest count];
+    [condition unlock];
+    return ret;
+}
+- (void)stop {
+    [condition lock];
+    stopRequested = YES;
+    [condition broadcast];
+    [condition unlock];
+}
+
+
+#pragma mark internal
+- (void)run {
+    for (;;) {
+        S3GlacierRequestQueueEntry *entry = nil;
+        BOOL isRequest = NO;
+        
+        [condition lock];
+        while (!stopRequested) {
+            NSDate *now = [NSDate date];
+            if (pauseUntilDate != nil && [pauseUntilDate compare:now] == NSOrderedDescending) {
+                [condition waitUntilDate:pauseUntilDate];
+                continue;
+            }
+            if ([entriesToRequest count] > 0) {
+                entry = [entriesToRequest objectAtIndex:0];
+                [entriesToRequest removeObjectAtIndex:0];
+                isRequest = YES;
+                break;
+            }
+            if ([entriesToCheck count] > 0) {
+                S3GlacierRequestQueueEntry *first = [entriesToCheck objectAtIndex:0];
+                if ([first->nextCheckDate compare:now] != NSOrderedDescending) {
+                    entry = first;
+                    [entriesToCheck removeObjectAtIndex:0];
+                    break;
+                }
+                [condition waitUntilDate:first->nextCheckDate];
+                continue;
+            }
+            [condition wait];
+        }
+        BOOL stop = stopRequested;
+        [condition unlock];
+        if (stop) {
+            break;
+        }
+        
+        @autoreleasepool {
+            if (isRequest) {
+                [self request:entry];
+            } else {
+                [self check:entry];
+            }
+        }
+    }
+}
+- (void)request:(S3GlacierRequestQueueEntry *)theEntry {
+    NSError *myError = nil;
+    BOOL alreadyRestoredOrRestoring = NO;
+    BOOL ret = [repo restoreObjectForBlobKey:theEntry->blobKey forDays:restoreDays tier:glacierRetrievalTier alreadyRestoredOrRestoring:&alreadyRestoredOrRestoring error:&myError];
+    
+    [condition lock];
+    if (!ret) {
+        HSLogError(@"failed to request restore of %@: %@", theEntry->blobKey, myError);
+        if (requestError == nil) {
+            requestError = myError;
+        }
+        [self lockedBackOff];
+    } else {
+        [self lockedResetBackOff];
+        theEntry->requestDate = [NSDate date];
+        if (alreadyRestoredOrRestoring) {
+            bytesAlreadyRestored += theEntry->dataSize;
+            theEntry->wasAlreadyRestored = YES;
+            theEntry->nextCheckDate = theEntry->requestDate;
+        } else {
+            // Don't bother checking until around the time earlier objects have taken to thaw.
+            NSTimeInterval firstCheck = expectedTimeToAvailable * 0.75;
+            if (firstCheck < minCheckInterval) {
+                firstCheck = minCheckInterval;
+            }
+            theEntry->nextCheckDate = [theEntry->requestDate dateByAddingTimeInterval:firstCheck];
+        }
+        theEntry->checkInterval = minCheckInterval;
+        [self lockedScheduleCheck:theEntry];
+    }
+    [condition unlock];
+}
+- (void)check:(S3GlacierRequestQueueEntry *)theEntry {
+    NSError *myError = nil;
+    NSNumber *available = [repo isObjectDownloadableForBlobKey:theEntry->blobKey error:&myError];
+    
+    [condition lock];
+    if (available == nil) {
+        HSLogError(@"failed to check availability of %@: %@", theEntry->blobKey, myError);
+        [self lockedBackOff];
+    } else {
+        [self lockedResetBackOff];
+    }
+    if ([available boolValue]) {
+        [availableSHA1s addObject:[theEntry->blobKey sha1]];
+        
+        // Keep a running estimate of how long objects take to become downloadable.
+        NSTimeInterval elapsed = [[NSDate date] timeIntervalSinceDate:theEntry->requestDate];
+        if (!theEntry->wasAlreadyRestored) {
+            if (theEntry->failedChecks == 0) {
+                // It was ready by the first check, so it may well have been ready sooner.
+                expectedTimeToAvailable = MIN(expectedTimeToAvailable, elapsed) * 0.9;
+            } else {
+                expectedTimeToAvailable = (expectedTimeToAvailable * 0.8) + (elapsed * 0.2);
+            }
+        }
+        HSLogDebug(@"%@ is available after %0.0f seconds", theEntry->blobKey, elapsed);
+    } else {
+        theEntry->failedChecks++;
+        theEntry->nextCheckDate = [NSDate dateWithTimeIntervalSinceNow:theEntry->checkInterval];
+        theEntry->checkInterval *= 2;
+        if (theEntry->checkInterval > maxCheckInterval) {
+            theEntry->checkInterval = maxCheckInterval;
+        }
+        [self lockedScheduleCheck:theEntry];
+    }
+    [condition broadcast];
+    [condition unlock];
+}
+- (void)lockedScheduleCheck:(S3GlacierRequestQueueEntry *)theEntry {
+    NSUInteger index = [entriesToCheck indexOfObject:theEntry
+                                       inSortedRange:NSMakeRange(0, [entriesToCheck count])
+                                             options:NSBinarySearchingInsertionIndex|NSBinarySearchingLastEqual
+                                     usingComparator:^NSComparisonResult(id obj1, id obj2) {
+                                         return [((S3GlacierRequestQueueEntry *)obj1)->nextCheckDate compare:((S3GlacierRequestQueueEntry *)obj2)->nextCheckDate];
+                                     }];
+    [entriesToCheck insertObject:theEntry atIndex:index];
+    [condition signal];
+}
+- (void)lockedBackOff {
+    // Every thread pauses after an error, with the pause doubling up to a minute.
+    errorBackoffInterval = (errorBackoffInterval == 0) ? 1.0 : (errorBackoffInterval * 2);
+    if (errorBackoffInterval > MAX_ERROR_BACKOFF_INTERVAL) {
+        errorBackoffInterval = MAX_ERROR_BACKOFF_INTERVAL;
+    }
+    double jitter = (double)arc4random_uniform(1000) / 1000.0;
+    pauseUntilDate = [NSDate dateWithTimeIntervalSinceNow:(errorBackoffInterval * (0.5 + jitter / 2.0))];
+}
+- (void)lockedResetBackOff {
+    errorBackoffInterval = errorBackoffInterval / 2;
+    if (errorBackoffInterval < 1.0) {
+        errorBackoffInterval = 0;
+    }
+}
+@end
@@ -38,12 +38,15 @@
 @class Commit;
 @class Tree;
 @class Node;
+@class S3GlacierRequestQueue;
+@class GlacierRetrievalScheduler;
 
 @interface S3GlacierRestorer : NSObject <Restorer, TargetConnectionDelegate> {
     S3GlacierRestorerParamSet *paramSet;
     id <S3GlacierRestorerDelegate> delegate;
 
     Repo *repo;
+    S3GlacierRequestQueue *requestQueue;
     Commit *commit;
     Tree *rootTree;
     Node *rootNode;
@@ -54,23 +57,21 @@
     
     NSString *skipFilesRoot;
     
-    NSTimeInterval requestRoundTimeInterval;
+    GlacierRetrievalScheduler *retrievalScheduler;
     
-    unsigned long long bytesActuallyRequestedThisRound;
     unsigned long long bytesRequested;
     unsigned long long totalBytesToRequest;
     
     unsigned long long bytesTransferred;
     unsigned long long totalBytesToTransfer;
     
-    unsigned long long bytesToRequestPerRound;
-    NSDate *dateToResumeRequesting;
-    NSUInteger roundsCompleted;
     NSMutableDictionary *hardlinks;
+    BOOL finishedRequesting;
     
     NSUInteger sleepCycles;
 }
 - (id)initWithS3GlacierRestorerParamSet:(S3GlacierRestorerParamSet *)theParamSet delegate:(id <S3GlacierRestorerDelegate>)theDelegate;
+- (id)initWithS3GlacierRestorerParamSet:(S3GlacierRestorerParamSet *)theParamSet delegate:(id <S3GlacierRestorerDelegate>)theDelegate retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler;
 
 - (void)run;
 @end
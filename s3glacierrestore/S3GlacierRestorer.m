@@ -46,8 +46,13 @@
 #import "Bucket.h"
 #import "Target.h"
 #import "S3Service.h"
+#import "S3GlacierRequestQueue.h"
+#import "GlacierRetrievalScheduler.h"
+#import "ThroughputGlacierRetrievalPolicy.h"
+#import "SystemGlacierRetrievalClock.h"
 
 #define RESTORE_DAYS (10)
+#define NUM_REQUEST_THREADS (8)
 
 #define SLEEP_CYCLES_START (1)
 #define SLEEP_CYCLES_MAX (10)
@@ -55,9 +60,29 @@
 
 @implementation S3GlacierRestorer
 - (id)initWithS3GlacierRestorerParamSet:(S3GlacierRestorerParamSet *)theParamSet delegate:(id <S3GlacierRestorerDelegate>)theDelegate {
+    NSTimeInterval requestRoundTimeInterval = 0;
+    switch(theParamSet.glacierRetrievalTier) {
+        case GLACIER_RETRIEVAL_TIER_BULK:
+            requestRoundTimeInterval = 60 * 60 * 6; // 6 hours (bulk is 5-12 hours)
+            break;
+        case GLACIER_RETRIEVAL_TIER_EXPEDITED:
+            requestRoundTimeInterval = 60; // 1 minute
+            break;
+        default:
+            requestRoundTimeInterval = 60 * 60 *4; // 4 hours (standard is 3-5 hours)
+            break;
+    }
+    // Request a round's worth of data at the preferred download rate each round.
+    ThroughputGlacierRetrievalPolicy *policy = [[ThroughputGlacierRetrievalPolicy alloc] initWithDownloadBytesPerSecond:theParamSet.downloadBytesPerSecond
+                                                                                                      roundTimeInterval:requestRoundTimeInterval];
+    GlacierRetrievalScheduler *scheduler = [[GlacierRetrievalScheduler alloc] initWithPolicy:policy clock:[[SystemGlacierRetrievalClock alloc] init]];
+    return [self initWithS3GlacierRestorerParamSet:theParamSet delegate:theDelegate retrievalScheduler:scheduler];
+}
+- (id)initWithS3GlacierRestorerParamSet:(S3GlacierRestorerParamSet *)theParamSet delegate:(id <S3GlacierRestorerDelegate>)theDelegate retrievalScheduler:(GlacierRetrievalScheduler *)theRetrievalScheduler {
     if (self = [super init]) {
         paramSet = theParamSet;
         delegate = theDelegate;
+        retrievalScheduler = theRetrievalScheduler;
         
         calculateItems = [[NSMutableArray alloc] init];
         glacierRequestItems = [[NSMutableArray alloc] init];
@@ -65,20 +90,6 @@
         
         skipFilesRoot = [[UserLibrary arqUserLibraryPath] stringByAppendingFormat:@"/RestoreJobSkipFiles/%f", [NSDate timeIntervalSinceReferenceDate]];
         
-        switch(paramSet.glacierRetrievalTier) {
-            case GLACIER_RETRIEVAL_TIER_BULK:
-                requestRoundTimeInterval = 60 * 60 * 6; // 6 hours (bulk is 5-12 hours)
-                break;
-            case GLACIER_RETRIEVAL_TIER_EXPEDITED:
-                requestRoundTimeInterval = 60; // 1 minute
-                break;
-            default:
-                requestRoundTimeInterval = 60 * 60 *4; // 4 hours (standard is 3-5 hours)
-                break;
-        }
-        
-        bytesToRequestPerRound = paramSet.downloadBytesPerSecond * requestRoundTimeInterval; // 4 hours at preferred download rate
-        dateToResumeRequesting = [NSDate date];
         hardlinks = [[NSMutableDictionary alloc] init];
 
         sleepCycles = SLEEP_CYCLES_START;
@@ -122,12 +133,11 @@
         return NO;
     }
     unsigned long long dataSize = [theSize unsignedLongLongValue];
-    BOOL alreadyRestoredOrRestoring = NO;
-    if (![repo restoreObjectForBlobKey:theBlobKey forDays:RESTORE_DAYS tier:paramSet.glacierRetrievalTier alreadyRestoredOrRestoring:&alreadyRestoredOrRestoring error:error]) {
-        return NO;
-    }
-    unsigned long long actualBytesRequested = alreadyRestoredOrRestoring ? 0 : dataSize;
-    if (![self addToBytesRequested:dataSize actualBytesRequested:actualBytesRequested error:error]) {
+    
+    // The request is issued by requestQueue. Count it against this round now; bytes for objects that turn out
+    // to be restored already are given back in run: when the queue reports them.
+    [requestQueue requestBlobKey:theBlobKey dataSize:dataSize];
+    if (![self addToBytesRequested:dataSize actualBytesRequested:dataSize error:error]) {
         return NO;
     }
     return YES;
@@ -139,6 +149,9 @@
         theBlobKey = [[BlobKey alloc] initCopyOfBlobKey:theBlobKey withStorageType:StorageTypeS3Glacier];
     }
     
+    if ([requestQueue isBlobKeyAvailable:theBlobKey]) {
+        return [NSNumber numberWithBool:YES];
+    }
     return [repo isObjectDownloadableForBlobKey:theBlobKey error:error];
 }
 - (NSNumber *)sizeOfBlob:(BlobKey *)theBlobKey error:(NSError **)error {
@@ -192,6 +205,12 @@
         return NO;
     }
     
+    requestQueue = [[S3GlacierRequestQueue alloc] initWithRepo:repo glacierRetrievalTier:paramSet.glacierRetrievalTier restoreDays:RESTORE_DAYS numThreads:NUM_REQUEST_THREADS];
+    BOOL ret = [self restore:error];
+    [requestQueue stop];
+    return ret;
+}
+- (BOOL)restore:(NSError **)error {
     commit = [repo commitForBlobKey:[paramSet commitBlobKey] dataSize:NULL error:error];
     if (commit == nil) {
         return NO;
@@ -243,26 +262,10 @@
 //    }
     
     
-    BOOL restoredAnItem = NO;
     BOOL ret = YES;
     while ([restoreItems count] > 0) {
         if ([glacierRequestItems count] > 0) {
-            // Reset counters if necessary.
-            if (bytesActuallyRequestedThisRound >= bytesToRequestPerRound) {
-                roundsCompleted++;
-                bytesActuallyRequestedThisRound = 0;
-                NSDate *nextResumeDate = [dateToResumeRequesting dateByAddingTimeInterval:requestRoundTimeInterval];
-                
-                dateToResumeRequesting = nextResumeDate;
-                HSLogDebug(@"reset next request resume date to %@", nextResumeDate);
-            }
-            
-            // Make sure we've transferred all the bytes from all but the most recent round of requests.
-            double theMinimum = (roundsCompleted = 0) ? 0 : ((double)bytesToRequestPerRound * (double)(roundsCompleted - 1)) * .9;
-            unsigned long long minimumBytesToHaveTransferred = (unsigned long long)theMinimum;
-            if ((bytesActuallyRequestedThisRound < bytesToRequestPerRound)
-                && (bytesTransferred >= minimumBytesToHaveTransferred)
-                && ([[NSDate date] earlierDate:dateToResumeRequesting] == dateToResumeRequesting)) {
+            if ([retrievalScheduler shouldRequestMoreWithBytesTransferred:bytesTransferred]) {
                 
                 // Request more Glacier items.
                 if ([glacierRequestItems count] > 0) {
@@ -276,56 +279,36 @@
                     break;
                 }
             }
-            
-            if ([glacierRequestItems count] == 0) {
-                HSLogDebug(@"finished requesting");
-                if ([delegate s3GlacierRestorerDidFinishRequesting]) {
-                    SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
-                    ret = NO;
-                    break;
-                }
-            }
         }
         
-        
-        // Restore an item if possible.
-        
-        NSError *restoreError = nil;
-        RestoreItem *restoreItem = [restoreItems objectAtIndex:0];
-        restoredAnItem = YES;
-        HSLogDebug(@"attempting to restore %@", restoreItem);
-        if ([delegate s3GlacierRestorerMessageDidChange:[NSString stringWithFormat:@"Restoring %@", [restoreItem path]]]) {
-            SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
-            return NO;
+        // Give back bytes for objects that were already restored (or being restored), and stop if a request failed.
+        unsigned long long bytesAlreadyRestored = 0;
+        if (![requestQueue takeBytesAlreadyRestored:&bytesAlreadyRestored error:error]) {
+            ret = NO;
+            break;
         }
-        if (![restoreItem restoreWithHardlinks:hardlinks restorer:self error:&restoreError]) {
-            if ([restoreError isErrorWithDomain:[restoreItem errorDomain] code:ERROR_GLACIER_OBJECT_NOT_AVAILABLE]) {
-                HSLogDebug(@"glacier object not available yet");
-                restoredAnItem = NO;
-            } else if ([restoreError isErrorWithDomain:[self errorDomain] code:ERROR_ABORT_REQUESTED]) {
-                if (error != NULL) {
-                    *error = restoreError;
-                }
+        [retrievalScheduler removeBytesRequested:bytesAlreadyRestored];
+        
+        if (!finishedRequesting && [glacierRequestItems count] == 0 && [requestQueue requestsOutstanding] == 0) {
+            finishedRequesting = YES;
+            HSLogDebug(@"finished requesting");
+            if ([delegate s3GlacierRestorerDidFinishRequesting]) {
+                SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
                 ret = NO;
                 break;
-            } else {
-                [delegate s3GlacierRestorerErrorMessage:[restoreError localizedDescription] didOccurForPath:[restoreItem path]];
             }
         }
-        if (restoredAnItem) {
-            sleepCycles = SLEEP_CYCLES_START;
-            NSArray *nextItems = [restoreItem nextItemsWithRepo:repo error:error];
-            if (nextItems == nil) {
-                ret = NO;
-                break;
-            }
-            [restoreItems removeObjectAtIndex:0];
-            if ([nextItems count] > 0) {
-                [restoreItems insertObjects:nextItems atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, [nextItems count])]];
-            }
+        
+        // Restore whatever is downloadable now, in any order.
+        NSUInteger restoredCount = 0;
+        if (![self restoreAvailableItems:&restoredCount error:error]) {
+            ret = NO;
+            break;
         }
         
-        if (!restoredAnItem) {
+        if (restoredCount > 0) {
+            sleepCycles = SLEEP_CYCLES_START;
+        } else {
             if ([delegate s3GlacierRestorerMessageDidChange:@"Waiting for objects to become downloadable"]) {
                 SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
                 return NO;
@@ -338,7 +321,7 @@
                     ret = NO;
                     break;
                 }
-                [NSThread sleepForTimeInterval:SLEEP_CYCLE_DURATION];
+                [[retrievalScheduler clock] sleepForTimeInterval:SLEEP_CYCLE_DURATION];
             }
             sleepCycles *= 2;
             if (sleepCycles > SLEEP_CYCLES_MAX) {
@@ -351,6 +334,81 @@
     }
     return ret;
 }
+- (BOOL)restoreAvailableItems:(NSUInteger *)theRestoredCount error:(NSError **)error {
+    NSUInteger restoredCount = 0;
+    NSString *lastSkippedPath = nil;
+    NSUInteger index = 0;
+    while (index < [restoreItems count]) {
+        RestoreItem *restoreItem = [restoreItems objectAtIndex:index];
+        if (![self isReadyToRestore:restoreItem lastSkippedPath:lastSkippedPath]) {
+            lastSkippedPath = [restoreItem path];
+            index++;
+            continue;
+        }
+        
+        NSError *restoreError = nil;
+        BOOL restoredAnItem = YES;
+        HSLogDebug(@"attempting to restore %@", restoreItem);
+        if ([delegate s3GlacierRestorerMessageDidChange:[NSString stringWithFormat:@"Restoring %@", [restoreItem path]]]) {
+            SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
+            return NO;
+        }
+        if (![restoreItem restoreWithHardlinks:hardlinks restorer:self error:&restoreError]) {
+            if ([restoreError isErrorWithDomain:[restoreItem errorDomain] code:ERROR_GLACIER_OBJECT_NOT_AVAILABLE]) {
+                HSLogDebug(@"glacier object not available yet");
+                restoredAnItem = NO;
+            } else if ([restoreError isErrorWithDomain:[self errorDomain] code:ERROR_ABORT_REQUESTED]) {
+                if (error != NULL) {
+                    *error = restoreError;
+                }
+                return NO;
+            } else {
+                [delegate s3GlacierRestorerErrorMessage:[restoreError localizedDescription] didOccurForPath:[restoreItem path]];
+            }
+        }
+        if (!restoredAnItem) {
+            lastSkippedPath = [restoreItem path];
+            index++;
+            continue;
+        }
+        
+        restoredCount++;
+        NSArray *nextItems = [restoreItem nextItemsWithRepo:repo error:error];
+        if (nextItems == nil) {
+            return NO;
+        }
+        // Replace the item with its next items in place, so everything under a directory stays ahead of its apply-tree item.
+        [restoreItems removeObjectAtIndex:index];
+        if ([nextItems count] > 0) {
+            [restoreItems insertObjects:nextItems atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(index, [nextItems count])]];
+        }
+    }
+    *theRestoredCount = restoredCount;
+    return YES;
+}
+- (BOOL)isReadyToRestore:(RestoreItem *)theItem lastSkippedPath:(NSString *)theLastSkippedPath {
+    if (theLastSkippedPath != nil) {
+        // Hardlinked files stay in tree order so the same path gets the data as before.
+        if ([theItem isHardlinked]) {
+            return NO;
+        }
+        // A directory's metadata waits until everything inside it is restored. Items under a directory sit
+        // contiguously before its apply-tree item, so checking the last skipped path is enough.
+        if ([theItem appliesTreeMetadata] && [theLastSkippedPath hasPrefix:[[theItem path] stringByAppendingString:@"/"]]) {
+            return NO;
+        }
+    }
+    for (BlobKey *blobKey in [theItem blobKeysNeededWithRestorer:self]) {
+        if (![requestQueue isBlobKeyAvailable:blobKey]) {
+            if (finishedRequesting) {
+                // Everything has been requested, so this one was never requested by us; make sure somebody checks on it.
+                [requestQueue watchBlobKey:blobKey];
+            }
+            return NO;
+        }
+    }
+    return YES;
+}
 
 - (BOOL)calculateSizes:(NSError **)error {
     if (![[NSFileManager defaultManager] fileExistsAtPath:paramSet.destinationPath]) {
@@ -413,7 +471,7 @@
 
 - (BOOL)requestMoreGlacierItems:(NSError **)error {
     BOOL ret = YES;
-    while (bytesActuallyRequestedThisRound < bytesToRequestPerRound && [glacierRequestItems count] > 0) {
+    while ([retrievalScheduler roundHasRoom] && [glacierRequestItems count] > 0) {
         GlacierRequestItem *item = [glacierRequestItems objectAtIndex:0];
         NSArray *nextItems = [item requestWithRestorer:self repo:repo error:error];
         if (nextItems == nil) {
@@ -430,7 +488,7 @@
 
 - (BOOL)addToBytesRequested:(unsigned long long)length actualBytesRequested:(unsigned long long)actualBytesRequested error:(NSError **)error {
     bytesRequested += length;
-    bytesActuallyRequestedThisRound += actualBytesRequested;
+    [retrievalScheduler addBytesRequested:actualBytesRequested];
     if ([delegate s3GlacierRestorerBytesRequestedDidChange:[NSNumber numberWithUnsignedLongLong:bytesRequested]]) {
         SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
         return NO;
@@ -439,6 +497,7 @@
 }
 - (BOOL)addToTotalBytesToRequest:(unsigned long long)length error:(NSError **)error {
     totalBytesToRequest += length;
+    [retrievalScheduler setTotalBytesToRequest:totalBytesToRequest];
     if ([delegate s3GlacierRestorerTotalBytesToRequestDidChange:[NSNumber numberWithUnsignedLongLong:totalBytesToRequest]]) {
         SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
         return NO;
@@ -47,6 +47,9 @@
 #import "FileACL.h"
 #import "CacheOwnership.h"
 #import "SHA1Hash.h"
+#import "RestoredBlobMap.h"
+#import "RestoreFileWriter.h"
+#import "RestoreMetrics.h"
 
 enum {
     kRestoreActionRestoreTree=1,
@@ -214,19 +217,44 @@ enum {
 - (BOOL)restoreRegularFile:(NSError **)error {
     if ([node uncompressedDataSize] > 0) {
         if ([[node dataBlobKeys] count] > 0) {
-            BufferedOutputStream *bos = [[BufferedOutputStream alloc] initWithPath:path targetUID:[[CacheOwnership sharedCacheOwnership] uid] targetGID:[[CacheOwnership sharedCacheOwnership] gid] append:NO];
-            BOOL ret = [self restoreFileDataToStream:bos error:error];
-            if (ret) {
-                ret = [bos flush:error];
-            }
-            
-            if (!ret) {
-                HSLogDebug(@"error restoring file data; deleting incomplete file %@", path);
-                NSError *rmError = nil;
-                if ([[NSFileManager defaultManager] fileExistsAtPath:path] && ![[NSFileManager defaultManager] removeItemAtPath:path error:&rmError]) {
-                    HSLogError(@"failed to delete incomplete file %@: %@", path, rmError);
+            RestoredBlobMap *restoredBlobMap = [standardRestorer restoredBlobMap];
+            NSArray *blobSHA1s = [[node dataBlobKeys] valueForKey:@"sha1"];
+            NSString *duplicatePath = [restoredBlobMap pathOfFileWithBlobIdentifiers:blobSHA1s];
+            NSError *cloneError = nil;
+            if (duplicatePath != nil && [RestoredBlobMap cloneFileAtPath:duplicatePath toPath:path error:&cloneError]) {
+                HSLogDetail(@"restored %@ (cloned from %@)", path, duplicatePath);
+                if (![standardRestorer addToFileBytesRestored:[node uncompressedDataSize] error:error]) {
+                    return NO;
                 }
-                return NO;
+            } else {
+                if (duplicatePath != nil) {
+                    HSLogError(@"failed to clone %@ to %@: %@", duplicatePath, path, cloneError);
+                }
+                NSMutableArray *writtenBlobLengths = [NSMutableArray array];
+                RestoreFileWriter *writer = [[RestoreFileWriter alloc] initWithPath:path expectedSize:[node uncompressedDataSize]];
+                BOOL ret = [writer open:error] && [self restoreFileDataToWriter:writer writtenBlobLengths:writtenBlobLengths error:error];
+                if (ret) {
+                    ret = [writer finish:error];
+                }
+                [writer close];
+                
+                if (!ret) {
+                    HSLogDebug(@"error restoring file data; deleting incomplete file %@", path);
+                    NSError *rmError = nil;
+                    if ([[NSFileManager defaultManager] fileExistsAtPath:path] && ![[NSFileManager defaultManager] removeItemAtPath:path error:&rmError]) {
+                        HSLogError(@"failed to delete incomplete file %@: %@", path, rmError);
+                    }
+                    return NO;
+                }
+                
+                // The file is closed, so other files can now read these blobs back from this one.
+                unsigned long long offset = 0;
+                for (NSUInteger index = 0; index < [writtenBlobLengths count]; index++) {
+                    unsigned long long length = [[writtenBlobLengths objectAtIndex:index] unsignedLongLongValue];
+                    [restoredBlobMap addBlobIdentifier:[blobSHA1s objectAtIndex:index] path:path offset:offset length:length];
+                    offset += length;
+                }
+                [restoredBlobMap addPath:path forFileWithBlobIdentifiers:blobSHA1s];
             }
         }
     } else {
@@ -251,22 +279,48 @@ enum {
     
     return YES;
 }
-- (BOOL)restoreFileDataToStream:(BufferedOutputStream *)theBOS error:(NSError **)error {
+- (BOOL)restoreFileDataToWriter:(RestoreFileWriter *)theWriter writtenBlobLengths:(NSMutableArray *)theWrittenBlobLengths error:(NSError **)error {
     BOOL ret = YES;
     HSLogDebug(@"restoring %@", [node dataBlobKeys]);
     for (NSUInteger index = 0; index < [[node dataBlobKeys] count]; index++) {
         BlobKey *dataBlobKey = [[node dataBlobKeys] objectAtIndex:index];
-        NSData *compressedData = [standardRestorer dataForBlobKey:dataBlobKey error:error];
-        if (compressedData == nil) {
+        
+        // Blobs already restored to another file are read back from disk instead of fetched again.
+        NSData *uncompressed = [[standardRestorer restoredBlobMap] dataForBlobIdentifier:[dataBlobKey sha1]];
+        if (uncompressed == nil) {
+            uncompressed = [self uncompressedDataForBlobKey:dataBlobKey index:index error:error];
+            if (uncompressed == nil) {
+                ret = NO;
+                break;
+            }
+        }
+        if (![standardRestorer addToFileBytesRestored:[uncompressed length] error:error]) {
             ret = NO;
             break;
         }
-        NSError *myError = nil;
-        NSData *uncompressed = [compressedData uncompress:[dataBlobKey compressionType] error:&myError];
-        if (uncompressed == nil) {
-            HSLogError(@"failed to uncompress %@ (chunk #%ld of %ld) for %@: %@", dataBlobKey, index, [[node dataBlobKeys] count], path, myError);
-            SETERRORFROMMYERROR;
-            
+        NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+        if (![theWriter writeData:uncompressed error:error]) {
+            ret = NO;
+            break;
+        }
+        [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageFileWrite startTime:startTime bytes:[uncompressed length]];
+        [theWrittenBlobLengths addObject:[NSNumber numberWithUnsignedLongLong:[uncompressed length]]];
+        HSLogDebug(@"appended chunk %ld of %ld (%ld bytes) to %@", (unsigned long)index, (unsigned long)[[node dataBlobKeys] count], (unsigned long)[uncompressed length], path);
+    }
+    return ret;
+}
+- (NSData *)uncompressedDataForBlobKey:(BlobKey *)dataBlobKey index:(NSUInteger)index error:(NSError **)error {
+    NSData *compressedData = [standardRestorer dataForBlobKey:dataBlobKey error:error];
+    if (compressedData == nil) {
+        return nil;
+    }
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    NSError *myError = nil;
+    NSData *uncompressed = [compressedData uncompress:[dataBlobKey compressionType] error:&myError];
+    if (uncompressed == nil) {
+        HSLogError(@"failed to uncompress %@ (chunk #%ld of %ld) for %@: %@", dataBlobKey, index, [[node dataBlobKeys] count], path, myError);
+        SETERRORFROMMYERROR;
+        
 //            // Save the blob to a file.
 //            NSString *blobFilename = [[dataBlobKey sha1] stringByAppendingString:@".uncompress_error"];
 //            NSString *blobPath = [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent:blobFilename];
@@ -291,27 +345,22 @@ enum {
 //                }
 //            }
 
-            if (![standardRestorer deleteBlobForBlobKey:dataBlobKey error:&myError]) {
-                HSLogError(@"failed to delete invalid object %@: %@", dataBlobKey, myError);
-            }
-            
-            ret = NO;
-            break;
-        }
-        if (![standardRestorer addToFileBytesRestored:[uncompressed length] error:error]) {
-            ret = NO;
-            break;
+        if (![standardRestorer deleteBlobForBlobKey:dataBlobKey error:&myError]) {
+            HSLogError(@"failed to delete invalid object %@: %@", dataBlobKey, myError);
         }
-        if (![theBOS writeFully:[uncompressed bytes] length:[uncompressed length] error:error]) {
-            ret = NO;
-            break;
-            return NO;
-        }
-        HSLogDebug(@"appended chunk %ld of %ld (%ld bytes) to %@", (unsigned long)index, (unsigned long)[[node dataBlobKeys] count], (unsigned long)[uncompressed length], path);
+        
+        return nil;
     }
-    return ret;
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageDecompress startTime:startTime bytes:[uncompressed length]];
+    return uncompressed;
 }
 - (BOOL)applyNode:(NSError **)error {
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    BOOL ret = [self doApplyNode:error];
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageMetadata startTime:startTime bytes:0];
+    return ret;
+}
+- (BOOL)doApplyNode:(NSError **)error {
     HSLogDebug(@"applying attributes to file %@", path);
     NSError *xattrsError = nil;
     if ([node xattrsBlobKey] != nil && ![self applyXAttrsBlobKey:[node xattrsBlobKey] error:&xattrsError]) {
@@ -436,6 +485,12 @@ enum {
     return YES;
 }
 - (BOOL)applyTree:(NSError **)error {
+    NSTimeInterval startTime = [NSDate timeIntervalSinceReferenceDate];
+    BOOL ret = [self doApplyTree:error];
+    [[RestoreMetrics sharedRestoreMetrics] recordStage:RestoreStageMetadata startTime:startTime bytes:0];
+    return ret;
+}
+- (BOOL)doApplyTree:(NSError **)error {
     HSLogDebug(@"applying attributes to directory %@", path);
     
     if ([standardRestorer useTargetUIDAndGID]) {
@@ -496,6 +551,20 @@ enum {
     return YES;
 }
 - (NSArray *)nextItemsForTree:(NSError **)error {
+    if (![standardRestorer createDirectory:path tree:tree error:error]) {
+        return nil;
+    }
+    
+    // Start fetching all the child trees at once instead of one after another.
+    NSMutableArray *childTreeBlobKeys = [NSMutableArray array];
+    for (NSString *childNodeName in [tree childNodeNames]) {
+        Node *childNode = [tree childNodeWithName:childNodeName];
+        if ([childNode isTree]) {
+            [childTreeBlobKeys addObject:[childNode treeBlobKey]];
+        }
+    }
+    [standardRestorer prefetchTreesForBlobKeys:childTreeBlobKeys];
+    
     NSMutableArray *nextItems = [NSMutableArray array];
     for (NSString *childNodeName in [tree childNodeNames]) {
         Node *childNode = [tree childNodeWithName:childNodeName];
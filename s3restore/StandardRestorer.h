@@ -43,12 +43,16 @@
 @class Node;
 @class StandardRestoreItem;
 @class StandardRestorerDelegateMux;
+@class RestoredBlobMap;
+@class TreePrefetcher;
 
 @interface StandardRestorer : NSObject <TargetConnectionDelegate, RepoActivityListener> {
     StandardRestorerParamSet *paramSet;
     StandardRestorerDelegateMux *srdMux;
     
     NSMutableDictionary *hardlinkPathsByInode;
+    RestoredBlobMap *restoredBlobMap;
+    TreePrefetcher *treePrefetcher;
 
     Repo *repo;
     Commit *commit;
@@ -57,9 +61,11 @@
     Node *nodeToRestore;
 
     NSMutableArray *standardRestoreItems;
+    NSUInteger itemsBeingExpanded;
     
     dispatch_semaphore_t workerThreadSemaphore;
-    NSLock *lock;
+    BOOL objectListIsCaching;
+    NSCondition *lock;
     
     unsigned long long bytesTransferred;
     unsigned long long totalBytesToTransfer;
@@ -76,7 +82,10 @@
 - (StandardRestoreItem *)nextItem;
 - (NSString *)hardlinkedPathForInode:(int)theInode;
 - (void)setHardlinkedPath:(NSString *)thePath forInode:(int)theInode;
+- (RestoredBlobMap *)restoredBlobMap;
 - (Tree *)treeForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error;
+- (void)prefetchTreesForBlobKeys:(NSArray *)theBlobKeys;
+- (BOOL)createDirectory:(NSString *)thePath tree:(Tree *)theTree error:(NSError **)error;
 - (NSData *)dataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error;
 - (BOOL)useTargetUIDAndGID;
 - (uid_t)targetUID;
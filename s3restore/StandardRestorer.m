@@ -57,8 +57,13 @@
 #import "StandardRestoreWorker.h"
 #import "StandardRestorerDelegateMux.h"
 #import "StandardRestoreItem.h"
+#import "RestoredBlobMap.h"
+#import "TreePrefetcher.h"
+#import "RestoreMetrics.h"
 
 #define DEFAULT_NUM_WORKER_THREADS (4)
+#define DEFAULT_NUM_TREE_PREFETCH_THREADS (8)
+#define MAX_PREFETCHED_TREES (1000)
 
 @implementation StandardRestorer
 - (id)initWithParamSet:(StandardRestorerParamSet *)theParamSet delegate:(id<StandardRestorerDelegate>)theDelegate {
@@ -67,11 +72,12 @@
         srdMux = [[StandardRestorerDelegateMux alloc] initWithStandardRestorerDelegate:theDelegate];
         
         hardlinkPathsByInode = [[NSMutableDictionary alloc] init];
+        restoredBlobMap = [[RestoredBlobMap alloc] init];
         
         standardRestoreItems = [[NSMutableArray alloc] init];
         
         workerThreadSemaphore = dispatch_semaphore_create(0);
-        lock = [[NSLock alloc] init];
+        lock = [[NSCondition alloc] init];
         [lock setName:@"StandardRestorer lock"];
         
         [self run];
@@ -97,20 +103,38 @@
 
 - (StandardRestoreItem *)nextItem {
     [lock lock];
+    // If the stack is empty but another worker is still expanding a tree, wait for its children.
+    while (!cancelRequested && [standardRestoreItems count] == 0 && itemsBeingExpanded > 0) {
+        [lock wait];
+    }
     StandardRestoreItem *ret = nil;
     if (!cancelRequested && [standardRestoreItems count] > 0) {
         ret = [standardRestoreItems lastObject];
         [standardRestoreItems removeLastObject];
-        
+        itemsBeingExpanded++;
+    }
+    NSUInteger queuedItemCount = [standardRestoreItems count];
+    [lock unlock];
+    [[RestoreMetrics sharedRestoreMetrics] setDepth:queuedItemCount ofQueueNamed:@"restore_items"];
+    
+    if (ret != nil) {
+        // Expand outside the lock: it may create a directory and wait for child trees to be fetched.
         NSError *myError = nil;
         NSArray *nextItems = [ret nextItems:&myError];
         if (nextItems == nil) {
             HSLogError(@"failed to load next items for %@: %@", [ret path], myError);
-        } else {
+            [srdMux standardRestorerErrorMessage:[myError localizedDescription] didOccurForPath:[ret path]];
+        }
+        [lock lock];
+        if (nextItems != nil) {
             [standardRestoreItems addObjectsFromArray:nextItems];
         }
+        itemsBeingExpanded--;
+        queuedItemCount = [standardRestoreItems count];
+        [lock broadcast];
+        [lock unlock];
+        [[RestoreMetrics sharedRestoreMetrics] setDepth:queuedItemCount ofQueueNamed:@"restore_items"];
     }
-    [lock unlock];
     if (ret == nil) {
         HSLogDebug(@"no more restore items");
     }
@@ -129,10 +153,63 @@
         [lock unlock];
     }
 }
+- (RestoredBlobMap *)restoredBlobMap {
+    return restoredBlobMap;
+}
 - (Tree *)treeForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error {
-    return [repo treeForBlobKey:theBlobKey error:error];
+    return [treePrefetcher treeForBlobKey:theBlobKey error:error];
+}
+- (void)prefetchTreesForBlobKeys:(NSArray *)theBlobKeys {
+    [treePrefetcher prefetchTreesForBlobKeys:theBlobKeys];
+}
+- (BOOL)createDirectory:(NSString *)thePath tree:(Tree *)theTree error:(NSError **)error {
+    BOOL isDir = NO;
+    if ([[NSFileManager defaultManager] fileExistsAtPath:thePath isDirectory:&isDir]) {
+        if (!isDir) {
+            SETNSERROR([self errorDomain], -1, @"%@ exists and is not a directory", thePath);
+            return NO;
+        }
+    } else {
+        [lock lock];
+        NSString *existingDir = [hardlinkPathsByInode objectForKey:[NSNumber numberWithInt:[theTree st_ino]]];
+        [lock unlock];
+        if (existingDir != nil) {
+            // Create hard link to the existing directory:
+            if (link([existingDir fileSystemRepresentation], [thePath fileSystemRepresentation]) == -1) {
+                int errnum = errno;
+                SETNSERROR([self errorDomain], errnum, @"link(%@, %@): %s", existingDir, thePath, strerror(errnum));
+                HSLogError(@"link(%@, %@): %s", existingDir, thePath, strerror(errnum));
+                return NO;
+            }
+        } else {
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:thePath withIntermediateDirectories:YES attributes:nil error:error]) {
+                return NO;
+            }
+            if ([theTree st_ino] != 0) {
+                [lock lock];
+                [hardlinkPathsByInode setObject:thePath forKey:[NSNumber numberWithInt:[theTree st_ino]]];
+                [lock unlock];
+            }
+        }
+    }
+    return YES;
 }
 - (NSData *)dataForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error {
+    [lock lock];
+    BOOL caching = objectListIsCaching;
+    [lock unlock];
+    if (caching) {
+        // The pack list is still loading, so ask for the blob as its own object first instead of waiting for it.
+        NSError *myError = nil;
+        NSData *ret = [repo unpackedDataForBlobKey:theBlobKey error:&myError];
+        if (ret != nil) {
+            return ret;
+        }
+        if (![myError isErrorWithDomain:[repo errorDomain] code:ERROR_NOT_FOUND]) {
+            SETERRORFROMMYERROR;
+            return nil;
+        }
+    }
     NSData *ret = [repo dataForBlobKey:theBlobKey error:error];
     if (ret == nil) {
         return nil;
@@ -155,7 +232,9 @@
 #pragma mark thread main
 - (void)run {
     NSError *myError = nil;
-    if (![self run:&myError]) {
+    BOOL ret = [self run:&myError];
+    [treePrefetcher stop];
+    if (!ret) {
         [srdMux standardRestorerDidFail:myError];
     } else {
         [srdMux standardRestorerDidSucceed];
@@ -197,16 +276,8 @@
         return NO;
     }
     
-    if ([srdMux standardRestorerMessageDidChange:[NSString stringWithFormat:@"Creating directory structure for %@", paramSet.rootItemName]]) {
-        cancelRequested = YES;
-        SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
-        return NO;
-    }
-    
-    if (![self createDirectoryTree:error]) {
-        return NO;
-    }
-    
+    // Directories are created as the workers reach them (see StandardRestoreItem nextItemsForTree:),
+    // so file data starts flowing without first walking the whole tree.
     if ([srdMux standardRestorerMessageDidChange:[NSString stringWithFormat:@"Restoring %@ from %@ to %@", paramSet.rootItemName, commitDescription, paramSet.destinationPath]]) {
         cancelRequested = YES;
         SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
@@ -244,14 +315,16 @@
     if (repo == nil) {
         return NO;
     }
-    if ([srdMux standardRestorerMessageDidChange:[NSString stringWithFormat:@"Caching object list from %@", [[paramSet.bucket target] endpointDisplayName]]]) {
-        cancelRequested = YES;
-        SETNSERROR([self errorDomain], ERROR_ABORT_REQUESTED, @"cancel requested");
-        return NO;
+    treePrefetcher = [[TreePrefetcher alloc] initWithRepo:repo numThreads:DEFAULT_NUM_TREE_PREFETCH_THREADS maxCachedTrees:MAX_PREFETCHED_TREES];
+    
+    if (![[NSUserDefaults standardUserDefaults] boolForKey:@"StandardRestorerSkipObjectListCaching"]) {
+        // Warm the RemoteFS object list cache in the background; it could take several minutes and
+        // shouldn't hold up the commit, the root tree or the first file (see dataForBlobKey:).
+        if ([[paramSet.bucket target] canAccessFilesByPath]) {
+            objectListIsCaching = YES;
+        }
+        [NSThread detachNewThreadSelector:@selector(cacheObjectList) toTarget:self withObject:nil];
     }
-    // Ask for an object, which forces RemoteFS to cache the list of objects, which could take several minutes.
-    BlobKey *fakeBlobKey = [[BlobKey alloc] initWithSHA1:@"0000000000000000000000000000000000000000" storageType:StorageTypeS3 stretchEncryptionKey:YES compressionType:BlobKeyCompressionNone error:NULL];
-    [repo dataForBlobKey:fakeBlobKey error:error];
     
     commit = [repo commitForBlobKey:paramSet.commitBlobKey error:error];
     if (commit == nil) {
@@ -288,67 +361,17 @@
     
     return YES;
 }
-- (BOOL)createDirectoryTree:(NSError **)error {
-    if (nodeToRestore == nil) {
-        if (![self createDirectoriesForTree:rootTree inDirectory:paramSet.destinationPath error:error]) {
-            return NO;
-        }
-    } else {
-        if (![[NSFileManager defaultManager] ensureParentPathExistsForPath:paramSet.destinationPath targetUID:paramSet.targetUID targetGID:paramSet.targetGID error:error]) {
-            return NO;
-        }
+- (void)cacheObjectList {
+    @autoreleasepool {
+        HSLogDetail(@"caching object list from %@", [[paramSet.bucket target] endpointDisplayName]);
+        // Ask for an object, which forces RemoteFS to cache the list of objects.
+        BlobKey *fakeBlobKey = [[BlobKey alloc] initWithSHA1:@"0000000000000000000000000000000000000000" storageType:StorageTypeS3 stretchEncryptionKey:YES compressionType:BlobKeyCompressionNone error:NULL];
+        [repo dataForBlobKey:fakeBlobKey error:NULL];
+        HSLogDetail(@"finished caching object list");
     }
-    return YES;
-}
-- (BOOL)createDirectoriesForTree:(Tree *)theTree inDirectory:(NSString *)theDir error:(NSError **)error {
-    if (![self createDirectory:theDir tree:theTree error:error]) {
-        return NO;
-    }
-    BOOL ret = YES;
-    for (NSString *childName in [theTree childNodeNames]) {
-        Node *childNode = [theTree childNodeWithName:childName];
-        if ([childNode isTree]) {
-            NSString *childPath = [theDir stringByAppendingPathComponent:childName];
-            Tree *childTree = [repo treeForBlobKey:[childNode treeBlobKey] dataSize:NULL error:error];
-            if (childTree == nil) {
-                ret = NO;
-                break;
-            }
-            if (![self createDirectoriesForTree:childTree inDirectory:childPath error:error]) {
-                ret = NO;
-                break;
-            }
-        }
-    }
-    return YES;
-}
-- (BOOL)createDirectory:(NSString *)thePath tree:(Tree *)theTree error:(NSError **)error {
-    BOOL isDir = NO;
-    if ([[NSFileManager defaultManager] fileExistsAtPath:thePath isDirectory:&isDir]) {
-        if (!isDir) {
-            SETNSERROR([self errorDomain], -1, @"%@ exists and is not a directory", thePath);
-            return NO;
-        }
-    } else {
-        NSString *existingDir = [hardlinkPathsByInode objectForKey:[NSNumber numberWithInt:[theTree st_ino]]];
-        if (existingDir != nil) {
-            // Create hard link to the existing directory:
-            if (link([existingDir fileSystemRepresentation], [thePath fileSystemRepresentation]) == -1) {
-                int errnum = errno;
-                SETNSERROR([self errorDomain], errnum, @"link(%@, %@): %s", existingDir, thePath, strerror(errnum));
-                HSLogError(@"link(%@, %@): %s", existingDir, thePath, strerror(errnum));
-                return NO;
-            }
-        } else {
-            if (![[NSFileManager defaultManager] createDirectoryAtPath:thePath withIntermediateDirectories:YES attributes:nil error:error]) {
-                return NO;
-            }
-            if ([theTree st_ino] != 0) {
-                [hardlinkPathsByInode setObject:thePath forKey:[NSNumber numberWithInt:[theTree st_ino]]];
-            }
-        }
-    }
-    return YES;
+    [lock lock];
+    objectListIsCaching = NO;
+    [lock unlock];
 }
 
 - (BOOL)addToFileBytesRestored:(unsigned long long)length error:(NSError **)error {
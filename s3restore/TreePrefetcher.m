@@ -0,0 +1,212 @@
+/*
+ Copyright (c) 2009-2026, Haystack Software LLC https://www.arqbackup.com
+ 
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+ 
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+ 
+ * Neither the names of PhotoMinds LLC or Haystack Software, nor the names of
+ their contributors may be used to endorse or promote products derived from
+ this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#import "TreePrefetcher.h"
+#import "Repo.h"
+#import "Tree.h"
+#import "Node.h"
+#import "BlobKey.h"
+#import "RestoreMetrics.h"
+
+// A full cache may give up a tree that no worker has asked for in this long.
+#define UNCLAIMED_TREE_EVICTION_AGE (60.0)
+
+@implementation TreePrefetcher
+- (id)initWithRepo:(Repo *)theRepo numThreads:(NSUInteger)theNumThreads maxCachedTrees:(NSUInteger)theMaxCachedTrees {
+    if (self = [super init]) {
+        repo = theRepo;
+        numThreads = theNumThreads;
+        maxCachedTrees = theMaxCachedTrees;
+        condition = [[NSCondition alloc] init];
+        [condition setName:@"TreePrefetcher"];
+        pendingBlobKeys = [[NSMutableArray alloc] init];
+        queuedSHA1s = [[NSMutableSet alloc] init];
+        inFlightSHA1s = [[NSMutableSet alloc] init];
+        treesBySHA1 = [[NSMutableDictionary alloc] init];
+        cachedSHA1s = [[NSMutableArray alloc] init];
+        cacheTimesBySHA1 = [[NSMutableDictionary alloc] init];
+        errorsBySHA1 = [[NSMutableDictionary alloc] init];
+        
+        for (NSUInteger i = 0; i < numThreads; i++) {
+            [NSThread detachNewThreadSelector:@selector(run) toTarget:self withObject:nil];
+        }
+    }
+    return self;
+}
+
+- (void)prefetchTreesForBlobKeys:(NSArray *)theBlobKeys {
+    [condition lock];
+    [self lockedEnqueueBlobKeys:theBlobKeys];
+    [condition unlock];
+}
+- (Tree *)treeForBlobKey:(BlobKey *)theBlobKey error:(NSError **)error {
+    NSString *sha1 = [theBlobKey sha1];
+    
+    [condition lock];
+    if ([queuedSHA1s containsObject:sha1]) {
+        // Nobody has started on it yet; fetch it on this thread instead of waiting in line.
+        // The prefetch threads skip keys that are no longer in queuedSHA1s.
+        [queuedSHA1s removeObject:sha1];
+        [condition unlock];
+        return [repo treeForBlobKey:theBlobKey error:error];
+    }
+    while ([inFlightSHA1s containsObject:sha1]) {
+        [condition wait];
+    }
+    Tree *ret = [treesBySHA1 objectForKey:sha1];
+    NSError *fetchError = [errorsBySHA1 objectForKey:sha1];
+    if (ret != nil) {
+        [self lockedRemoveCachedTreeForSHA1:sha1];
+    }
+    [errorsBySHA1 removeObjectForKey:sha1];
+    [condition broadcast];
+    [condition unlock];
+    
+    if (ret != nil) {
+        return ret;
+    }
+    if (fetchError != nil) {
+        if (error != NULL) {
+            *error = fetchError;
+        }
+        return nil;
+    }
+    return [repo treeForBlobKey:theBlobKey error:error];
+}
+- (void)stop {
+    [condition lock];
+    stopRequested = YES;
+    [pendingBlobKeys removeAllObjects];
+    [queuedSHA1s removeAllObjects];
+    [treesBySHA1 removeAllObjects];
+    [cachedSHA1s removeAllObjects];
+    [cacheTimesBySHA1 removeAllObjects];
+    [errorsBySHA1 removeAllObjects];
+    [condition broadcast];
+    [condition unlock];
+}
+
+
+#pragma mark internal
+- (void)run {
+    for (;;) {
+        [condition lock];
+        while (!stopRequested && ([pendingBlobKeys count] == 0 || ([treesBySHA1 count] + [inFlightSHA1s count]) >= maxCachedTrees)) {
+            if ([pendingBlobKeys count] > 0 && [cachedSHA1s count] > 0) {
+                // The cache is full. A tree nobody claims (e.g. under a folder that failed to restore, or a second
+                // copy of an identical folder) would hold its slot for good, so give up the oldest once it's stale.
+                // treeForBlobKey: fetches it again if a worker wants it after all.
+                NSString *oldestSHA1 = [cachedSHA1s objectAtIndex:0];
+                NSDate *evictionDate = [NSDate dateWithTimeIntervalSinceReferenceDate:[[cacheTimesBySHA1 objectForKey:oldestSHA1] doubleValue] + UNCLAIMED_TREE_EVICTION_AGE];
+                if ([evictionDate timeIntervalSinceNow] <= 0) {
+                    HSLogDebug(@"evicting unclaimed prefetched tree %@", oldestSHA1);
+                    [self lockedRemoveCachedTreeForSHA1:oldestSHA1];
+                    continue;
+                }
+                [condition waitUntilDate:evictionDate];
+            } else {
+                [condition wait];
+            }
+        }
+        if (stopRequested) {
+            [condition unlock];
+            break;
+        }
+        // Take the most recently queued key; the restore workers also work through the tree depth-first.
+        BlobKey *blobKey = [pendingBlobKeys lastObject];
+        [pendingBlobKeys removeLastObject];
+        NSString *sha1 = [blobKey sha1];
+        if (![queuedSHA1s containsObject:sha1]) {
+            [condition unlock];
+            continue;
+        }
+        [queuedSHA1s removeObject:sha1];
+        [inFlightSHA1s addObject:sha1];
+        NSUInteger pendingCount = [pendingBlobKeys count];
+        [condition unlock];
+        [[RestoreMetrics sharedRestoreMetrics] setDepth:pendingCount ofQueueNamed:@"tree_prefetch"];
+        
+        NSError *myError = nil;
+        Tree *tree = nil;
+        @autoreleasepool {
+            tree = [repo treeForBlobKey:blobKey error:&myError];
+        }
+        
+        [condition lock];
+        [inFlightSHA1s removeObject:sha1];
+        if (!stopRequested) {
+            if (tree == nil) {
+                HSLogDebug(@"failed to prefetch tree %@: %@", blobKey, myError);
+                [errorsBySHA1 setObject:myError forKey:sha1];
+            } else {
+                [treesBySHA1 setObject:tree forKey:sha1];
+                [cachedSHA1s addObject:sha1];
+                [cacheTimesBySHA1 setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]] forKey:sha1];
+                [self lockedEnqueueBlobKeys:[self childTreeBlobKeysForTree:tree]];
+            }
+        }
+        [condition broadcast];
+        [condition unlock];
+    }
+}
+- (void)lockedEnqueueBlobKeys:(NSArray *)theBlobKeys {
+    if (stopRequested) {
+        return;
+    }
+    for (BlobKey *blobKey in theBlobKeys) {
+        NSString *sha1 = [blobKey sha1];
+        if ([queuedSHA1s containsObject:sha1] || [inFlightSHA1s containsObject:sha1] || [treesBySHA1 objectForKey:sha1] != nil) {
+            continue;
+        }
+        [queuedSHA1s addObject:sha1];
+        [pendingBlobKeys addObject:blobKey];
+    }
+    [[RestoreMetrics sharedRestoreMetrics] setDepth:[pendingBlobKeys count] ofQueueNamed:@"tree_prefetch"];
+    [condition broadcast];
+}
+- (void)lockedRemoveCachedTreeForSHA1:(NSString *)theSHA1 {
+    [treesBySHA1 removeObjectForKey:theSHA1];
+    [cachedSHA1s removeObject:theSHA1];
+    [cacheTimesBySHA1 removeObjectForKey:theSHA1];
+}
+- (NSArray *)childTreeBlobKeysForTree:(Tree *)theTree {
+    NSMutableArray *ret = [NSMutableArray array];
+    for (NSString *childNodeName in [theTree childNodeNames]) {
+        Node *childNode = [theTree childNodeWithName:childNodeName];
+        if ([childNode isTree] && [childNode treeBlobKey] != nil) {
+            [ret addObject:[childNode treeBlobKey]];
+        }
+    }
+    return ret;
+}
+@end